@@ -9,6 +9,11 @@
  * - Arduino Mega #1 (для управления блоками 1-8)
  * - Arduino Mega #2 (для управления блоками 9-15)
  *
+ * BLOCK_CONFIGS лежит во flash (PROGMEM): на AVR обычная константа
+ * копируется при старте в SRAM (8 КБ на Mega). Читать таблицу только через
+ * getBlockConfig() / blockConfigMega() / getBlockActuatorCount(); на этапе
+ * компиляции (constexpr, RELAY_PORTS.h) - напрямую.
+ *
  * @version 3.0
  * @date 2026-02-15
  * @author RAMS Global Team
@@ -45,13 +50,32 @@
 // Максимальное количество одновременно активных блоков
 #define MAX_ACTIVE_BLOCKS   2
 
+// Бюджет блока питания в актуаторах: MAX_ACTIVE_BLOCKS обычных блоков
+// (по 2). Блок 15 (3 актуатора) весит в 1.5 раза больше обычного и едет
+// без второго блока. Ходы сверх бюджета ESP32 ставит в очередь (MOVE_QUEUE.h)
+#define MAX_ACTIVE_ACTUATORS  (MAX_ACTIVE_BLOCKS * 2)
+
+// Полный ход блока (калибровка секундомером на объекте): по нему Mega
+// считает положение блока по времени работы реле (BLOCK_POSITION.h)
+#define ACTUATOR_TRAVEL_UP_MS       6000  // 0 → 100 %
+#define ACTUATOR_TRAVEL_DOWN_MS     6000  // 100 → 0 %
+#define ACTUATOR_ENDSTOP_MARGIN_MS  500   // Ход на 0 / 100 % - дожать до концевика
+
+// Положение в 1/10000 хода: 0 = низ, POS_FULL = верх
+#define POS_FULL            10000
+
 // ============================================================================
 // ПРОТОКОЛ СВЯЗИ (ТЕКСТОВЫЙ - БЫСТРЫЙ)
 // ============================================================================
 
-// Baud rate для Serial связи
+// Baud rate для Serial связи (USB отладка)
 #define SERIAL_BAUD         115200
 
+// Канал ESP32 ↔ Mega: 8E1 (чётность - счётчик ошибок на Mega, MEGA_UART.h),
+// 11 бит на байт. Менять только вместе на ESP32 и обеих Mega
+#define MEGA_LINK_BAUD      500000
+#define MEGA_LINK_BYTE_BITS 11
+
 // Разделитель в протоколе
 #define PROTOCOL_DELIMITER  ':'
 
@@ -117,10 +141,17 @@ struct BlockConfig {
  * - Блок 6 на Mega #1: пины 50-53 (физически запаян)
  * - Блок 7 на Mega #1: пины 42-45 (переназначен)
  * - Блок 8 на Mega #1: пины 46-49 (переназначен)
- * - Блок 14 на Mega #2: пины 50-53 (аналогично блоку 6)
- * - Блок 15 на Mega #2: пины 42-47 (3 АКТУАТОРА!)
+ * - Блок 14 на Mega #2: пины 42-45 (2 актуатора)
+ * - Блок 15 на Mega #2: пины 46-51 (3 АКТУАТОРА, 52-53 не используются!)
+ *
+ * Все четыре копии файла (shared/, скетчи обеих Mega и ESP32) одинаковы -
+ * это проверяет ctest copies_in_sync (firmware/test_scripts/host). Копия
+ * Mega #1 до v3.3 хранила строки Mega #2 до исправлений проводки (блоки 11
+ * и 12 не переставлены, блок 14 на 50-53, блок 15 на 42-47): Mega #1 эти
+ * строки не исполняет, и расхождение не было видно. Верная проводка -
+ * PIN_MAPPING_REFERENCE.md, раздел "Исправления"
  */
-const BlockConfig BLOCK_CONFIGS[TOTAL_BLOCKS] = {
+constexpr BlockConfig BLOCK_CONFIGS[TOTAL_BLOCKS] PROGMEM = {
   // MEGA #1 - Блоки 1-8
   {
     .blockNum = 1,
@@ -207,16 +238,16 @@ const BlockConfig BLOCK_CONFIGS[TOTAL_BLOCKS] = {
   {
     .blockNum = 11,
     .megaNum = 2,
-    .actuator1 = {30, 31},
-    .actuator2 = {32, 33},
+    .actuator1 = {34, 35},  // ВАЖНО: Поменяли с блоком 12
+    .actuator2 = {36, 37},
     .actuator3 = {0, 0},
     .actuatorCount = 2
   },
   {
     .blockNum = 12,
     .megaNum = 2,
-    .actuator1 = {34, 35},
-    .actuator2 = {36, 37},
+    .actuator1 = {30, 31},  // ВАЖНО: Поменяли с блоком 11
+    .actuator2 = {32, 33},
     .actuator3 = {0, 0},
     .actuatorCount = 2
   },
@@ -231,17 +262,17 @@ const BlockConfig BLOCK_CONFIGS[TOTAL_BLOCKS] = {
   {
     .blockNum = 14,
     .megaNum = 2,
-    .actuator1 = {50, 51},  // ВАЖНО: Физически запаян (аналогично блоку 6)
-    .actuator2 = {52, 53},
+    .actuator1 = {42, 43},  // ВАЖНО: 2 актуатора, пины 42-45
+    .actuator2 = {44, 45},
     .actuator3 = {0, 0},
     .actuatorCount = 2
   },
   {
     .blockNum = 15,
     .megaNum = 2,
-    .actuator1 = {42, 43},  // ВАЖНО: 3 АКТУАТОРА!
-    .actuator2 = {44, 45},
-    .actuator3 = {46, 47},  // Третий актуатор
+    .actuator1 = {46, 47},  // ВАЖНО: 3 АКТУАТОРА, пины 46-51!
+    .actuator2 = {48, 49},
+    .actuator3 = {51, 50},  // ВАЖНО: Инвертирован! UP=51, DOWN=50
     .actuatorCount = 3
   }
 };
@@ -252,6 +283,8 @@ const BlockConfig BLOCK_CONFIGS[TOTAL_BLOCKS] = {
 
 /**
  * Получить конфигурацию блока по его номеру
+ * На AVR таблица во flash: указатель на копию в SRAM, она действует до
+ * следующего вызова (не вызывать из прерываний). На ESP32 - на саму таблицу
  * @param blockNum Номер блока (1-15)
  * @return Указатель на BlockConfig или nullptr если блок не найден
  */
@@ -259,7 +292,23 @@ inline const BlockConfig* getBlockConfig(uint8_t blockNum) {
   if (blockNum < 1 || blockNum > TOTAL_BLOCKS) {
     return nullptr;
   }
+#if defined(__AVR__)
+  static BlockConfig copy;
+  memcpy_P(&copy, &BLOCK_CONFIGS[blockNum - 1], sizeof(copy));
+  return &copy;
+#else
   return &BLOCK_CONFIGS[blockNum - 1];
+#endif
+}
+
+/**
+ * Номер Mega блока (одно поле из flash, без копии)
+ * @param blockNum Номер блока (1-15)
+ * @return 1 или 2, 0 если блок не найден
+ */
+inline uint8_t blockConfigMega(uint8_t blockNum) {
+  if (blockNum < 1 || blockNum > TOTAL_BLOCKS) return 0;
+  return pgm_read_byte(&BLOCK_CONFIGS[blockNum - 1].megaNum);
 }
 
 /**
@@ -269,9 +318,8 @@ inline const BlockConfig* getBlockConfig(uint8_t blockNum) {
  * @return true если блок принадлежит указанной Mega
  */
 inline bool isBlockOnMega(uint8_t blockNum, uint8_t megaNum) {
-  const BlockConfig* config = getBlockConfig(blockNum);
-  if (config == nullptr) return false;
-  return config->megaNum == megaNum;
+  uint8_t mega = blockConfigMega(blockNum);
+  return mega != 0 && mega == megaNum;
 }
 
 /**
@@ -280,9 +328,8 @@ inline bool isBlockOnMega(uint8_t blockNum, uint8_t megaNum) {
  * @return Количество актуаторов (обычно 2, для блока 15 = 3)
  */
 inline uint8_t getBlockActuatorCount(uint8_t blockNum) {
-  const BlockConfig* config = getBlockConfig(blockNum);
-  if (config == nullptr) return 0;
-  return config->actuatorCount;
+  if (blockNum < 1 || blockNum > TOTAL_BLOCKS) return 0;
+  return pgm_read_byte(&BLOCK_CONFIGS[blockNum - 1].actuatorCount);
 }
 
 /**
@@ -305,6 +352,20 @@ inline bool isValidAction(const char* action) {
           strcmp(action, ACTION_STOP) == 0);
 }
 
+/**
+ * Время хода блока между положениями (единицы POS_FULL)
+ * Цель на упоре (0 / POS_FULL) - с запасом ACTUATOR_ENDSTOP_MARGIN_MS:
+ * актуатор встаёт на концевик, ошибка оценки положения обнуляется
+ * @return мс, 0 если блок уже в цели (не на упоре)
+ */
+inline unsigned long positionTravelMs(uint16_t from, uint16_t to) {
+  unsigned long ms = (to > from)
+    ? (unsigned long)(to - from) * ACTUATOR_TRAVEL_UP_MS / POS_FULL
+    : (unsigned long)(from - to) * ACTUATOR_TRAVEL_DOWN_MS / POS_FULL;
+  if (to == 0 || to == POS_FULL) ms += ACTUATOR_ENDSTOP_MARGIN_MS;
+  return ms;
+}
+
 // ============================================================================
 // DEBUG ФУНКЦИИ
 // ============================================================================
@@ -312,57 +373,58 @@ inline bool isValidAction(const char* action) {
 /**
  * Вывести конфигурацию всех блоков в Serial
  * Полезно для отладки и проверки маппинга
+ * Строки - F(): на AVR остаются во flash, а не копируются в SRAM
  */
 inline void printAllBlockConfigs() {
-  Serial.println("\n========================================");
-  Serial.println("  ACTUATOR BLOCKS CONFIGURATION");
-  Serial.println("========================================");
-  Serial.print("Total blocks: ");
+  Serial.println(F("\n========================================"));
+  Serial.println(F("  ACTUATOR BLOCKS CONFIGURATION"));
+  Serial.println(F("========================================"));
+  Serial.print(F("Total blocks: "));
   Serial.println(TOTAL_BLOCKS);
-  Serial.print("Mega #1: blocks ");
+  Serial.print(F("Mega #1: blocks "));
   Serial.print(MEGA1_BLOCK_START);
-  Serial.print("-");
+  Serial.print('-');
   Serial.println(MEGA1_BLOCK_END);
-  Serial.print("Mega #2: blocks ");
+  Serial.print(F("Mega #2: blocks "));
   Serial.print(MEGA2_BLOCK_START);
-  Serial.print("-");
+  Serial.print('-');
   Serial.println(MEGA2_BLOCK_END);
-  Serial.print("Relay logic: ");
-  Serial.print(RELAY_ON == LOW ? "INVERSE (LOW=ON)" : "DIRECT (HIGH=ON)");
-  Serial.println("\n");
+  Serial.print(F("Relay logic: "));
+  Serial.print(RELAY_ON == LOW ? F("INVERSE (LOW=ON)") : F("DIRECT (HIGH=ON)"));
+  Serial.println(F("\n"));
 
-  for (int i = 0; i < TOTAL_BLOCKS; i++) {
-    const BlockConfig* cfg = &BLOCK_CONFIGS[i];
-    Serial.print("Block ");
+  for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+    const BlockConfig* cfg = getBlockConfig(i);
+    Serial.print(F("Block "));
     Serial.print(cfg->blockNum);
-    Serial.print(" (Mega #");
+    Serial.print(F(" (Mega #"));
     Serial.print(cfg->megaNum);
-    Serial.print("):");
+    Serial.print(F("):"));
 
-    Serial.print(" Act1[");
+    Serial.print(F(" Act1["));
     Serial.print(cfg->actuator1.upPin);
-    Serial.print(",");
+    Serial.print(',');
     Serial.print(cfg->actuator1.downPin);
-    Serial.print("]");
+    Serial.print(']');
 
-    Serial.print(" Act2[");
+    Serial.print(F(" Act2["));
     Serial.print(cfg->actuator2.upPin);
-    Serial.print(",");
+    Serial.print(',');
     Serial.print(cfg->actuator2.downPin);
-    Serial.print("]");
+    Serial.print(']');
 
     if (cfg->actuatorCount == 3) {
-      Serial.print(" Act3[");
+      Serial.print(F(" Act3["));
       Serial.print(cfg->actuator3.upPin);
-      Serial.print(",");
+      Serial.print(',');
       Serial.print(cfg->actuator3.downPin);
-      Serial.print("]");
+      Serial.print(']');
     }
 
     Serial.println();
   }
 
-  Serial.println("========================================\n");
+  Serial.println(F("========================================\n"));
 }
 
 /**
@@ -372,33 +434,33 @@ inline void printAllBlockConfigs() {
 inline void printBlockConfig(uint8_t blockNum) {
   const BlockConfig* cfg = getBlockConfig(blockNum);
   if (cfg == nullptr) {
-    Serial.print("ERROR: Invalid block number ");
+    Serial.print(F("ERROR: Invalid block number "));
     Serial.println(blockNum);
     return;
   }
 
-  Serial.print("Block ");
+  Serial.print(F("Block "));
   Serial.print(cfg->blockNum);
-  Serial.print(" (Mega #");
+  Serial.print(F(" (Mega #"));
   Serial.print(cfg->megaNum);
-  Serial.print(", ");
+  Serial.print(F(", "));
   Serial.print(cfg->actuatorCount);
-  Serial.println(" actuators):");
+  Serial.println(F(" actuators):"));
 
-  Serial.print("  Actuator 1: UP=");
+  Serial.print(F("  Actuator 1: UP="));
   Serial.print(cfg->actuator1.upPin);
-  Serial.print(", DOWN=");
+  Serial.print(F(", DOWN="));
   Serial.println(cfg->actuator1.downPin);
 
-  Serial.print("  Actuator 2: UP=");
+  Serial.print(F("  Actuator 2: UP="));
   Serial.print(cfg->actuator2.upPin);
-  Serial.print(", DOWN=");
+  Serial.print(F(", DOWN="));
   Serial.println(cfg->actuator2.downPin);
 
   if (cfg->actuatorCount == 3) {
-    Serial.print("  Actuator 3: UP=");
+    Serial.print(F("  Actuator 3: UP="));
     Serial.print(cfg->actuator3.upPin);
-    Serial.print(", DOWN=");
+    Serial.print(F(", DOWN="));
     Serial.println(cfg->actuator3.downPin);
   }
 }
@@ -0,0 +1,207 @@
+/**
+ * RAMS BLOCK POSITION - положение блоков по времени работы реле
+ *
+ * Датчиков положения нет: положение = время хода × скорость, полный ход
+ * калибруется в ACTUATOR_CONFIG.h (ACTUATOR_TRAVEL_UP_MS / _DOWN_MS).
+ * Все актуаторы блока переключаются одной записью в порт (RELAY_PORTS.h),
+ * поэтому положение одно на блок.
+ *
+ * - Положение в 1/POS_FULL хода: 0 = низ, POS_FULL = верх
+ * - После первой прошивки неизвестно; становится известным после хода
+ *   не короче полного (блок на концевике)
+ * - Ход на 0 / 100 % - с запасом на концевик: ошибка оценки обнуляется
+ *
+ * Сохранение в EEPROM (4 КБ, ~100 000 перезаписей ячейки):
+ * - кольцо из POS_EEPROM_SLOTS записей [magic, seq, положения, CRC-8],
+ *   каждая новая запись - в следующий слот: износ делится на число слотов
+ * - при старте берётся целая запись с самым новым seq; оборванная
+ *   (пропало питание) не проходит CRC, остаётся предыдущая
+ * - запись идёт по одному байту из loop(), только когда EEPROM готова:
+ *   байт пишется ~3.3 мс, ждать их все loop() не должен
+ * - движущийся блок сохраняется как неизвестный: пропало питание посреди
+ *   хода - после перезагрузки положению не верим
+ *
+ * ВАЖНО: Этот файл используется в:
+ * - Arduino Mega #1 (actuator_mega1_v3)
+ * - Arduino Mega #2 (actuator_mega2_v3)
+ *
+ * @version 1.0
+ * @date 2026-03-25
+ * @author RAMS Global Team
+ */
+
+#ifndef BLOCK_POSITION_H
+#define BLOCK_POSITION_H
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include "ACTUATOR_CONFIG.h"
+#include "FRAME_CODEC.h"
+
+// ============================================================================
+// КОНСТАНТЫ
+// ============================================================================
+
+#define POS_UNKNOWN         0xFFFF
+#define POS_BLOCKS_MAX      8       // Блоков на одной Mega
+
+#define POS_EEPROM_BASE     0
+#define POS_EEPROM_SLOTS    200     // × POS_RECORD_SIZE = 4000 байт из 4096
+#define POS_RECORD_MAGIC    0x5A
+#define POS_RECORD_SIZE     (1 + 2 + POS_BLOCKS_MAX * 2 + 1)
+
+static_assert(POS_EEPROM_BASE + POS_EEPROM_SLOTS * POS_RECORD_SIZE <= 4096,
+              "Position ring does not fit ATmega2560 EEPROM");
+
+// ============================================================================
+// МОДЕЛЬ ХОДА
+// ============================================================================
+
+inline uint16_t positionFromPercent(uint8_t percent) {
+  return (uint16_t)percent * (POS_FULL / 100);
+}
+
+inline uint8_t positionPercent(uint16_t pos) {
+  return pos == POS_UNKNOWN ? FRAME_STATUS_POS_UNKNOWN : (uint8_t)((pos + 50) / 100);
+}
+
+/**
+ * Положение после ms работы реле в направлении act (FRAME_ACT_UP / DOWN)
+ * Неизвестное становится известным, если ход не короче полного
+ */
+inline uint16_t positionAfter(uint16_t pos, uint8_t act, unsigned long ms) {
+  bool up = (act == FRAME_ACT_UP);
+  unsigned long travel = up ? ACTUATOR_TRAVEL_UP_MS : ACTUATOR_TRAVEL_DOWN_MS;
+
+  if (ms >= travel) return up ? POS_FULL : 0;
+  if (pos == POS_UNKNOWN) return POS_UNKNOWN;
+
+  uint16_t delta = (uint16_t)((ms * POS_FULL + travel / 2) / travel);
+  if (up) return (pos + delta > POS_FULL) ? POS_FULL : pos + delta;
+  return (delta > pos) ? 0 : pos - delta;
+}
+
+// ============================================================================
+// ХРАНЕНИЕ В EEPROM
+// ============================================================================
+
+class PositionStore {
+public:
+  PositionStore()
+    : _slot(0), _seq(0), _pos(0), _writing(false), _pending(false), _writes(0) {}
+
+  /**
+   * Найти самую новую целую запись (только из setup: ~4 КБ чтения)
+   * @param pos count положений; без записи - все POS_UNKNOWN
+   * @return true если запись найдена
+   */
+  bool load(uint16_t* pos, uint8_t count) {
+    bool found = false;
+    uint16_t bestSeq = 0;
+    uint8_t best = 0;
+
+    for (uint8_t slot = 0; slot < POS_EEPROM_SLOTS; slot++) {
+      uint8_t rec[POS_RECORD_SIZE];
+      eeprom_read_block(rec, (const void*)(uintptr_t)slotAddr(slot), POS_RECORD_SIZE);
+      if (!recordValid(rec)) continue;
+
+      // seq идут подряд по кольцу - сравнение через разность переживает переполнение
+      uint16_t seq = (uint16_t)(rec[1] | (rec[2] << 8));
+      if (!found || (int16_t)(seq - bestSeq) > 0) {
+        found = true;
+        bestSeq = seq;
+        best = slot;
+      }
+    }
+
+    for (uint8_t i = 0; i < count; i++) pos[i] = POS_UNKNOWN;
+    if (!found) return false;
+
+    uint8_t rec[POS_RECORD_SIZE];
+    eeprom_read_block(rec, (const void*)(uintptr_t)slotAddr(best), POS_RECORD_SIZE);
+    for (uint8_t i = 0; i < count && i < POS_BLOCKS_MAX; i++) {
+      pos[i] = (uint16_t)(rec[3 + i * 2] | (rec[4 + i * 2] << 8));
+    }
+
+    _slot = (uint8_t)((best + 1) % POS_EEPROM_SLOTS);
+    _seq = bestSeq + 1;
+    return true;
+  }
+
+  /**
+   * Запомнить положения - запишутся в фоне (service)
+   * Несколько вызовов до начала записи дают одну запись с последними
+   */
+  void save(const uint16_t* pos, uint8_t count) {
+    for (uint8_t i = 0; i < POS_BLOCKS_MAX; i++) {
+      _next[i] = (i < count) ? pos[i] : POS_UNKNOWN;
+    }
+    _pending = true;
+  }
+
+  /**
+   * Записать один байт, если EEPROM готова (вызывать в каждом loop)
+   */
+  void service() {
+    if (!_writing) {
+      if (!_pending) return;
+      buildRecord();
+      _pending = false;
+      _writing = true;
+      _pos = 0;
+    }
+
+    if (!eeprom_is_ready()) return;
+
+    // Байт без изменений не пишется (не тратит ресурс ячейки)
+    uint8_t* addr = (uint8_t*)(uintptr_t)(slotAddr(_slot) + _pos);
+    if (eeprom_read_byte(addr) != _rec[_pos]) eeprom_write_byte(addr, _rec[_pos]);
+
+    if (++_pos >= POS_RECORD_SIZE) {
+      _writing = false;
+      _slot = (uint8_t)((_slot + 1) % POS_EEPROM_SLOTS);
+      _seq++;
+      _writes++;
+    }
+  }
+
+  bool busy() const { return _writing || _pending; }
+  uint32_t writes() const { return _writes; }
+
+private:
+  static uint16_t slotAddr(uint8_t slot) {
+    return POS_EEPROM_BASE + (uint16_t)slot * POS_RECORD_SIZE;
+  }
+
+  static uint8_t recordCrc(const uint8_t* rec) {
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < POS_RECORD_SIZE - 1; i++) crc = frameCrc8(crc, rec[i]);
+    return crc;
+  }
+
+  static bool recordValid(const uint8_t* rec) {
+    return rec[0] == POS_RECORD_MAGIC && rec[POS_RECORD_SIZE - 1] == recordCrc(rec);
+  }
+
+  void buildRecord() {
+    _rec[0] = POS_RECORD_MAGIC;
+    _rec[1] = (uint8_t)_seq;
+    _rec[2] = (uint8_t)(_seq >> 8);
+    for (uint8_t i = 0; i < POS_BLOCKS_MAX; i++) {
+      _rec[3 + i * 2] = (uint8_t)_next[i];
+      _rec[4 + i * 2] = (uint8_t)(_next[i] >> 8);
+    }
+    _rec[POS_RECORD_SIZE - 1] = recordCrc(_rec);
+  }
+
+  uint8_t _slot;                      // Слот следующей записи
+  uint16_t _seq;
+  uint8_t _pos;                       // Следующий байт записи
+  bool _writing;
+  bool _pending;
+  uint32_t _writes;
+  uint16_t _next[POS_BLOCKS_MAX];     // Ждут записи
+  uint8_t _rec[POS_RECORD_SIZE];      // Пишется сейчас
+};
+
+#endif // BLOCK_POSITION_H
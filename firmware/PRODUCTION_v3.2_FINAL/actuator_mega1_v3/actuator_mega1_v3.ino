@@ -2,34 +2,103 @@
  * RAMS Actuator Controller - Arduino Mega #1
  *
  * Управляет блоками 1-8 (16 актуаторов)
- * Простой текстовый протокол (стиль DroneControl.ino)
+ * Бинарный протокол v4 (FRAME_CODEC.h) + текстовый v3 как fallback
  * Использует общий конфигурационный файл ACTUATOR_CONFIG.h
  *
- * Протокол связи с ESP32 (Serial1):
+ * Протокол связи с ESP32 (USART1, MEGA_LINK_BAUD 8E1):
  * RX: BLOCK:5:UP:10000\n      - Блок 5 вверх на 10 сек
  * RX: BLOCK:3:DOWN:5000\n     - Блок 3 вниз на 5 сек
  * RX: BLOCK:7:STOP\n          - Остановить блок 7
+ * RX: BLOCK:5:POS:60\n        - Блок 5 в положение 60 % хода
+ * RX: GROUP:6:UP:10000\n      - Блоки 2 и 3 вверх на 10 сек (бит n-1 = блок n)
  * RX: ALL:STOP\n              - Остановить все блоки
  * RX: PING\n                  - Проверка связи
  *
  * TX: ACK:5:UP\n              - Подтверждение
+ * TX: ACK:GROUP:6:UP\n        - Подтверждение всей группы
  * TX: DONE:5\n                - Блок завершил работу
  * TX: PONG\n                  - Ответ на пинг
  * TX: ERROR:message\n         - Ошибка
  *
- * @version 3.1 (DroneControl style)
- * @date 2026-02-15
+ * RX: PROTO:4\n               - ESP32 предлагает протокол v4
+ * TX: PROTO:4\n               - Согласие, дальше ESP32 шлёт кадры
+ *
+ * Протокол v4 (кадры SYNC|LEN|SEQ|OP|PAYLOAD|CRC8, см. FRAME_CODEC.h):
+ * RX: BLOCK  [block, action, duration_ms]  → TX: ACK [block, action] с тем же SEQ
+ * RX: ALL_STOP                             → TX: ACK [0, STOP]
+ * RX: BATCH  N × [block, action, dur]     → TX: ACK [0, NONE, N]
+ * RX: AT     [t_us, N × блок]             → TX: ACK [0, NONE, N], старт в t_us
+ * RX: GROUP  [mask, action, dur]          → TX: ACK [0, action, N]
+ * RX: PING                                 → TX: PONG
+ * RX: PING   [t_esp]                       → TX: PONG [t_esp, micros()]
+ *                                            TX: STATUS (SEQ = 0)
+ * Ошибка команды → NAK [код, block]. Кадр с битым CRC игнорируется.
+ * BATCH и GROUP проверяются целиком до первого переключения реле: одна
+ * ошибка - NAK, ни один блок не запущен.
+ *
+ * STATUS - кадр фиксированного размера раз в FRAME_STATUS_INTERVAL_MS и
+ * сразу после переключения реле: направление и остаток времени каждого
+ * блока, ошибки приёма, uptime. ESP32 сверяет по нему своё состояние,
+ * отдельный DONE на бинарном канале больше не нужен (текстом - DONE:n).
+ *
+ * Положение блоков (BLOCK_POSITION.h): считается по времени работы реле,
+ * хранится в EEPROM. POS - ход к цели в % (направление и время выбирает
+ * Mega); UP / DOWN без длительности - ход до упора от текущего положения,
+ * а не DEFAULT_DURATION_MS. Положение неизвестно до первого хода до упора.
+ *
+ * AT - синхронный старт блоков на обеих Mega: время выполнения уже
+ * в часах этой Mega (ESP32 оценивает смещение по PING/PONG). Команды ждут
+ * в очереди по времени; ALL:STOP и STOP блока снимают их из очереди.
+ *
+ * Текстовые команды разбираются без String и sscanf (MEGA_LINK.h), ответ
+ * собирается в буфере и уходит одним write.
+ *
+ * Реле переключаются регистрами портов (RELAY_PORTS.h): все актуаторы блока
+ * одновременно, ALL:STOP - одна запись в каждый порт. Все блоки GROUP,
+ * BATCH и наступивших AT - тоже одна запись (BlockCommandSet), лог - после.
+ *
+ * Остановка по времени - прерывание Timer3 (BLOCK_TIMER.h): реле выключаются
+ * в срок с точностью в единицы мкс, даже когда loop() занят разбором или
+ * печатью; loop() потом только учитывает остановку (положение, лог, STATUS).
+ *
+ * USART1 - свой драйвер на прерываниях (MEGA_UART.h): кольцо приёма 256 байт,
+ * счётчики ошибок кадра / чётности / overrun / переполнения - в STATUS.
+ * Serial1 ядра в скетче не используется (те же векторы прерываний).
+ *
+ * SRAM (8 КБ): таблица блоков и маски реле - во flash (PROGMEM), строки
+ * отладки и ответов - F("..."). Свободная SRAM печатается при старте,
+ * отчёт по сборке - sram_report.sh.
+ *
+ * @version 4.7 (Binary frames + AT queue + status frames + positions + timer stop + UART ISR + groups + text fallback)
+ * @date 2026-03-29
  * @author RAMS Global Team
  */
 
 #include "ACTUATOR_CONFIG.h"
+#include "FRAME_CODEC.h"
+#include "MEGA_LINK.h"
+#include "RELAY_PORTS.h"
+#include "BLOCK_POSITION.h"
+#include "BLOCK_TIMER.h"
+#include "MEGA_UART.h"
 
 // ============================================================================
 // SERIAL CONFIGURATION
 // ============================================================================
 
-#define ESP32_SERIAL Serial1  // TX1 (pin 18), RX1 (pin 19)
-#define DEBUG_SERIAL Serial   // USB serial для отладки
+#define ESP32_SERIAL esp32Uart  // USART1: TX1 (pin 18), RX1 (pin 19)
+#define DEBUG_SERIAL Serial     // USB serial для отладки
+
+// Канал к ESP32 на своих прерываниях (MEGA_UART.h)
+MegaUart1 esp32Uart;
+
+ISR(USART1_RX_vect) {
+  esp32Uart.onRx();
+}
+
+ISR(USART1_UDRE_vect) {
+  esp32Uart.onUdre();
+}
 
 // ============================================================================
 // СОСТОЯНИЕ БЛОКОВ
@@ -38,17 +107,87 @@
 struct BlockState {
   bool isActive;
   unsigned long startTime;
-  int duration;
+  unsigned long duration;
+  uint8_t action;           // FRAME_ACT_UP / FRAME_ACT_DOWN, пока isActive
+  uint16_t pos;             // 1/POS_FULL хода: на startTime, пока isActive, иначе текущее
 };
 
 // Состояния блоков 1-8 (индекс 0 не используется)
 BlockState blockStates[MEGA1_BLOCK_COUNT + 1];
 
-// Буфер для команд
-String cmdRaw;
-int blockNum;
-char action[10];
-int duration;
+/**
+ * Команды блокам этой Mega, которые переключаются вместе (GROUP / BATCH / AT):
+ * одна запись в порты и одна установка сроков на весь набор
+ */
+struct BlockCommandSet {
+  uint8_t mask;                          // Бит i: блок MEGA1_BLOCK_START + i
+  uint8_t act[MEGA1_BLOCK_COUNT];
+  unsigned long dur[MEGA1_BLOCK_COUNT];
+};
+
+// Положения блоков в EEPROM (пишутся в фоне из loop)
+PositionStore positionStore;
+
+static_assert(MEGA1_BLOCK_COUNT <= POS_BLOCKS_MAX, "Position record has no slot for every block");
+
+// Сроки остановки блоков: реле выключает прерывание Timer3
+BlockStopTimer stopTimer;
+
+static_assert(MEGA1_BLOCK_COUNT <= BLOCK_TIMER_BLOCKS, "Stop timer has no slot for every block");
+
+ISR(TIMER3_COMPA_vect) {
+  stopTimer.onCompare();
+}
+
+// Текстовые команды: строка в фиксированном буфере (MEGA_LINK.h), без String
+LineReader textRx;
+
+// ============================================================================
+// ПРОТОКОЛ v4
+// ============================================================================
+
+FrameDecoder frameRx;
+uint16_t rxGapResets = 0;     // Кадры, оборванные паузой > FRAME_GAP_MS
+
+// Последняя команда пришла кадром → DONE тоже отправляем кадром
+bool binaryLink = false;
+
+// Кадр состояния (FRAME_OP_STATUS): по таймеру и сразу после переключения реле
+unsigned long lastStatusMs = 0;
+bool statusDirty = false;
+
+static_assert(MEGA1_BLOCK_COUNT <= FRAME_STATUS_BLOCKS, "STATUS frame has no slot for every block");
+
+// Последние обработанные SEQ (повтор команды после потерянного ACK)
+#define SEQ_HISTORY 4
+
+struct SeqResult {
+  uint8_t seq;
+  uint8_t err;
+};
+
+SeqResult recentSeq[SEQ_HISTORY];
+uint8_t recentSeqPos = 0;
+
+// ============================================================================
+// ОЧЕРЕДЬ AT (СИНХРОННЫЙ СТАРТ)
+// ============================================================================
+
+#define AT_QUEUE_MAX 16  // Два полных пакета AT на все блоки Mega
+
+/**
+ * Команда блоку, ждущая своего времени (micros() этой Mega)
+ */
+struct ScheduledCommand {
+  unsigned long atUs;
+  unsigned long duration;
+  uint8_t blockNum;
+  uint8_t act;
+};
+
+// Отсортирована по atUs: наступившие команды всегда в начале
+ScheduledCommand atQueue[AT_QUEUE_MAX];
+uint8_t atQueueCount = 0;
 
 // ============================================================================
 // SETUP
@@ -57,10 +196,10 @@ int duration;
 void setup() {
   // Debug serial
   DEBUG_SERIAL.begin(SERIAL_BAUD);
-  DEBUG_SERIAL.println("\n========================================");
-  DEBUG_SERIAL.println("  RAMS ACTUATOR CONTROLLER - MEGA #1");
-  DEBUG_SERIAL.println("  Blocks 1-8 | DroneControl Style");
-  DEBUG_SERIAL.println("========================================");
+  DEBUG_SERIAL.println(F("\n========================================"));
+  DEBUG_SERIAL.println(F("  RAMS ACTUATOR CONTROLLER - MEGA #1"));
+  DEBUG_SERIAL.println(F("  Blocks 1-8 | DroneControl Style"));
+  DEBUG_SERIAL.println(F("========================================"));
 
   // Инициализация всех пинов
   for (int i = MEGA1_BLOCK_START; i <= MEGA1_BLOCK_END; i++) {
@@ -77,17 +216,17 @@ void setup() {
     digitalWrite(cfg->actuator2.upPin, RELAY_OFF);
     digitalWrite(cfg->actuator2.downPin, RELAY_OFF);
 
-    DEBUG_SERIAL.print("  Block ");
+    DEBUG_SERIAL.print(F("  Block "));
     DEBUG_SERIAL.print(i);
-    DEBUG_SERIAL.print(": [");
+    DEBUG_SERIAL.print(F(": ["));
     DEBUG_SERIAL.print(cfg->actuator1.upPin);
-    DEBUG_SERIAL.print(",");
+    DEBUG_SERIAL.print(',');
     DEBUG_SERIAL.print(cfg->actuator1.downPin);
-    DEBUG_SERIAL.print("] [");
+    DEBUG_SERIAL.print(F("] ["));
     DEBUG_SERIAL.print(cfg->actuator2.upPin);
-    DEBUG_SERIAL.print(",");
+    DEBUG_SERIAL.print(',');
     DEBUG_SERIAL.print(cfg->actuator2.downPin);
-    DEBUG_SERIAL.println("]");
+    DEBUG_SERIAL.println(']');
   }
 
   // Инициализация состояний
@@ -95,163 +234,802 @@ void setup() {
     blockStates[i].isActive = false;
     blockStates[i].startTime = 0;
     blockStates[i].duration = 0;
+    blockStates[i].action = FRAME_ACT_NONE;
+    blockStates[i].pos = POS_UNKNOWN;
+  }
+
+  // Положения с прошлого запуска
+  uint16_t saved[MEGA1_BLOCK_COUNT];
+  bool restored = positionStore.load(saved, MEGA1_BLOCK_COUNT);
+  for (int i = 0; i < MEGA1_BLOCK_COUNT; i++) {
+    blockStates[i + 1].pos = saved[i];
   }
+  DEBUG_SERIAL.println(restored ? F("[POS] Positions restored from EEPROM")
+                                : F("[POS] No saved positions - unknown until an end stop"));
+
+  // Остановка блоков по Timer3
+  stopTimer.begin();
 
   // ESP32 serial
-  ESP32_SERIAL.begin(SERIAL_BAUD);
+  ESP32_SERIAL.begin(MEGA_LINK_BAUD);
+
+  // Свободно между кучей и стеком: на очереди, кольца UART и стек loop()
+  DEBUG_SERIAL.print(F("[RAM] Free SRAM: "));
+  DEBUG_SERIAL.print(freeSram());
+  DEBUG_SERIAL.println(F(" bytes"));
 
-  DEBUG_SERIAL.println("[READY] System initialized!\n");
+  DEBUG_SERIAL.println(F("[READY] System initialized!\n"));
+}
+
+/**
+ * Свободная SRAM сейчас: от конца кучи (или её начала - malloc скетч
+ * не вызывает) до вершины стека
+ */
+int freeSram() {
+  extern char __heap_start;
+  extern char* __brkval;
+  char top;
+  return (int)(&top - (__brkval == 0 ? &__heap_start : __brkval));
 }
 
 // ============================================================================
-// MAIN LOOP - СТИЛЬ DroneControl.ino
+// РЕЛЕ БЛОКА
 // ============================================================================
 
-void loop() {
-  // ===== ЧТЕНИЕ КОМАНД ОТ ESP32 =====
-  if (ESP32_SERIAL.available()) {
-    cmdRaw = ESP32_SERIAL.readStringUntil('\n');
-    cmdRaw.trim();
-
-    if (cmdRaw.length() > 0) {
-      DEBUG_SERIAL.print("[RX] ");
-      DEBUG_SERIAL.println(cmdRaw);
-
-      // PING
-      if (cmdRaw == CMD_PING) {
-        ESP32_SERIAL.println(CMD_PONG);
-        DEBUG_SERIAL.println("[TX] PONG");
-      }
-      // ALL:STOP
-      else if (cmdRaw.startsWith(CMD_ALL_STOP)) {
-        DEBUG_SERIAL.println("[ALL] STOP ALL");
+/**
+ * Добавить реле всех актуаторов блока в общую запись в порты (RELAY_PORTS.h)
+ * Противоположное направление выключается той же записью в порт,
+ * которой включается нужное
+ * @param action FRAME_ACT_UP / FRAME_ACT_DOWN / FRAME_ACT_STOP
+ */
+void addBlockRelays(RelayPortWrite& w, uint8_t bNum, uint8_t action) {
+  if (action == FRAME_ACT_UP) {
+    relayGroupUp(w, bNum);
+  } else if (action == FRAME_ACT_DOWN) {
+    relayGroupDown(w, bNum);
+  } else {
+    relayGroupStop(w, bNum);
+  }
+}
+
+/**
+ * Проверить команду блока (номер этой Mega, известное действие)
+ * POS: цель 0-100 % и известное положение блока
+ * @return 0 если команду можно выполнить, иначе FRAME_ERR_*
+ */
+uint8_t checkBlockCommand(int bNum, uint8_t act, unsigned long dur) {
+  if (bNum < MEGA1_BLOCK_START || bNum > MEGA1_BLOCK_END) return FRAME_ERR_BAD_BLOCK;
+  if (act == FRAME_ACT_POS) {
+    if (dur > 100 || blockStates[bNum - MEGA1_BLOCK_START + 1].pos == POS_UNKNOWN) return FRAME_ERR_BAD_POSITION;
+    return 0;
+  }
+  if (act != FRAME_ACT_UP && act != FRAME_ACT_DOWN && act != FRAME_ACT_STOP) return FRAME_ERR_BAD_ACTION;
+  return 0;
+}
 
-        for (int i = MEGA1_BLOCK_START; i <= MEGA1_BLOCK_END; i++) {
-          const BlockConfig* cfg = getBlockConfig(i);
-          if (cfg == nullptr) continue;
+/**
+ * Положение блока сейчас (в движении - по времени с начала хода)
+ */
+uint16_t blockPosition(const BlockState& bs, unsigned long now) {
+  if (!bs.isActive) return bs.pos;
+  unsigned long elapsed = now - bs.startTime;
+  return positionAfter(bs.pos, bs.action, elapsed < bs.duration ? elapsed : bs.duration);
+}
 
-          digitalWrite(cfg->actuator1.upPin, RELAY_OFF);
-          digitalWrite(cfg->actuator1.downPin, RELAY_OFF);
-          digitalWrite(cfg->actuator2.upPin, RELAY_OFF);
-          digitalWrite(cfg->actuator2.downPin, RELAY_OFF);
+/**
+ * Сохранить положения в EEPROM (в фоне); движущийся блок - неизвестен:
+ * пропадёт питание посреди хода - после перезагрузки положению не верим
+ */
+void savePositions() {
+  uint16_t pos[MEGA1_BLOCK_COUNT];
+  for (uint8_t i = 0; i < MEGA1_BLOCK_COUNT; i++) {
+    pos[i] = blockStates[i + 1].isActive ? POS_UNKNOWN : blockStates[i + 1].pos;
+  }
+  positionStore.save(pos, MEGA1_BLOCK_COUNT);
+}
 
-          int idx = i - MEGA1_BLOCK_START + 1;
-          blockStates[idx].isActive = false;
-        }
+/**
+ * Во что превращается команда блока, стоящего в bs.pos:
+ * - POS → UP / DOWN на время хода до цели (уже в цели - STOP)
+ * - UP / DOWN без длительности → ход до упора от текущего положения
+ *   (положение неизвестно - DEFAULT_DURATION_MS)
+ */
+void resolveBlockMove(const BlockState& bs, uint8_t& act, unsigned long& dur) {
+  if (act == FRAME_ACT_POS) {
+    uint16_t target = positionFromPercent((uint8_t)dur);
+    dur = positionTravelMs(bs.pos, target);
+    if (bs.pos == POS_UNKNOWN) act = FRAME_ACT_STOP;  // Не угадываем направление
+    else if (target > bs.pos || target == POS_FULL) act = FRAME_ACT_UP;
+    else if (target < bs.pos || target == 0) act = FRAME_ACT_DOWN;
+    else act = FRAME_ACT_STOP;
+  } else if (act != FRAME_ACT_STOP && dur == 0) {
+    dur = (bs.pos == POS_UNKNOWN) ? DEFAULT_DURATION_MS
+                                  : positionTravelMs(bs.pos, act == FRAME_ACT_UP ? POS_FULL : 0);
+  }
+
+  if (dur > BLOCK_TIMER_MAX_MS) dur = BLOCK_TIMER_MAX_MS;
+}
+
+/**
+ * Добавить проверенную команду в набор; повтор блока заменяет его
+ * прежнюю команду (UP и DOWN блока не попадут в одну запись)
+ */
+void addBlockCommand(BlockCommandSet& set, int bNum, uint8_t act, unsigned long dur) {
+  uint8_t idx = bNum - MEGA1_BLOCK_START;
+  set.mask |= (uint8_t)(1 << idx);
+  set.act[idx] = act;
+  set.dur[idx] = dur;
+}
+
+/**
+ * Реле и состояние блоков набора (команды уже проверены), без вывода в DEBUG_SERIAL
+ * - реле всех блоков - одна запись в порты (RELAY_PORTS.h)
+ * - сроки остановки - один BlockStopTimer::setGroup, реле выключит прерывание
+ */
+void applyBlockCommands(const BlockCommandSet& set) {
+  unsigned long now = millis();
+  RelayPortWrite w = {};
+  unsigned long stopAt[BLOCK_TIMER_BLOCKS];
+  uint8_t moving = 0;
+
+  for (uint8_t idx = 0; idx < MEGA1_BLOCK_COUNT; idx++) {
+    if (!(set.mask & (1 << idx))) continue;
+
+    BlockState& bs = blockStates[idx + 1];
+    uint8_t act = set.act[idx];
+    unsigned long dur = set.dur[idx];
+
+    // Текущий ход прерывается или разворачивается - зафиксировать положение
+    bs.pos = blockPosition(bs, now);
+    resolveBlockMove(bs, act, dur);
+    addBlockRelays(w, MEGA1_BLOCK_START + idx, act);
+
+    if (act == FRAME_ACT_STOP) {
+      bs.isActive = false;
+      continue;
+    }
+    bs.isActive = true;
+    bs.startTime = now;
+    bs.duration = dur;
+    bs.action = act;
+    stopAt[idx] = dur * 1000UL;  // Срок от момента записи в порты
+    moving |= (uint8_t)(1 << idx);
+  }
+
+  // Сроки и реле без прерываний между ними: старый срок блока не должен
+  // выключить уже новый ход
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    unsigned long nowUs = micros();
+    for (uint8_t idx = 0; idx < MEGA1_BLOCK_COUNT; idx++) {
+      if (moving & (1 << idx)) stopAt[idx] += nowUs;
+    }
+    stopTimer.setGroup(moving, set.mask & ~moving, MEGA1_BLOCK_START, stopAt);
+    relayWritePorts(w);
+  }
+  statusDirty = true;
+  savePositions();
+}
+
+void printPosition(uint16_t pos) {
+  if (pos == POS_UNKNOWN) {
+    DEBUG_SERIAL.print('?');
+    return;
+  }
+  DEBUG_SERIAL.print(positionPercent(pos));
+  DEBUG_SERIAL.print('%');
+}
+
+/**
+ * Лог команды после applyBlockCommands: POS и ход до упора - с тем, во что
+ * они превратились (направление, время)
+ */
+void logBlockCommand(int bNum, uint8_t act, unsigned long dur) {
+  const BlockState& bs = blockStates[bNum - MEGA1_BLOCK_START + 1];
+
+  DEBUG_SERIAL.print(F("[BLOCK "));
+  DEBUG_SERIAL.print(bNum);
+  DEBUG_SERIAL.print(F("] "));
+  if (act == FRAME_ACT_POS) {
+    DEBUG_SERIAL.print(F("POS "));
+    DEBUG_SERIAL.print(dur);
+    DEBUG_SERIAL.print(F("% -> "));
+  }
+  if (!bs.isActive) {
+    DEBUG_SERIAL.print(F("STOP at "));
+    printPosition(bs.pos);
+    DEBUG_SERIAL.println();
+    return;
+  }
+
+  DEBUG_SERIAL.print(bs.action == FRAME_ACT_UP ? F("UP ") : F("DOWN "));
+  DEBUG_SERIAL.print(bs.duration);
+  DEBUG_SERIAL.print(F("ms from "));
+  printPosition(bs.pos);
+  DEBUG_SERIAL.println();
+}
+
+/**
+ * Лог набора после applyBlockCommands
+ */
+void logBlockCommands(const BlockCommandSet& set) {
+  for (uint8_t idx = 0; idx < MEGA1_BLOCK_COUNT; idx++) {
+    if (set.mask & (1 << idx)) logBlockCommand(MEGA1_BLOCK_START + idx, set.act[idx], set.dur[idx]);
+  }
+}
+
+/**
+ * Выполнить набор команд сейчас (общая для текстового и бинарного протокола)
+ * STOP заодно снимает команды блока из очереди AT
+ */
+void runBlockCommands(const BlockCommandSet& set) {
+  for (uint8_t idx = 0; idx < MEGA1_BLOCK_COUNT; idx++) {
+    if ((set.mask & (1 << idx)) && set.act[idx] == FRAME_ACT_STOP) cancelScheduled(MEGA1_BLOCK_START + idx);
+  }
+  applyBlockCommands(set);
+  logBlockCommands(set);
+}
+
+/**
+ * Выполнить команду одного блока сейчас
+ * @return 0 если выполнено, иначе FRAME_ERR_*
+ */
+uint8_t runBlockCommand(int bNum, uint8_t act, unsigned long dur) {
+  uint8_t err = checkBlockCommand(bNum, act, dur);
+  if (err) return err;
+
+  BlockCommandSet set = {};
+  addBlockCommand(set, bNum, act, dur);
+  runBlockCommands(set);
+  return 0;
+}
+
+/**
+ * GROUP: одно действие всем блокам маски (бит n-1 = блок n), реле группы -
+ * одной записью в порты. Блок другой Mega в маске - ошибка всей группы
+ * @return 0 если выполнено, иначе FRAME_ERR_* (errBlock - блок с ошибкой,
+ *         0 - пустая маска); при ошибке ни один блок не тронут
+ */
+uint8_t runGroupCommand(uint16_t mask, uint8_t act, unsigned long dur, uint8_t& errBlock) {
+  errBlock = 0;
+  if (mask == 0) return FRAME_ERR_BAD_BLOCK;
+
+  for (uint8_t bNum = 1; bNum <= 16; bNum++) {
+    if (!(mask & FRAME_GROUP_BIT(bNum))) continue;
+    uint8_t err = checkBlockCommand(bNum, act, dur);
+    if (err) {
+      errBlock = bNum;
+      return err;
+    }
+  }
+
+  BlockCommandSet set = {};
+  for (int bNum = MEGA1_BLOCK_START; bNum <= MEGA1_BLOCK_END; bNum++) {
+    if (mask & FRAME_GROUP_BIT(bNum)) addBlockCommand(set, bNum, act, dur);
+  }
+  runBlockCommands(set);
+  return 0;
+}
+
+// ============================================================================
+// ОЧЕРЕДЬ AT
+// ============================================================================
+
+/**
+ * Поставить команду в очередь по времени (после команд с тем же временем)
+ * Сравнение через разность со знаком - переживает переполнение micros()
+ * @return false если очередь заполнена
+ */
+bool scheduleBlockCommand(unsigned long atUs, uint8_t bNum, uint8_t act, unsigned long dur) {
+  if (atQueueCount >= AT_QUEUE_MAX) return false;
+
+  uint8_t pos = atQueueCount;
+  while (pos > 0 && (long)(atQueue[pos - 1].atUs - atUs) > 0) {
+    atQueue[pos] = atQueue[pos - 1];
+    pos--;
+  }
+  atQueue[pos].atUs = atUs;
+  atQueue[pos].duration = dur;
+  atQueue[pos].blockNum = bNum;
+  atQueue[pos].act = act;
+  atQueueCount++;
+  return true;
+}
+
+/**
+ * Убрать из очереди команды блока (0 = все блоки)
+ */
+void cancelScheduled(uint8_t bNum) {
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < atQueueCount; i++) {
+    if (bNum != 0 && atQueue[i].blockNum != bNum) atQueue[kept++] = atQueue[i];
+  }
+  atQueueCount = kept;
+}
+
+/**
+ * Выполнить наступившие команды очереди
+ * Сначала реле всех блоков (одна запись в порты), потом лог: печать
+ * в DEBUG_SERIAL ждёт место в буфере и задержала бы следующие блоки
+ */
+void runScheduledCommands() {
+  unsigned long nowUs = micros();
+
+  uint8_t due = 0;
+  while (due < atQueueCount && (long)(nowUs - atQueue[due].atUs) >= 0) due++;
+  if (due == 0) return;
+
+  // Все наступившие - одним переключением (позже в очереди - важнее)
+  BlockCommandSet set = {};
+  for (uint8_t i = 0; i < due; i++) {
+    addBlockCommand(set, atQueue[i].blockNum, atQueue[i].act, atQueue[i].duration);
+  }
+  applyBlockCommands(set);
+
+  DEBUG_SERIAL.print(F("[AT] late "));
+  DEBUG_SERIAL.print(nowUs - atQueue[0].atUs);
+  DEBUG_SERIAL.println(F("us"));
+  logBlockCommands(set);
+
+  for (uint8_t i = due; i < atQueueCount; i++) atQueue[i - due] = atQueue[i];
+  atQueueCount -= due;
+}
+
+/**
+ * Остановить все блоки этой Mega
+ */
+void stopAllBlocks() {
+  DEBUG_SERIAL.println(F("[ALL] STOP ALL"));
 
-        ESP32_SERIAL.println("ACK:0:STOP");
+  // Все реле этой Mega одной записью в каждый порт
+  stopTimer.cancelAll();
+  relayAllOff<1>();
+  cancelScheduled(0);
+  statusDirty = true;
+
+  unsigned long now = millis();
+  for (int i = 1; i <= MEGA1_BLOCK_COUNT; i++) {
+    blockStates[i].pos = blockPosition(blockStates[i], now);
+    blockStates[i].isActive = false;
+  }
+  savePositions();
+}
+
+// ============================================================================
+// ТЕКСТОВЫЙ ПРОТОКОЛ (v3, ОСТАЁТСЯ КАК FALLBACK)
+// ============================================================================
+
+/**
+ * Текст ошибки команды блока / группы (FRAME_ERR_*)
+ */
+void addCommandError(MegaReplyBuf& reply, uint8_t err) {
+  if (err == FRAME_ERR_BAD_BLOCK) {
+    reply.add(F("ERROR:Invalid block"));
+  } else if (err == FRAME_ERR_BAD_ACTION) {
+    reply.add(F("ERROR:Invalid action"));
+  } else {
+    reply.add(F("ERROR:Invalid position"));
+  }
+}
+
+void handleTextCommand(const char* line) {
+  DEBUG_SERIAL.print(F("[RX] "));
+  DEBUG_SERIAL.println(line);
+
+  // Текстовая команда - ESP32 работает по v3, отвечаем текстом
+  binaryLink = false;
+
+  // Один проход по строке, без sscanf (MEGA_LINK.h)
+  MegaCommand cmd;
+  parseMegaCommand(line, cmd);
+
+  MegaReplyBuf reply;
+
+  switch (cmd.type) {
+    case MEGA_CMD_PING:
+      reply.add(F(CMD_PONG));
+      break;
+
+    // PROTO:4 - ESP32 предлагает бинарные кадры
+    case MEGA_CMD_PROTO:
+      if (cmd.protoVersion != FRAME_PROTO_VERSION) {
+        reply.add(F("ERROR:Unknown command"));
+        break;
       }
-      // BLOCK:N:ACTION:DURATION
-      else if (cmdRaw.startsWith(CMD_BLOCK)) {
-        blockNum = 0;
-        duration = 0;
-        memset(action, 0, sizeof(action));
-
-        // Парсинг как в DroneControl.ino
-        int parsed = sscanf(cmdRaw.c_str(), "BLOCK:%d:%[^:]:%d", &blockNum, action, &duration);
-
-        if (parsed >= 2 && blockNum >= MEGA1_BLOCK_START && blockNum <= MEGA1_BLOCK_END) {
-          const BlockConfig* cfg = getBlockConfig(blockNum);
-          int idx = blockNum - MEGA1_BLOCK_START + 1;
-
-          if (duration == 0) duration = DEFAULT_DURATION_MS;
-
-          // UP
-          if (strcmp(action, ACTION_UP) == 0) {
-            digitalWrite(cfg->actuator1.upPin, RELAY_ON);
-            digitalWrite(cfg->actuator2.upPin, RELAY_ON);
-            digitalWrite(cfg->actuator1.downPin, RELAY_OFF);
-            digitalWrite(cfg->actuator2.downPin, RELAY_OFF);
-
-            blockStates[idx].isActive = true;
-            blockStates[idx].startTime = millis();
-            blockStates[idx].duration = duration;
-
-            DEBUG_SERIAL.print("[BLOCK ");
-            DEBUG_SERIAL.print(blockNum);
-            DEBUG_SERIAL.print("] UP ");
-            DEBUG_SERIAL.println(duration);
-
-            ESP32_SERIAL.print("ACK:");
-            ESP32_SERIAL.print(blockNum);
-            ESP32_SERIAL.println(":UP");
-          }
-          // DOWN
-          else if (strcmp(action, ACTION_DOWN) == 0) {
-            digitalWrite(cfg->actuator1.downPin, RELAY_ON);
-            digitalWrite(cfg->actuator2.downPin, RELAY_ON);
-            digitalWrite(cfg->actuator1.upPin, RELAY_OFF);
-            digitalWrite(cfg->actuator2.upPin, RELAY_OFF);
-
-            blockStates[idx].isActive = true;
-            blockStates[idx].startTime = millis();
-            blockStates[idx].duration = duration;
-
-            DEBUG_SERIAL.print("[BLOCK ");
-            DEBUG_SERIAL.print(blockNum);
-            DEBUG_SERIAL.print("] DOWN ");
-            DEBUG_SERIAL.println(duration);
-
-            ESP32_SERIAL.print("ACK:");
-            ESP32_SERIAL.print(blockNum);
-            ESP32_SERIAL.println(":DOWN");
-          }
-          // STOP
-          else if (strcmp(action, ACTION_STOP) == 0) {
-            digitalWrite(cfg->actuator1.upPin, RELAY_OFF);
-            digitalWrite(cfg->actuator1.downPin, RELAY_OFF);
-            digitalWrite(cfg->actuator2.upPin, RELAY_OFF);
-            digitalWrite(cfg->actuator2.downPin, RELAY_OFF);
-
-            blockStates[idx].isActive = false;
-
-            DEBUG_SERIAL.print("[BLOCK ");
-            DEBUG_SERIAL.print(blockNum);
-            DEBUG_SERIAL.println("] STOP");
-
-            ESP32_SERIAL.print("ACK:");
-            ESP32_SERIAL.print(blockNum);
-            ESP32_SERIAL.println(":STOP");
-          }
-          else {
-            ESP32_SERIAL.println("ERROR:Invalid action");
-          }
-        }
-        else {
-          ESP32_SERIAL.println("ERROR:Invalid block");
-        }
+      // Новая сессия ESP32: её SEQ начинаются заново
+      memset(recentSeq, 0, sizeof(recentSeq));
+      reply.add(F(FRAME_PROTO_HELLO));
+      break;
+
+    case MEGA_CMD_ALL_STOP:
+      stopAllBlocks();
+      reply.add(F("ACK:0:STOP"));
+      break;
+
+    // BLOCK:N:ACTION:DURATION
+    case MEGA_CMD_BLOCK: {
+      uint8_t err = cmd.hasBlock ? runBlockCommand(cmd.blockNum, cmd.action, cmd.duration)
+                                 : FRAME_ERR_BAD_BLOCK;
+
+      if (err) {
+        addCommandError(reply, err);
+      } else {
+        reply.add(F("ACK:")).add((uint32_t)cmd.blockNum).add(':').add(megaActionName(cmd.action));
       }
-      else {
-        ESP32_SERIAL.println("ERROR:Unknown command");
+      break;
+    }
+
+    // GROUP:MASK:ACTION:DURATION - вся группа одним переключением реле
+    case MEGA_CMD_GROUP: {
+      uint8_t errBlock;
+      uint8_t err = cmd.hasBlock ? runGroupCommand(cmd.blockMask, cmd.action, cmd.duration, errBlock)
+                                 : FRAME_ERR_BAD_BLOCK;
+
+      if (err) {
+        addCommandError(reply, err);
+      } else {
+        reply.add(F("ACK:GROUP:")).add((uint32_t)cmd.blockMask).add(':').add(megaActionName(cmd.action));
       }
+      break;
     }
+
+    default:
+      reply.add(F("ERROR:Unknown command"));
+      break;
   }
 
-  // ===== ПРОВЕРКА ТАЙМАУТОВ =====
+  // Ответ одним write
+  ESP32_SERIAL.write((const uint8_t*)reply.text, reply.line());
+  DEBUG_SERIAL.print(F("[TX] "));
+  DEBUG_SERIAL.print(reply.text);
+}
+
+// ============================================================================
+// БИНАРНЫЙ ПРОТОКОЛ v4 (FRAME_CODEC.h)
+// ============================================================================
+
+void sendFrame(uint8_t seq, uint8_t op, const uint8_t* payload, uint8_t len) {
+  uint8_t buf[FRAME_SIZE_MAX];
+  uint8_t n = frameEncode(buf, seq, op, payload, len);
+  ESP32_SERIAL.write(buf, n);
+}
+
+void sendAck(uint8_t seq, uint8_t bNum, uint8_t act) {
+  uint8_t payload[2] = { bNum, act };
+  sendFrame(seq, FRAME_OP_ACK, payload, sizeof(payload));
+}
+
+void sendNak(uint8_t seq, uint8_t err, uint8_t bNum) {
+  uint8_t payload[2] = { err, bNum };
+  sendFrame(seq, FRAME_OP_NAK, payload, sizeof(payload));
+}
+
+/**
+ * Ответ на BATCH / AT / GROUP: ACK [0, act, count] или NAK [err, block]
+ * @param act FRAME_ACT_NONE для BATCH / AT, действие группы для GROUP
+ */
+void sendBatchReply(uint8_t seq, uint8_t err, uint8_t errBlock, uint8_t act, uint8_t count) {
+  if (err) {
+    sendNak(seq, err, errBlock);
+  } else {
+    uint8_t payload[3] = { 0, act, count };
+    sendFrame(seq, FRAME_OP_ACK, payload, sizeof(payload));
+  }
+}
+
+/**
+ * Кадр состояния всех блоков этой Mega (FRAME_OP_STATUS, SEQ = 0)
+ */
+void sendStatus(unsigned long now) {
+  FrameStatus st;
+  memset(&st, 0, sizeof(st));
+  st.uptimeMs = now;
+  st.firstBlock = MEGA1_BLOCK_START;
+  st.blockCount = MEGA1_BLOCK_COUNT;
+
+  memset(st.pos, FRAME_STATUS_POS_UNKNOWN, sizeof(st.pos));
+
+  for (uint8_t i = 0; i < MEGA1_BLOCK_COUNT; i++) {
+    const BlockState& bs = blockStates[i + 1];
+    st.pos[i] = positionPercent(blockPosition(bs, now));
+    if (!bs.isActive) continue;
+
+    if (bs.action == FRAME_ACT_UP) st.upMask |= (uint8_t)(1 << i);
+    else st.downMask |= (uint8_t)(1 << i);
+
+    unsigned long elapsed = now - bs.startTime;
+    st.remain[i] = frameStatusRemain(elapsed < bs.duration ? bs.duration - elapsed : 0);
+  }
+
+  st.crcErrors = (uint16_t)frameRx.crcErrors();
+  st.lenErrors = (uint16_t)frameRx.lenErrors();
+  st.gapResets = rxGapResets;
+  st.lineOverflows = (uint16_t)textRx.overflows();
+  st.queued = atQueueCount;
+  st.uartFrameErrors = ESP32_SERIAL.frameErrors();
+  st.uartParityErrors = ESP32_SERIAL.parityErrors();
+  st.uartOverruns = ESP32_SERIAL.overruns();
+  st.uartDropped = ESP32_SERIAL.rxDropped();
+
+  uint8_t payload[FRAME_STATUS_SIZE];
+  sendFrame(0, FRAME_OP_STATUS, payload, frameStatusEncode(payload, st));
+  lastStatusMs = now;
+  statusDirty = false;
+}
+
+/**
+ * Отправить состояние, если пора: после изменения (не чаще
+ * FRAME_STATUS_MIN_GAP_MS - пачка AT даёт один кадр) или раз в
+ * FRAME_STATUS_INTERVAL_MS. Текстовый ESP32 (v3) кадров не ждёт
+ */
+void serviceStatus() {
+  if (!binaryLink) return;
+
   unsigned long now = millis();
+  unsigned long since = now - lastStatusMs;
+  if (since >= FRAME_STATUS_INTERVAL_MS || (statusDirty && since >= FRAME_STATUS_MIN_GAP_MS)) {
+    sendStatus(now);
+  }
+}
 
-  for (int i = 1; i <= MEGA1_BLOCK_COUNT; i++) {
-    if (blockStates[i].isActive) {
-      unsigned long elapsed = now - blockStates[i].startTime;
+/**
+ * Проверить все записи BATCH / AT до первого переключения реле
+ * @return 0 или FRAME_ERR_* (errBlock - блок с ошибкой)
+ */
+uint8_t checkBatchEntries(const uint8_t* entries, uint8_t count, uint8_t& errBlock) {
+  for (uint8_t i = 0; i < count; i++) {
+    const uint8_t* e = &entries[i * FRAME_BATCH_ENTRY];
+    uint8_t err = checkBlockCommand(e[0], e[1], frameGetU32(&e[2]));
+    if (err) {
+      errBlock = e[0];
+      return err;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Повтор команды с тем же SEQ (ESP32 не получил наш ACK)
+ * Повтор не исполняется второй раз - отвечаем тем же результатом
+ * @return true если SEQ уже обработан (результат в err)
+ */
+bool findRecentSeq(uint8_t seq, uint8_t& err) {
+  for (uint8_t i = 0; i < SEQ_HISTORY; i++) {
+    if (recentSeq[i].seq == seq) {
+      err = recentSeq[i].err;
+      return true;
+    }
+  }
+  return false;
+}
 
-      if (elapsed >= blockStates[i].duration) {
-        int bNum = MEGA1_BLOCK_START + i - 1;
-        const BlockConfig* cfg = getBlockConfig(bNum);
+void rememberSeq(uint8_t seq, uint8_t err) {
+  recentSeq[recentSeqPos].seq = seq;
+  recentSeq[recentSeqPos].err = err;
+  recentSeqPos = (recentSeqPos + 1) % SEQ_HISTORY;
+}
 
-        // Остановить блок
-        digitalWrite(cfg->actuator1.upPin, RELAY_OFF);
-        digitalWrite(cfg->actuator1.downPin, RELAY_OFF);
-        digitalWrite(cfg->actuator2.upPin, RELAY_OFF);
-        digitalWrite(cfg->actuator2.downPin, RELAY_OFF);
+void handleFrame(const Frame& f) {
+  binaryLink = true;
+
+  if (f.op == FRAME_OP_PING) {
+    if (f.len < 4) {
+      sendFrame(f.seq, FRAME_OP_PONG, nullptr, 0);
+      return;
+    }
+    // Отметка ESP32 + наше время: по ним ESP32 считает смещение часов для AT
+    uint8_t payload[8];
+    memcpy(payload, f.payload, 4);
+    framePutU32(&payload[4], micros());
+    sendFrame(f.seq, FRAME_OP_PONG, payload, sizeof(payload));
+    return;
+  }
+
+  if (f.op == FRAME_OP_ALL_STOP) {
+    DEBUG_SERIAL.print(F("[RX] #"));
+    DEBUG_SERIAL.print(f.seq);
+    DEBUG_SERIAL.println(F(" ALL:STOP"));
+
+    uint8_t err;
+    if (!findRecentSeq(f.seq, err)) {
+      stopAllBlocks();
+      rememberSeq(f.seq, 0);
+    }
+    sendAck(f.seq, 0, FRAME_ACT_STOP);
+    return;
+  }
+
+  if (f.op == FRAME_OP_BLOCK) {
+    if (f.len < 6) {
+      sendNak(f.seq, FRAME_ERR_BAD_LENGTH, 0);
+      return;
+    }
 
-        blockStates[i].isActive = false;
+    uint8_t bNum = f.payload[0];
+    uint8_t act = f.payload[1];
+    unsigned long dur = frameGetU32(&f.payload[2]);
 
-        DEBUG_SERIAL.print("[TIMEOUT] Block ");
-        DEBUG_SERIAL.println(bNum);
+    DEBUG_SERIAL.print(F("[RX] #"));
+    DEBUG_SERIAL.print(f.seq);
+    DEBUG_SERIAL.print(F(" BLOCK "));
+    DEBUG_SERIAL.print(bNum);
+    DEBUG_SERIAL.print(' ');
+    DEBUG_SERIAL.print(act);
+    DEBUG_SERIAL.print(' ');
+    DEBUG_SERIAL.println(dur);
 
-        ESP32_SERIAL.print("DONE:");
-        ESP32_SERIAL.println(bNum);
+    uint8_t err;
+    if (!findRecentSeq(f.seq, err)) {
+      err = runBlockCommand(bNum, act, dur);
+      rememberSeq(f.seq, err);
+    }
+
+    if (err) sendNak(f.seq, err, bNum);
+    else sendAck(f.seq, bNum, act);
+    return;
+  }
+
+  if (f.op == FRAME_OP_BATCH) {
+    uint8_t count = f.len / FRAME_BATCH_ENTRY;
+    if (count == 0 || f.len % FRAME_BATCH_ENTRY != 0) {
+      sendNak(f.seq, FRAME_ERR_BAD_LENGTH, 0);
+      return;
+    }
+
+    DEBUG_SERIAL.print(F("[RX] #"));
+    DEBUG_SERIAL.print(f.seq);
+    DEBUG_SERIAL.print(F(" BATCH x"));
+    DEBUG_SERIAL.println(count);
+
+    uint8_t err;
+    uint8_t errBlock = 0;
+    if (!findRecentSeq(f.seq, err)) {
+      // Сначала проверить весь пакет - либо запускаются все блоки, либо ни один
+      err = checkBatchEntries(f.payload, count, errBlock);
+      if (!err) {
+        BlockCommandSet set = {};
+        for (uint8_t i = 0; i < count; i++) {
+          const uint8_t* e = &f.payload[i * FRAME_BATCH_ENTRY];
+          addBlockCommand(set, e[0], e[1], frameGetU32(&e[2]));
+        }
+        runBlockCommands(set);
+      }
+      rememberSeq(f.seq, err);
+    }
+
+    sendBatchReply(f.seq, err, errBlock, FRAME_ACT_NONE, count);
+    return;
+  }
+
+  if (f.op == FRAME_OP_AT) {
+    uint8_t count = (f.len > FRAME_AT_HEADER) ? (f.len - FRAME_AT_HEADER) / FRAME_BATCH_ENTRY : 0;
+    if (count == 0 || (f.len - FRAME_AT_HEADER) % FRAME_BATCH_ENTRY != 0) {
+      sendNak(f.seq, FRAME_ERR_BAD_LENGTH, 0);
+      return;
+    }
+
+    unsigned long atUs = frameGetU32(f.payload);
+    const uint8_t* entries = &f.payload[FRAME_AT_HEADER];
+    long aheadUs = (long)(atUs - micros());
+
+    DEBUG_SERIAL.print(F("[RX] #"));
+    DEBUG_SERIAL.print(f.seq);
+    DEBUG_SERIAL.print(F(" AT x"));
+    DEBUG_SERIAL.print(count);
+    DEBUG_SERIAL.print(F(" in "));
+    DEBUG_SERIAL.print(aheadUs);
+    DEBUG_SERIAL.println(F("us"));
+
+    uint8_t err;
+    uint8_t errBlock = 0;
+    if (!findRecentSeq(f.seq, err)) {
+      // Весь пакет в очередь или ничего; время в прошлом - выполнится сразу
+      err = checkBatchEntries(entries, count, errBlock);
+      if (!err && aheadUs > (long)FRAME_AT_MAX_AHEAD_MS * 1000L) err = FRAME_ERR_BAD_TIME;
+      if (!err && atQueueCount + count > AT_QUEUE_MAX) err = FRAME_ERR_QUEUE_FULL;
+      if (!err) {
+        for (uint8_t i = 0; i < count; i++) {
+          const uint8_t* e = &entries[i * FRAME_BATCH_ENTRY];
+          scheduleBlockCommand(atUs, e[0], e[1], frameGetU32(&e[2]));
+        }
       }
+      rememberSeq(f.seq, err);
     }
+
+    sendBatchReply(f.seq, err, errBlock, FRAME_ACT_NONE, count);
+    return;
+  }
+
+  if (f.op == FRAME_OP_GROUP) {
+    if (f.len < FRAME_GROUP_SIZE) {
+      sendNak(f.seq, FRAME_ERR_BAD_LENGTH, 0);
+      return;
+    }
+
+    uint16_t mask = frameGetU16(f.payload);
+    uint8_t act = f.payload[2];
+    unsigned long dur = frameGetU32(&f.payload[3]);
+
+    DEBUG_SERIAL.print(F("[RX] #"));
+    DEBUG_SERIAL.print(f.seq);
+    DEBUG_SERIAL.print(F(" GROUP 0x"));
+    DEBUG_SERIAL.print(mask, HEX);
+    DEBUG_SERIAL.print(' ');
+    DEBUG_SERIAL.print(act);
+    DEBUG_SERIAL.print(' ');
+    DEBUG_SERIAL.println(dur);
+
+    uint8_t err;
+    uint8_t errBlock = 0;
+    if (!findRecentSeq(f.seq, err)) {
+      err = runGroupCommand(mask, act, dur, errBlock);
+      rememberSeq(f.seq, err);
+    }
+
+    sendBatchReply(f.seq, err, errBlock, act, (uint8_t)__builtin_popcount(mask));
+    return;
   }
+
+  sendNak(f.seq, FRAME_ERR_BAD_OPCODE, 0);
+}
+
+// ============================================================================
+// MAIN LOOP - СТИЛЬ DroneControl.ino
+// ============================================================================
+
+void loop() {
+  // ===== ЧТЕНИЕ КОМАНД ОТ ESP32 =====
+  // Побайтово: 0xA5 начинает бинарный кадр, всё остальное - текстовая строка
+  while (ESP32_SERIAL.available()) {
+    uint8_t c = ESP32_SERIAL.read();
+
+    // Паузу перед байтом отметило прерывание приёма - проход loop() её не удлиняет
+    if (frameRx.busy() && ESP32_SERIAL.gapBefore()) {
+      frameRx.reset();  // Оборванный кадр
+      rxGapResets++;
+    }
+
+    if (frameRx.busy() || c == FRAME_SYNC) {
+      if (frameRx.feed(c)) handleFrame(frameRx.frame());
+    }
+    else if (textRx.feed((char)c)) {
+      handleTextCommand(textRx.line());
+    }
+  }
+
+  // ===== ОЧЕРЕДЬ AT =====
+  runScheduledCommands();
+
+  // ===== ОСТАНОВКИ ПО ТАЙМЕРУ =====
+  // Реле уже выключило прерывание Timer3 - здесь только учёт
+  uint8_t fired = stopTimer.takeFired();
+
+  for (int i = 1; i <= MEGA1_BLOCK_COUNT; i++) {
+    if (!(fired & (1 << (i - 1)))) continue;
+
+    int bNum = MEGA1_BLOCK_START + i - 1;
+
+    blockStates[i].pos = positionAfter(blockStates[i].pos, blockStates[i].action, blockStates[i].duration);
+    blockStates[i].isActive = false;
+    statusDirty = true;
+    savePositions();
+
+    DEBUG_SERIAL.print(F("[TIMEOUT] Block "));
+    DEBUG_SERIAL.print(bNum);
+    DEBUG_SERIAL.print(F(" +"));
+    DEBUG_SERIAL.print(stopTimer.lateUs(i - 1));
+    DEBUG_SERIAL.println(F("us"));
+
+    // Бинарному ESP32 остановку сообщит кадр STATUS (serviceStatus)
+    if (!binaryLink) {
+      MegaReplyBuf reply;
+      reply.add(F("DONE:")).add((uint32_t)bNum);
+      ESP32_SERIAL.write((const uint8_t*)reply.text, reply.line());
+    }
+  }
+
+  // ===== ПОЛОЖЕНИЯ В EEPROM (по байту за проход) =====
+  positionStore.service();
+
+  // ===== СОСТОЯНИЕ ДЛЯ ESP32 =====
+  serviceStatus();
 }
@@ -0,0 +1,417 @@
+/**
+ * RAMS FRAME CODEC - бинарный протокол v4 ESP32 ↔ Mega
+ *
+ * Кадр (все поля 1 байт, кроме payload):
+ *
+ *   SYNC | LEN | SEQ | OP | PAYLOAD[LEN] | CRC8
+ *   0xA5                                   CRC-8 (poly 0x07) по LEN..PAYLOAD
+ *
+ * - SEQ: номер команды ESP32 (1-255, 0 = кадр по инициативе Mega)
+ * - ACK/NAK/PONG возвращают SEQ команды, на которую отвечают
+ * - Битый кадр (CRC/длина) молча отбрасывается, ESP32 повторит по таймауту
+ *
+ * BLOCK:5:UP:10000 (17 байт текста + sscanf) → 11 байт, разбор за один проход.
+ *
+ * Согласование (текстом, чтобы старые прошивки не сломались):
+ *   ESP32 → PROTO:4      Mega v4 → PROTO:4      (дальше бинарные кадры)
+ *                        Mega v3 → ERROR:...    (остаёмся на тексте)
+ * Mega принимает оба формата одновременно: 0xA5 никогда не встречается
+ * в ASCII командах. Отвечает в том формате, в котором пришла команда.
+ *
+ * Синхронный старт на двух Mega (FRAME_OP_AT):
+ *   PING [t_esp] → PONG [t_esp, t_mega]   ESP32 оценивает смещение часов Mega
+ *   AT [t_mega, N × блок]                 Mega ставит команды в очередь и
+ *                                         выполняет их по своему micros()
+ *
+ * Состояние Mega (FRAME_OP_STATUS, v4.2): кадр фиксированного размера
+ * раз в FRAME_STATUS_INTERVAL_MS и сразу после переключения реле -
+ * направление и остаток времени каждого блока, счётчики ошибок приёма,
+ * uptime. Заменяет DONE на бинарном канале; ESP32 сверяет по нему свои
+ * blockStates и по нему же видит, что Mega жива.
+ *
+ * Положение блока (v4.3): действие POS - в поле duration цель 0-100 %,
+ * Mega сама выбирает направление и время хода (BLOCK_POSITION.h).
+ * Положение блоков в % - в кадре STATUS.
+ *
+ * Ошибки UART Mega (v4.4): кадр / чётность / overrun / переполнение
+ * кольца приёма (MEGA_UART.h) - в кадре STATUS.
+ *
+ * Группа блоков (v4.5, FRAME_OP_GROUP): маска блоков + одно действие и
+ * длительность на всех. Mega проверяет всю группу и переключает все её
+ * реле одной записью в порты, отвечает одним ACK [0, action, count].
+ *
+ * ВАЖНО: Этот файл используется ОДНОВРЕМЕННО в:
+ * - ESP32 v3.3 (rams_controller_v3)
+ * - Arduino Mega #1 (actuator_mega1_v3)
+ * - Arduino Mega #2 (actuator_mega2_v3)
+ *
+ * @version 4.5
+ * @date 2026-03-29
+ * @author RAMS Global Team
+ */
+
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <Arduino.h>
+
+// ============================================================================
+// КОНСТАНТЫ
+// ============================================================================
+
+#define FRAME_PROTO_VERSION   4
+#define FRAME_PROTO_HELLO     "PROTO:4"   // Текстовое согласование
+
+#define FRAME_SYNC            0xA5
+#define FRAME_HEADER_SIZE     4           // SYNC + LEN + SEQ + OP
+#define FRAME_PAYLOAD_MAX     52          // AT (4 + 8 × 6) на 8 блоков Mega #1
+#define FRAME_SIZE_MAX        (FRAME_HEADER_SIZE + FRAME_PAYLOAD_MAX + 1)
+
+// Повтор команды ESP32 без ACK
+#define FRAME_ACK_TIMEOUT_MS  60
+#define FRAME_MAX_RETRIES     3
+
+// Пауза внутри кадра больше этой - кадр оборван, декодер сбрасывается
+#define FRAME_GAP_MS          5
+
+// ============================================================================
+// ОПКОДЫ
+// ============================================================================
+
+// ESP32 → Mega
+#define FRAME_OP_PING         0x01        // (пусто) | t_esp_us(4)
+#define FRAME_OP_BLOCK        0x02        // block(1) action(1) duration_ms(4, LE)
+#define FRAME_OP_ALL_STOP     0x03        // (пусто)
+#define FRAME_OP_BATCH        0x04        // N × [block, action, duration_ms(4, LE)]
+#define FRAME_OP_AT           0x05        // t_mega_us(4) + N × [block, action, duration_ms(4)]
+#define FRAME_OP_GROUP        0x06        // mask(2, LE) action(1) duration_ms(4)
+
+#define FRAME_BATCH_ENTRY     6           // Байт на блок в BLOCK / BATCH / AT
+#define FRAME_AT_HEADER       4           // Время выполнения перед блоками AT
+#define FRAME_GROUP_SIZE      7           // Payload GROUP
+
+// Маска GROUP: бит (n - 1) = блок n (как BATCH, номера блоков общие)
+#define FRAME_GROUP_BIT(n)    ((uint16_t)(1u << ((n) - 1)))
+
+// AT дальше этого в будущем отклоняется (micros() переполняется за 71 мин)
+#define FRAME_AT_MAX_AHEAD_MS 10000
+
+// Mega → ESP32 (старший бит = ответ)
+#define FRAME_OP_ACK          0x80        // block(1) action(1); на BATCH/AT: 0, NONE, count(1);
+                                          // на GROUP: 0, action, count(1)
+#define FRAME_OP_PONG         0x81        // (пусто) | t_esp_us(4) t_mega_us(4) на PING с временем
+#define FRAME_OP_DONE         0x82        // block(1) - Mega до v4.2, теперь STATUS
+#define FRAME_OP_NAK          0x83        // error(1) block(1)
+#define FRAME_OP_STATUS       0x84        // FrameStatus (SEQ = 0), см. ниже
+
+// Действия (значения совпадают с MegaAction из MEGA_LINK.h)
+#define FRAME_ACT_NONE        0
+#define FRAME_ACT_UP          1
+#define FRAME_ACT_DOWN        2
+#define FRAME_ACT_STOP        3
+#define FRAME_ACT_POS         4           // duration_ms = цель 0-100 % хода
+
+// Коды ошибок NAK
+#define FRAME_ERR_BAD_BLOCK   1
+#define FRAME_ERR_BAD_ACTION  2
+#define FRAME_ERR_BAD_OPCODE  3
+#define FRAME_ERR_BAD_LENGTH  4
+#define FRAME_ERR_BAD_TIME    5           // AT дальше FRAME_AT_MAX_AHEAD_MS
+#define FRAME_ERR_QUEUE_FULL  6           // В очереди AT нет места на весь пакет
+#define FRAME_ERR_BAD_POSITION 7          // POS: цель > 100 % или положение неизвестно
+
+// ============================================================================
+// CRC-8
+// ============================================================================
+
+/**
+ * CRC-8 (poly 0x07, init 0x00) - без таблицы, чтобы не тратить 256 байт
+ * Кадры короткие (≤ 57 байт), побитовый расчёт укладывается в микросекунды
+ */
+inline uint8_t frameCrc8(uint8_t crc, uint8_t data) {
+  crc ^= data;
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+// ============================================================================
+// КОДИРОВАНИЕ
+// ============================================================================
+
+inline void framePutU32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)(v);
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+inline void framePutU16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)(v);
+  p[1] = (uint8_t)(v >> 8);
+}
+
+inline uint16_t frameGetU16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t frameGetU32(const uint8_t* p) {
+  return (uint32_t)p[0] |
+         ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Собрать кадр в out (минимум FRAME_SIZE_MAX байт)
+ * @return Полный размер кадра, 0 если payload слишком длинный
+ */
+inline uint8_t frameEncode(uint8_t* out, uint8_t seq, uint8_t op,
+                           const uint8_t* payload, uint8_t len) {
+  if (len > FRAME_PAYLOAD_MAX) return 0;
+
+  out[0] = FRAME_SYNC;
+  out[1] = len;
+  out[2] = seq;
+  out[3] = op;
+
+  uint8_t crc = 0;
+  crc = frameCrc8(crc, len);
+  crc = frameCrc8(crc, seq);
+  crc = frameCrc8(crc, op);
+  for (uint8_t i = 0; i < len; i++) {
+    out[FRAME_HEADER_SIZE + i] = payload[i];
+    crc = frameCrc8(crc, payload[i]);
+  }
+  out[FRAME_HEADER_SIZE + len] = crc;
+  return FRAME_HEADER_SIZE + len + 1;
+}
+
+// ============================================================================
+// СОСТОЯНИЕ MEGA (FRAME_OP_STATUS)
+// ============================================================================
+//
+//   uptime_ms(4) | first(1) count(1) | up(1) down(1) | remain(2) × 8
+//   | crc_err(2) len_err(2) gap_err(2) line_err(2) | queued(1) | pos(1) × 8
+//   | uart_fe(2) uart_pe(2) uart_ovr(2) uart_drop(2)
+//
+// Все актуаторы блока переключаются одной записью в порт (RELAY_PORTS.h),
+// поэтому направление передаётся на блок: бит i = блок first + i.
+
+#define FRAME_STATUS_BLOCKS       8       // Слотов блоков (Mega #1 - 8, Mega #2 - 7)
+#define FRAME_STATUS_SIZE         49      // Payload, одинаковый на обеих Mega
+#define FRAME_STATUS_SIZE_V43     41      // Mega v4.3: без ошибок UART
+#define FRAME_STATUS_SIZE_V42     33      // Mega v4.2: без положений
+#define FRAME_STATUS_POS_UNKNOWN  0xFF    // Положение блока неизвестно
+#define FRAME_STATUS_REMAIN_MS    10      // Единица остатка времени
+#define FRAME_STATUS_REMAIN_MAX   0xFFFF  // Остаток ≥ 655 с - не помещается
+#define FRAME_STATUS_INTERVAL_MS  500     // Период без изменений
+#define FRAME_STATUS_MIN_GAP_MS   10      // Пачка изменений (BATCH/AT) - один кадр
+
+struct FrameStatus {
+  uint32_t uptimeMs;        // millis() Mega (уменьшился - Mega перезагрузилась)
+  uint8_t firstBlock;
+  uint8_t blockCount;
+  uint8_t upMask;           // Бит i: блок firstBlock + i движется вверх
+  uint8_t downMask;         // Бит i: блок firstBlock + i движется вниз
+  uint16_t remain[FRAME_STATUS_BLOCKS];  // × FRAME_STATUS_REMAIN_MS, 0 = стоит
+  uint16_t crcErrors;       // Счётчики приёма Mega (по модулю 2^16)
+  uint16_t lenErrors;
+  uint16_t gapResets;       // Кадры, оборванные паузой > FRAME_GAP_MS
+  uint16_t lineOverflows;   // Текстовые строки длиннее буфера
+  uint8_t queued;           // Команд в очереди AT
+  uint8_t pos[FRAME_STATUS_BLOCKS];      // Положение, % хода (или POS_UNKNOWN)
+  uint16_t uartFrameErrors; // USART Mega: стоп-бит не на месте
+  uint16_t uartParityErrors;
+  uint16_t uartOverruns;    // Байт потерян в USART (прерывание опоздало)
+  uint16_t uartDropped;     // Байт потерян: кольцо приёма полно
+};
+
+/**
+ * Остаток времени в единицах кадра (с округлением вверх: ESP32 не должна
+ * решить, что блок стоит, раньше Mega)
+ */
+inline uint16_t frameStatusRemain(uint32_t ms) {
+  // Без ms + 9: у остатка около 2^32 сумма переполнилась бы в 0 ("стоит")
+  uint32_t units = ms / FRAME_STATUS_REMAIN_MS + (ms % FRAME_STATUS_REMAIN_MS != 0);
+  return units > FRAME_STATUS_REMAIN_MAX ? FRAME_STATUS_REMAIN_MAX : (uint16_t)units;
+}
+
+/**
+ * @param out Минимум FRAME_STATUS_SIZE байт
+ * @return FRAME_STATUS_SIZE
+ */
+inline uint8_t frameStatusEncode(uint8_t* out, const FrameStatus& s) {
+  framePutU32(&out[0], s.uptimeMs);
+  out[4] = s.firstBlock;
+  out[5] = s.blockCount;
+  out[6] = s.upMask;
+  out[7] = s.downMask;
+  for (uint8_t i = 0; i < FRAME_STATUS_BLOCKS; i++) {
+    framePutU16(&out[8 + i * 2], s.remain[i]);
+  }
+  framePutU16(&out[24], s.crcErrors);
+  framePutU16(&out[26], s.lenErrors);
+  framePutU16(&out[28], s.gapResets);
+  framePutU16(&out[30], s.lineOverflows);
+  out[32] = s.queued;
+  for (uint8_t i = 0; i < FRAME_STATUS_BLOCKS; i++) {
+    out[33 + i] = s.pos[i];
+  }
+  framePutU16(&out[41], s.uartFrameErrors);
+  framePutU16(&out[43], s.uartParityErrors);
+  framePutU16(&out[45], s.uartOverruns);
+  framePutU16(&out[47], s.uartDropped);
+  return FRAME_STATUS_SIZE;
+}
+
+/**
+ * Кадр Mega v4.2 (FRAME_STATUS_SIZE_V42) принимается, положения - неизвестны;
+ * v4.3 (FRAME_STATUS_SIZE_V43) - ошибки UART нулевые
+ * @return false если payload короче или блоков больше слотов
+ */
+inline bool frameStatusDecode(const uint8_t* p, uint8_t len, FrameStatus& s) {
+  if (len < FRAME_STATUS_SIZE_V42 || p[5] > FRAME_STATUS_BLOCKS) return false;
+
+  s.uptimeMs = frameGetU32(&p[0]);
+  s.firstBlock = p[4];
+  s.blockCount = p[5];
+  s.upMask = p[6];
+  s.downMask = p[7];
+  for (uint8_t i = 0; i < FRAME_STATUS_BLOCKS; i++) {
+    s.remain[i] = frameGetU16(&p[8 + i * 2]);
+  }
+  s.crcErrors = frameGetU16(&p[24]);
+  s.lenErrors = frameGetU16(&p[26]);
+  s.gapResets = frameGetU16(&p[28]);
+  s.lineOverflows = frameGetU16(&p[30]);
+  s.queued = p[32];
+  for (uint8_t i = 0; i < FRAME_STATUS_BLOCKS; i++) {
+    s.pos[i] = (len >= FRAME_STATUS_SIZE_V43) ? p[33 + i] : FRAME_STATUS_POS_UNKNOWN;
+  }
+  bool uart = (len >= FRAME_STATUS_SIZE);
+  s.uartFrameErrors = uart ? frameGetU16(&p[41]) : 0;
+  s.uartParityErrors = uart ? frameGetU16(&p[43]) : 0;
+  s.uartOverruns = uart ? frameGetU16(&p[45]) : 0;
+  s.uartDropped = uart ? frameGetU16(&p[47]) : 0;
+  return true;
+}
+
+// ============================================================================
+// ДЕКОДЕР (ПОБАЙТОВЫЙ, БЕЗ ОЖИДАНИЯ)
+// ============================================================================
+
+struct Frame {
+  uint8_t seq;
+  uint8_t op;
+  uint8_t len;
+  uint8_t payload[FRAME_PAYLOAD_MAX];
+};
+
+/**
+ * Автомат приёма кадров
+ *
+ * Байты подаются по одному через feed(). Пока busy() == false, поток
+ * принадлежит текстовому протоколу - в декодер нужно отдавать только
+ * FRAME_SYNC. Это позволяет держать текст и кадры на одном UART.
+ *
+ * Использование:
+ *   if (rx.busy() || c == FRAME_SYNC) {
+ *     if (rx.feed(c)) handleFrame(rx.frame());
+ *   } else {
+ *     lineRx.feed(c);
+ *   }
+ */
+class FrameDecoder {
+public:
+  FrameDecoder() : _state(WAIT_SYNC), _pos(0), _crc(0), _crcErrors(0), _lenErrors(0) {
+    memset(&_frame, 0, sizeof(_frame));
+  }
+
+  /**
+   * @return true если этим байтом завершён кадр с верным CRC
+   */
+  bool feed(uint8_t c) {
+    switch (_state) {
+      case WAIT_SYNC:
+        if (c == FRAME_SYNC) _state = READ_LEN;
+        return false;
+
+      case READ_LEN:
+        if (c > FRAME_PAYLOAD_MAX) {
+          // Длина невозможна - это не кадр, ищем следующий SYNC
+          _lenErrors++;
+          _state = WAIT_SYNC;
+          return false;
+        }
+        _frame.len = c;
+        _crc = frameCrc8(0, c);
+        _state = READ_SEQ;
+        return false;
+
+      case READ_SEQ:
+        _frame.seq = c;
+        _crc = frameCrc8(_crc, c);
+        _state = READ_OP;
+        return false;
+
+      case READ_OP:
+        _frame.op = c;
+        _crc = frameCrc8(_crc, c);
+        _pos = 0;
+        _state = (_frame.len > 0) ? READ_PAYLOAD : READ_CRC;
+        return false;
+
+      case READ_PAYLOAD:
+        _frame.payload[_pos++] = c;
+        _crc = frameCrc8(_crc, c);
+        if (_pos >= _frame.len) _state = READ_CRC;
+        return false;
+
+      case READ_CRC:
+        _state = WAIT_SYNC;
+        if (c != _crc) {
+          _crcErrors++;
+          return false;
+        }
+        return true;
+    }
+
+    _state = WAIT_SYNC;
+    return false;
+  }
+
+  /**
+   * Декодер внутри кадра (следующие байты принадлежат ему)
+   */
+  bool busy() const { return _state != WAIT_SYNC; }
+
+  /**
+   * Сбросить незавершённый кадр (например, по таймауту межбайтовой паузы)
+   */
+  void reset() { _state = WAIT_SYNC; }
+
+  const Frame& frame() const { return _frame; }
+  uint32_t crcErrors() const { return _crcErrors; }
+  uint32_t lenErrors() const { return _lenErrors; }
+
+private:
+  enum State : uint8_t {
+    WAIT_SYNC,
+    READ_LEN,
+    READ_SEQ,
+    READ_OP,
+    READ_PAYLOAD,
+    READ_CRC
+  };
+
+  State _state;
+  uint8_t _pos;
+  uint8_t _crc;
+  uint32_t _crcErrors;
+  uint32_t _lenErrors;
+  Frame _frame;
+};
+
+#endif // FRAME_CODEC_H
@@ -0,0 +1,182 @@
+/**
+ * RAMS MEGA UART - USART1 (канал к ESP32) на своих прерываниях
+ *
+ * HardwareSerial ядра: буфер приёма 64 байта, переполнение молча теряет
+ * байты, ошибки кадра / чётности / overrun не видны вовсе. Пачка команд
+ * при смене сцены (BATCH + AT + PING) легко не помещается в 64 байта,
+ * пока loop() печатает в DEBUG_SERIAL.
+ *
+ * Здесь:
+ * - приём: ISR(USART1_RX_vect) → кольцо MEGA_UART_RX_SIZE (256) байт,
+ *   индексы uint8_t переполняются сами; нет места - байт теряется
+ *   и считается (rxDropped)
+ * - ошибки USART по флагам UCSR1A до чтения UDR1: кадр (FE), чётность
+ *   (UPE, канал 8E1), overrun (DOR - байт потерян ещё в железе).
+ *   Байт с ошибкой отдаётся дальше - кадр с ним отбросит CRC-8
+ * - пауза перед байтом (> FRAME_GAP_MS) отмечается в прерывании, а не по
+ *   millis() в loop(): медленный проход loop() не рвёт кадр, целиком
+ *   лежащий в кольце (gapBefore)
+ * - передача: кольцо MEGA_UART_TX_SIZE байт, ISR(USART1_UDRE_vect);
+ *   write() ждёт только если кольцо заполнено
+ *
+ * Serial1 ядра в скетче использовать нельзя: его прерывания те же
+ * (две ISR на один вектор - ошибка линковки).
+ *
+ * ВАЖНО: Этот файл используется в:
+ * - Arduino Mega #1 (actuator_mega1_v3)
+ * - Arduino Mega #2 (actuator_mega2_v3)
+ *
+ * @version 1.0
+ * @date 2026-03-27
+ * @author RAMS Global Team
+ */
+
+#ifndef MEGA_UART_H
+#define MEGA_UART_H
+
+#include <Arduino.h>
+#include <util/atomic.h>
+#include "FRAME_CODEC.h"
+
+// ============================================================================
+// КОНСТАНТЫ
+// ============================================================================
+
+#define MEGA_UART_RX_SIZE   256     // Индекс uint8_t: размер ровно 256
+#define MEGA_UART_TX_SIZE   128     // Степень двойки
+
+static_assert((MEGA_UART_TX_SIZE & (MEGA_UART_TX_SIZE - 1)) == 0, "TX ring size must be a power of two");
+
+// ============================================================================
+// USART1
+// ============================================================================
+
+/**
+ * loop() вызывает available/read/write, прерывания - onRx/onUdre
+ */
+class MegaUart1 {
+public:
+  MegaUart1()
+    : _rxHead(0), _rxTail(0), _txHead(0), _txTail(0), _lastRxMs(0), _lastGap(false),
+      _frameErrors(0), _parityErrors(0), _overruns(0), _rxDropped(0) {
+    memset(_rxGap, 0, sizeof(_rxGap));
+  }
+
+  /**
+   * 8E1, U2X: на 16 МГц 500000 и 1000000 бод - без ошибки частоты
+   */
+  void begin(unsigned long baud) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      UBRR1 = (uint16_t)((F_CPU / 4 / baud - 1) / 2);
+      UCSR1A = (1 << U2X1);
+      UCSR1C = (1 << UPM11) | (1 << UCSZ11) | (1 << UCSZ10);
+      UCSR1B = (1 << RXEN1) | (1 << TXEN1) | (1 << RXCIE1);
+      _lastRxMs = millis();
+    }
+  }
+
+  uint8_t available() const {
+    return (uint8_t)(_rxHead - _rxTail);
+  }
+
+  /**
+   * Следующий байт (только если available() > 0)
+   */
+  uint8_t read() {
+    uint8_t i = _rxTail;
+    uint8_t c = _rxBuf[i];
+    _lastGap = (_rxGap[i >> 3] >> (i & 7)) & 1;
+    _rxTail = i + 1;  // Однобайтная запись - атомарна
+    return c;
+  }
+
+  /**
+   * Перед байтом последнего read() линия молчала дольше FRAME_GAP_MS
+   */
+  bool gapBefore() const { return _lastGap; }
+
+  /**
+   * В кольцо передачи; не из прерываний (ждёт, пока UDRE освободит место)
+   */
+  size_t write(const uint8_t* buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      uint8_t next = (uint8_t)((_txHead + 1) & (MEGA_UART_TX_SIZE - 1));
+      while (next == _txTail) {}
+      _txBuf[_txHead] = buf[i];
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        _txHead = next;
+        UCSR1B |= (1 << UDRIE1);
+      }
+    }
+    return len;
+  }
+
+  // Счётчики по модулю 2^16 (как остальные в кадре STATUS)
+  uint16_t frameErrors()  { return atomicRead(_frameErrors); }
+  uint16_t parityErrors() { return atomicRead(_parityErrors); }
+  uint16_t overruns()     { return atomicRead(_overruns); }
+  uint16_t rxDropped()    { return atomicRead(_rxDropped); }
+
+  /**
+   * Из ISR(USART1_RX_vect)
+   */
+  void onRx() {
+    uint8_t status = UCSR1A;  // Флаги ошибок - до чтения UDR1
+    uint8_t c = UDR1;
+
+    if (status & (1 << FE1)) _frameErrors++;
+    if (status & (1 << UPE1)) _parityErrors++;
+    if (status & (1 << DOR1)) _overruns++;
+
+    unsigned long now = millis();
+    bool gap = now - _lastRxMs > FRAME_GAP_MS;
+    _lastRxMs = now;
+
+    uint8_t i = _rxHead;
+    if ((uint8_t)(i + 1) == _rxTail) {
+      _rxDropped++;
+      return;
+    }
+    _rxBuf[i] = c;
+    if (gap) _rxGap[i >> 3] |= (uint8_t)(1 << (i & 7));
+    else _rxGap[i >> 3] &= (uint8_t)~(1 << (i & 7));
+    _rxHead = i + 1;
+  }
+
+  /**
+   * Из ISR(USART1_UDRE_vect)
+   */
+  void onUdre() {
+    if (_txHead == _txTail) {
+      UCSR1B &= (uint8_t)~(1 << UDRIE1);
+      return;
+    }
+    UDR1 = _txBuf[_txTail];
+    _txTail = (uint8_t)((_txTail + 1) & (MEGA_UART_TX_SIZE - 1));
+  }
+
+private:
+  static uint16_t atomicRead(volatile uint16_t& v) {
+    uint16_t x;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      x = v;
+    }
+    return x;
+  }
+
+  uint8_t _rxBuf[MEGA_UART_RX_SIZE];
+  uint8_t _rxGap[MEGA_UART_RX_SIZE / 8];  // Бит i: перед _rxBuf[i] была пауза
+  volatile uint8_t _rxHead;               // Пишет ISR
+  volatile uint8_t _rxTail;               // Пишет loop()
+  uint8_t _txBuf[MEGA_UART_TX_SIZE];
+  volatile uint8_t _txHead;               // Пишет loop()
+  volatile uint8_t _txTail;               // Пишет ISR
+  unsigned long _lastRxMs;
+  bool _lastGap;
+  volatile uint16_t _frameErrors;
+  volatile uint16_t _parityErrors;
+  volatile uint16_t _overruns;
+  volatile uint16_t _rxDropped;
+};
+
+#endif // MEGA_UART_H
@@ -0,0 +1,293 @@
+/**
+ * RAMS RELAY PORTS - реле блоков напрямую через регистры портов ATmega2560
+ *
+ * digitalWrite() = поиск пина в таблице + ~4-5 мкс на каждый пин, блок 15
+ * переключал 6 пинов по очереди - его три актуатора стартовали не вместе.
+ *
+ * Здесь BLOCK_CONFIGS (ACTUATOR_CONFIG.h) на этапе компиляции (constexpr)
+ * переводится в битовые маски по портам A/B/C/D/G/L:
+ * - UP / DOWN / STOP блока = одна запись в каждый затронутый порт (1-2 порта)
+ *   с запрещёнными прерываниями, все актуаторы блока переключаются < 1 мкс
+ * - противоположное направление гасится той же записью, в которой
+ *   включается нужное: оба направления одновременно не включены ни на такт
+ * - ALL:STOP = OR готовой маски всех реле этой Mega в каждый порт
+ * - GROUP / BATCH: маски нескольких блоков складываются в одну запись
+ *   (RelayPortWrite) - блоки одной Mega не делят пины, все выбранные
+ *   блоки переключаются одной записью в каждый порт
+ * - маски блоков во flash (PROGMEM, 180 байт): перед записью в порты
+ *   маски блока копируются на стек (memcpy_P, ~2 мкс), в SRAM не живут
+ *
+ * Пины Mega 2560 (22-53):
+ *   22-29 → PA0..PA7    30-37 → PC7..PC0    38 → PD7
+ *   39-41 → PG2..PG0    42-49 → PL7..PL0    50-53 → PB3..PB0
+ *
+ * ВАЖНО: Этот файл используется в:
+ * - Arduino Mega #1 (actuator_mega1_v3)
+ * - Arduino Mega #2 (actuator_mega2_v3)
+ *
+ * @version 1.2
+ * @date 2026-03-29
+ * @author RAMS Global Team
+ */
+
+#ifndef RELAY_PORTS_H
+#define RELAY_PORTS_H
+
+#include <Arduino.h>
+#include <util/atomic.h>
+#include "ACTUATOR_CONFIG.h"
+
+#if !defined(__AVR_ATmega2560__)
+#error "RELAY_PORTS.h: карта пинов только для Arduino Mega 2560"
+#endif
+
+// ============================================================================
+// ПИН → ПОРТ / БИТ (constexpr, C++11)
+// ============================================================================
+
+#define RELAY_PORT_A     0
+#define RELAY_PORT_B     1
+#define RELAY_PORT_C     2
+#define RELAY_PORT_D     3
+#define RELAY_PORT_G     4
+#define RELAY_PORT_L     5
+#define RELAY_PORT_COUNT 6
+#define RELAY_PORT_NONE  0xFF
+
+constexpr uint8_t relayPinPort(uint8_t pin) {
+  return (pin >= 22 && pin <= 29) ? RELAY_PORT_A :
+         (pin >= 30 && pin <= 37) ? RELAY_PORT_C :
+         (pin == 38)              ? RELAY_PORT_D :
+         (pin >= 39 && pin <= 41) ? RELAY_PORT_G :
+         (pin >= 42 && pin <= 49) ? RELAY_PORT_L :
+         (pin >= 50 && pin <= 53) ? RELAY_PORT_B :
+                                    RELAY_PORT_NONE;
+}
+
+constexpr uint8_t relayPinBit(uint8_t pin) {
+  return (pin <= 29) ? pin - 22 :
+         (pin <= 37) ? 37 - pin :
+         (pin == 38) ? 7 :
+         (pin <= 41) ? 41 - pin :
+         (pin <= 49) ? 49 - pin :
+                       53 - pin;
+}
+
+constexpr uint8_t relayPinMask(uint8_t pin, uint8_t port) {
+  return relayPinPort(pin) == port ? (uint8_t)(1 << relayPinBit(pin)) : 0;
+}
+
+// ============================================================================
+// МАСКИ БЛОКОВ
+// ============================================================================
+
+struct RelayBlockMasks {
+  uint8_t up[RELAY_PORT_COUNT];
+  uint8_t down[RELAY_PORT_COUNT];
+};
+
+constexpr uint8_t relayUpMask(const BlockConfig& c, uint8_t port) {
+  return relayPinMask(c.actuator1.upPin, port) |
+         relayPinMask(c.actuator2.upPin, port) |
+         (c.actuatorCount == 3 ? relayPinMask(c.actuator3.upPin, port) : 0);
+}
+
+constexpr uint8_t relayDownMask(const BlockConfig& c, uint8_t port) {
+  return relayPinMask(c.actuator1.downPin, port) |
+         relayPinMask(c.actuator2.downPin, port) |
+         (c.actuatorCount == 3 ? relayPinMask(c.actuator3.downPin, port) : 0);
+}
+
+constexpr RelayBlockMasks relayBlockMasks(const BlockConfig& c) {
+  return RelayBlockMasks{
+    { relayUpMask(c, 0), relayUpMask(c, 1), relayUpMask(c, 2),
+      relayUpMask(c, 3), relayUpMask(c, 4), relayUpMask(c, 5) },
+    { relayDownMask(c, 0), relayDownMask(c, 1), relayDownMask(c, 2),
+      relayDownMask(c, 3), relayDownMask(c, 4), relayDownMask(c, 5) }
+  };
+}
+
+// Индекс = blockNum - 1, как в BLOCK_CONFIGS. Во flash: во время работы
+// читать только через relayReadMasks()
+constexpr RelayBlockMasks RELAY_BLOCK_MASKS[TOTAL_BLOCKS] PROGMEM = {
+  relayBlockMasks(BLOCK_CONFIGS[0]),  relayBlockMasks(BLOCK_CONFIGS[1]),
+  relayBlockMasks(BLOCK_CONFIGS[2]),  relayBlockMasks(BLOCK_CONFIGS[3]),
+  relayBlockMasks(BLOCK_CONFIGS[4]),  relayBlockMasks(BLOCK_CONFIGS[5]),
+  relayBlockMasks(BLOCK_CONFIGS[6]),  relayBlockMasks(BLOCK_CONFIGS[7]),
+  relayBlockMasks(BLOCK_CONFIGS[8]),  relayBlockMasks(BLOCK_CONFIGS[9]),
+  relayBlockMasks(BLOCK_CONFIGS[10]), relayBlockMasks(BLOCK_CONFIGS[11]),
+  relayBlockMasks(BLOCK_CONFIGS[12]), relayBlockMasks(BLOCK_CONFIGS[13]),
+  relayBlockMasks(BLOCK_CONFIGS[14])
+};
+
+/**
+ * Все реле одной Mega на порту (для ALL:STOP)
+ */
+constexpr uint8_t relayMegaPortMask(uint8_t megaNum, uint8_t port, uint8_t i = 0) {
+  return i >= TOTAL_BLOCKS ? 0 :
+         ((BLOCK_CONFIGS[i].megaNum == megaNum
+             ? (uint8_t)(RELAY_BLOCK_MASKS[i].up[port] | RELAY_BLOCK_MASKS[i].down[port])
+             : 0) |
+          relayMegaPortMask(megaNum, port, i + 1));
+}
+
+/**
+ * Проверки конфигурации на этапе компиляции:
+ * каждый пин блока попадает в порт, UP и DOWN не делят пины,
+ * два блока одной Mega не делят пины
+ */
+constexpr bool relayPinValid(uint8_t pin) {
+  return relayPinPort(pin) != RELAY_PORT_NONE;
+}
+
+constexpr bool relayBlockPinsValid(const BlockConfig& c) {
+  return relayPinValid(c.actuator1.upPin) && relayPinValid(c.actuator1.downPin) &&
+         relayPinValid(c.actuator2.upPin) && relayPinValid(c.actuator2.downPin) &&
+         (c.actuatorCount != 3 ||
+          (relayPinValid(c.actuator3.upPin) && relayPinValid(c.actuator3.downPin)));
+}
+
+constexpr bool relayUpDownDisjoint(const RelayBlockMasks& m, uint8_t port = 0) {
+  return port >= RELAY_PORT_COUNT ||
+         ((m.up[port] & m.down[port]) == 0 && relayUpDownDisjoint(m, port + 1));
+}
+
+constexpr uint8_t relayBlockBits(const RelayBlockMasks& m, uint8_t port) {
+  return m.up[port] | m.down[port];
+}
+
+constexpr bool relayBlocksDisjoint(uint8_t a, uint8_t b, uint8_t port = 0) {
+  return port >= RELAY_PORT_COUNT ||
+         ((relayBlockBits(RELAY_BLOCK_MASKS[a], port) & relayBlockBits(RELAY_BLOCK_MASKS[b], port)) == 0 &&
+          relayBlocksDisjoint(a, b, port + 1));
+}
+
+constexpr bool relayConfigValid(uint8_t i = 0, uint8_t j = 1) {
+  return i >= TOTAL_BLOCKS ? true :
+         j >= TOTAL_BLOCKS ? (relayBlockPinsValid(BLOCK_CONFIGS[i]) &&
+                              relayUpDownDisjoint(RELAY_BLOCK_MASKS[i]) &&
+                              relayConfigValid(i + 1, i + 2)) :
+         ((BLOCK_CONFIGS[i].megaNum != BLOCK_CONFIGS[j].megaNum || relayBlocksDisjoint(i, j)) &&
+          relayConfigValid(i, j + 1));
+}
+
+static_assert(relayConfigValid(), "BLOCK_CONFIGS: pin outside 22-53, UP/DOWN overlap or shared pin on one Mega");
+
+// ============================================================================
+// ПЕРЕКЛЮЧЕНИЕ
+// ============================================================================
+
+/**
+ * Один порт: выключить off, включить on (RELAY_ON = LOW - включено нулём)
+ */
+#define RELAY_PORT_WRITE(reg, off, on)                                 \
+  do {                                                                 \
+    if ((off) | (on)) {                                                \
+      if (RELAY_ON == LOW) reg = (uint8_t)((reg | (off)) & ~(on));     \
+      else reg = (uint8_t)((reg & ~(off)) | (on));                     \
+    }                                                                  \
+  } while (0)
+
+/**
+ * Одна запись во все порты: выключить off, включить on (по битам портов)
+ */
+struct RelayPortWrite {
+  uint8_t off[RELAY_PORT_COUNT];
+  uint8_t on[RELAY_PORT_COUNT];
+};
+
+/**
+ * Записать во все порты (прерывания запрещены на время записи:
+ * PORTL вне I/O пространства, его read-modify-write не атомарен)
+ */
+inline void relayWritePorts(const RelayPortWrite& w) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    RELAY_PORT_WRITE(PORTA, w.off[RELAY_PORT_A], w.on[RELAY_PORT_A]);
+    RELAY_PORT_WRITE(PORTB, w.off[RELAY_PORT_B], w.on[RELAY_PORT_B]);
+    RELAY_PORT_WRITE(PORTC, w.off[RELAY_PORT_C], w.on[RELAY_PORT_C]);
+    RELAY_PORT_WRITE(PORTD, w.off[RELAY_PORT_D], w.on[RELAY_PORT_D]);
+    RELAY_PORT_WRITE(PORTG, w.off[RELAY_PORT_G], w.on[RELAY_PORT_G]);
+    RELAY_PORT_WRITE(PORTL, w.off[RELAY_PORT_L], w.on[RELAY_PORT_L]);
+  }
+}
+
+/**
+ * Маски блока из flash на стек
+ */
+inline void relayReadMasks(uint8_t blockNum, RelayBlockMasks& m) {
+  memcpy_P(&m, &RELAY_BLOCK_MASKS[blockNum - 1], sizeof(m));
+}
+
+/**
+ * Добавить блок в запись: UP / DOWN / STOP
+ * Блок в записи один раз - иначе его UP и DOWN попадут в одну запись
+ */
+inline void relayGroupUp(RelayPortWrite& w, uint8_t blockNum) {
+  RelayBlockMasks m;
+  relayReadMasks(blockNum, m);
+  for (uint8_t p = 0; p < RELAY_PORT_COUNT; p++) {
+    w.off[p] |= m.down[p];
+    w.on[p] |= m.up[p];
+  }
+}
+
+inline void relayGroupDown(RelayPortWrite& w, uint8_t blockNum) {
+  RelayBlockMasks m;
+  relayReadMasks(blockNum, m);
+  for (uint8_t p = 0; p < RELAY_PORT_COUNT; p++) {
+    w.off[p] |= m.up[p];
+    w.on[p] |= m.down[p];
+  }
+}
+
+inline void relayGroupStop(RelayPortWrite& w, uint8_t blockNum) {
+  RelayBlockMasks m;
+  relayReadMasks(blockNum, m);
+  for (uint8_t p = 0; p < RELAY_PORT_COUNT; p++) {
+    w.off[p] |= m.up[p] | m.down[p];
+  }
+}
+
+inline void relayBlockUp(uint8_t blockNum) {
+  RelayPortWrite w = {};
+  relayGroupUp(w, blockNum);
+  relayWritePorts(w);
+}
+
+inline void relayBlockDown(uint8_t blockNum) {
+  RelayPortWrite w = {};
+  relayGroupDown(w, blockNum);
+  relayWritePorts(w);
+}
+
+inline void relayBlockStop(uint8_t blockNum) {
+  RelayPortWrite w = {};
+  relayGroupStop(w, blockNum);
+  relayWritePorts(w);
+}
+
+/**
+ * Маска всех реле Mega на порту как константа шаблона: вычисляется
+ * при компиляции и попадает в код операндом, не в SRAM
+ */
+template <uint8_t MEGA_NUM, uint8_t PORT>
+struct RelayMegaMask {
+  static constexpr uint8_t value = relayMegaPortMask(MEGA_NUM, PORT);
+};
+
+/**
+ * Выключить все реле этой Mega (маски готовы на этапе компиляции)
+ */
+template <uint8_t MEGA_NUM>
+inline void relayAllOff() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    RELAY_PORT_WRITE(PORTA, (RelayMegaMask<MEGA_NUM, RELAY_PORT_A>::value), 0);
+    RELAY_PORT_WRITE(PORTB, (RelayMegaMask<MEGA_NUM, RELAY_PORT_B>::value), 0);
+    RELAY_PORT_WRITE(PORTC, (RelayMegaMask<MEGA_NUM, RELAY_PORT_C>::value), 0);
+    RELAY_PORT_WRITE(PORTD, (RelayMegaMask<MEGA_NUM, RELAY_PORT_D>::value), 0);
+    RELAY_PORT_WRITE(PORTG, (RelayMegaMask<MEGA_NUM, RELAY_PORT_G>::value), 0);
+    RELAY_PORT_WRITE(PORTL, (RelayMegaMask<MEGA_NUM, RELAY_PORT_L>::value), 0);
+  }
+}
+
+#endif // RELAY_PORTS_H
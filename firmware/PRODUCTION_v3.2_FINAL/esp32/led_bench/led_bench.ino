@@ -0,0 +1,97 @@
+/**
+ * RAMS LED Driver Benchmark - ESP32
+ *
+ * Замер времени вывода кадра для 10 лент контроллера v3.4
+ * (8 лучей × 33 + внутренний 64 + внешний 150 = 478 LED)
+ *
+ * Прошить ДВАЖДЫ и сравнить вывод в Serial Monitor:
+ *   LED_DRIVER_I2S 0 → RMT (стандартный FastLED)
+ *   LED_DRIVER_I2S 1 → I2S parallel + DMA (как в rams_controller_v3)
+ *
+ * Ожидание (WS2812B, 30 мкс на LED):
+ *   - последовательный вывод: 478 × 30 мкс ≈ 14.3 мс
+ *   - параллельный вывод:     150 × 30 мкс ≈  4.5 мс (самая длинная лента)
+ *
+ * @version 1.0
+ * @date 2026-03-14
+ * @author RAMS Global Team
+ */
+
+#define LED_DRIVER_I2S  1
+
+#if LED_DRIVER_I2S
+  #define FASTLED_ESP32_I2S true
+  #define LED_DRIVER_NAME "I2S parallel"
+#else
+  #define LED_DRIVER_NAME "RMT"
+#endif
+
+#include <FastLED.h>
+
+#define NUM_STRIPS  10
+#define MAX_LEDS    150
+#define FRAMES      500
+
+// Тот же маппинг что в rams_controller_v3.ino
+static const uint16_t PIN_LEDS[NUM_STRIPS] = { 33, 33, 33, 33, 33, 33, 33, 33, 64, 150 };
+static CRGB leds[NUM_STRIPS][MAX_LEDS];
+
+void setup() {
+  Serial.begin(115200);
+  delay(500);
+
+  FastLED.addLeds<WS2812B, 32, GRB>(leds[0], PIN_LEDS[0]);
+  FastLED.addLeds<WS2812B, 22, GRB>(leds[1], PIN_LEDS[1]);
+  FastLED.addLeds<WS2812B, 18, GRB>(leds[2], PIN_LEDS[2]);
+  FastLED.addLeds<WS2812B, 21, GRB>(leds[3], PIN_LEDS[3]);
+  FastLED.addLeds<WS2812B, 13, GRB>(leds[4], PIN_LEDS[4]);
+  FastLED.addLeds<WS2812B, 27, GRB>(leds[5], PIN_LEDS[5]);
+  FastLED.addLeds<WS2812B,  4, GRB>(leds[6], PIN_LEDS[6]);
+  FastLED.addLeds<WS2812B, 14, GRB>(leds[7], PIN_LEDS[7]);
+  FastLED.addLeds<WS2812B,  5, GRB>(leds[8], PIN_LEDS[8]);
+  FastLED.addLeds<WS2812B,  2, GRB>(leds[9], PIN_LEDS[9]);
+  FastLED.setBrightness(40);
+
+  uint32_t totalLeds = 0;
+  uint16_t longest = 0;
+  for (int s = 0; s < NUM_STRIPS; s++) {
+    totalLeds += PIN_LEDS[s];
+    if (PIN_LEDS[s] > longest) longest = PIN_LEDS[s];
+  }
+
+  Serial.println("\n========================================");
+  Serial.println("  LED DRIVER BENCHMARK");
+  Serial.print("  Driver: ");
+  Serial.println(LED_DRIVER_NAME);
+  Serial.println("========================================");
+  Serial.printf("Strips: %d | LEDs: %lu | Longest: %u\n", NUM_STRIPS, totalLeds, longest);
+  Serial.printf("Wire time: sequential %lu us | parallel %lu us\n",
+    totalLeds * 30UL, (uint32_t)longest * 30UL);
+}
+
+void loop() {
+  uint32_t minUs = UINT32_MAX;
+  uint32_t maxUs = 0;
+  uint64_t sumUs = 0;
+  static uint8_t hue = 0;
+
+  for (int f = 0; f < FRAMES; f++) {
+    hue += 3;
+    for (int s = 0; s < NUM_STRIPS; s++) {
+      fill_rainbow(leds[s], PIN_LEDS[s], hue + s * 25, 3);
+    }
+
+    uint32_t start = micros();
+    FastLED.show();
+    uint32_t us = micros() - start;
+
+    if (us < minUs) minUs = us;
+    if (us > maxUs) maxUs = us;
+    sumUs += us;
+  }
+
+  Serial.printf("[BENCH] %s: show() min %lu us | avg %lu us | max %lu us (%d frames)\n",
+    LED_DRIVER_NAME, minUs, (uint32_t)(sumUs / FRAMES), maxUs, FRAMES);
+
+  delay(2000);
+}
@@ -0,0 +1,168 @@
+/**
+ * RAMS COMMAND LATENCY - задержки команд Mega: ответ и время хода
+ *
+ * Медленный блок раньше нечем было разобрать: Wi-Fi, loop() ESP32, UART
+ * или сама Mega. Теперь у каждой команды Mega есть отметка отправки:
+ *
+ *   ответ (ACK / NAK / ERROR)  - по SEQ кадра (v4) или по порядку строк
+ *                                (v3: Mega отвечает на строки по очереди),
+ *                                гистограмма на Mega, мкс
+ *   ход (команда -> стоп)      - до DONE:n (v3) или кадра STATUS, где блок
+ *                                перестал двигаться (v4), гистограмма на
+ *                                блок и на Mega, мс
+ *
+ * Дрейф хода - скользящее среднее (факт - ожидание) по ходам блока
+ * (вес последнего 1/LATENCY_DRIFT_WEIGHT). Датчиков нет: Mega ведёт реле
+ * по времени, поэтому дрейф - это цепочка UART -> очередь / таймер Mega ->
+ * отчёт о стопе, а не сам актуатор. Растущий дрейф - первый признак
+ * перегруженной Mega или сбоев на линии.
+ *
+ * Логика не зависит от Arduino: время передаётся параметром.
+ *
+ * @version 1.0
+ * @date 2026-04-03
+ * @author RAMS Global Team
+ */
+
+#ifndef COMMAND_LATENCY_H
+#define COMMAND_LATENCY_H
+
+#include <Arduino.h>
+#include "PERF_PROFILER.h"
+
+// ============================================================================
+// КОНСТАНТЫ
+// ============================================================================
+
+#define LATENCY_TEXT_PENDING    8       // Строк без ответа (v3); больше - старейшая теряется
+#define LATENCY_DRIFT_WEIGHT    8       // Скользящее среднее дрейфа: 1/8 последнего хода
+#define LATENCY_DRIFT_FLAG_MS   200     // |дрейф| больше - блок в "drifting"
+#define LATENCY_DRIFT_MIN_RUNS  4       // Раньше стольких ходов дрейф не оценивается
+
+// ============================================================================
+// ОТВЕТЫ MEGA
+// ============================================================================
+
+struct LinkLatency {
+  PerfHistogram ackUs;                  // Команда -> ACK / NAK / ERROR, мкс
+  PerfHistogram travelMs;               // Ход блоков этой Mega, мс
+  uint32_t textSentUs[LATENCY_TEXT_PENDING];
+  uint8_t textHead;                     // Старейшая строка без ответа
+  uint8_t textCount;
+  uint32_t rejected;                    // NAK / ERROR на команды
+  uint32_t unmatched;                   // Ответ без отправленной команды
+};
+
+inline void latencyReset(LinkLatency& l) {
+  memset(&l, 0, sizeof(l));
+  perfHistReset(l.ackUs);
+  perfHistReset(l.travelMs);
+}
+
+/**
+ * Строка команды ушла на Mega (v3)
+ */
+inline void latencyTextSent(LinkLatency& l, uint32_t nowUs) {
+  if (l.textCount == LATENCY_TEXT_PENDING) {
+    l.textHead = (l.textHead + 1) % LATENCY_TEXT_PENDING;
+    l.textCount--;
+  }
+  l.textSentUs[(l.textHead + l.textCount) % LATENCY_TEXT_PENDING] = nowUs;
+  l.textCount++;
+}
+
+/**
+ * Ответ ACK / ERROR на строку (v3): отвечает на старейшую без ответа
+ * @return задержка ответа, мкс; -1 - отправленных строк нет
+ */
+inline int32_t latencyTextReply(LinkLatency& l, uint32_t nowUs) {
+  if (l.textCount == 0) {
+    l.unmatched++;
+    return -1;
+  }
+  uint32_t us = nowUs - l.textSentUs[l.textHead];
+  perfHistAdd(l.ackUs, us);
+  l.textHead = (l.textHead + 1) % LATENCY_TEXT_PENDING;
+  l.textCount--;
+  return (int32_t)us;
+}
+
+/**
+ * Строки без ответа больше не ждём (смена протокола, связь потеряна)
+ */
+inline void latencyTextDrop(LinkLatency& l) {
+  l.textHead = 0;
+  l.textCount = 0;
+}
+
+// ============================================================================
+// ХОД БЛОКА
+// ============================================================================
+
+struct BlockTravel {
+  bool timing;                          // Ход отправлен, стоп ещё не видели
+  bool seenMoving;                      // STATUS уже показал движение (v4)
+  uint32_t startMs;                     // Отправка (AT - момент старта)
+  uint32_t expectedMs;                  // Ожидание ESP32 (как у таймаута блока)
+  uint32_t runs;                        // Измеренные ходы
+  int32_t driftMs;                      // Скользящее среднее (факт - ожидание)
+  PerfHistogram travelMs;
+};
+
+inline void travelReset(BlockTravel& t) {
+  memset(&t, 0, sizeof(t));
+  perfHistReset(t.travelMs);
+}
+
+inline void travelStart(BlockTravel& t, uint32_t startMs, uint32_t expectedMs) {
+  t.timing = true;
+  t.seenMoving = false;
+  t.startMs = startMs;
+  t.expectedMs = expectedMs;
+}
+
+/**
+ * STOP / ALL:STOP: ход прерван, не измеряется
+ */
+inline void travelCancel(BlockTravel& t) {
+  t.timing = false;
+}
+
+/**
+ * Mega сообщила стоп блока
+ * @return время хода, мс; -1 - ход не измерялся
+ */
+inline int32_t travelEnd(BlockTravel& t, uint32_t nowMs) {
+  if (!t.timing) return -1;
+  t.timing = false;
+
+  int32_t actual = (int32_t)(nowMs - t.startMs);
+  if (actual < 0) actual = 0;
+  int32_t err = actual - (int32_t)t.expectedMs;
+
+  perfHistAdd(t.travelMs, (uint32_t)actual);
+  t.driftMs = (t.runs == 0) ? err : t.driftMs + (err - t.driftMs) / LATENCY_DRIFT_WEIGHT;
+  t.runs++;
+  return actual;
+}
+
+/**
+ * Состояние блока по кадру STATUS (v4): стоп - только после движения,
+ * иначе STATUS до старта (AT, кадр в пути) закончил бы ход раньше времени
+ * @return время хода, мс; -1 - ход не закончился
+ */
+inline int32_t travelObserve(BlockTravel& t, bool moving, uint32_t nowMs) {
+  if (!t.timing) return -1;
+  if (moving) {
+    t.seenMoving = true;
+    return -1;
+  }
+  return t.seenMoving ? travelEnd(t, nowMs) : -1;
+}
+
+inline bool travelDrifting(const BlockTravel& t) {
+  return t.runs >= LATENCY_DRIFT_MIN_RUNS &&
+         (t.driftMs > LATENCY_DRIFT_FLAG_MS || t.driftMs < -LATENCY_DRIFT_FLAG_MS);
+}
+
+#endif // COMMAND_LATENCY_H
@@ -0,0 +1,60 @@
+/**
+ * RAMS CONTROL LOCK - общий mutex состояния контроллера ESP32
+ *
+ * С асинхронным HTTP сервером handlers выполняются в задаче async_tcp,
+ * а loop() - в loopTask. Оба меняют blockStates, LED состояние и канал
+ * к Mega, поэтому каждый вход берёт один и тот же mutex на время обработки.
+ *
+ * Внутри блокировки нельзя вызывать delay() - HTTP встанет на это время.
+ *
+ * Использование:
+ *   void loop() { ControlLock lock; ... }
+ *   server.on("/api/x", HTTP_POST, [](AsyncWebServerRequest* request) {
+ *     ControlLock lock;
+ *     ...
+ *   });
+ *
+ * ВАЖНО: Этот файл используется в:
+ * - ESP32 v3.3 (rams_controller_v3)
+ * - ESP32 Master (esp32_master, через firmware/shared)
+ *
+ * @version 1.0
+ * @date 2026-03-16
+ * @author RAMS Global Team
+ */
+
+#ifndef CONTROL_LOCK_H
+#define CONTROL_LOCK_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+inline SemaphoreHandle_t& controlMutex() {
+  static SemaphoreHandle_t mutex = nullptr;
+  return mutex;
+}
+
+/**
+ * Создать mutex - вызвать в setup() до server.begin()
+ */
+inline void controlLockInit() {
+  if (controlMutex() == nullptr) {
+    controlMutex() = xSemaphoreCreateRecursiveMutex();
+  }
+}
+
+/**
+ * RAII блокировка (рекурсивная: handler может вызвать функцию, которая
+ * тоже берёт блокировку)
+ */
+class ControlLock {
+public:
+  ControlLock() { xSemaphoreTakeRecursive(controlMutex(), portMAX_DELAY); }
+  ~ControlLock() { xSemaphoreGiveRecursive(controlMutex()); }
+
+  ControlLock(const ControlLock&) = delete;
+  ControlLock& operator=(const ControlLock&) = delete;
+};
+
+#endif // CONTROL_LOCK_H
@@ -0,0 +1,142 @@
+/**
+ * RAMS DEADLINE HEAP - общие таймеры loop() (min-heap по моменту срабатывания)
+ *
+ * Раньше loop() каждый проход перебирал все 15 блоков (таймауты), все 15
+ * огибающих (завершение fade) и после каждого таймаута ещё раз все блоки
+ * (счётчик активных). Теперь каждый таймер взводится здесь один раз -
+ * при старте хода / fade / PING - и loop() смотрит только вершину кучи:
+ *
+ *   ничего не наступило  - O(1)
+ *   взвести / снять      - O(log n)
+ *
+ * - Таймер = id (0..DEADLINE_IDS-1), раскладку id задаёт скетч
+ * - Повторный deadlineSet того же id переносит таймер, а не дублирует
+ * - Переполнение millis() (49.7 суток) не мешает: сравниваются только
+ *   разности (int32_t)(a - b), таймер должен быть ближе 24.8 суток
+ *
+ * Логика не зависит от Arduino: время передаётся параметром (millis()
+ * на ESP32, поддельные часы на хосте).
+ *
+ * @version 1.0
+ * @date 2026-04-01
+ * @author RAMS Global Team
+ */
+
+#ifndef DEADLINE_HEAP_H
+#define DEADLINE_HEAP_H
+
+#include <Arduino.h>
+
+// ============================================================================
+// КОНСТАНТЫ
+// ============================================================================
+
+#ifndef DEADLINE_IDS
+#define DEADLINE_IDS  32                // Таймеров всего (id 0..31)
+#endif
+
+// ============================================================================
+// КУЧА
+// ============================================================================
+
+struct DeadlineHeap {
+  uint8_t count;
+  uint8_t heap[DEADLINE_IDS];   // id; heap[0] - ближайший
+  uint8_t slot[DEADLINE_IDS];   // Место id в heap + 1, 0 - таймер не взведён
+  uint32_t at[DEADLINE_IDS];    // Момент срабатывания (millis())
+};
+
+/**
+ * a раньше b (с учётом переполнения)
+ */
+inline bool deadlineBefore(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b) < 0;
+}
+
+inline void deadlinePlace(DeadlineHeap& h, uint8_t pos, uint8_t id) {
+  h.heap[pos] = id;
+  h.slot[id] = pos + 1;
+}
+
+inline void deadlineSiftUp(DeadlineHeap& h, uint8_t pos) {
+  uint8_t id = h.heap[pos];
+  while (pos > 0) {
+    uint8_t parent = (pos - 1) / 2;
+    if (!deadlineBefore(h.at[id], h.at[h.heap[parent]])) break;
+    deadlinePlace(h, pos, h.heap[parent]);
+    pos = parent;
+  }
+  deadlinePlace(h, pos, id);
+}
+
+inline void deadlineSiftDown(DeadlineHeap& h, uint8_t pos) {
+  uint8_t id = h.heap[pos];
+  while (true) {
+    uint8_t child = pos * 2 + 1;
+    if (child >= h.count) break;
+    if (child + 1 < h.count && deadlineBefore(h.at[h.heap[child + 1]], h.at[h.heap[child]])) child++;
+    if (!deadlineBefore(h.at[h.heap[child]], h.at[id])) break;
+    deadlinePlace(h, pos, h.heap[child]);
+    pos = child;
+  }
+  deadlinePlace(h, pos, id);
+}
+
+inline bool deadlinePending(const DeadlineHeap& h, uint8_t id) {
+  return id < DEADLINE_IDS && h.slot[id] != 0;
+}
+
+/**
+ * Взвести таймер на момент atMs (уже взведённый - перенести)
+ */
+inline void deadlineSet(DeadlineHeap& h, uint8_t id, uint32_t atMs) {
+  if (id >= DEADLINE_IDS) return;
+
+  h.at[id] = atMs;
+  if (h.slot[id] == 0) {
+    deadlinePlace(h, h.count++, id);
+    deadlineSiftUp(h, h.count - 1);
+    return;
+  }
+
+  deadlineSiftUp(h, h.slot[id] - 1);
+  deadlineSiftDown(h, h.slot[id] - 1);
+}
+
+/**
+ * Снять таймер
+ * @return true если он был взведён
+ */
+inline bool deadlineCancel(DeadlineHeap& h, uint8_t id) {
+  if (!deadlinePending(h, id)) return false;
+
+  uint8_t pos = h.slot[id] - 1;
+  h.slot[id] = 0;
+  h.count--;
+  if (pos == h.count) return true;
+
+  // На освободившееся место - последний; он может пойти в любую сторону
+  uint8_t last = h.heap[h.count];
+  deadlinePlace(h, pos, last);
+  deadlineSiftUp(h, pos);
+  deadlineSiftDown(h, h.slot[last] - 1);
+  return true;
+}
+
+/**
+ * Снять наступивший таймер (вызывать в цикле, пока не -1)
+ * @return id таймера, -1 - ничего не наступило
+ */
+inline int deadlinePopDue(DeadlineHeap& h, uint32_t nowMs) {
+  if (h.count == 0 || deadlineBefore(nowMs, h.at[h.heap[0]])) return -1;
+
+  uint8_t id = h.heap[0];
+  deadlineCancel(h, id);
+  return id;
+}
+
+inline void deadlineClear(DeadlineHeap& h) {
+  memset(&h, 0, sizeof(h));
+}
+
+#endif // DEADLINE_HEAP_H
@@ -0,0 +1,135 @@
+/**
+ * RAMS FADE ENVELOPE - огибающая яркости LED зоны блока (целочисленная)
+ *
+ * Одна огибающая на блок вместо отдельных FadeInState / FadeOutState:
+ *   fade IN  = огибающая к 255
+ *   fade OUT = огибающая к 0
+ *
+ * - Без float: прогресс и кривые в Q16 (0..65535 = 0.0..1.0), уровень в Q8
+ * - Кривая выбирается на каждый запуск (FADE_CURVE_*)
+ * - Разворот посреди fade (UP во время fade OUT) продолжает с текущего
+ *   уровня, а не начинает с 0
+ *
+ * @version 1.0
+ * @date 2026-03-20
+ * @author RAMS Global Team
+ */
+
+#ifndef FADE_ENVELOPE_H
+#define FADE_ENVELOPE_H
+
+#include <Arduino.h>
+
+// ============================================================================
+// КРИВЫЕ
+// ============================================================================
+
+enum FadeCurve : uint8_t {
+  FADE_CURVE_LINEAR = 0,
+  FADE_CURVE_EASE_IN,       // Медленный старт (t²)
+  FADE_CURVE_EASE_OUT,      // Медленный финиш (1 - (1-t)²)
+  FADE_CURVE_EASE_IN_OUT    // Smoothstep (3t² - 2t³)
+};
+
+/**
+ * Применить кривую к прогрессу
+ * @param t Прогресс Q16 (0..65535)
+ * @return Прогресс после кривой, Q16
+ */
+inline uint16_t fadeEaseQ16(uint8_t curve, uint16_t t) {
+  switch (curve) {
+    case FADE_CURVE_EASE_IN:
+      return (uint16_t)(((uint32_t)t * t) >> 16);
+
+    case FADE_CURVE_EASE_OUT: {
+      uint16_t inv = 65535 - t;
+      return (uint16_t)(65535 - (((uint32_t)inv * inv) >> 16));
+    }
+
+    case FADE_CURVE_EASE_IN_OUT: {
+      uint32_t t2 = ((uint32_t)t * t) >> 16;               // t², Q16
+      uint32_t k = 3UL * 65536 - 2UL * t;                  // 3 - 2t, Q16
+      uint32_t v = (uint32_t)(((uint64_t)t2 * k) >> 16);
+      return v > 65535 ? 65535 : (uint16_t)v;
+    }
+
+    default:
+      return t;
+  }
+}
+
+// ============================================================================
+// ОГИБАЮЩАЯ
+// ============================================================================
+
+struct FadeEnvelope {
+  bool isActive;
+  uint8_t curve;
+  uint8_t from;             // Уровень на старте (0-255)
+  uint8_t to;               // Цель; когда неактивна - текущий уровень
+  unsigned long startTime;
+  uint32_t duration;        // мс
+};
+
+/**
+ * Прогресс огибающей Q16 (0..65535)
+ * Деление 64-бит: elapsed << 16 не помещается в 32 бита уже с 65 536 мс
+ * (опускание дольше 65 с), а 15 делений на кадр при 50 Гц - копейки
+ */
+inline uint16_t fadeProgressQ16(const FadeEnvelope& env, unsigned long now) {
+  uint32_t elapsed = now - env.startTime;
+  if (env.duration == 0 || elapsed >= env.duration) return 65535;
+
+  uint32_t q = (uint32_t)(((uint64_t)elapsed << 16) / env.duration);
+  return q > 65535 ? 65535 : (uint16_t)q;
+}
+
+/**
+ * Уровень яркости огибающей сейчас (0-255)
+ */
+inline uint8_t fadeEnvelopeLevel(const FadeEnvelope& env, unsigned long now) {
+  if (!env.isActive) return env.to;
+
+  uint16_t t = fadeProgressQ16(env, now);
+  if (t == 65535) return env.to;
+
+  uint16_t e = fadeEaseQ16(env.curve, t);
+  int32_t delta = (int32_t)env.to - (int32_t)env.from;
+  return (uint8_t)((int32_t)env.from + ((delta * (int32_t)e) >> 16));
+}
+
+inline bool fadeEnvelopeDone(const FadeEnvelope& env, unsigned long now) {
+  return env.isActive && (uint32_t)(now - env.startTime) >= env.duration;
+}
+
+/**
+ * Запустить огибающую к target от ТЕКУЩЕГО уровня
+ */
+inline void fadeEnvelopeStart(FadeEnvelope& env, uint8_t target, uint32_t duration,
+                              uint8_t curve, unsigned long now) {
+  env.from = fadeEnvelopeLevel(env, now);
+  env.to = target;
+  env.curve = curve;
+  env.startTime = now;
+  env.duration = duration;
+  env.isActive = true;
+}
+
+/**
+ * Остановить огибающую и зафиксировать уровень (без анимации)
+ */
+inline void fadeEnvelopeSet(FadeEnvelope& env, uint8_t level) {
+  env.isActive = false;
+  env.from = level;
+  env.to = level;
+}
+
+inline bool fadeEnvelopeRising(const FadeEnvelope& env) {
+  return env.isActive && env.to > env.from;
+}
+
+inline bool fadeEnvelopeFalling(const FadeEnvelope& env) {
+  return env.isActive && env.to < env.from;
+}
+
+#endif // FADE_ENVELOPE_H
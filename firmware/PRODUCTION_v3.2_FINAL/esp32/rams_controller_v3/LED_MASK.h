@@ -0,0 +1,133 @@
+/**
+ * RAMS LED MASK - маска активных LED в виде битов + участки зон блоков
+ *
+ * Было: bool mask[10][150] = 1500 байт, хотя реальных LED 478, и проверка
+ * по одному пикселю в каждом эффекте. Когда блоков нет, маска копировалась
+ * во временный буфер на стеке и обратно каждый кадр.
+ *
+ * Стало:
+ * - по 32 LED в слове на каждую ленту (10 × 5 × 4 = 200 байт)
+ * - зона блока = до 4 непрерывных участков (2 луча + 2 круга), считается
+ *   один раз при старте; маска собирается и fade применяется участками
+ * - "все LED включены" - флаг allOn, без копирования маски
+ * - эффекты идут по непрерывным участкам (forEachRun), а не по пикселям
+ *
+ * @version 1.0
+ * @date 2026-03-18
+ * @author RAMS Global Team
+ */
+
+#ifndef LED_MASK_H
+#define LED_MASK_H
+
+#include <Arduino.h>
+
+// Участков в зоне блока: левый луч, правый луч, внутренний круг, внешний круг
+#define LED_ZONE_MAX_SPANS  4
+
+/**
+ * Непрерывный участок одной ленты
+ */
+struct LedSpan {
+  uint8_t strip;
+  uint8_t start;
+  uint8_t count;
+};
+
+/**
+ * LED зона блока
+ */
+struct LedZone {
+  uint8_t count;
+  LedSpan spans[LED_ZONE_MAX_SPANS];
+
+  void clear() { count = 0; }
+
+  /**
+   * Добавить участок (пустой участок пропускается: блок 8 без внешнего круга)
+   */
+  void add(uint8_t strip, uint16_t start, uint16_t n) {
+    if (n == 0 || count >= LED_ZONE_MAX_SPANS) return;
+    spans[count].strip = strip;
+    spans[count].start = (uint8_t)start;
+    spans[count].count = (uint8_t)n;
+    count++;
+  }
+};
+
+/**
+ * Маска активных LED: бит на пиксель, отдельный ряд слов на ленту
+ */
+template <uint8_t STRIPS, uint16_t LEDS_PER_STRIP>
+class LedMask {
+public:
+  LedMask() : _allOn(false) { clear(); }
+
+  void clear() { memset(_bits, 0, sizeof(_bits)); }
+
+  void setSpan(const LedSpan& span) {
+    for (uint16_t j = span.start; j < span.start + span.count; j++) {
+      _bits[span.strip][j >> 5] |= (1UL << (j & 31));
+    }
+  }
+
+  void setZone(const LedZone& zone) {
+    for (uint8_t i = 0; i < zone.count; i++) setSpan(zone.spans[i]);
+  }
+
+  /**
+   * Временно считать включёнными все LED (нет блоков - эффект на всех лентах)
+   * Сами биты не меняются
+   */
+  void setAllOn(bool on) { _allOn = on; }
+  bool allOn() const { return _allOn; }
+
+  bool test(uint8_t s, uint16_t j) const {
+    return _allOn || ((_bits[s][j >> 5] >> (j & 31)) & 1);
+  }
+
+  /**
+   * Вызвать fn(start, count) для каждого непрерывного участка первых n LED
+   * ленты s, где маска равна lit. Слова из одних нулей/единиц пропускаются
+   * целиком.
+   */
+  template <typename F>
+  void forEachRun(uint8_t s, uint16_t n, bool lit, F fn) const {
+    if (_allOn) {
+      if (lit && n > 0) fn(0, n);
+      return;
+    }
+
+    uint16_t j = findNext(s, 0, n, lit);
+    while (j < n) {
+      uint16_t end = findNext(s, j, n, !lit);
+      fn(j, end - j);
+      j = findNext(s, end, n, lit);
+    }
+  }
+
+private:
+  static const uint8_t WORDS = (LEDS_PER_STRIP + 31) / 32;
+
+  /**
+   * Первый индекс в [from, n) со значением бита value, иначе n
+   */
+  uint16_t findNext(uint8_t s, uint16_t from, uint16_t n, bool value) const {
+    while (from < n) {
+      uint32_t w = _bits[s][from >> 5];
+      if (!value) w = ~w;
+      w &= 0xFFFFFFFFUL << (from & 31);
+      if (w) {
+        uint16_t pos = (from & ~31) + __builtin_ctz(w);
+        return pos < n ? pos : n;
+      }
+      from = (from & ~31) + 32;
+    }
+    return n;
+  }
+
+  uint32_t _bits[STRIPS][WORDS];
+  bool _allOn;
+};
+
+#endif // LED_MASK_H
@@ -0,0 +1,132 @@
+/**
+ * RAMS MEGA CLOCK - оценка часов Mega по PING/PONG с отметками времени
+ *
+ * Команды на две Mega идут по разным UART и стартуют с разницей в десятки
+ * мс. Для синхронного старта ESP32 шлёт кадр AT с временем в часах каждой
+ * Mega, а её часы оценивает здесь:
+ *
+ *   PING [t_send] → PONG [t_send, t_mega], t_recv - приход PONG
+ *   смещение = t_mega - (t_send + t_recv) / 2 + asym
+ *
+ * - asym: PING и PONG разной длины, середина RTT сдвинута на половину
+ *   разницы времени передачи
+ * - Фильтр по RTT: выборка, задержанная очередью UART или занятым loop(),
+ *   отбрасывается (RTT заметно больше минимального)
+ * - Уход кварцев (ppm) считается по соседним выборкам и экстраполируется
+ *   до момента команды; скачок смещения (перезагрузка Mega) - новый отсчёт
+ *
+ * Все времена - micros() (uint32, переполнение через 71 мин не мешает:
+ * используются только разности).
+ *
+ * @version 1.0
+ * @date 2026-03-23
+ * @author RAMS Global Team
+ */
+
+#ifndef MEGA_CLOCK_H
+#define MEGA_CLOCK_H
+
+#include <Arduino.h>
+
+// ============================================================================
+// КОНСТАНТЫ
+// ============================================================================
+
+#define MEGA_CLOCK_RTT_SLACK_US   300     // Выборка годна при RTT ≤ min + запас
+#define MEGA_CLOCK_RTT_AGING_US   20      // Минимум RTT медленно растёт (разовый выброс вниз)
+#define MEGA_CLOCK_DRIFT_MIN_US   1000000 // Уход считается по выборкам не ближе 1 с
+#define MEGA_CLOCK_DRIFT_MAX_PPM  20000   // Больше - это не уход, а скачок часов
+#define MEGA_CLOCK_STALE_US       10000000 // Без выборок 10 с - оценке не верим
+
+// ============================================================================
+// ОЦЕНКА
+// ============================================================================
+
+struct MegaClock {
+  bool valid;
+  uint32_t offsetUs;      // t_mega - t_esp на момент выборки (по модулю 2^32)
+  int32_t driftPpm;       // Часы Mega быстрее ESP32 на driftPpm
+  uint32_t sampleUs;      // t_esp выборки
+  uint32_t anchorUs;      // Выборка, от которой считается уход (≥ 1 с назад)
+  uint32_t anchorOffsetUs;
+  uint32_t minRttUs;
+  uint32_t lastRttUs;
+  uint32_t samples;       // Принятые выборки
+  uint32_t rejected;      // Отброшенные по RTT
+};
+
+inline void megaClockReset(MegaClock& c) {
+  memset(&c, 0, sizeof(c));
+  c.minRttUs = UINT32_MAX;
+}
+
+/**
+ * Учесть ответ PONG
+ * @param sentUs t_esp из PING (эхо в PONG)
+ * @param megaUs micros() Mega при разборе PING
+ * @param recvUs micros() ESP32 при приходе PONG
+ * @param asymUs (длина PONG - длина PING) × время байта / 2
+ * @return true если выборка принята
+ */
+inline bool megaClockSample(MegaClock& c, uint32_t sentUs, uint32_t megaUs,
+                            uint32_t recvUs, int32_t asymUs) {
+  uint32_t rtt = recvUs - sentUs;
+  c.lastRttUs = rtt;
+
+  if (c.minRttUs != UINT32_MAX) c.minRttUs += MEGA_CLOCK_RTT_AGING_US;
+  if (rtt < c.minRttUs) c.minRttUs = rtt;
+  if (rtt > c.minRttUs + MEGA_CLOCK_RTT_SLACK_US) {
+    c.rejected++;
+    return false;
+  }
+
+  uint32_t midUs = sentUs + rtt / 2;
+  uint32_t offset = megaUs - midUs + (uint32_t)asymUs;
+
+  if (!c.valid) {
+    c.anchorUs = midUs;
+    c.anchorOffsetUs = offset;
+  } else {
+    int32_t dt = (int32_t)(midUs - c.anchorUs);
+    if (dt >= MEGA_CLOCK_DRIFT_MIN_US) {
+      int32_t dOffset = (int32_t)(offset - c.anchorOffsetUs);
+      int32_t ppm = (int32_t)((int64_t)dOffset * 1000000 / dt);
+
+      if (ppm > MEGA_CLOCK_DRIFT_MAX_PPM || ppm < -MEGA_CLOCK_DRIFT_MAX_PPM) {
+        // Mega перезагрузилась - старая оценка ухода ни при чём
+        c.driftPpm = 0;
+        c.samples = 0;
+      } else if (c.samples < 2) {
+        c.driftPpm = ppm;
+      } else {
+        c.driftPpm += (ppm - c.driftPpm) / 4;
+      }
+      c.anchorUs = midUs;
+      c.anchorOffsetUs = offset;
+    }
+  }
+
+  c.offsetUs = offset;
+  c.sampleUs = midUs;
+  c.valid = true;
+  c.samples++;
+  return true;
+}
+
+/**
+ * Оценке можно верить для команды AT сейчас
+ */
+inline bool megaClockReady(const MegaClock& c, uint32_t nowUs) {
+  return c.valid && (uint32_t)(nowUs - c.sampleUs) < MEGA_CLOCK_STALE_US;
+}
+
+/**
+ * Перевести время ESP32 в часы Mega (с учётом ухода с момента выборки)
+ */
+inline uint32_t megaClockToMega(const MegaClock& c, uint32_t espUs) {
+  int32_t since = (int32_t)(espUs - c.sampleUs);
+  int32_t drift = (int32_t)((int64_t)since * c.driftPpm / 1000000);
+  return espUs + c.offsetUs + (uint32_t)drift;
+}
+
+#endif // MEGA_CLOCK_H
@@ -0,0 +1,120 @@
+/**
+ * RAMS MOVE QUEUE - очередь ходов блоков, ждущих бюджет питания
+ *
+ * Блок питания тянет ограниченное число актуаторов сразу
+ * (MAX_ACTIVE_ACTUATORS). Раньше лишняя команда получала 429 и терялась -
+ * теперь ход встаёт в очередь и стартует, как только движущиеся блоки
+ * освободят бюджет (DONE / STATUS от Mega, таймаут, STOP).
+ *
+ * - FIFO: голова ждёт, пока не поместится, следующие за ней не обгоняют
+ *   (блок 15 с тремя актуаторами не голодает за лёгкими блоками)
+ * - priority: ход с большим priority встаёт перед всеми с меньшим,
+ *   среди равных - порядок прихода
+ * - Не больше одного хода на блок: новая команда блоку снимает его
+ *   прежний ход из очереди
+ *
+ * Логика не зависит от Arduino и бюджета: решение "помещается ли голова"
+ * принимает вызывающий.
+ *
+ * @version 1.0
+ * @date 2026-03-31
+ * @author RAMS Global Team
+ */
+
+#ifndef MOVE_QUEUE_H
+#define MOVE_QUEUE_H
+
+#include <Arduino.h>
+#include "ACTUATOR_CONFIG.h"
+
+// ============================================================================
+// ОЧЕРЕДЬ
+// ============================================================================
+
+struct QueuedMove {
+  uint8_t blockNum;
+  uint8_t act;                // MEGA_ACTION_UP / DOWN / POS
+  uint8_t priority;           // 0 - обычный, больше - раньше
+  unsigned long arg;          // Как BatchCommand::duration: мс (0 - до упора) / POS %
+  uint32_t queuedMs;          // millis() постановки
+};
+
+struct MoveQueue {
+  uint8_t count;
+  QueuedMove items[TOTAL_BLOCKS];
+  uint32_t admitted;          // Стартовали из очереди
+  uint32_t waitMaxMs;         // Худшее ожидание старта
+};
+
+/**
+ * Место хода блока в очереди (1 - голова), 0 - блока в очереди нет
+ */
+inline uint8_t moveQueuePosition(const MoveQueue& q, uint8_t blockNum) {
+  for (uint8_t i = 0; i < q.count; i++) {
+    if (q.items[i].blockNum == blockNum) return i + 1;
+  }
+  return 0;
+}
+
+/**
+ * Снять ход блока (новая команда блоку, STOP)
+ * @return true если ход был в очереди
+ */
+inline bool moveQueueRemove(MoveQueue& q, uint8_t blockNum) {
+  uint8_t pos = moveQueuePosition(q, blockNum);
+  if (pos == 0) return false;
+
+  for (uint8_t i = pos; i < q.count; i++) q.items[i - 1] = q.items[i];
+  q.count--;
+  return true;
+}
+
+/**
+ * Поставить ход в очередь (прежний ход блока снимается)
+ * @return место в очереди (1 - голова)
+ */
+inline uint8_t moveQueuePush(MoveQueue& q, uint8_t blockNum, uint8_t act, unsigned long arg,
+                             uint8_t priority, uint32_t nowMs) {
+  moveQueueRemove(q, blockNum);
+
+  uint8_t pos = q.count;
+  while (pos > 0 && q.items[pos - 1].priority < priority) {
+    q.items[pos] = q.items[pos - 1];
+    pos--;
+  }
+  q.items[pos].blockNum = blockNum;
+  q.items[pos].act = act;
+  q.items[pos].priority = priority;
+  q.items[pos].arg = arg;
+  q.items[pos].queuedMs = nowMs;
+  q.count++;
+  return pos + 1;
+}
+
+/**
+ * Есть ли в очереди ход с priority не ниже данного (новый ход с этим
+ * priority не должен его обгонять)
+ */
+inline bool moveQueueHasWaiting(const MoveQueue& q, uint8_t priority) {
+  return q.count > 0 && q.items[0].priority >= priority;
+}
+
+/**
+ * Снять голову после старта (учитывает время ожидания)
+ */
+inline void moveQueuePop(MoveQueue& q, uint32_t nowMs) {
+  if (q.count == 0) return;
+
+  uint32_t waited = nowMs - q.items[0].queuedMs;
+  if (waited > q.waitMaxMs) q.waitMaxMs = waited;
+  q.admitted++;
+
+  for (uint8_t i = 1; i < q.count; i++) q.items[i - 1] = q.items[i];
+  q.count--;
+}
+
+inline void moveQueueClear(MoveQueue& q) {
+  q.count = 0;
+}
+
+#endif // MOVE_QUEUE_H
@@ -0,0 +1,260 @@
+/**
+ * RAMS PERF PROFILER - время по этапам кадра и loop() (счётчик тактов CPU)
+ *
+ * Каждый этап - гистограмма фиксированного размера: 4 корзины на октаву
+ * от 1 мкс до ~1 с. По ней считаются min/avg/max/p99 без хранения выборок.
+ *
+ * Запись без блокировок: у каждого этапа ровно один пишущий поток
+ * (render task, loop() или async_tcp). Сброс - флаг, который применяет
+ * сам писатель при следующей записи.
+ *
+ * PERF_ENABLED 0 убирает профайлер: макросы пустые, памяти не занимает.
+ * Гистограмма остаётся - ею же считаются задержки Mega (COMMAND_LATENCY.h).
+ *
+ * Использование:
+ *   { PERF_SCOPE(PERF_STAGE_OTA); ArduinoOTA.handle(); }
+ *
+ *   PERF_MARK(t);
+ *   FastLED.show();
+ *   PERF_RECORD(PERF_STAGE_SHOW, t);
+ *
+ * @version 1.0
+ * @date 2026-03-21
+ * @author RAMS Global Team
+ */
+
+#ifndef PERF_PROFILER_H
+#define PERF_PROFILER_H
+
+#include <Arduino.h>
+
+#ifndef PERF_ENABLED
+#define PERF_ENABLED 1
+#endif
+
+// ============================================================================
+// ЭТАПЫ
+// ============================================================================
+
+enum PerfStage : uint8_t {
+  // render task (ядро 0)
+  PERF_STAGE_FRAME = 0,   // Весь кадр
+  PERF_STAGE_EFFECT,      // Эффект / static (включая applyMask внутри эффекта)
+  PERF_STAGE_MASK,        // Пересборка маски из блоков
+  PERF_STAGE_FADE,        // Огибающие fade IN/OUT
+  PERF_STAGE_SHOW,        // FastLED.show()
+  // loop() (ядро 1)
+  PERF_STAGE_LOOP,        // Весь проход loop()
+  PERF_STAGE_OTA,         // ArduinoOTA.handle()
+  PERF_STAGE_MEGA_RX,     // Приём от обеих Mega
+  // async_tcp
+  PERF_STAGE_HTTP,        // HTTP handler под ControlLock (столько же ждёт loop)
+  PERF_STAGE_COUNT
+};
+
+inline const char* perfStageName(uint8_t stage) {
+  static const char* const names[PERF_STAGE_COUNT] = {
+    "frame", "effect", "mask", "fade", "show",
+    "loop", "ota", "megaRx", "http"
+  };
+  return stage < PERF_STAGE_COUNT ? names[stage] : "?";
+}
+
+// ============================================================================
+// ГИСТОГРАММА
+// ============================================================================
+
+#define PERF_SUB_BUCKETS  4       // Корзин на октаву (шаг ~19%)
+#define PERF_OCTAVES      20      // До 2^20 мкс ≈ 1 с
+#define PERF_BUCKETS      (PERF_OCTAVES * PERF_SUB_BUCKETS)
+
+struct PerfHistogram {
+  uint32_t count;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t sumUs;
+  uint32_t buckets[PERF_BUCKETS];
+};
+
+/**
+ * Корзина для значения: октава (старший бит) + 2 следующих бита
+ */
+inline uint8_t perfBucket(uint32_t us) {
+  if (us < PERF_SUB_BUCKETS) return (uint8_t)us;
+
+  uint8_t msb = 31 - __builtin_clz(us);
+  uint8_t sub = (us >> (msb - 2)) & (PERF_SUB_BUCKETS - 1);
+  uint16_t idx = (uint16_t)(msb - 1) * PERF_SUB_BUCKETS + sub;
+  return idx < PERF_BUCKETS ? (uint8_t)idx : PERF_BUCKETS - 1;
+}
+
+/**
+ * Верхняя граница корзины в мкс (для p99)
+ */
+inline uint32_t perfBucketUpperUs(uint8_t idx) {
+  if (idx < PERF_SUB_BUCKETS) return idx;
+
+  uint8_t msb = idx / PERF_SUB_BUCKETS + 1;
+  uint8_t sub = idx % PERF_SUB_BUCKETS;
+  uint32_t base = 1UL << msb;
+  uint32_t step = base / PERF_SUB_BUCKETS;
+  return base + step * (sub + 1) - 1;
+}
+
+inline void perfHistReset(PerfHistogram& h) {
+  memset(&h, 0, sizeof(h));
+  h.minUs = UINT32_MAX;
+}
+
+inline void perfHistAdd(PerfHistogram& h, uint32_t us) {
+  h.count++;
+  h.sumUs += us;
+  if (us < h.minUs) h.minUs = us;
+  if (us > h.maxUs) h.maxUs = us;
+  h.buckets[perfBucket(us)]++;
+}
+
+/**
+ * Перцентиль по корзинам (верхняя граница корзины, не больше max)
+ * @param permille 990 = p99
+ */
+inline uint32_t perfHistPercentile(const PerfHistogram& h, uint16_t permille) {
+  if (h.count == 0) return 0;
+
+  uint32_t target = (uint32_t)(((uint64_t)h.count * permille + 999) / 1000);
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < PERF_BUCKETS; i++) {
+    seen += h.buckets[i];
+    if (seen >= target) {
+      uint32_t upper = perfBucketUpperUs(i);
+      return upper < h.maxUs ? upper : h.maxUs;
+    }
+  }
+  return h.maxUs;
+}
+
+/**
+ * {"n":..,"min":..,"avg":..,"max":..,"p99":..} (единицы - как при записи)
+ */
+inline String perfHistJson(const PerfHistogram& h) {
+  bool empty = (h.count == 0);
+  String json = "{\"n\":" + String(h.count);
+  json += ",\"min\":" + String(empty ? 0 : h.minUs);
+  json += ",\"avg\":" + String(empty ? 0 : (uint32_t)(h.sumUs / h.count));
+  json += ",\"max\":" + String(h.maxUs);
+  json += ",\"p99\":" + String(perfHistPercentile(h, 990)) + "}";
+  return json;
+}
+
+#if PERF_ENABLED
+
+// ============================================================================
+// ПРОФАЙЛЕР
+// ============================================================================
+
+struct PerfProfiler {
+  PerfHistogram stages[PERF_STAGE_COUNT];
+  volatile bool resetPending[PERF_STAGE_COUNT];
+  uint32_t cpuMHz;
+};
+
+inline PerfProfiler& perf() {
+  static PerfProfiler instance;
+  return instance;
+}
+
+inline void perfInit() {
+  PerfProfiler& p = perf();
+  for (uint8_t i = 0; i < PERF_STAGE_COUNT; i++) {
+    perfHistReset(p.stages[i]);
+    p.resetPending[i] = false;
+  }
+  p.cpuMHz = ESP.getCpuFreqMHz();
+}
+
+inline uint32_t perfNow() {
+  return ESP.getCycleCount();
+}
+
+/**
+ * Записать длительность этапа (только из потока-владельца этапа)
+ */
+inline void perfRecord(uint8_t stage, uint32_t cycles) {
+  PerfProfiler& p = perf();
+  PerfHistogram& h = p.stages[stage];
+  if (p.resetPending[stage]) {
+    perfHistReset(h);
+    p.resetPending[stage] = false;
+  }
+  perfHistAdd(h, cycles / (p.cpuMHz ? p.cpuMHz : 240));
+}
+
+/**
+ * Сбросить все этапы (применится при следующей записи каждого этапа)
+ */
+inline void perfRequestReset() {
+  for (uint8_t i = 0; i < PERF_STAGE_COUNT; i++) perf().resetPending[i] = true;
+}
+
+/**
+ * Этап от конструктора до деструктора
+ * Счётчик тактов у каждого ядра свой: если задача (async_tcp без привязки
+ * к ядру) проснулась на другом ядре, разность тактов - мусор, выборка
+ * отбрасывается. platformio.ini привязывает async_tcp к ядру 1
+ * (CONFIG_ASYNC_TCP_RUNNING_CORE), это страховка для сборки без него.
+ */
+class PerfScope {
+public:
+  explicit PerfScope(uint8_t stage) : _stage(stage), _core(xPortGetCoreID()), _start(perfNow()) {}
+  ~PerfScope() {
+    uint32_t end = perfNow();
+    if (xPortGetCoreID() == _core) perfRecord(_stage, end - _start);
+  }
+
+private:
+  uint8_t _stage;
+  uint8_t _core;
+  uint32_t _start;
+
+  PerfScope(const PerfScope&) = delete;
+  PerfScope& operator=(const PerfScope&) = delete;
+};
+
+/**
+ * JSON для /api/perf (мкс):
+ *   {"enabled":true,"cpuMHz":240,"stages":{"frame":{"n":..,"min":..,"avg":..,"max":..,"p99":..},...}}
+ */
+inline String perfJson() {
+  PerfProfiler& p = perf();
+  String json = "{\"enabled\":true,\"cpuMHz\":" + String(p.cpuMHz) + ",\"stages\":{";
+  for (uint8_t i = 0; i < PERF_STAGE_COUNT; i++) {
+    const PerfHistogram& h = p.stages[i];
+    bool empty = (h.count == 0 || p.resetPending[i]);
+    if (i > 0) json += ",";
+    json += "\"" + String(perfStageName(i)) + "\":{\"n\":" + String(empty ? 0 : h.count);
+    json += ",\"min\":" + String(empty ? 0 : h.minUs);
+    json += ",\"avg\":" + String(empty ? 0 : (uint32_t)(h.sumUs / h.count));
+    json += ",\"max\":" + String(empty ? 0 : h.maxUs);
+    json += ",\"p99\":" + String(empty ? 0 : perfHistPercentile(h, 990)) + "}";
+  }
+  json += "}}";
+  return json;
+}
+
+#define PERF_SCOPE(stage)        PerfScope _perfScope(stage)
+#define PERF_MARK(var)           uint32_t var = perfNow()
+#define PERF_RECORD(stage, var)  perfRecord(stage, perfNow() - (var))
+
+#else  // PERF_ENABLED
+
+inline void perfInit() {}
+inline void perfRequestReset() {}
+inline String perfJson() { return "{\"enabled\":false}"; }
+
+#define PERF_SCOPE(stage)
+#define PERF_MARK(var)
+#define PERF_RECORD(stage, var)
+
+#endif // PERF_ENABLED
+
+#endif // PERF_PROFILER_H
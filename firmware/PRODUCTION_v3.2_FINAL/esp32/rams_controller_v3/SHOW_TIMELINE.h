@@ -0,0 +1,201 @@
+/**
+ * RAMS SHOW TIMELINE - хореография на контроллере (список реплик по времени)
+ *
+ * Многошаговое шоу (блок 3 вверх, цвет кольца, блок 3 вниз, блок 7...)
+ * раньше отсчитывал киоск, отправляя HTTP запросы - джиттер Wi-Fi попадал
+ * в движение. Теперь список реплик загружается один раз, хранится во flash
+ * (LittleFS) и исполняется из loop() ESP32 по своим часам:
+ *
+ *   реплика = { t от старта (мс), блоки / LED, параметры }
+ *
+ * - Реплики отсортированы по t (при равном t - в порядке загрузки)
+ * - showPlayerNext() отдаёт реплики, время которых наступило; все реплики
+ *   одного прохода loop() исполняются вместе (блоки - одним GROUP / AT)
+ * - Опоздание считается от расчётного момента (start + t), а не от
+ *   прошлой реплики - задержка одного прохода не накапливается
+ * - Повтор (loop): период - время последней реплики
+ *
+ * Логика не зависит от Arduino: время передаётся параметром (millis()
+ * на ESP32, поддельные часы на хосте), переполнение millis() не мешает -
+ * используются только разности.
+ *
+ * Формат во flash (LE, FRAME_CODEC.h): magic, count, count × 12 байт
+ * [t(4), type, act, blocks(2), arg(4)]
+ *
+ * @version 1.0
+ * @date 2026-03-30
+ * @author RAMS Global Team
+ */
+
+#ifndef SHOW_TIMELINE_H
+#define SHOW_TIMELINE_H
+
+#include <Arduino.h>
+#include "FRAME_CODEC.h"
+
+// ============================================================================
+// КОНСТАНТЫ
+// ============================================================================
+
+#define SHOW_CUES_MAX     128           // 128 × 12 байт = 1.5 КБ RAM
+#define SHOW_CUE_SIZE     12            // Реплика во flash
+#define SHOW_HEADER_SIZE  6             // magic(4) + count(2)
+#define SHOW_MAGIC        0x31485352UL  // "RSH1"
+#define SHOW_FILE         "/show.bin"
+
+// Тип реплики
+#define SHOW_CUE_BLOCK    1             // blocks, act = MEGA_ACTION_*, arg = мс / POS %
+#define SHOW_CUE_COLOR    2             // arg = 0xRRGGBB
+#define SHOW_CUE_EFFECT   3             // act = id эффекта, arg = скорость
+#define SHOW_CUE_BRI      4             // arg = яркость 0-255
+#define SHOW_CUE_STOP     5             // Остановить все блоки
+
+// ============================================================================
+// СПИСОК РЕПЛИК
+// ============================================================================
+
+struct ShowCue {
+  uint32_t atMs;        // От старта шоу
+  uint8_t type;         // SHOW_CUE_*
+  uint8_t act;
+  uint16_t blocks;      // Бит N = блок N (SHOW_CUE_BLOCK)
+  uint32_t arg;
+};
+
+struct ShowTimeline {
+  uint16_t count;
+  ShowCue cues[SHOW_CUES_MAX];
+};
+
+/**
+ * Длительность шоу - время последней реплики
+ */
+inline uint32_t showTimelineLength(const ShowTimeline& t) {
+  return (t.count > 0) ? t.cues[t.count - 1].atMs : 0;
+}
+
+/**
+ * Упорядочить по времени; равные t сохраняют порядок загрузки
+ */
+inline void showTimelineSort(ShowTimeline& t) {
+  for (uint16_t i = 1; i < t.count; i++) {
+    ShowCue cue = t.cues[i];
+    uint16_t pos = i;
+    while (pos > 0 && t.cues[pos - 1].atMs > cue.atMs) {
+      t.cues[pos] = t.cues[pos - 1];
+      pos--;
+    }
+    t.cues[pos] = cue;
+  }
+}
+
+/**
+ * Размер списка во flash
+ */
+inline size_t showTimelineEncodedSize(const ShowTimeline& t) {
+  return SHOW_HEADER_SIZE + (size_t)t.count * SHOW_CUE_SIZE;
+}
+
+/**
+ * Записать список в буфер (showTimelineEncodedSize байт)
+ */
+inline void showTimelineEncode(const ShowTimeline& t, uint8_t* out) {
+  framePutU32(out, SHOW_MAGIC);
+  framePutU16(&out[4], t.count);
+  for (uint16_t i = 0; i < t.count; i++) {
+    uint8_t* e = &out[SHOW_HEADER_SIZE + i * SHOW_CUE_SIZE];
+    framePutU32(e, t.cues[i].atMs);
+    e[4] = t.cues[i].type;
+    e[5] = t.cues[i].act;
+    framePutU16(&e[6], t.cues[i].blocks);
+    framePutU32(&e[8], t.cues[i].arg);
+  }
+}
+
+/**
+ * Прочитать список из буфера
+ * @return false - чужой / обрезанный файл, t не изменён
+ */
+inline bool showTimelineDecode(ShowTimeline& t, const uint8_t* in, size_t len) {
+  if (len < SHOW_HEADER_SIZE || frameGetU32(in) != SHOW_MAGIC) return false;
+
+  uint16_t count = frameGetU16(&in[4]);
+  if (count > SHOW_CUES_MAX || len < SHOW_HEADER_SIZE + (size_t)count * SHOW_CUE_SIZE) return false;
+
+  for (uint16_t i = 0; i < count; i++) {
+    const uint8_t* e = &in[SHOW_HEADER_SIZE + i * SHOW_CUE_SIZE];
+    t.cues[i].atMs = frameGetU32(e);
+    t.cues[i].type = e[4];
+    t.cues[i].act = e[5];
+    t.cues[i].blocks = frameGetU16(&e[6]);
+    t.cues[i].arg = frameGetU32(&e[8]);
+  }
+  t.count = count;
+  showTimelineSort(t);
+  return true;
+}
+
+// ============================================================================
+// ВОСПРОИЗВЕДЕНИЕ
+// ============================================================================
+
+struct ShowPlayer {
+  bool playing;
+  bool loop;
+  uint32_t startMs;     // Момент t = 0 текущего прохода
+  uint16_t next;        // Следующая реплика
+  uint32_t passes;      // Завершённые проходы (loop)
+  uint32_t fired;       // Исполненные реплики с последнего старта
+  uint32_t skipped;     // Отклонённые при исполнении (лимит, положение)
+  uint32_t lateMaxMs;   // Худшее опоздание реплики от start + t
+};
+
+inline void showPlayerStart(ShowPlayer& p, uint32_t nowMs, bool loop) {
+  memset(&p, 0, sizeof(p));
+  p.playing = true;
+  p.loop = loop;
+  p.startMs = nowMs;
+}
+
+inline void showPlayerStop(ShowPlayer& p) {
+  p.playing = false;
+}
+
+/**
+ * Время от старта текущего прохода
+ */
+inline uint32_t showPlayerElapsed(const ShowPlayer& p, uint32_t nowMs) {
+  return p.playing ? nowMs - p.startMs : 0;
+}
+
+/**
+ * Следующая наступившая реплика (вызывать в цикле, пока не nullptr)
+ * Конец списка: loop - новый проход через длительность шоу от старта
+ * прошлого, иначе остановка
+ */
+inline const ShowCue* showPlayerNext(ShowPlayer& p, const ShowTimeline& t, uint32_t nowMs) {
+  if (!p.playing) return nullptr;
+
+  if (p.next >= t.count) {
+    uint32_t length = showTimelineLength(t);
+    if (!p.loop || length == 0) {
+      p.playing = false;
+      return nullptr;
+    }
+    if (nowMs - p.startMs < length) return nullptr;
+    p.startMs += length;
+    p.next = 0;
+    p.passes++;
+  }
+
+  const ShowCue& cue = t.cues[p.next];
+  int32_t late = (int32_t)(nowMs - (p.startMs + cue.atMs));
+  if (late < 0) return nullptr;
+
+  if ((uint32_t)late > p.lateMaxMs) p.lateMaxMs = late;
+  p.next++;
+  p.fired++;
+  return &cue;
+}
+
+#endif // SHOW_TIMELINE_H
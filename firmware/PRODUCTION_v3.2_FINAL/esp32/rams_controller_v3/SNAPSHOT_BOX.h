@@ -0,0 +1,67 @@
+/**
+ * RAMS SNAPSHOT BOX - lock-free обмен состоянием между задачами ESP32
+ *
+ * Seqlock на один писатель и любое число читателей:
+ * - писатель (loop / HTTP) никогда не ждёт читателя
+ * - читатель (render task на другом ядре) копирует снимок и повторяет
+ *   копирование, если писатель успел его изменить во время чтения
+ *
+ * Подходит для небольших POD-структур (сотни байт), которые читаются
+ * целиком раз в кадр.
+ *
+ * @version 1.0
+ * @date 2026-03-12
+ * @author RAMS Global Team
+ */
+
+#ifndef SNAPSHOT_BOX_H
+#define SNAPSHOT_BOX_H
+
+#include <Arduino.h>
+#include <atomic>
+
+template <typename T>
+class SnapshotBox {
+public:
+  SnapshotBox() : _seq(0) {
+    memset((void*)&_data, 0, sizeof(T));
+  }
+
+  /**
+   * Опубликовать новый снимок (только один писатель!)
+   */
+  void publish(const T& value) {
+    uint32_t seq = _seq.load(std::memory_order_relaxed);
+    _seq.store(seq + 1, std::memory_order_relaxed);     // нечётный = идёт запись
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy((void*)&_data, &value, sizeof(T));
+    _seq.store(seq + 2, std::memory_order_release);     // чётный = снимок готов
+  }
+
+  /**
+   * Прочитать согласованный снимок
+   * @return Версия снимка (растёт с каждым publish)
+   */
+  uint32_t read(T& out) const {
+    for (;;) {
+      uint32_t before = _seq.load(std::memory_order_acquire);
+      if (before & 1) continue;  // писатель в процессе - повторить
+      memcpy(&out, (const void*)&_data, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (_seq.load(std::memory_order_relaxed) == before) return before >> 1;
+    }
+  }
+
+  /**
+   * Текущая версия без копирования (для проверки "изменилось ли")
+   */
+  uint32_t version() const {
+    return _seq.load(std::memory_order_acquire) >> 1;
+  }
+
+private:
+  std::atomic<uint32_t> _seq;
+  T _data;
+};
+
+#endif // SNAPSHOT_BOX_H
@@ -21,6 +21,56 @@
  * ✅ Создана функция applyFadeBrightnessToBlock() для fade IN/OUT
  * ✅ Добавлена поддержка OTA обновлений (ArduinoOTA)
  *
+ * ИЗМЕНЕНИЯ v3.4:
+ * ✅ Неблокирующее чтение ответов Mega (MEGA_LINK.h, без readStringUntil)
+ * ✅ LED pipeline в отдельной FreeRTOS задаче на ядре 0 (двойной буфер кадров,
+ *    lock-free снимок состояния, джиттер кадров в /api/status → render)
+ * ✅ Параллельный вывод всех 10 лент через I2S + DMA (LED_DRIVER_I2S),
+ *    время кадра = самая длинная лента (150 LED), а не сумма всех лент
+ * ✅ Бинарный протокол v4 с Mega (FRAME_CODEC.h): CRC-8, SEQ, ACK с SEQ,
+ *    повтор без ACK; текстовый протокол остаётся fallback для старых Mega
+ * ✅ Асинхронный HTTP сервер (ESPAsyncWebServer): keep-alive, параллельные
+ *    клиенты, общий ControlLock с loop(); контракт API не изменился
+ * ✅ Push состояния через SSE (/api/events): дельта только при изменении
+ *    блоков / LED / fade / связи с Mega, версия состояния растёт монотонно
+ * ✅ POST /api/batch: несколько блоков одним запросом, лимит активных
+ *    проверяется для всего набора, один кадр BATCH на каждую Mega
+ * ✅ Маска LED в битах (LED_MASK.h): зоны блоков - готовые участки лент,
+ *    маска и fade применяются участками, "все LED" - флаг вместо копии маски
+ * ✅ Одна огибающая fade на блок (FADE_ENVELOPE.h): целочисленные кривые Q16
+ *    без float в render task, разворот UP/DOWN с текущего уровня
+ * ✅ Профайлер этапов кадра и loop() (PERF_PROFILER.h): min/avg/max/p99
+ *    в GET /api/perf, сброс POST /api/perf/reset, PERF_ENABLED 0 - выключен
+ * ✅ Синхронный старт на двух Mega: смещение часов каждой Mega по PING/PONG
+ *    (MEGA_CLOCK.h), /api/batch на обе Mega - кадры AT с одним временем
+ * ✅ Кадр состояния от Mega (FRAME_OP_STATUS): blockStates сверяются с реле
+ *    Mega, живость без PONG, ошибки приёма и перезагрузки Mega в /api/status
+ * ✅ Положение блоков (Mega считает по времени хода, хранит в EEPROM):
+ *    positions в /api/status, action=POS&pos=60, UP/DOWN без duration -
+ *    ход до упора от текущего положения
+ * ✅ Канал к Mega 500000 бод 8E1 (MEGA_LINK_BAUD): Mega принимает в кольцо
+ *    256 байт из своего прерывания, ошибки кадра / чётности / overrun /
+ *    переполнения кольца Mega - в /api/status → megaN.status
+ * ✅ Группа блоков одной Mega (FRAME_OP_GROUP): одно действие и время -
+ *    один кадр с маской, Mega переключает реле группы одной записью в порты;
+ *    /api/block?num=2,3,5 - список блоков как /api/batch
+ * ✅ Хореография на контроллере (SHOW_TIMELINE.h): список реплик по времени
+ *    загружается в LittleFS (POST /api/show/upload) и исполняется из loop()
+ *    по часам ESP32 - /api/show/play, /api/show/stop, /api/show/status
+ * ✅ Бюджет питания вместо 429 (MOVE_QUEUE.h): вес блока = число его
+ *    актуаторов, ходы сверх MAX_ACTIVE_ACTUATORS ждут в очереди (FIFO,
+ *    priority) и стартуют, как только DONE / STATUS освободят бюджет;
+ *    ответ 202 QUEUED:N - место в очереди
+ * ✅ Таймеры loop() в одной куче (DEADLINE_HEAP.h): таймауты блоков,
+ *    завершение fade и PING взводятся при старте, loop() смотрит только
+ *    ближайший; activeBlocksCount / activeActuators правятся на месте
+ * ✅ Автомат движения блока (BLOCK_MOTION.h): down / rising / up / lowering /
+ *    mid / fault по командам, DONE, таймаутам, NAK и потере связи; STATUS
+ *    сверяет его с реле и положением Mega (/api/status "motion")
+ * ✅ Задержки команд Mega (COMMAND_LATENCY.h): ответ ACK / NAK по SEQ (v4) или
+ *    по порядку строк (v3), ход команда -> стоп по DONE / STATUS -
+ *    гистограммы на Mega и на блок, дрейф хода (/api/status "latency")
+ *
  * OTA ОБНОВЛЕНИЕ:
  * - Hostname: RAMS-ESP32
  * - Password: rams2026
@@ -32,11 +82,44 @@
  * @author RAMS Global Team
  */
 
+// ============================================================================
+// LED DRIVER (ВЫБОР ДО #include <FastLED.h>!)
+// ============================================================================
+// 1 = I2S parallel + DMA: все 10 линий выводятся одновременно
+//     (кадр ≈ 150 LED × 30 мкс ≈ 4.5 мс, ограничен самой длинной лентой)
+// 0 = RMT (стандартный FastLED): каналы выводятся по очереди
+//     (кадр растёт с суммой лент, 478 LED ≈ 14 мс)
+// Замер обоих вариантов: led_bench/led_bench.ino
+#define LED_DRIVER_I2S  1
+
+#if LED_DRIVER_I2S
+  #define FASTLED_ESP32_I2S true
+  #define LED_DRIVER_NAME "i2s"
+#else
+  #define LED_DRIVER_NAME "rmt"
+#endif
+
 #include <WiFi.h>
-#include <WebServer.h>
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
 #include <FastLED.h>
 #include <ArduinoOTA.h>
+#include <ArduinoJson.h>
+#include <LittleFS.h>
 #include "ACTUATOR_CONFIG.h"
+#include "MEGA_LINK.h"
+#include "FRAME_CODEC.h"
+#include "SNAPSHOT_BOX.h"
+#include "CONTROL_LOCK.h"
+#include "LED_MASK.h"
+#include "FADE_ENVELOPE.h"
+#include "PERF_PROFILER.h"
+#include "MEGA_CLOCK.h"
+#include "SHOW_TIMELINE.h"
+#include "MOVE_QUEUE.h"
+#include "DEADLINE_HEAP.h"
+#include "BLOCK_MOTION.h"
+#include "COMMAND_LATENCY.h"
 
 // ============================================================================
 // WiFi КОНФИГУРАЦИЯ
@@ -62,11 +145,18 @@
 static const uint8_t  PIN_GPIO[NUM_STRIPS] = { 32, 22, 18, 21, 13, 27,  4, 14,  5,  2 };
 static const uint16_t PIN_LEDS[NUM_STRIPS] = { 33, 33, 33, 33, 33, 33, 33, 33, 64, 150 };
 
-static CRGB leds[NUM_STRIPS][MAX_LEDS];
+// ВНИМАНИЕ: leds/heat/mask и g* параметры принадлежат render task (ядро 0)!
+// loop() и HTTP обработчики меняют только ledControl и публикуют его снимок.
+static CRGB leds[NUM_STRIPS][MAX_LEDS];     // Рабочий буфер эффектов (сохраняется между кадрами)
 static uint8_t heat[NUM_STRIPS][MAX_LEDS];  // Для эффекта Fire
-static bool mask[NUM_STRIPS][MAX_LEDS];     // Маска активных LED (из svetdiod-project)
+static LedMask<NUM_STRIPS, MAX_LEDS> mask;  // Маска активных LED (биты, LED_MASK.h)
 
-// Глобальные LED параметры
+// Двойная буферизация: FastLED выводит front, следующий кадр собирается в back
+static CRGB frameBuf[2][NUM_STRIPS][MAX_LEDS];
+static uint8_t frontFrame = 0;
+static CLEDController* stripControllers[NUM_STRIPS];
+
+// Глобальные LED параметры (копия из снимка на начало кадра)
 uint8_t gR = 0, gG = 150, gB = 255;  // Cyan
 uint8_t gBri = 200;
 uint8_t gFx = 0;    // Текущий эффект: 0=Static, 1=Pulse, 2=Rainbow, 3=Chase, 4=Sparkle, 5=Wave, 6=Fire, 7=Meteor
@@ -74,6 +164,18 @@ uint8_t gSpd = 128; // Скорость эффекта (0-255)
 
 #define FPS 50  // Частота обновления эффектов
 
+// ============================================================================
+// RENDER TASK КОНФИГУРАЦИЯ
+// ============================================================================
+// loop() (WiFi, HTTP, OTA, Mega) работает на ядре 1,
+// LED pipeline (эффект → маска → fade → show) - отдельная задача на ядре 0
+#define RENDER_CORE      0
+#define RENDER_PRIORITY  3
+#define RENDER_STACK     6144
+#define FRAME_US         (1000000UL / FPS)
+
+TaskHandle_t renderTaskHandle = nullptr;
+
 // Разделение луча на внутреннюю/внешнюю части
 #define RAY_IN_START   0
 #define RAY_IN_COUNT  18   // 0-17 (18 LED)
@@ -116,52 +218,210 @@ HardwareSerial Mega1Serial(1);
 #define MEGA2_RX 17
 HardwareSerial Mega2Serial(2);
 
+// ============================================================================
+// MEGA LINK (ПРОТОКОЛ v4 + ТЕКСТОВЫЙ FALLBACK)
+// ============================================================================
+#define MEGA_PENDING_MAX  4   // Команд без ACK на одну Mega
+
+// Время байта UART к Mega (8E1 = 11 бит)
+#define MEGA_BYTE_US        (MEGA_LINK_BYTE_BITS * 1000000UL / MEGA_LINK_BAUD)
+
+// Mega до MEGA_UART.h (v3.2 и старше) слушают 115200 8N1 и новую скорость
+// не понимают. Если Mega молчит, ESP32 по очереди пробует обе скорости:
+// старая прошивка ответит на текстовый PING, и канал останется на 115200
+#define MEGA_LEGACY_BAUD     115200
+#define MEGA_LEGACY_BYTE_US  (10 * 1000000UL / MEGA_LEGACY_BAUD)
+#define MEGA_BAUD_PROBE_MS   (3 * HEARTBEAT_INTERVAL)  // Окно на одной скорости
+
+// Запас до синхронного старта AT: доставка кадра + один повтор без ACK
+#define MEGA_SYNC_LEAD_MS   80
+
+// Команда блоку моложе этого может быть ещё в пути (AT + повторы без ACK):
+// такой блок по кадру STATUS не сверяется
+#define MEGA_STATUS_GRACE_MS  (MEGA_SYNC_LEAD_MS + FRAME_MAX_RETRIES * FRAME_ACK_TIMEOUT_MS)
+
+/**
+ * Отправленный кадр, ждущий ACK/NAK с тем же SEQ
+ */
+struct PendingCommand {
+  bool active;
+  uint8_t seq;
+  uint8_t retries;
+  unsigned long sentAt;
+  uint32_t sentUs;            // micros() первой отправки (ответ - с учётом повторов)
+  uint8_t len;
+  uint8_t frame[FRAME_SIZE_MAX];
+};
+
+/**
+ * Состояние канала к одной Mega
+ * proto = 3 (текст) до ответа PROTO:4 на согласование, потом 4 (кадры)
+ */
+struct MegaLink {
+  HardwareSerial* port;
+  LineReader lineRx;          // Текстовые строки (v3 / согласование)
+  FrameDecoder frameRx;       // Бинарные кадры (v4)
+  unsigned long lastRxByteMs;
+  uint8_t proto;
+  bool textOnly;              // Mega ответила ERROR на PROTO:4 - старая прошивка
+  bool legacyBaud;            // Канал на MEGA_LEGACY_BAUD 8N1 (Mega не перепрошита)
+  unsigned long baudProbeMs;  // Начало окна на текущей скорости (0 - Mega отвечала)
+  uint32_t baudSwitches;
+  unsigned long lastReplyMs;  // Последний STATUS/PONG/ответ (для возврата на текст)
+  uint8_t txSeq;
+  PendingCommand pending[MEGA_PENDING_MAX];
+  uint32_t retransmits;       // Повторы по таймауту ACK
+  uint32_t lost;              // Команды без ACK после всех повторов
+  MegaClock clock;            // Часы Mega по PING/PONG (для AT)
+  FrameStatus status;         // Последний кадр STATUS
+  unsigned long statusMs;
+  uint32_t statusFrames;      // 0 - Mega без STATUS (до v4.2), сверки нет
+  uint32_t reboots;           // uptime в STATUS уменьшился
+  uint32_t resyncs;           // Блоки, исправленные по STATUS
+  LinkLatency latency;        // Задержки ответов и ходов (COMMAND_LATENCY.h)
+};
+
+MegaLink megaLinks[3];        // 1 = Mega #1, 2 = Mega #2 (0 не используется)
+
+// ============================================================================
+// BATCH (/api/batch)
+// ============================================================================
+#define BATCH_BODY_MAX     1024  // JSON тело: 15 команд × ~45 байт с запасом
+#define BATCH_PER_MEGA     (FRAME_PAYLOAD_MAX / FRAME_BATCH_ENTRY)  // 8 блоков
+#define BATCH_TEXT_LINE    32    // "BLOCK:15:DOWN:4294967295\n" + запас
+
+/**
+ * Одна команда пакета (уже проверенная)
+ */
+struct BatchCommand {
+  uint8_t blockNum;
+  uint8_t act;                // MEGA_ACTION_* (= FRAME_ACT_*)
+  unsigned long duration;     // Для Mega: мс (0 - до упора), для POS - цель в %
+  int expectedMs;             // Таймер блока на ESP32 (по положению из STATUS)
+};
+
+// ============================================================================
+// ШОУ (/api/show, SHOW_TIMELINE.h)
+// ============================================================================
+#define SHOW_BODY_MAX      8192  // JSON тело: 128 реплик × ~60 байт с запасом
+
+ShowTimeline showTimeline;       // Загруженное шоу (LittleFS при старте)
+ShowTimeline showUpload;         // Разбор загрузки (в стеке async_tcp не помещается)
+ShowPlayer showPlayer;
+bool showStorageReady = false;   // LittleFS смонтирована
+uint8_t showFileBuf[SHOW_HEADER_SIZE + SHOW_CUES_MAX * SHOW_CUE_SIZE];
+
 // ============================================================================
 // СОСТОЯНИЕ БЛОКОВ
 // ============================================================================
 struct BlockState {
-  bool isActive;
+  uint8_t motion;             // BlockMotion (BLOCK_MOTION.h)
+  uint8_t rest;               // Куда придёт текущий ход (UP / IDLE_DOWN / STOPPED_MID)
   unsigned long startTime;
   int duration;
 };
 
 BlockState blockStates[TOTAL_BLOCKS + 1];  // 0 не используется
 int activeBlocksCount = 0;
+uint8_t activeActuators = 0;       // Нагрузка на БП: актуаторы движущихся блоков
+MoveQueue moveQueue;               // Ходы, ждущие бюджет питания
+BlockTravel blockTravel[TOTAL_BLOCKS + 1];  // Время ходов (COMMAND_LATENCY.h)
+uint16_t driftingBlocks = 0;       // Бит N - ход блока N дрейфует
+
+// Таймеры loop() (DEADLINE_HEAP.h): id 0 - PING, 1..15 - таймаут блока,
+// 17..31 - завершение fade блока
+#define DEADLINE_HEARTBEAT    0
+#define DEADLINE_BLOCK(n)     (n)
+#define DEADLINE_FADE(n)      (TOTAL_BLOCKS + 1 + (n))
+DeadlineHeap deadlines;
 
 // LED состояния - ОТДЕЛЬНО от актуаторов!
 // LED включается при UP и остается ВКЛ пока не придет STOP или DOWN
 bool ledStates[TOTAL_BLOCKS + 1];  // true = LED ВКЛ, false = LED ВЫКЛ
 
-// Fade IN состояния для плавного ВКЛЮЧЕНИЯ LED при поднятии
-struct FadeInState {
-  bool isActive;
-  unsigned long startTime;
-  int duration;
+// Fade LED зоны: к 255 при поднятии (fade IN), к 0 при опускании (fade OUT)
+#define FADE_IN_MS      1000
+#define FADE_IN_CURVE   FADE_CURVE_LINEAR
+#define FADE_OUT_CURVE  FADE_CURVE_LINEAR
+
+FadeEnvelope fadeStates[TOTAL_BLOCKS + 1];  // 0 не используется
+
+/**
+ * Снимок LED состояния для render task
+ * Пишется только из loop() (publishLedState), читается render task раз в кадр
+ */
+struct LedFrameState {
+  uint8_t r, g, b;
+  uint8_t bri;
+  uint8_t fx;
+  uint8_t spd;
+  bool outputEnabled;   // false = погасить ленты (OTA)
+  bool anyLedOn;        // есть блоки с LED ВКЛ (иначе эффект на ВСЕХ LED)
+  uint16_t maskBlocks;  // бит N = LED зона блока N в маске
+  FadeEnvelope fade[TOTAL_BLOCKS + 1];
 };
 
-FadeInState fadeInStates[TOTAL_BLOCKS + 1];  // 0 не используется
+LedFrameState ledControl;                  // Мастер-копия (loop / HTTP)
+SnapshotBox<LedFrameState> ledStateBox;    // Lock-free обмен с render task
 
-// Fade OUT состояния для плавного угасания LED при опускании
-struct FadeOutState {
-  bool isActive;
-  unsigned long startTime;
-  int duration;
+/**
+ * Статистика кадров render task (окно 1 секунда)
+ */
+struct RenderStats {
+  uint32_t frames;        // Всего кадров
+  uint16_t fps;           // Кадров в секунду за последнее окно (кадры / время окна)
+  uint32_t frameUs;       // Средняя длительность кадра (рендер + show)
+  uint32_t frameMaxUs;    // Максимальная длительность кадра
+  uint32_t jitterUs;      // Среднее |период - FRAME_US|
+  uint32_t jitterMaxUs;   // Максимальное отклонение периода
+  uint32_t overruns;      // Кадры дольше FRAME_US (всего)
+  uint32_t showUs;        // Среднее время FastLED.show() (вывод на ленты)
+  uint32_t showMaxUs;     // Максимальное время FastLED.show()
 };
 
-FadeOutState fadeOutStates[TOTAL_BLOCKS + 1];  // 0 не используется
+SnapshotBox<RenderStats> renderStatsBox;
 
 // Heartbeat
 bool mega1Alive = false;
 bool mega2Alive = false;
-unsigned long lastHeartbeat = 0;
 
 // ============================================================================
 // WEB SERVER
 // ============================================================================
-WebServer server(80);
+// Асинхронный: keep-alive и несколько клиентов одновременно (киоск опрашивает
+// /api/status с трёх таймеров + кнопки). Handlers выполняются в задаче async_tcp,
+// поэтому берут ControlLock, как и loop().
+AsyncWebServer server(80);
+
+// ============================================================================
+// PUSH СОСТОЯНИЯ (SSE /api/events)
+// ============================================================================
+// Вместо опроса /api/status: событие "state" уходит только когда состояние
+// изменилось. id события = версия состояния (растёт на каждое изменение).
+//
+// Новый клиент получает полное состояние, дальше - только изменённые поля:
+//   {"v":12,"active":1,"blocks":[5]}
+//   {"v":13,"leds":[5],"fadeIn":[5]}
+//   {"v":14,"mega2":false}
+//
+// При полной очереди клиента AsyncEventSource событие теряется. Клиент,
+// увидевший v больше last+1, переподключается и получает полное состояние.
+AsyncEventSource events("/api/events");
+
+/**
+ * Состояние, которое видит UI (битовые маски: бит N = блок N)
+ */
+struct PushState {
+  uint16_t blocks;    // Актуатор движется
+  uint16_t leds;      // LED зона ВКЛ
+  uint16_t fadeIn;
+  uint16_t fadeOut;
+  bool mega1;
+  bool mega2;
+};
 
-String mega1Response;
-String mega2Response;
+PushState pushedState;      // Последнее отправленное
+uint32_t stateVersion = 0;
 
 // ============================================================================
 // SETUP
@@ -171,6 +431,10 @@ void setup() {
   Serial.begin(115200);
   delay(100);
 
+  // До server.begin(): HTTP handlers и loop() делят этот mutex
+  controlLockInit();
+  perfInit();
+
   Serial.println("\n========================================");
   Serial.println("  RAMS CONTROLLER v3.3 PRODUCTION");
   Serial.println("  Actuators + LED Zones + OTA Updates");
@@ -186,20 +450,21 @@ void setup() {
   // Serial.println("[POWER] GPIO4  = Power Button (INPUT)");
 
   // LED инициализация (ФИНАЛЬНЫЙ маппинг из тестовой версии)
-  FastLED.addLeds<WS2812B, 32, GRB>(leds[0], PIN_LEDS[0]);  // Ray 1 (GPIO 32)
-  FastLED.addLeds<WS2812B, 22, GRB>(leds[1], PIN_LEDS[1]);  // Ray 2 (GPIO 22)
-  FastLED.addLeds<WS2812B, 18, GRB>(leds[2], PIN_LEDS[2]);  // Ray 3 (GPIO 18)
-  FastLED.addLeds<WS2812B, 21, GRB>(leds[3], PIN_LEDS[3]);  // Ray 4 (GPIO 21)
-  FastLED.addLeds<WS2812B, 13, GRB>(leds[4], PIN_LEDS[4]);  // Ray 5 (GPIO 13)
-  FastLED.addLeds<WS2812B, 27, GRB>(leds[5], PIN_LEDS[5]);  // Ray 6 (GPIO 27)
-  FastLED.addLeds<WS2812B,  4, GRB>(leds[6], PIN_LEDS[6]);  // Ray 7 (GPIO  4, перепаян с GPIO23)
-  FastLED.addLeds<WS2812B, 14, GRB>(leds[7], PIN_LEDS[7]);  // Ray 8 (GPIO 14)
-  FastLED.addLeds<WS2812B,  5, GRB>(leds[8], PIN_LEDS[8]);  // Inner circle (GPIO 5)
-  FastLED.addLeds<WS2812B,  2, GRB>(leds[9], PIN_LEDS[9]);  // Outer circle (GPIO 2)
+  // Контроллеры привязаны к frameBuf[0], render task переключает их на back буфер
+  stripControllers[0] = &FastLED.addLeds<WS2812B, 32, GRB>(frameBuf[0][0], PIN_LEDS[0]);  // Ray 1 (GPIO 32)
+  stripControllers[1] = &FastLED.addLeds<WS2812B, 22, GRB>(frameBuf[0][1], PIN_LEDS[1]);  // Ray 2 (GPIO 22)
+  stripControllers[2] = &FastLED.addLeds<WS2812B, 18, GRB>(frameBuf[0][2], PIN_LEDS[2]);  // Ray 3 (GPIO 18)
+  stripControllers[3] = &FastLED.addLeds<WS2812B, 21, GRB>(frameBuf[0][3], PIN_LEDS[3]);  // Ray 4 (GPIO 21)
+  stripControllers[4] = &FastLED.addLeds<WS2812B, 13, GRB>(frameBuf[0][4], PIN_LEDS[4]);  // Ray 5 (GPIO 13)
+  stripControllers[5] = &FastLED.addLeds<WS2812B, 27, GRB>(frameBuf[0][5], PIN_LEDS[5]);  // Ray 6 (GPIO 27)
+  stripControllers[6] = &FastLED.addLeds<WS2812B,  4, GRB>(frameBuf[0][6], PIN_LEDS[6]);  // Ray 7 (GPIO  4, перепаян с GPIO23)
+  stripControllers[7] = &FastLED.addLeds<WS2812B, 14, GRB>(frameBuf[0][7], PIN_LEDS[7]);  // Ray 8 (GPIO 14)
+  stripControllers[8] = &FastLED.addLeds<WS2812B,  5, GRB>(frameBuf[0][8], PIN_LEDS[8]);  // Inner circle (GPIO 5)
+  stripControllers[9] = &FastLED.addLeds<WS2812B,  2, GRB>(frameBuf[0][9], PIN_LEDS[9]);  // Outer circle (GPIO 2)
 
   FastLED.setBrightness(gBri);
   FastLED.clear(true);
-  Serial.println("[LED] 10 strips initialized");
+  Serial.println("[LED] 10 strips initialized (driver: " LED_DRIVER_NAME ")");
   Serial.println("[LED] Rays: 8x33 LED | Inner: 64 LED | Outer: 150 LED");
 
   // Инициализация LED координат блоков (ВАЖНО: ПЕРЕД использованием!)
@@ -208,26 +473,50 @@ void setup() {
 
   // Инициализация состояний блоков и маски
   for (int i = 0; i <= TOTAL_BLOCKS; i++) {
-    blockStates[i].isActive = false;
+    blockStates[i].motion = MOTION_IDLE_DOWN;
+    blockStates[i].rest = MOTION_IDLE_DOWN;
     blockStates[i].startTime = 0;
     blockStates[i].duration = 0;
     ledStates[i] = false;  // LED выключены
-    fadeInStates[i].isActive = false;
-    fadeInStates[i].startTime = 0;
-    fadeInStates[i].duration = 0;
-    fadeOutStates[i].isActive = false;
-    fadeOutStates[i].startTime = 0;
-    fadeOutStates[i].duration = 0;
+    memset(&fadeStates[i], 0, sizeof(FadeEnvelope));
+    travelReset(blockTravel[i]);
   }
+  deadlineClear(deadlines);
+  deadlineSet(deadlines, DEADLINE_HEARTBEAT, millis() + HEARTBEAT_INTERVAL);
 
   // Инициализация маски (все LED выключены)
-  memset(mask, 0, sizeof(mask));
+  mask.clear();
+
+  // Начальный LED снимок для render task
+  ledControl.r = gR;
+  ledControl.g = gG;
+  ledControl.b = gB;
+  ledControl.bri = gBri;
+  ledControl.fx = gFx;
+  ledControl.spd = gSpd;
+  ledControl.outputEnabled = true;
+  ledControl.maskBlocks = 0;
+  publishLedState();
 
   // Mega Serial
-  Mega1Serial.begin(SERIAL_BAUD, SERIAL_8N1, MEGA1_RX, MEGA1_TX);
-  Mega2Serial.begin(SERIAL_BAUD, SERIAL_8N1, MEGA2_RX, MEGA2_TX);
+  Mega1Serial.begin(MEGA_LINK_BAUD, SERIAL_8E1, MEGA1_RX, MEGA1_TX);
+  Mega2Serial.begin(MEGA_LINK_BAUD, SERIAL_8E1, MEGA2_RX, MEGA2_TX);
   Serial.println("[MEGA] Serial ready on GPIO25/26 and GPIO16/17");
 
+  // Канал начинает с текста, PROTO:4 согласуется на первом heartbeat
+  megaLinks[1].port = &Mega1Serial;
+  megaLinks[2].port = &Mega2Serial;
+  for (uint8_t m = 1; m <= 2; m++) {
+    megaLinks[m].proto = 3;
+    megaLinks[m].txSeq = 0;
+    megaClockReset(megaLinks[m].clock);
+    latencyReset(megaLinks[m].latency);
+  }
+
+  // Шоу из flash (форматирует раздел при первом старте)
+  showStorageReady = LittleFS.begin(true);
+  loadShow();
+
   // WiFi - сначала сканируем доступные сети
   Serial.println("[WIFI] Scanning networks...");
   int n = WiFi.scanNetworks();
@@ -284,44 +573,21 @@ void setup() {
   }
 
   // ===== CORS ЗАГОЛОВКИ =====
-  // Обработка OPTIONS preflight запросов для CORS
-  server.on("/api/status", HTTP_OPTIONS, []() {
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-    server.send(204);  // No Content
-  });
-
-  server.on("/api/block", HTTP_OPTIONS, []() {
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-    server.send(204);
-  });
-
-  server.on("/api/stop", HTTP_OPTIONS, []() {
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-    server.send(204);
-  });
-
-  server.on("/api/color", HTTP_OPTIONS, []() {
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-    server.send(204);
-  });
-
-  server.on("/api/effect", HTTP_OPTIONS, []() {
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-    server.send(204);
+  // Добавляются к каждому ответу; OPTIONS preflight отвечает onNotFound (204)
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "Content-Type");
+
+  server.onNotFound([](AsyncWebServerRequest* request) {
+    if (request->method() == HTTP_OPTIONS) {
+      request->send(204);  // No Content
+      return;
+    }
+    request->send(404, "text/plain", "ERROR:Not found");
   });
 
   // Web Server
-  server.on("/", HTTP_GET, []() {
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest* request) {
     String html = "<!DOCTYPE html><html><head><meta charset='UTF-8'>";
     html += "<title>RAMS v3.2</title>";
     html += "<style>*{margin:0;padding:0;box-sizing:border-box}";
@@ -354,162 +620,432 @@ void setup() {
     html += "</div><script>";
     html += "function cmd(b,a){fetch('/api/block?num='+b+'&action='+a+'&duration=10000',{method:'POST'}).then(()=>updateStatus())}";
     html += "function stopAll(){fetch('/api/stop',{method:'POST'}).then(()=>updateStatus())}";
-    html += "function updateStatus(){fetch('/api/status').then(r=>r.json()).then(d=>{";
-    html += "document.getElementById('active').textContent=d.active;";
-    html += "for(let i=1;i<=15;i++){";
+    html += "function apply(d){";
+    html += "if(d.active!==undefined)document.getElementById('active').textContent=d.active;";
+    html += "if(d.blocks)for(let i=1;i<=15;i++){";
     html += "const b=document.getElementById('b'+i);";
     html += "if(b)b.classList.toggle('active',d.blocks.includes(i))";
-    html += "}});}";
-    html += "setInterval(updateStatus,1000);updateStatus();";
+    html += "}}";
+    html += "function updateStatus(){fetch('/api/status').then(r=>r.json()).then(apply);}";
+    // Push через SSE; опрос раз в секунду только если браузер не умеет EventSource.
+    // AsyncEventSource молча выбрасывает события при полной очереди клиента:
+    // пропуск версии (v > last+1) - переподключение, onConnect пришлёт всё
+    html += "let sv=-1,es;";
+    html += "function sse(){es=new EventSource('/api/events');";
+    html += "es.addEventListener('open',()=>{sv=-1});";
+    html += "es.addEventListener('state',e=>{const d=JSON.parse(e.data);";
+    html += "if(sv>=0&&d.v>sv+1){es.close();sse();return}";
+    html += "sv=Math.max(sv,d.v);apply(d)})}";
+    html += "if(window.EventSource){sse()}";
+    html += "else{setInterval(updateStatus,1000)}updateStatus();";
     html += "</script></body></html>";
 
-    server.send(200, "text/html", html);
+    request->send(200, "text/html", html);
   });
 
-  server.on("/api/status", HTTP_GET, []() {
-    // CORS заголовки
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
+  server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
 
     String json = "{\"active\":" + String(activeBlocksCount) + ",\"blocks\":[";
     bool first = true;
     for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-      if (blockStates[i].isActive) {
+      if (blockMoving(i)) {
         if (!first) json += ",";
         json += String(i);
         first = false;
       }
     }
+    json += "]";
+
+    // Бюджет питания и очередь ходов (по порядку старта)
+    json += ",\"power\":{\"actuators\":" + String(activeActuators);
+    json += ",\"budget\":" + String(MAX_ACTIVE_ACTUATORS);
+    json += ",\"queued\":[";
+    for (uint8_t i = 0; i < moveQueue.count; i++) {
+      if (i > 0) json += ",";
+      json += String(moveQueue.items[i].blockNum);
+    }
+    json += "],\"admitted\":" + String(moveQueue.admitted);
+    json += ",\"waitMaxMs\":" + String(moveQueue.waitMaxMs) + "}";
+    json += ",\"v\":" + String(stateVersion);
+
+    // Положение блоков в % по STATUS Mega (null - неизвестно)
+    json += ",\"positions\":[";
+    for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+      if (i > 1) json += ",";
+      uint8_t pos = blockPosition(i);
+      json += (pos == FRAME_STATUS_POS_UNKNOWN) ? String("null") : String(pos);
+    }
+    json += "]";
+
+    // Состояние автомата движения блоков (BLOCK_MOTION.h)
+    json += ",\"motion\":[";
+    for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+      if (i > 1) json += ",";
+      json += "\"" + String(motionName(blockStates[i].motion)) + "\"";
+    }
+    json += "]";
+
+    // Задержки команд Mega (COMMAND_LATENCY.h): ответ в мкс, ход в мс
+    json += ",\"latency\":{";
+    for (uint8_t m = 1; m <= 2; m++) {
+      const LinkLatency& l = megaLinks[m].latency;
+      json += "\"mega" + String(m) + "\":{\"ackUs\":" + perfHistJson(l.ackUs);
+      json += ",\"travelMs\":" + perfHistJson(l.travelMs);
+      json += ",\"rejected\":" + String(l.rejected);
+      json += ",\"unmatched\":" + String(l.unmatched) + "},";
+    }
+    json += "\"blocks\":[";
+    for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+      const BlockTravel& t = blockTravel[i];
+      if (i > 1) json += ",";
+      json += "{\"expectedMs\":" + String(t.expectedMs);
+      json += ",\"driftMs\":" + String(t.driftMs);
+      json += ",\"travelMs\":" + perfHistJson(t.travelMs) + "}";
+    }
+    json += "],\"drifting\":[";
+    first = true;
+    for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+      if (!(driftingBlocks & (1u << i))) continue;
+      if (!first) json += ",";
+      json += String(i);
+      first = false;
+    }
     json += "]}";
-    server.send(200, "application/json", json);
+
+    // Статистика render task (джиттер кадров)
+    RenderStats rs;
+    renderStatsBox.read(rs);
+    json += ",\"render\":{\"driver\":\"" LED_DRIVER_NAME "\"";
+    json += ",\"fps\":" + String(rs.fps);
+    json += ",\"frameUs\":" + String(rs.frameUs);
+    json += ",\"frameMaxUs\":" + String(rs.frameMaxUs);
+    json += ",\"jitterUs\":" + String(rs.jitterUs);
+    json += ",\"jitterMaxUs\":" + String(rs.jitterMaxUs);
+    json += ",\"overruns\":" + String(rs.overruns);
+    json += ",\"showUs\":" + String(rs.showUs);
+    json += ",\"showMaxUs\":" + String(rs.showMaxUs);
+    json += "}";
+
+    // Канал к Mega (протокол, ошибки CRC, повторы)
+    for (uint8_t m = 1; m <= 2; m++) {
+      MegaLink& link = megaLinks[m];
+      json += ",\"mega" + String(m) + "\":{\"proto\":" + String(link.proto);
+      json += ",\"baud\":" + String(link.legacyBaud ? MEGA_LEGACY_BAUD : MEGA_LINK_BAUD);
+      json += ",\"baudSwitches\":" + String(link.baudSwitches);
+      json += ",\"alive\":" + String((m == 1 ? mega1Alive : mega2Alive) ? "true" : "false");
+      json += ",\"crcErrors\":" + String(link.frameRx.crcErrors());
+      json += ",\"retransmits\":" + String(link.retransmits);
+      json += ",\"lost\":" + String(link.lost);
+      json += ",\"clock\":{\"valid\":" + String(link.clock.valid ? "true" : "false");
+      json += ",\"rttUs\":" + String(link.clock.lastRttUs);
+      json += ",\"driftPpm\":" + String(link.clock.driftPpm);
+      json += ",\"rejected\":" + String(link.clock.rejected) + "}";
+
+      // Последний кадр STATUS (счётчики приёма - на стороне Mega)
+      if (link.statusFrames == 0) {
+        json += ",\"status\":null}";
+        continue;
+      }
+      json += ",\"status\":{\"ageMs\":" + String(millis() - link.statusMs);
+      json += ",\"uptimeMs\":" + String(link.status.uptimeMs);
+      json += ",\"reboots\":" + String(link.reboots);
+      json += ",\"resyncs\":" + String(link.resyncs);
+      json += ",\"queued\":" + String(link.status.queued);
+      json += ",\"rxCrc\":" + String(link.status.crcErrors);
+      json += ",\"rxLen\":" + String(link.status.lenErrors);
+      json += ",\"rxGap\":" + String(link.status.gapResets);
+      json += ",\"rxLine\":" + String(link.status.lineOverflows);
+      json += ",\"uartFe\":" + String(link.status.uartFrameErrors);
+      json += ",\"uartPe\":" + String(link.status.uartParityErrors);
+      json += ",\"uartOvr\":" + String(link.status.uartOverruns);
+      json += ",\"uartDrop\":" + String(link.status.uartDropped) + "}}";
+    }
+    json += "}";
+    request->send(200, "application/json", json);
   });
 
-  server.on("/api/block", HTTP_POST, []() {
-    // CORS заголовки
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
+  // Профайлер: время этапов в мкс (PERF_PROFILER.h), без ControlLock
+  server.on("/api/perf", HTTP_GET, [](AsyncWebServerRequest* request) {
+    request->send(200, "application/json", perfJson());
+  });
 
-    int blockNum = server.arg("num").toInt();
-    String action = server.arg("action");
-    int duration = server.arg("duration").toInt();
+  server.on("/api/perf/reset", HTTP_POST, [](AsyncWebServerRequest* request) {
+    perfRequestReset();
+    request->send(200, "text/plain", "OK");
+  });
 
-    if (blockNum < 1 || blockNum > TOTAL_BLOCKS) {
-      server.send(400, "text/plain", "ERROR:Invalid block");
+  // num=5 или список num=2,3,5: одно действие всем блокам списка
+  // (блоки одной Mega уходят одним кадром GROUP, обе Mega - AT)
+  server.on("/api/block", HTTP_POST, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
+
+    String numArg = request->arg("num");
+    String action = request->arg("action");
+    int duration = request->arg("duration").toInt();
+    long target = request->hasArg("pos") ? request->arg("pos").toInt() : -1;
+    int8_t priority = requestPriority(request);
+    if (priority < 0) {
+      request->send(400, "text/plain", "ERROR:Invalid priority");
       return;
     }
 
-    if (duration <= 0) duration = DEFAULT_DURATION_MS;
+    int blockNums[TOTAL_BLOCKS];
+    uint8_t count = 0;
+    uint16_t seen = 0;
+    const char* p = numArg.c_str();
+    while (true) {
+      char* end;
+      long blockNum = strtol(p, &end, 10);
+      if (end == p || blockNum < 1 || blockNum > TOTAL_BLOCKS || (*end != ',' && *end != '\0')) {
+        request->send(400, "text/plain", "ERROR:Invalid block");
+        return;
+      }
+      if (seen & (1 << blockNum)) {
+        request->send(400, "text/plain", "ERROR:Duplicate block");
+        return;
+      }
+      seen |= (1 << blockNum);
+      blockNums[count++] = (int)blockNum;
+      if (*end == '\0') break;
+      p = end + 1;
+    }
 
-    // Лимит активных блоков
-    if ((action == "UP" || action == "DOWN") && activeBlocksCount >= MAX_ACTIVE_BLOCKS && !blockStates[blockNum].isActive) {
-      server.send(429, "text/plain", "ERROR:Max active");
+    const char* actionStr = action.c_str();
+    uint8_t act = megaLinkTakeAction(actionStr);
+    if (act == MEGA_ACTION_NONE) {
+      request->send(400, "text/plain", "ERROR:Invalid action");
       return;
     }
 
-    // Формат команды: BLOCK:5:UP:10000
-    String cmd = "BLOCK:" + String(blockNum) + ":" + action + ":" + String(duration);
+    BatchCommand cmds[TOTAL_BLOCKS];
+    for (uint8_t i = 0; i < count; i++) {
+      int httpCode;
+      const char* err = prepareBlockCommand(cmds[i], blockNums[i], act, duration, target, httpCode);
+      if (err) {
+        request->send(httpCode, "text/plain", err);
+        return;
+      }
+    }
 
-    // Роутинг через общий конфиг
-    const BlockConfig* cfg = getBlockConfig(blockNum);
-    if (cfg->megaNum == 1) {
-      Mega1Serial.println(cmd);
-      Serial.println("[MEGA1 TX] " + cmd);
+    // Сверх бюджета питания - в очередь (priority=1 - вперёд обычных)
+    uint8_t queuePos = admitBlockCommands(cmds, count, priority);
+
+    if (count == 1) {
+      Serial.printf("[BLOCK] %d %s %dms (power: %u/%u)\n", blockNums[0], action.c_str(),
+        cmds[0].expectedMs, activeActuators, MAX_ACTIVE_ACTUATORS);
     } else {
-      Mega2Serial.println(cmd);
-      Serial.println("[MEGA2 TX] " + cmd);
+      Serial.printf("[BLOCK] %s %s (power: %u/%u)\n", numArg.c_str(), action.c_str(),
+        activeActuators, MAX_ACTIVE_ACTUATORS);
     }
+    sendAdmission(request, queuePos);
+  });
 
-    // Обновить состояние
-    blockStates[blockNum].isActive = (action != "STOP");
-    blockStates[blockNum].startTime = millis();
-    blockStates[blockNum].duration = duration;
+  // Сцена одним запросом:
+  //   POST /api/batch  [{"block":5,"action":"UP","duration":10000},
+  //                     {"block":12,"action":"UP","duration":10000}]
+  // Набор проверяется целиком: при любой ошибке не отправляется ни одна
+  // команда. Ходы сверх бюджета питания ждут в очереди (202 QUEUED:N).
+  server.on("/api/batch", HTTP_POST, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
+
+    const char* body = (const char*)request->_tempObject;
+    if (body == nullptr) {
+      request->send(400, "text/plain", "ERROR:Empty or too large body");
+      return;
+    }
 
-    // Пересчитать активные
-    activeBlocksCount = 0;
-    for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-      if (blockStates[i].isActive) activeBlocksCount++;
-    }
-
-    // ===== LED УПРАВЛЕНИЕ =====
-    if (action == "UP") {
-      // ВАЖНО: Отменить fade OUT ТОЛЬКО для блоков которые пересекаются по кругам
-      // Проверяем пересечение по сектору (соседние блоки используют один круг)
-      int currentSector = (blockNum - 1) / 2;
-
-      for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-        if (i != blockNum && fadeOutStates[i].isActive) {
-          int otherSector = (i - 1) / 2;
-
-          // Пересечение если:
-          // 1. Одинаковый сектор (блоки 1-2, 3-4, 5-6 и т.д.)
-          // 2. Соседние сектора (круги могут пересекаться)
-          bool sameOrAdjacentSector = (currentSector == otherSector) ||
-                                      (abs(currentSector - otherSector) == 1) ||
-                                      (currentSector == 0 && otherSector == 7) ||
-                                      (currentSector == 7 && otherSector == 0);
-
-          if (sameOrAdjacentSector) {
-            fadeOutStates[i].isActive = false;
-            Serial.printf("[LED] Block %d fade OUT cancelled (circle overlap with block %d)\n", i, blockNum);
-          }
-        }
+    int8_t priority = requestPriority(request);
+    if (priority < 0) {
+      request->send(400, "text/plain", "ERROR:Invalid priority");
+      return;
+    }
+
+    JsonDocument doc;
+    if (deserializeJson(doc, body) || !doc.is<JsonArray>()) {
+      request->send(400, "text/plain", "ERROR:Invalid JSON");
+      return;
+    }
+
+    JsonArray list = doc.as<JsonArray>();
+    if (list.size() == 0 || list.size() > TOTAL_BLOCKS) {
+      request->send(400, "text/plain", "ERROR:Invalid batch size");
+      return;
+    }
+
+    BatchCommand cmds[TOTAL_BLOCKS];
+    uint8_t count = 0;
+    uint16_t seen = 0;
+
+    for (JsonVariant item : list) {
+      int blockNum = item["block"] | 0;
+      const char* actionStr = item["action"] | "";
+      long duration = item["duration"] | 0L;
+
+      if (blockNum < 1 || blockNum > TOTAL_BLOCKS) {
+        request->send(400, "text/plain", "ERROR:Invalid block");
+        return;
+      }
+      if (seen & (1 << blockNum)) {
+        request->send(400, "text/plain", "ERROR:Duplicate block");
+        return;
+      }
+
+      uint8_t act = megaLinkTakeAction(actionStr);
+      if (act == MEGA_ACTION_NONE) {
+        request->send(400, "text/plain", "ERROR:Invalid action");
+        return;
       }
 
-      // Включить LED зону для этого блока
-      ledStates[blockNum] = true;   // ✅ LED ВКЛ
-      lightUpBlock(blockNum);
-    } else if (action == "DOWN") {
-      // Fade LED зоны
-      ledStates[blockNum] = false;  // ❌ LED ВЫКЛ
-      fadeBlock(blockNum);
-    } else if (action == "STOP") {
-      // Выключить LED зону
-      ledStates[blockNum] = false;  // ❌ LED ВЫКЛ
-      turnOffBlock(blockNum);
-    }
-
-    Serial.printf("[BLOCK] %d %s %dms (active: %d/%d)\n", blockNum, action.c_str(), duration, activeBlocksCount, MAX_ACTIVE_BLOCKS);
-    server.send(200, "text/plain", "OK");
+      int httpCode;
+      const char* err = prepareBlockCommand(cmds[count], blockNum, act, duration, item["pos"] | -1L, httpCode);
+      if (err) {
+        request->send(httpCode, "text/plain", err);
+        return;
+      }
+
+      seen |= (1 << blockNum);
+      count++;
+    }
+
+    // Сверх бюджета питания - в очередь, остальные стартуют вместе
+    uint8_t queuePos = admitBlockCommands(cmds, count, priority);
+
+    Serial.printf("[BATCH] %u blocks, %u queued (power: %u/%u)\n", count, moveQueue.count,
+      activeActuators, MAX_ACTIVE_ACTUATORS);
+    sendAdmission(request, queuePos);
+  }, nullptr, [](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    collectRequestBody(request, data, len, index, total, BATCH_BODY_MAX);
   });
 
-  server.on("/api/stop", HTTP_POST, []() {
-    // CORS заголовки
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
+  server.on("/api/stop", HTTP_POST, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
 
     Serial.println("[API] STOP ALL");
 
-    Mega1Serial.println("ALL:STOP");
-    Mega2Serial.println("ALL:STOP");
+    // Аварийная остановка - и шоу тоже, иначе следующая реплика снова поедет
+    showPlayerStop(showPlayer);
+    stopAllBlocks();
 
-    for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-      blockStates[i].isActive = false;
-      ledStates[i] = false;  // ❌ Выключить все LED
-      fadeInStates[i].isActive = false;   // ❌ Отменить fade IN
-      fadeOutStates[i].isActive = false;  // ❌ Отменить fade OUT
+    request->send(200, "text/plain", "OK");
+  });
+
+  // Шоу: список реплик (JSON тело), сохраняется в LittleFS
+  //   POST /api/show/upload  [{"t":0,"block":3,"action":"UP"},
+  //                           {"t":0,"color":[255,0,0]},
+  //                           {"t":6500,"blocks":[3,7],"action":"DOWN"}]
+  // Список проверяется целиком: при ошибке старое шоу остаётся.
+  server.on("/api/show/upload", HTTP_POST, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
+
+    if (showPlayer.playing) {
+      request->send(409, "text/plain", "ERROR:Show playing");
+      return;
     }
-    activeBlocksCount = 0;
 
-    // Очистить маску и LED
-    memset(mask, 0, sizeof(mask));
-    FastLED.clear(true);
+    const char* body = (const char*)request->_tempObject;
+    if (body == nullptr) {
+      request->send(400, "text/plain", "ERROR:Empty or too large body");
+      return;
+    }
 
-    server.send(200, "text/plain", "OK");
+    JsonDocument doc;
+    if (deserializeJson(doc, body) || !doc.is<JsonArray>()) {
+      request->send(400, "text/plain", "ERROR:Invalid JSON");
+      return;
+    }
+
+    JsonArray list = doc.as<JsonArray>();
+    if (list.size() == 0 || list.size() > SHOW_CUES_MAX) {
+      request->send(400, "text/plain", "ERROR:Invalid show size");
+      return;
+    }
+
+    showUpload.count = 0;
+    for (JsonVariant item : list) {
+      const char* err = parseShowCue(item, showUpload.cues[showUpload.count]);
+      if (err) {
+        request->send(400, "text/plain", err);
+        return;
+      }
+      showUpload.count++;
+    }
+    showTimelineSort(showUpload);
+
+    if (!saveShow(showUpload)) {
+      request->send(500, "text/plain", "ERROR:Show not saved");
+      return;
+    }
+    showTimeline = showUpload;
+
+    Serial.printf("[SHOW] Uploaded %u cues, %lums\n", showTimeline.count,
+      (unsigned long)showTimelineLength(showTimeline));
+    request->send(200, "text/plain", "OK");
+  }, nullptr, [](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    collectRequestBody(request, data, len, index, total, SHOW_BODY_MAX);
+  });
+
+  // ?loop=1 - повтор с периодом = время последней реплики
+  server.on("/api/show/play", HTTP_POST, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
+
+    if (showTimeline.count == 0) {
+      request->send(409, "text/plain", "ERROR:No show");
+      return;
+    }
+
+    unsigned long now = millis();
+    showPlayerStart(showPlayer, now, request->arg("loop") == "1");
+    Serial.printf("[SHOW] Play %u cues%s\n", showTimeline.count, showPlayer.loop ? " (loop)" : "");
+
+    // Реплики t = 0 - сразу, без ожидания прохода loop()
+    runShowCues(now);
+    request->send(200, "text/plain", "OK");
+  });
+
+  // Только останавливает воспроизведение: блоки доезжают свою команду
+  server.on("/api/show/stop", HTTP_POST, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
+
+    showPlayerStop(showPlayer);
+    Serial.println("[SHOW] Stopped");
+    request->send(200, "text/plain", "OK");
+  });
+
+  server.on("/api/show/status", HTTP_GET, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
+
+    String json = "{\"playing\":" + String(showPlayer.playing ? "true" : "false");
+    json += ",\"loop\":" + String(showPlayer.loop ? "true" : "false");
+    json += ",\"stored\":" + String(showStorageReady ? "true" : "false");
+    json += ",\"cues\":" + String(showTimeline.count);
+    json += ",\"lengthMs\":" + String(showTimelineLength(showTimeline));
+    json += ",\"elapsedMs\":" + String(showPlayerElapsed(showPlayer, millis()));
+    json += ",\"next\":" + String(showPlayer.next);
+    json += ",\"passes\":" + String(showPlayer.passes);
+    json += ",\"fired\":" + String(showPlayer.fired);
+    json += ",\"skipped\":" + String(showPlayer.skipped);
+    json += ",\"lateMaxMs\":" + String(showPlayer.lateMaxMs);
+    json += "}";
+    request->send(200, "application/json", json);
   });
 
-  server.on("/api/color", HTTP_POST, []() {
-    // CORS заголовки
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
+  server.on("/api/color", HTTP_POST, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
 
     // Получить RGB параметры из query string
-    int r = server.arg("r").toInt();
-    int g = server.arg("g").toInt();
-    int b = server.arg("b").toInt();
+    int r = request->arg("r").toInt();
+    int g = request->arg("g").toInt();
+    int b = request->arg("b").toInt();
 
     // Валидация (0-255)
     if (r < 0) r = 0;
@@ -519,128 +1055,90 @@ void setup() {
     if (b < 0) b = 0;
     if (b > 255) b = 255;
 
-    // Обновить глобальные переменные
-    gR = r;
-    gG = g;
-    gB = b;
+    // Обновить LED снимок
+    ledControl.r = r;
+    ledControl.g = g;
+    ledControl.b = b;
+    publishLedState();
 
     Serial.printf("[API] LED color set to RGB(%d, %d, %d)\n", r, g, b);
 
-    server.send(200, "text/plain", "OK");
+    request->send(200, "text/plain", "OK");
   });
 
-  server.on("/api/effect", HTTP_POST, []() {
-    // CORS заголовки
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
+  server.on("/api/effect", HTTP_POST, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
 
     // Получить ID эффекта и скорость
-    int id = server.arg("id").toInt();
-    int speed = server.arg("speed").toInt();
+    int id = request->arg("id").toInt();
+    int speed = request->arg("speed").toInt();
 
     // Валидация
     if (id < 0) id = 0;
     if (id > 7) id = 7;
 
     if (speed >= 0 && speed <= 255) {
-      gSpd = speed;
+      ledControl.spd = speed;
     }
 
-    // Обновить эффект
-    gFx = id;
+    // Обновить эффект (heat buffer для Fire очищает render task)
+    ledControl.fx = id;
+    publishLedState();
 
-    // Очистить heat buffer при переключении на Fire
-    if (id == 6) {
-      memset(heat, 0, sizeof(heat));
-    }
-
-    Serial.printf("[API] LED effect set to %d (speed: %d)\n", id, gSpd);
-
-    server.send(200, "text/plain", "OK");
-  });
+    Serial.printf("[API] LED effect set to %d (speed: %d)\n", id, ledControl.spd);
 
-  // OPTIONS для /api/bri
-  server.on("/api/bri", HTTP_OPTIONS, []() {
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-    server.send(204);
+    request->send(200, "text/plain", "OK");
   });
 
-  server.on("/api/bri", HTTP_POST, []() {
-    // CORS заголовки
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
+  server.on("/api/bri", HTTP_POST, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
 
-    int v = server.arg("v").toInt();
+    int v = request->arg("v").toInt();
     if (v < 0) v = 0;
     if (v > 255) v = 255;
 
-    gBri = v;
-    FastLED.setBrightness(gBri);
-    FastLED.show();
+    ledControl.bri = v;
+    publishLedState();
 
-    Serial.printf("[API] LED brightness set to %d\n", gBri);
-    server.send(200, "text/plain", "OK");
+    Serial.printf("[API] LED brightness set to %d\n", ledControl.bri);
+    request->send(200, "text/plain", "OK");
   });
 
-  // OPTIONS для /api/spd
-  server.on("/api/spd", HTTP_OPTIONS, []() {
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-    server.send(204);
-  });
-
-  server.on("/api/spd", HTTP_POST, []() {
-    // CORS заголовки
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
+  server.on("/api/spd", HTTP_POST, [](AsyncWebServerRequest* request) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
 
-    int v = server.arg("v").toInt();
+    int v = request->arg("v").toInt();
     if (v < 0) v = 0;
     if (v > 255) v = 255;
 
-    gSpd = v;
-
-    Serial.printf("[API] LED speed set to %d\n", gSpd);
-    server.send(200, "text/plain", "OK");
-  });
+    ledControl.spd = v;
+    publishLedState();
 
-  // OPTIONS для /api/zones
-  server.on("/api/zones", HTTP_OPTIONS, []() {
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-    server.send(204);
+    Serial.printf("[API] LED speed set to %d\n", ledControl.spd);
+    request->send(200, "text/plain", "OK");
   });
 
-  server.on("/api/zones", HTTP_POST, []() {
-    // CORS заголовки
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-
+  server.on("/api/zones", HTTP_POST, [](AsyncWebServerRequest* request) {
     // Зоны пока не используются, но эндпоинт нужен для совместимости
-    int m = server.arg("m").toInt();
+    int m = request->arg("m").toInt();
 
     Serial.printf("[API] LED zones mask set to %d (not implemented)\n", m);
-    server.send(200, "text/plain", "OK");
+    request->send(200, "text/plain", "OK");
   });
 
   // ===== POWER CONTROL API (ВРЕМЕННО ОТКЛЮЧЕНО) =====
   /*
-  server.on("/api/power/on", HTTP_POST, []() {
+  server.on("/api/power/on", HTTP_POST, [](AsyncWebServerRequest* request) {
     Serial.println("[POWER] Main power ON");
     digitalWrite(RELAY_MAIN_POWER, HIGH);
     mainPowerOn = true;
-    server.send(200, "text/plain", "Power ON");
+    request->send(200, "text/plain", "Power ON");
   });
 
-  server.on("/api/power/off", HTTP_POST, []() {
+  server.on("/api/power/off", HTTP_POST, [](AsyncWebServerRequest* request) {
     Serial.println("[POWER] Main power OFF - stopping all blocks first");
     Mega1Serial.println("ALL:STOP");
     Mega2Serial.println("ALL:STOP");
@@ -652,15 +1150,24 @@ void setup() {
       blockStates[i].isActive = false;
     }
     activeBlocksCount = 0;
-    server.send(200, "text/plain", "Power OFF");
+    request->send(200, "text/plain", "Power OFF");
   });
 
-  server.on("/api/power/status", HTTP_GET, []() {
+  server.on("/api/power/status", HTTP_GET, [](AsyncWebServerRequest* request) {
     String json = "{\"power\":" + String(mainPowerOn ? "true" : "false") + "}";
-    server.send(200, "application/json", json);
+    request->send(200, "application/json", json);
   });
   */
 
+  // SSE: новому клиенту - полное состояние, дальше дельты из loop()
+  events.onConnect([](AsyncEventSourceClient* client) {
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
+    String json = pushStateJson(pushedState, nullptr);
+    client->send(json.c_str(), "state", stateVersion);
+  });
+  server.addHandler(&events);
+
   server.begin();
   Serial.println("[SERVER] Started on port 80");
 
@@ -677,12 +1184,17 @@ void setup() {
     }
     Serial.println("[OTA] Update Start: " + type);
 
+    ControlLock lock;
+    PERF_SCOPE(PERF_STAGE_HTTP);
+
     // Остановить все актуаторы перед обновлением
-    Mega1Serial.println("ALL:STOP");
-    Mega2Serial.println("ALL:STOP");
+    showPlayerStop(showPlayer);
+    megaSendAllStop(1);
+    megaSendAllStop(2);
 
-    // Выключить LED
-    FastLED.clear(true);
+    // Выключить LED (render task гасит ленты и перестаёт выводить кадры)
+    ledControl.outputEnabled = false;
+    publishLedState();
   });
 
   ArduinoOTA.onEnd([]() {
@@ -713,6 +1225,11 @@ void setup() {
     Serial.println(WiFi.softAPIP());
   }
 
+  // ===== RENDER TASK =====
+  xTaskCreatePinnedToCore(renderTask, "render", RENDER_STACK, nullptr,
+                          RENDER_PRIORITY, &renderTaskHandle, RENDER_CORE);
+  Serial.printf("[LED] Render task started on core %d (%d FPS)\n", RENDER_CORE, FPS);
+
   Serial.println("[READY] System initialized!\n");
 }
 
@@ -737,6 +1254,9 @@ struct BlockLEDCoords {
  */
 static BlockLEDCoords blockCoords[TOTAL_BLOCKS + 1];
 
+// Зона блока участками лент (из blockCoords + INNER_/OUTER_START), для маски и fade
+static LedZone blockZones[TOTAL_BLOCKS + 1];
+
 /**
  * Инициализация координат блоков
  * ВАЖНО: Вызывать в setup() ОДИН РАЗ!
@@ -749,74 +1269,79 @@ void initBlockLEDCoords() {
     blockCoords[blockNum].rightRay = RAY[(sector + 1) % 8];
     blockCoords[blockNum].isOuter = (blockNum % 2 == 1);
     blockCoords[blockNum].isSpecial = (blockNum == 15);
+
+    const BlockLEDCoords& coords = blockCoords[blockNum];
+    LedZone& zone = blockZones[blockNum];
+    zone.clear();
+
+    if (coords.isSpecial) {
+      // Блок 15: полные лучи + внутренний круг, БЕЗ внешнего круга!
+      zone.add(coords.leftRay, 0, PIN_LEDS[coords.leftRay]);
+      zone.add(coords.rightRay, 0, PIN_LEDS[coords.rightRay]);
+      zone.add(S_INNER, INNER_START[sector], INNER_COUNT[sector]);
+    } else if (coords.isOuter) {
+      // ВНЕШНИЕ блоки (1,3,5,7,9,11,13): внешняя часть лучей + внешний круг
+      zone.add(coords.leftRay, RAY_OUT_START, RAY_OUT_COUNT);
+      zone.add(coords.rightRay, RAY_OUT_START, RAY_OUT_COUNT);
+      zone.add(S_OUTER, OUTER_START[sector], OUTER_COUNT[sector]);
+    } else {
+      // ВНУТРЕННИЕ блоки (2,4,6,8,10,12,14): внутренняя часть лучей + оба круга
+      zone.add(coords.leftRay, RAY_IN_START, RAY_IN_COUNT);
+      zone.add(coords.rightRay, RAY_IN_START, RAY_IN_COUNT);
+      zone.add(S_INNER, INNER_START[sector], INNER_COUNT[sector]);
+      zone.add(S_OUTER, OUTER_START[sector], OUTER_COUNT[sector]);
+    }
   }
 }
 
 /**
- * Обновить маску для конкретного блока
+ * DEBUG: Показать какие LED входят в зону блока
  */
-void updateMaskForBlock(int blockNum, bool enable) {
+void printBlockLEDZone(int blockNum) {
   if (blockNum < 1 || blockNum > TOTAL_BLOCKS) return;
 
   const BlockLEDCoords& coords = blockCoords[blockNum];
-  uint8_t L = coords.leftRay;
-  uint8_t R = coords.rightRay;
   int sector = coords.sector;
 
-  // DEBUG: Показать что именно включается
-  if (enable) {
-    Serial.printf("[DEBUG] Block %d: sector=%d, rays=%d-%d, type=%s\n",
-      blockNum, sector, L, R,
-      coords.isSpecial ? "SPECIAL" : (coords.isOuter ? "OUTER" : "INNER"));
-  }
+  Serial.printf("[DEBUG] Block %d: sector=%d, rays=%d-%d, type=%s\n",
+    blockNum, sector, coords.leftRay, coords.rightRay,
+    coords.isSpecial ? "SPECIAL" : (coords.isOuter ? "OUTER" : "INNER"));
 
-  if (coords.isSpecial) {
-    // Блок 15: полные лучи + внутренний круг, БЕЗ внешнего круга!
-    for (int j = 0; j < 33; j++) {
-      mask[L][j] = enable;
-      mask[R][j] = enable;
-    }
-    for (int j = 0; j < INNER_COUNT[sector]; j++) {
-      mask[S_INNER][INNER_START[sector] + j] = enable;
-    }
-    if (enable) {
-      Serial.printf("[DEBUG]   Inner circle: LED %d-%d (%d LEDs)\n",
-        INNER_START[sector], INNER_START[sector] + INNER_COUNT[sector] - 1, INNER_COUNT[sector]);
-    }
+  if (coords.isSpecial || !coords.isOuter) {
+    Serial.printf("[DEBUG]   Inner circle: LED %d-%d (%d LEDs)\n",
+      INNER_START[sector], INNER_START[sector] + INNER_COUNT[sector] - 1, INNER_COUNT[sector]);
   }
-  else if (coords.isOuter) {
-    // ВНЕШНИЕ блоки (1,3,5,7,9,11,13): внешняя часть лучей + внешний круг
-    for (int j = RAY_OUT_START; j < RAY_OUT_START + RAY_OUT_COUNT; j++) {
-      mask[L][j] = enable;
-      mask[R][j] = enable;
-    }
-    for (int j = 0; j < OUTER_COUNT[sector]; j++) {
-      mask[S_OUTER][OUTER_START[sector] + j] = enable;
-    }
-    if (enable) {
-      Serial.printf("[DEBUG]   Outer circle: LED %d-%d (%d LEDs)\n",
-        OUTER_START[sector], OUTER_START[sector] + OUTER_COUNT[sector] - 1, OUTER_COUNT[sector]);
-    }
+  if (!coords.isSpecial) {
+    Serial.printf("[DEBUG]   Outer circle: LED %d-%d (%d LEDs)\n",
+      OUTER_START[sector], OUTER_START[sector] + OUTER_COUNT[sector] - 1, OUTER_COUNT[sector]);
   }
-  else {
-    // ВНУТРЕННИЕ блоки (2,4,6,8,10,12,14): внутренняя часть лучей + оба круга
-    for (int j = RAY_IN_START; j < RAY_IN_START + RAY_IN_COUNT; j++) {
-      mask[L][j] = enable;
-      mask[R][j] = enable;
-    }
-    for (int j = 0; j < INNER_COUNT[sector]; j++) {
-      mask[S_INNER][INNER_START[sector] + j] = enable;
-    }
-    for (int j = 0; j < OUTER_COUNT[sector]; j++) {
-      mask[S_OUTER][OUTER_START[sector] + j] = enable;
-    }
-    if (enable) {
-      Serial.printf("[DEBUG]   Inner circle: LED %d-%d (%d LEDs)\n",
-        INNER_START[sector], INNER_START[sector] + INNER_COUNT[sector] - 1, INNER_COUNT[sector]);
-      Serial.printf("[DEBUG]   Outer circle: LED %d-%d (%d LEDs)\n",
-        OUTER_START[sector], OUTER_START[sector] + OUTER_COUNT[sector] - 1, OUTER_COUNT[sector]);
+}
+
+/**
+ * Включить/выключить LED зону блока в снимке (loop / HTTP)
+ * Саму маску пересобирает render task при изменении maskBlocks
+ */
+void setBlockMask(int blockNum, bool enable) {
+  if (blockNum < 1 || blockNum > TOTAL_BLOCKS) return;
+
+  if (enable) ledControl.maskBlocks |= (uint16_t)(1u << blockNum);
+  else ledControl.maskBlocks &= (uint16_t)~(1u << blockNum);
+}
+
+/**
+ * Опубликовать LED состояние для render task
+ * Вызывать после любого изменения ledControl / fade / ledStates
+ */
+void publishLedState() {
+  ledControl.anyLedOn = false;
+  for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+    if (ledStates[i]) {
+      ledControl.anyLedOn = true;
+      break;
     }
   }
+  memcpy(ledControl.fade, fadeStates, sizeof(fadeStates));
+  ledStateBox.publish(ledControl);
 }
 
 /**
@@ -827,43 +1352,10 @@ void updateMaskForBlock(int blockNum, bool enable) {
 void applyFadeBrightnessToBlock(int blockNum, uint8_t fadeBrightness) {
   if (blockNum < 1 || blockNum > TOTAL_BLOCKS) return;
 
-  const BlockLEDCoords& coords = blockCoords[blockNum];
-  uint8_t L = coords.leftRay;
-  uint8_t R = coords.rightRay;
-  int sector = coords.sector;
-
-  if (coords.isSpecial) {
-    // Блок 15: полные лучи + внутренний круг
-    for (int j = 0; j < 33; j++) {
-      leds[L][j].nscale8(fadeBrightness);
-      leds[R][j].nscale8(fadeBrightness);
-    }
-    for (int j = 0; j < INNER_COUNT[sector]; j++) {
-      leds[S_INNER][INNER_START[sector] + j].nscale8(fadeBrightness);
-    }
-  }
-  else if (coords.isOuter) {
-    // ВНЕШНИЕ блоки: внешняя часть лучей + внешний круг
-    for (int j = RAY_OUT_START; j < RAY_OUT_START + RAY_OUT_COUNT; j++) {
-      leds[L][j].nscale8(fadeBrightness);
-      leds[R][j].nscale8(fadeBrightness);
-    }
-    for (int j = 0; j < OUTER_COUNT[sector]; j++) {
-      leds[S_OUTER][OUTER_START[sector] + j].nscale8(fadeBrightness);
-    }
-  }
-  else {
-    // ВНУТРЕННИЕ блоки: внутренняя часть лучей + оба круга
-    for (int j = RAY_IN_START; j < RAY_IN_START + RAY_IN_COUNT; j++) {
-      leds[L][j].nscale8(fadeBrightness);
-      leds[R][j].nscale8(fadeBrightness);
-    }
-    for (int j = 0; j < INNER_COUNT[sector]; j++) {
-      leds[S_INNER][INNER_START[sector] + j].nscale8(fadeBrightness);
-    }
-    for (int j = 0; j < OUTER_COUNT[sector]; j++) {
-      leds[S_OUTER][OUTER_START[sector] + j].nscale8(fadeBrightness);
-    }
+  const LedZone& zone = blockZones[blockNum];
+  for (uint8_t i = 0; i < zone.count; i++) {
+    const LedSpan& span = zone.spans[i];
+    nscale8(&leds[span.strip][span.start], span.count, fadeBrightness);
   }
 }
 
@@ -871,10 +1363,12 @@ void applyFadeBrightnessToBlock(int blockNum, uint8_t fadeBrightness) {
  * Применить маску - выключить неактивные LED
  */
 void applyMask() {
+  if (mask.allOn()) return;
+
   for (int s = 0; s < NUM_STRIPS; s++) {
-    for (uint16_t j = 0; j < PIN_LEDS[s]; j++) {
-      if (!mask[s][j]) leds[s][j] = CRGB::Black;
-    }
+    mask.forEachRun(s, PIN_LEDS[s], false, [s](uint16_t start, uint16_t count) {
+      fill_solid(&leds[s][start], count, CRGB::Black);
+    });
   }
 }
 
@@ -898,12 +1392,12 @@ void lightUpBlock(int blockNum) {
   }
 
   // Обновить маску для этого блока
-  updateMaskForBlock(blockNum, true);
+  setBlockMask(blockNum, true);
+  printBlockLEDZone(blockNum);
 
   // Запустить FADE IN анимацию (1 секунда = плавное появление)
-  fadeInStates[blockNum].isActive = true;
-  fadeInStates[blockNum].startTime = millis();
-  fadeInStates[blockNum].duration = 1000;  // 1 секунда
+  // Если блок ещё гаснет (DOWN) - продолжаем с текущей яркости, а не с 0
+  startBlockFade(blockNum, 255, FADE_IN_MS, FADE_IN_CURVE);
 
   const BlockLEDCoords& coords = blockCoords[blockNum];
   Serial.printf("[LED] Block %d FADE IN started (sector %d, rays %d-%d, %s)\n",
@@ -920,11 +1414,9 @@ void fadeBlock(int blockNum) {
   }
 
   // Запустить FADE OUT анимацию с тем же duration что у актуатора
-  fadeOutStates[blockNum].isActive = true;
-  fadeOutStates[blockNum].startTime = millis();
-  fadeOutStates[blockNum].duration = blockStates[blockNum].duration;
+  startBlockFade(blockNum, 0, blockStates[blockNum].duration, FADE_OUT_CURVE);
 
-  Serial.printf("[LED] Block %d FADE OUT started (%dms)\n", blockNum, fadeOutStates[blockNum].duration);
+  Serial.printf("[LED] Block %d FADE OUT started (%dms)\n", blockNum, blockStates[blockNum].duration);
 }
 
 /**
@@ -935,16 +1427,51 @@ void turnOffBlock(int blockNum) {
     return;
   }
 
-  // Обновить маску - выключить этот блок
-  updateMaskForBlock(blockNum, false);
-
-  // Применить маску - это очистит LED этого блока
-  applyMask();
-  FastLED.show();
+  // Обновить маску - выключить этот блок (погаснет в следующем кадре)
+  setBlockMask(blockNum, false);
+  setBlockFade(blockNum, 0);
 
   Serial.printf("[LED] Block %d OFF (instant)\n", blockNum);
 }
 
+/**
+ * Запустить огибающую зоны блока и взвести таймер её завершения
+ */
+void startBlockFade(int blockNum, uint8_t target, uint32_t duration, uint8_t curve) {
+  unsigned long now = millis();
+  fadeEnvelopeStart(fadeStates[blockNum], target, duration, curve, now);
+  deadlineSet(deadlines, DEADLINE_FADE(blockNum), now + duration);
+}
+
+/**
+ * Зафиксировать уровень зоны блока (fade отменён - таймер тоже)
+ */
+void setBlockFade(int blockNum, uint8_t level) {
+  fadeEnvelopeSet(fadeStates[blockNum], level);
+  deadlineCancel(deadlines, DEADLINE_FADE(blockNum));
+}
+
+/**
+ * Fade зоны блока дошёл до цели (таймер DEADLINE_FADE)
+ * @return true - LED состояние изменилось, нужен publishLedState()
+ */
+bool finishBlockFade(int blockNum, unsigned long now) {
+  if (!fadeEnvelopeDone(fadeStates[blockNum], now)) return false;
+
+  uint8_t level = fadeStates[blockNum].to;
+  fadeEnvelopeSet(fadeStates[blockNum], level);
+
+  if (level == 0) {
+    // Fade OUT завершен - выключаем LED полностью
+    setBlockMask(blockNum, false);  // Убрать из маски
+    Serial.printf("[LED] Block %d FADE OUT completed\n", blockNum);
+  } else {
+    // Fade IN завершен - LED полностью включены
+    Serial.printf("[LED] Block %d FADE IN completed\n", blockNum);
+  }
+  return true;
+}
+
 // ============================================================================
 // LED ЭФФЕКТЫ (из svetdiod-project)
 // ============================================================================
@@ -958,10 +1485,9 @@ void fxPulse() {
 
   // Применить ко ВСЕМ лентам
   for (int s = 0; s < NUM_STRIPS; s++) {
-    for (uint16_t j = 0; j < PIN_LEDS[s]; j++) {
-      leds[s][j] = mask[s][j] ? c : CRGB::Black;
-    }
+    fill_solid(leds[s], PIN_LEDS[s], c);
   }
+  applyMask();  // ✅ Применить маску!
 }
 
 /**
@@ -971,12 +1497,15 @@ void fxRainbow() {
   static uint8_t hue = 0;
   hue += map(gSpd, 0, 255, 1, 5);
 
-  // Генерировать радугу на ВСЕХ лентах
+  // Генерировать радугу только на включенных участках
   for (int s = 0; s < NUM_STRIPS; s++) {
-    for (uint16_t j = 0; j < PIN_LEDS[s]; j++) {
-      leds[s][j] = mask[s][j] ? (CRGB)CHSV(hue + j * 3 + s * 25, 255, 255) : CRGB::Black;
-    }
+    mask.forEachRun(s, PIN_LEDS[s], true, [s](uint16_t start, uint16_t count) {
+      for (uint16_t j = start; j < start + count; j++) {
+        leds[s][j] = CHSV(hue + j * 3 + s * 25, 255, 255);
+      }
+    });
   }
+  applyMask();  // ✅ Применить маску!
 }
 
 /**
@@ -1020,7 +1549,7 @@ void fxSparkle() {
     }
     if (random8() < rate) {
       uint16_t p = random16() % PIN_LEDS[s];
-      if (mask[s][p]) leds[s][p] = CRGB(gR, gG, gB);  // ✅ Проверка маски!
+      if (mask.test(s, p)) leds[s][p] = CRGB(gR, gG, gB);  // ✅ Проверка маски!
     }
   }
   applyMask();  // ✅ Применить маску!
@@ -1034,15 +1563,15 @@ void fxWave() {
   phase += map(gSpd, 0, 255, 50, 600);
 
   for (int s = 0; s < NUM_STRIPS; s++) {
-    for (uint16_t j = 0; j < PIN_LEDS[s]; j++) {
-      if (!mask[s][j]) {  // ✅ Проверка маски!
-        leds[s][j] = CRGB::Black;
-        continue;
+    uint16_t n = PIN_LEDS[s];
+    mask.forEachRun(s, n, true, [s, n](uint16_t start, uint16_t count) {
+      for (uint16_t j = start; j < start + count; j++) {
+        leds[s][j].setRGB(gR, gG, gB);
+        leds[s][j].nscale8(sin8((uint8_t)(j * 255 / n) + (phase >> 8) + s * 40));
       }
-      leds[s][j].setRGB(gR, gG, gB);
-      leds[s][j].nscale8(sin8((uint8_t)(j * 255 / PIN_LEDS[s]) + (phase >> 8) + s * 40));
-    }
+    });
   }
+  applyMask();  // ✅ Применить маску!
 }
 
 /**
@@ -1114,65 +1643,1355 @@ void fxMeteor() {
 }
 
 // ============================================================================
-// MAIN LOOP - СТИЛЬ DroneControl.ino
+// КОМАНДЫ БЛОКОВ (ОБЩЕЕ ДЛЯ /api/block, /api/batch И ШОУ)
 // ============================================================================
 
-void loop() {
-  server.handleClient();
-  ArduinoOTA.handle();  // Обработка OTA обновлений
+/**
+ * Тело POST приходит кусками - собрать в _tempObject (освобождает библиотека)
+ * Больше maxLen - не собирается, handler видит пустое тело
+ */
+void collectRequestBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total, size_t maxLen) {
+  if (total > maxLen) return;
+  if (index == 0) request->_tempObject = calloc(total + 1, 1);
+  if (request->_tempObject == nullptr) return;
+  memcpy((uint8_t*)request->_tempObject + index, data, len);
+}
 
-  // ===== ЧТЕНИЕ ОТВЕТОВ ОТ MEGA =====
-  if (Mega1Serial.available()) {
-    mega1Response = Mega1Serial.readStringUntil('\n');
-    mega1Response.trim();
-    if (mega1Response.length() > 0) {
-      Serial.println("[MEGA1 RX] " + mega1Response);
-
-      if (mega1Response == CMD_PONG) {
-        mega1Alive = true;
-      }
-    }
+/**
+ * Остановить все блоки и погасить их LED зоны (/api/stop, реплика stop)
+ * Очередь ходов тоже очищается - после STOP ничего не должно поехать
+ */
+void stopAllBlocks() {
+  moveQueueClear(moveQueue);
+  megaSendAllStop(1);
+  megaSendAllStop(2);
+
+  for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+    blockMotionEvent(i, MOTION_EV_STOP);
+    travelCancel(blockTravel[i]);
+    ledStates[i] = false;  // ❌ Выключить все LED
+    setBlockFade(i, 0);  // ❌ Отменить fade IN/OUT
   }
 
-  if (Mega2Serial.available()) {
-    mega2Response = Mega2Serial.readStringUntil('\n');
-    mega2Response.trim();
-    if (mega2Response.length() > 0) {
-      Serial.println("[MEGA2 RX] " + mega2Response);
+  // Очистить маску (render task применит со следующего кадра)
+  ledControl.maskBlocks = 0;
+  publishLedState();
+}
 
-      if (mega2Response == CMD_PONG) {
-        mega2Alive = true;
-      }
+/**
+ * Проверить команду блока и собрать её для отправки на Mega
+ * - POS: цель в % (duration Mega = цель), положение блока должно быть известно
+ * - UP / DOWN без duration: ход до упора, таймер ESP32 - по положению из STATUS
+ * @param target Цель POS в % (-1 - не задана)
+ * @return nullptr - готово, иначе текст ошибки (httpCode - 400 / 409)
+ */
+const char* prepareBlockCommand(BatchCommand& out, int blockNum, uint8_t act, long duration, long target, int& httpCode) {
+  unsigned long megaArg = (duration > 0) ? duration : 0;
+  if (act == MEGA_ACTION_POS) {
+    if (target < 0 || target > 100) {
+      httpCode = 400;
+      return "ERROR:Invalid position";
     }
+    if (blockPosition(blockNum) == FRAME_STATUS_POS_UNKNOWN) {
+      httpCode = 409;
+      return "ERROR:Position unknown";
+    }
+    megaArg = target;
+    duration = expectedMoveMs(blockNum, target);
+  } else if (duration <= 0) {
+    duration = expectedMoveMs(blockNum, act == MEGA_ACTION_UP ? 100 : 0);
+  }
+
+  out.blockNum = (uint8_t)blockNum;
+  out.act = act;
+  out.duration = megaArg;
+  out.expectedMs = (int)duration;
+  return nullptr;
+}
+
+/**
+ * Сколько бюджета питания добавит ход блока: его актуаторы, если блок
+ * стоит (движущийся блок новой командой только меняет ход)
+ */
+uint8_t movePowerCost(uint8_t blockNum) {
+  return blockMoving(blockNum) ? 0 : getBlockActuatorCount(blockNum);
+}
+
+/**
+ * Допуск набора по бюджету питания (MAX_ACTIVE_ACTUATORS):
+ * - STOP - сразу, заодно снимает ход блока из очереди
+ * - ход - сразу, если помещается и в очереди нет ходов с тем же или
+ *   большим priority (иначе обгонит их), остальные - в очередь
+ * Всё, что стартует сейчас, уходит одним набором (runBatchCommands)
+ * @return 0 - всё запущено, иначе наибольшее место в очереди среди
+ *         отложенных (когда стартует весь набор)
+ */
+uint8_t admitBlockCommands(const BatchCommand* cmds, uint8_t count, uint8_t priority) {
+  BatchCommand run[TOTAL_BLOCKS];
+  uint8_t runCount = 0;
+  uint8_t load = activeActuators;
+  uint8_t queuePos = 0;
+
+  // Сначала STOP: их актуаторы освобождают бюджет для ходов того же набора
+  for (uint8_t i = 0; i < count; i++) {
+    if (cmds[i].act != MEGA_ACTION_STOP) continue;
+    moveQueueRemove(moveQueue, cmds[i].blockNum);
+    if (blockMoving(cmds[i].blockNum)) load -= getBlockActuatorCount(cmds[i].blockNum);
+    run[runCount++] = cmds[i];
+  }
+
+  bool waiting = moveQueueHasWaiting(moveQueue, priority);
+  for (uint8_t i = 0; i < count; i++) {
+    if (cmds[i].act == MEGA_ACTION_STOP) continue;
+
+    uint8_t cost = movePowerCost(cmds[i].blockNum);
+    if (cost == 0 || (!waiting && load + cost <= MAX_ACTIVE_ACTUATORS)) {
+      moveQueueRemove(moveQueue, cmds[i].blockNum);
+      load += cost;
+      run[runCount++] = cmds[i];
+      continue;
+    }
+
+    // Дальше по набору тоже в очередь - порядок набора сохраняется
+    waiting = true;
+    uint8_t pos = moveQueuePush(moveQueue, cmds[i].blockNum, cmds[i].act, cmds[i].duration,
+                                priority, millis());
+    if (pos > queuePos) queuePos = pos;
+    Serial.printf("[POWER] Block %u queued #%u (power: %u/%u)\n", cmds[i].blockNum, pos,
+      load, MAX_ACTIVE_ACTUATORS);
+  }
+
+  if (runCount > 0) runBatchCommands(run, runCount);
+  return queuePos;
+}
+
+/**
+ * Запустить ходы из головы очереди, пока они помещаются в бюджет
+ * Вызывается из loop() после DONE / STATUS / таймаутов - в том же проходе,
+ * в котором освободился бюджет. Положение и время хода считаются заново:
+ * блок мог сдвинуться, пока ждал
+ */
+void admitQueuedMoves() {
+  if (moveQueue.count == 0) return;
+
+  BatchCommand run[TOTAL_BLOCKS];
+  uint8_t runCount = 0;
+  uint8_t load = activeActuators;
+  unsigned long now = millis();
+
+  while (moveQueue.count > 0) {
+    const QueuedMove& m = moveQueue.items[0];
+    uint8_t cost = movePowerCost(m.blockNum);
+    // Больше бюджета целиком (не бывает при весе ≤ бюджета) - когда всё стоит
+    if (load + cost > MAX_ACTIVE_ACTUATORS && load > 0) break;
+
+    bool pos = (m.act == MEGA_ACTION_POS);
+    int httpCode;
+    const char* err = prepareBlockCommand(run[runCount], m.blockNum, m.act,
+      pos ? 0 : (long)m.arg, pos ? (long)m.arg : -1, httpCode);
+    if (err) {
+      Serial.printf("[POWER] Block %u dropped from queue: %s\n", m.blockNum, err);
+      moveQueueRemove(moveQueue, m.blockNum);
+      continue;
+    }
+
+    Serial.printf("[POWER] Block %u started after %lums in queue\n", m.blockNum,
+      (unsigned long)(now - m.queuedMs));
+    load += cost;
+    runCount++;
+    moveQueuePop(moveQueue, now);
+  }
+
+  if (runCount > 0) runBatchCommands(run, runCount);
+}
+
+/**
+ * ?priority= команды блоков: нет / 0 - обычный ход, 1 - вперёд обычных
+ * Остальное - -1 (400): toInt() в uint8_t превратил бы -1 в 255,
+ * а 256 в 0
+ */
+int8_t requestPriority(AsyncWebServerRequest* request) {
+  if (!request->hasArg("priority")) return 0;
+  String arg = request->arg("priority");
+  if (arg == "0") return 0;
+  if (arg == "1") return 1;
+  return -1;
+}
+
+/**
+ * Ответ на команду блоков: 200 OK - всё запущено,
+ * 202 QUEUED:N - часть ходов ждёт бюджет, N - место последнего в очереди
+ */
+void sendAdmission(AsyncWebServerRequest* request, uint8_t queuePos) {
+  if (queuePos == 0) {
+    request->send(200, "text/plain", "OK");
+    return;
+  }
+  request->send(202, "text/plain", "QUEUED:" + String(queuePos));
+}
+
+/**
+ * Отправить проверенный набор на Mega и применить его на ESP32
+ * - группировка по Mega: одна запись в UART на каждую (BLOCK / GROUP / BATCH)
+ * - блоки на обеих Mega: один момент старта в часах каждой (кадры AT)
+ * @return true - старт на обеих Mega синхронизирован
+ */
+bool runBatchCommands(const BatchCommand* cmds, uint8_t count) {
+  BatchCommand groups[3][BATCH_PER_MEGA];
+  uint8_t groupCount[3] = { 0, 0, 0 };
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t megaNum = getBlockConfig(cmds[i].blockNum)->megaNum;
+    groups[megaNum][groupCount[megaNum]++] = cmds[i];
+  }
+
+  uint32_t nowUs = micros();
+  bool synced = groupCount[1] > 0 && groupCount[2] > 0 &&
+                megaClockReady(megaLinks[1].clock, nowUs) &&
+                megaClockReady(megaLinks[2].clock, nowUs);
+  uint32_t atUs = nowUs + MEGA_SYNC_LEAD_MS * 1000UL;
+
+  for (uint8_t megaNum = 1; megaNum <= 2; megaNum++) {
+    if (synced) megaSendBatchAt(megaNum, groups[megaNum], groupCount[megaNum], atUs);
+    else megaSendBatch(megaNum, groups[megaNum], groupCount[megaNum]);
   }
 
-  // ===== ТАЙМАУТЫ БЛОКОВ =====
-  // ВАЖНО: LED НЕ выключается по timeout!
-  // LED остается включенным пока не придет команда STOP или DOWN
-  // Таймаут нужен только для безопасности актуаторов (автостоп после движения)
   unsigned long now = millis();
+  unsigned long startMs = synced ? now + MEGA_SYNC_LEAD_MS : now;
+  for (uint8_t i = 0; i < count; i++) {
+    applyBlockCommand(cmds[i].blockNum, cmds[i].act, cmds[i].duration, cmds[i].expectedMs, now);
+    // Ход меряется от старта до стопа, о котором сообщит Mega
+    BlockTravel& travel = blockTravel[cmds[i].blockNum];
+    if (cmds[i].act == MEGA_ACTION_STOP) travelCancel(travel);
+    else travelStart(travel, startMs, cmds[i].expectedMs);
+  }
+  publishLedState();
+  return synced;
+}
+
+/**
+ * Блок едет (RISING / LOWERING) - занимает бюджет питания и ждёт таймаут
+ */
+bool blockMoving(int blockNum) {
+  return motionMoving(blockStates[blockNum].motion);
+}
+
+/**
+ * Перевести блок в состояние next - единственное место, где меняется
+ * motion: activeBlocksCount и нагрузка на БП правятся на месте, таймаут
+ * движущегося блока (пере)взводится на startTime + duration (их
+ * выставляет вызывающий), остановившегося - снимается
+ */
+void setBlockMotion(int blockNum, uint8_t next) {
+  BlockState& bs = blockStates[blockNum];
+  bool wasMoving = motionMoving(bs.motion);
+  bool moving = motionMoving(next);
+
+  if (next != bs.motion) {
+    Serial.printf("[MOTION] Block %d %s -> %s\n", blockNum, motionName(bs.motion), motionName(next));
+    bs.motion = next;
+  }
+
+  if (moving && !wasMoving) {
+    activeBlocksCount++;
+    activeActuators += getBlockActuatorCount(blockNum);
+  } else if (!moving && wasMoving) {
+    activeBlocksCount--;
+    activeActuators -= getBlockActuatorCount(blockNum);
+  }
 
+  if (moving) deadlineSet(deadlines, DEADLINE_BLOCK(blockNum), bs.startTime + bs.duration);
+  else deadlineCancel(deadlines, DEADLINE_BLOCK(blockNum));
+}
+
+/**
+ * Применить событие автомата (STOP, DONE, FAULT)
+ * @return true - состояние изменилось
+ */
+bool blockMotionEvent(int blockNum, uint8_t event) {
+  BlockState& bs = blockStates[blockNum];
+  uint8_t next = motionNext(bs.motion, event, bs.rest);
+  if (next == bs.motion) return false;
+
+  setBlockMotion(blockNum, next);
+  return true;
+}
+
+/**
+ * Ход блока сорван: NAK, команда без ACK, связь с Mega потеряна
+ * Положение неизвестно до STATUS или новой команды
+ */
+void handleBlockFault(int blockNum, const char* reason) {
+  if (blockNum < 1 || blockNum > TOTAL_BLOCKS) return;
+  if (blockMotionEvent(blockNum, MOTION_EV_FAULT)) {
+    Serial.printf("[FAULT] Block %d: %s\n", blockNum, reason);
+  }
+}
+
+#if MOTION_CHECKS
+/**
+ * Отладочная сборка: производные значения сходятся с состояниями блоков
+ */
+void checkMotionInvariants() {
+  int blocks = 0;
+  uint8_t actuators = 0;
   for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-    if (blockStates[i].isActive) {
-      unsigned long elapsed = now - blockStates[i].startTime;
+    const BlockState& bs = blockStates[i];
+    bool moving = motionMoving(bs.motion);
+    if (bs.motion >= MOTION_COUNT || bs.rest >= MOTION_COUNT || motionMoving(bs.rest)) {
+      Serial.printf("[MOTION] Invariant: block %d state %u rest %u\n", i, bs.motion, bs.rest);
+    }
+    if (moving != deadlinePending(deadlines, DEADLINE_BLOCK(i))) {
+      Serial.printf("[MOTION] Invariant: block %d %s, timer %s\n", i, motionName(bs.motion),
+        moving ? "missing" : "armed");
+    }
+    if (moving) {
+      blocks++;
+      actuators += getBlockActuatorCount(i);
+    }
+  }
+  if (blocks != activeBlocksCount || actuators != activeActuators) {
+    Serial.printf("[MOTION] Invariant: active %d/%d, actuators %u/%u\n", activeBlocksCount, blocks,
+      activeActuators, actuators);
+  }
+}
+#endif
 
-      if (elapsed >= blockStates[i].duration) {
-        Serial.printf("[TIMEOUT] Block %d - actuator stopped, LED stays ON\n", i);
+/**
+ * Обновить автомат блока и его LED зону после отправки команды на Mega
+ * - UP / DOWN: RISING / LOWERING до упора
+ * - POS: направление - от положения по STATUS, rest - по цели
+ * Не публикует LED - это делает вызывающий (один раз на набор)
+ * @param arg Как BatchCommand::duration (POS - цель в %)
+ * @param now Общее время старта (весь batch стартует в одну миллисекунду)
+ */
+void applyBlockCommand(int blockNum, uint8_t act, unsigned long arg, int duration, unsigned long now) {
+  BlockState& bs = blockStates[blockNum];
+  if (act == MEGA_ACTION_STOP) {
+    blockMotionEvent(blockNum, MOTION_EV_STOP);
+  } else {
+    bool raise = (act == MEGA_ACTION_UP);
+    bs.rest = raise ? MOTION_UP : MOTION_IDLE_DOWN;
+    if (act == MEGA_ACTION_POS) {
+      uint8_t pos = blockPosition(blockNum);
+      raise = (pos == FRAME_STATUS_POS_UNKNOWN) ? arg > 0 : arg > pos;
+      bs.rest = motionRestAt((uint8_t)arg);
+    }
+    bs.startTime = now;
+    bs.duration = duration;
+    setBlockMotion(blockNum, raise ? MOTION_RISING : MOTION_LOWERING);
+  }
 
-        // Блок больше не активен (актуатор остановился)
-        blockStates[i].isActive = false;
+  // ===== LED УПРАВЛЕНИЕ =====
+  // POS для LED - как UP / DOWN (blockMoveAction), а не по направлению хода
+  uint8_t led = blockMoveAction(act, arg);
+  if (led == MEGA_ACTION_UP) {
+    // ВАЖНО: Отменить fade OUT ТОЛЬКО для блоков которые пересекаются по кругам
+    // Проверяем пересечение по сектору (соседние блоки используют один круг)
+    int currentSector = (blockNum - 1) / 2;
 
-        // НЕ выключаем LED! LED остается включенным до STOP/DOWN
-        // turnOffBlock(i);  ← УБРАНО
+    for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+      if (i != blockNum && fadeEnvelopeFalling(fadeStates[i])) {
+        int otherSector = (i - 1) / 2;
+
+        // Пересечение если:
+        // 1. Одинаковый сектор (блоки 1-2, 3-4, 5-6 и т.д.)
+        // 2. Соседние сектора (круги могут пересекаться)
+        bool sameOrAdjacentSector = (currentSector == otherSector) ||
+                                    (abs(currentSector - otherSector) == 1) ||
+                                    (currentSector == 0 && otherSector == 7) ||
+                                    (currentSector == 7 && otherSector == 0);
+
+        if (sameOrAdjacentSector) {
+          setBlockFade(i, 255);
+          Serial.printf("[LED] Block %d fade OUT cancelled (circle overlap with block %d)\n", i, blockNum);
+        }
+      }
+    }
 
-        // Пересчитать активные
-        activeBlocksCount = 0;
-        for (int k = 1; k <= TOTAL_BLOCKS; k++) {
-          if (blockStates[k].isActive) activeBlocksCount++;
+    // Включить LED зону для этого блока
+    ledStates[blockNum] = true;   // ✅ LED ВКЛ
+    lightUpBlock(blockNum);
+  } else if (led == MEGA_ACTION_DOWN) {
+    // Fade LED зоны
+    ledStates[blockNum] = false;  // ❌ LED ВЫКЛ
+    fadeBlock(blockNum);
+  } else if (led == MEGA_ACTION_STOP) {
+    // Выключить LED зону
+    ledStates[blockNum] = false;  // ❌ LED ВЫКЛ
+    turnOffBlock(blockNum);
+  }
+}
+
+// ============================================================================
+// ШОУ (SHOW_TIMELINE.h)
+// ============================================================================
+
+/**
+ * Разобрать реплику загрузки:
+ *   {"t":0,"block":3,"action":"UP","duration":6000}  - как /api/block
+ *   {"t":0,"blocks":[3,7],"action":"POS","pos":60}
+ *   {"t":500,"color":[255,0,0]}   {"t":500,"effect":2,"speed":100}
+ *   {"t":800,"bri":128}           {"t":9000,"stop":true}
+ * @return nullptr - готово, иначе текст ошибки
+ */
+const char* parseShowCue(JsonVariant item, ShowCue& cue) {
+  long t = item["t"] | -1L;
+  if (t < 0) return "ERROR:Invalid time";
+
+  memset(&cue, 0, sizeof(cue));
+  cue.atMs = (uint32_t)t;
+
+  if (item["block"].is<int>() || item["blocks"].is<JsonArray>()) {
+    if (item["block"].is<int>()) {
+      int blockNum = item["block"];
+      if (blockNum < 1 || blockNum > TOTAL_BLOCKS) return "ERROR:Invalid block";
+      cue.blocks = (1 << blockNum);
+    } else {
+      for (JsonVariant b : item["blocks"].as<JsonArray>()) {
+        int blockNum = b | 0;
+        if (blockNum < 1 || blockNum > TOTAL_BLOCKS) return "ERROR:Invalid block";
+        cue.blocks |= (1 << blockNum);
+      }
+      if (cue.blocks == 0) return "ERROR:Invalid block";
+    }
+
+    const char* actionStr = item["action"] | "";
+    cue.act = megaLinkTakeAction(actionStr);
+    if (cue.act == MEGA_ACTION_NONE) return "ERROR:Invalid action";
+
+    if (cue.act == MEGA_ACTION_POS) {
+      long target = item["pos"] | -1L;
+      if (target < 0 || target > 100) return "ERROR:Invalid position";
+      cue.arg = target;
+    } else {
+      long duration = item["duration"] | 0L;
+      cue.arg = (duration > 0) ? duration : 0;
+    }
+    cue.type = SHOW_CUE_BLOCK;
+    return nullptr;
+  }
+
+  if (item["color"].is<JsonArray>()) {
+    JsonArray rgb = item["color"].as<JsonArray>();
+    if (rgb.size() != 3) return "ERROR:Invalid color";
+    for (JsonVariant c : rgb) {
+      int v = c | -1;
+      if (v < 0 || v > 255) return "ERROR:Invalid color";
+      cue.arg = (cue.arg << 8) | v;
+    }
+    cue.type = SHOW_CUE_COLOR;
+    return nullptr;
+  }
+
+  if (item["effect"].is<int>()) {
+    int id = item["effect"];
+    if (id < 0 || id > 7) return "ERROR:Invalid effect";
+    cue.act = id;
+    cue.arg = item["speed"] | 256L;  // Вне 0-255 - скорость не меняется, как /api/effect
+    cue.type = SHOW_CUE_EFFECT;
+    return nullptr;
+  }
+
+  if (item["bri"].is<int>()) {
+    int v = item["bri"];
+    if (v < 0 || v > 255) return "ERROR:Invalid brightness";
+    cue.arg = v;
+    cue.type = SHOW_CUE_BRI;
+    return nullptr;
+  }
+
+  if (item["stop"] | false) {
+    cue.type = SHOW_CUE_STOP;
+    return nullptr;
+  }
+
+  return "ERROR:Invalid cue";
+}
+
+/**
+ * Записать шоу в LittleFS (целиком, поверх прежнего)
+ */
+bool saveShow(const ShowTimeline& t) {
+  if (!showStorageReady) return false;
+
+  File f = LittleFS.open(SHOW_FILE, "w");
+  if (!f) return false;
+
+  size_t size = showTimelineEncodedSize(t);
+  showTimelineEncode(t, showFileBuf);
+  bool ok = f.write(showFileBuf, size) == size;
+  f.close();
+  return ok;
+}
+
+/**
+ * Загрузить шоу из LittleFS при старте (нет файла - пустое шоу)
+ */
+void loadShow() {
+  showTimeline.count = 0;
+  if (!showStorageReady) {
+    Serial.println("[SHOW] LittleFS not mounted, show is not stored");
+    return;
+  }
+
+  File f = LittleFS.open(SHOW_FILE, "r");
+  if (!f) return;
+
+  size_t size = f.read(showFileBuf, sizeof(showFileBuf));
+  f.close();
+
+  if (showTimelineDecode(showTimeline, showFileBuf, size)) {
+    Serial.printf("[SHOW] Loaded %u cues, %lums\n", showTimeline.count,
+      (unsigned long)showTimelineLength(showTimeline));
+  } else {
+    Serial.println("[SHOW] Stored show is corrupt, ignored");
+  }
+}
+
+/**
+ * Исполнить наступившие реплики шоу (из loop() и сразу при play)
+ * Блоки всех реплик прохода - одним набором, как /api/batch: GROUP на
+ * одной Mega, AT с общим стартом на обеих; сверх бюджета питания - в
+ * очередь. Реплика, которую нельзя исполнить (положение неизвестно),
+ * пропускается - шоу идёт
+ */
+void runShowCues(unsigned long now) {
+  if (!showPlayer.playing) return;
+
+  BatchCommand cmds[TOTAL_BLOCKS];
+  uint8_t count = 0;
+  bool ledChanged = false;
+
+  const ShowCue* cue;
+  while ((cue = showPlayerNext(showPlayer, showTimeline, now)) != nullptr) {
+    switch (cue->type) {
+      case SHOW_CUE_BLOCK: {
+        bool pos = (cue->act == MEGA_ACTION_POS);
+        for (int blockNum = 1; blockNum <= TOTAL_BLOCKS; blockNum++) {
+          if (!(cue->blocks & (1 << blockNum))) continue;
+
+          // Блок уже в наборе этого прохода - действует последняя реплика
+          uint8_t i = 0;
+          while (i < count && cmds[i].blockNum != blockNum) i++;
+
+          int httpCode;
+          const char* err = prepareBlockCommand(cmds[i], blockNum, cue->act,
+            pos ? 0 : (long)cue->arg, pos ? (long)cue->arg : -1, httpCode);
+          if (err) {
+            showPlayer.skipped++;
+            Serial.printf("[SHOW] t=%lu block %d skipped: %s\n", (unsigned long)cue->atMs, blockNum, err);
+            continue;
+          }
+          if (i == count) count++;
         }
+        break;
       }
+
+      case SHOW_CUE_COLOR:
+        ledControl.r = (cue->arg >> 16) & 0xFF;
+        ledControl.g = (cue->arg >> 8) & 0xFF;
+        ledControl.b = cue->arg & 0xFF;
+        ledChanged = true;
+        break;
+
+      case SHOW_CUE_EFFECT:
+        ledControl.fx = cue->act;
+        if (cue->arg <= 255) ledControl.spd = cue->arg;
+        ledChanged = true;
+        break;
+
+      case SHOW_CUE_BRI:
+        ledControl.bri = cue->arg;
+        ledChanged = true;
+        break;
+
+      case SHOW_CUE_STOP:
+        count = 0;  // Блоки раньше в этом проходе тоже остановлены
+        stopAllBlocks();
+        break;
+    }
+  }
+
+  if (count > 0) admitBlockCommands(cmds, count, 0);
+  if (ledChanged) publishLedState();
+
+  if (!showPlayer.playing) Serial.printf("[SHOW] Finished (late max %lums)\n", (unsigned long)showPlayer.lateMaxMs);
+}
+
+// ============================================================================
+// ОТВЕТЫ ОТ MEGA
+// ============================================================================
+
+/**
+ * Обработать одну полную строку от Mega (без String)
+ * @param megaNum Номер Mega (1 или 2)
+ * @param line Строка без '\r\n'
+ */
+void handleMegaLine(uint8_t megaNum, const char* line) {
+  Serial.printf("[MEGA%d RX] %s\n", megaNum, line);
+
+  MegaLink& link = megaLinks[megaNum];
+
+  MegaReply reply;
+  if (!parseMegaReply(line, reply)) return;
+
+  if (reply.type == MEGA_REPLY_PONG) {
+    markMegaAlive(megaNum);
+  }
+  else if (reply.type == MEGA_REPLY_ACK) {
+    latencyTextReply(link.latency, micros());
+  }
+  else if (reply.type == MEGA_REPLY_DONE) {
+    handleBlockDone(reply.blockNum);
+  }
+  else if (reply.type == MEGA_REPLY_PROTO) {
+    // Mega согласилась на кадры
+    if (atoi(reply.detail) >= FRAME_PROTO_VERSION && link.proto != FRAME_PROTO_VERSION) {
+      link.proto = FRAME_PROTO_VERSION;
+      latencyTextDrop(link.latency);
+      Serial.printf("[MEGA%d] Protocol v%d (binary frames)\n", megaNum, FRAME_PROTO_VERSION);
+    }
+    markMegaAlive(megaNum);
+  }
+  else if (reply.type == MEGA_REPLY_ERROR && strcmp(reply.detail, "Unknown command") == 0) {
+    // Единственная неизвестная для v3 команда - PROTO:4
+    if (!link.textOnly) {
+      link.textOnly = true;
+      Serial.printf("[MEGA%d] Firmware v3 - staying on text protocol\n", megaNum);
+    }
+  }
+  else if (reply.type == MEGA_REPLY_ERROR) {
+    // Ответ на команду (ERR:BLOCK:n:... / ERROR:...) - тоже по порядку строк
+    latencyTextReply(link.latency, micros());
+    link.latency.rejected++;
+  }
+}
+
+/**
+ * Кадр состояния Mega: реле - источник истины для blockStates
+ * - Mega: блок стоит, ESP32: движется (DONE потерян, Mega перезагрузилась) - стоп
+ * - Mega: движется, ESP32: стоит (свой таймаут раньше Mega) - движется
+ * - Конец движения по таймеру ESP32 выравнивается по остатку на Mega
+ * Блоки с командой моложе MEGA_STATUS_GRACE_MS пропускаются: Mega её ещё не видела
+ */
+void handleMegaStatus(uint8_t megaNum, const Frame& f) {
+  MegaLink& link = megaLinks[megaNum];
+
+  FrameStatus st;
+  if (!frameStatusDecode(f.payload, f.len, st)) {
+    Serial.printf("[MEGA%d RX] Bad STATUS length %u\n", megaNum, f.len);
+    return;
+  }
+
+  markMegaAlive(megaNum);
+
+  if (link.statusFrames > 0 && st.uptimeMs < link.status.uptimeMs) {
+    link.reboots++;
+    Serial.printf("[MEGA%d] Rebooted (uptime %lu ms)\n", megaNum, (unsigned long)st.uptimeMs);
+  }
+
+  unsigned long now = millis();
+  link.status = st;
+  link.statusMs = now;
+  link.statusFrames++;
+
+  for (uint8_t i = 0; i < st.blockCount; i++) {
+    int blockNum = st.firstBlock + i;
+    if (blockNum < 1 || blockNum > TOTAL_BLOCKS) continue;
+
+    // Время хода - по реле Mega, до сверки (она пропускает свежие команды)
+    bool megaMoving = ((st.upMask | st.downMask) >> i) & 1;
+    recordBlockTravel(blockNum, travelObserve(blockTravel[blockNum], megaMoving, now));
+
+    BlockState& bs = blockStates[blockNum];
+    if (now - bs.startTime < MEGA_STATUS_GRACE_MS) continue;
+
+    uint8_t next = motionFromStatus(bs.motion, bs.rest, (st.upMask >> i) & 1, (st.downMask >> i) & 1,
+                                    st.pos[i]);
+    bool moving = motionMoving(next);
+    if (moving != motionMoving(bs.motion)) {
+      Serial.printf("[SYNC] Block %d %s on Mega%d\n", blockNum, moving ? "moving" : "stopped", megaNum);
+      if (moving) bs.startTime = now;
+      link.resyncs++;
     }
+
+    // Остаток не поместился в кадр - свой таймер точнее
+    bool retimed = moving && st.remain[i] != FRAME_STATUS_REMAIN_MAX;
+    if (retimed) {
+      bs.duration = (int)(now - bs.startTime + (unsigned long)st.remain[i] * FRAME_STATUS_REMAIN_MS);
+    }
+
+    if (next != bs.motion || retimed) setBlockMotion(blockNum, next);
   }
+}
+
+/**
+ * Положение блока в % по последнему STATUS его Mega
+ * @return FRAME_STATUS_POS_UNKNOWN - Mega его не знает, без STATUS или без связи
+ */
+uint8_t blockPosition(int blockNum) {
+  const BlockConfig* cfg = getBlockConfig(blockNum);
+  if (cfg == nullptr) return FRAME_STATUS_POS_UNKNOWN;
+
+  const MegaLink& link = megaLinks[cfg->megaNum];
+  bool alive = (cfg->megaNum == 1) ? mega1Alive : mega2Alive;
+  int idx = blockNum - link.status.firstBlock;
+  if (!alive || link.statusFrames == 0 || idx < 0 || idx >= link.status.blockCount) {
+    return FRAME_STATUS_POS_UNKNOWN;
+  }
+  return link.status.pos[idx];
+}
+
+/**
+ * Сколько Mega будет вести блок к цели (% хода) - для таймера и fade на ESP32
+ * Положение неизвестно - Mega возьмёт DEFAULT_DURATION_MS
+ */
+int expectedMoveMs(int blockNum, uint8_t target) {
+  uint8_t pos = blockPosition(blockNum);
+  if (pos == FRAME_STATUS_POS_UNKNOWN) return DEFAULT_DURATION_MS;
+  return (int)positionTravelMs(pos * (POS_FULL / 100), target * (POS_FULL / 100));
+}
+
+/**
+ * POS для LED и лимита активных: цель выше низа - как UP (зона горит),
+ * низ - как DOWN (fade OUT)
+ */
+uint8_t blockMoveAction(uint8_t act, unsigned long arg) {
+  if (act != MEGA_ACTION_POS) return act;
+  return (arg > 0) ? MEGA_ACTION_UP : MEGA_ACTION_DOWN;
+}
+
+/**
+ * Mega остановила блок по своему таймеру (DONE:n) - не ждать свой таймаут
+ */
+void handleBlockDone(uint8_t blockNum) {
+  if (blockNum < 1 || blockNum > TOTAL_BLOCKS) return;
+
+  recordBlockTravel(blockNum, travelEnd(blockTravel[blockNum], millis()));
+  if (!blockMoving(blockNum)) return;
+
+  blockMotionEvent(blockNum, MOTION_EV_DONE);
+  Serial.printf("[DONE] Block %d stopped by Mega, LED stays ON\n", blockNum);
+}
+
+/**
+ * Учесть измеренный ход блока: гистограмма его Mega, флаг дрейфа
+ * @param travelMs Из travelEnd / travelObserve (-1 - ход не закончился)
+ */
+void recordBlockTravel(int blockNum, int32_t travelMs) {
+  if (travelMs < 0) return;
+
+  const BlockTravel& t = blockTravel[blockNum];
+  perfHistAdd(megaLinks[getBlockConfig(blockNum)->megaNum].latency.travelMs, (uint32_t)travelMs);
+
+  uint16_t bit = (uint16_t)(1u << blockNum);
+  bool drifting = travelDrifting(t);
+  if (drifting == ((driftingBlocks & bit) != 0)) return;
+
+  if (drifting) {
+    driftingBlocks |= bit;
+    Serial.printf("[LATENCY] Block %d travel drifts %+ldms (last %ldms, expected %lums)\n", blockNum,
+      (long)t.driftMs, (long)travelMs, (unsigned long)t.expectedMs);
+  } else {
+    driftingBlocks &= ~bit;
+    Serial.printf("[LATENCY] Block %d travel back on time\n", blockNum);
+  }
+}
+
+void markMegaAlive(uint8_t megaNum) {
+  MegaLink& link = megaLinks[megaNum];
+  link.lastReplyMs = millis();
+  link.baudProbeMs = 0;
+
+  bool& alive = (megaNum == 1) ? mega1Alive : mega2Alive;
+  if (!alive && link.legacyBaud) {
+    Serial.printf("[MEGA%d] WARNING: answers at %d 8N1 - old firmware, flash actuator_mega%d_v3\n",
+                  megaNum, MEGA_LEGACY_BAUD, megaNum);
+  }
+  alive = true;
+}
+
+/**
+ * Перезапустить UART к Mega на новой или старой скорости
+ * Протокол заново согласуется на следующем heartbeat (link.proto уже 3)
+ */
+void megaLinkSetBaud(uint8_t megaNum, bool legacy) {
+  MegaLink& link = megaLinks[megaNum];
+  int8_t rx = (megaNum == 1) ? MEGA1_RX : MEGA2_RX;
+  int8_t tx = (megaNum == 1) ? MEGA1_TX : MEGA2_TX;
+
+  link.port->end();
+  if (legacy) link.port->begin(MEGA_LEGACY_BAUD, SERIAL_8N1, rx, tx);
+  else link.port->begin(MEGA_LINK_BAUD, SERIAL_8E1, rx, tx);
+
+  link.legacyBaud = legacy;
+  link.frameRx.reset();
+  link.lineRx = LineReader();
+  link.baudSwitches++;
+  Serial.printf("[MEGA%d] Probing %d baud\n", megaNum, legacy ? MEGA_LEGACY_BAUD : MEGA_LINK_BAUD);
+}
+
+// ============================================================================
+// КАНАЛ К MEGA (ОТПРАВКА, ПОВТОРЫ, КАДРЫ)
+// ============================================================================
+
+/**
+ * Отправить кадр v4 и запомнить его до ACK
+ * @param track false для PING (его повторяет сам heartbeat)
+ */
+void megaSendFrame(uint8_t megaNum, uint8_t op, const uint8_t* payload, uint8_t len, bool track) {
+  MegaLink& link = megaLinks[megaNum];
+
+  // SEQ 0 зарезервирован за кадрами по инициативе Mega (DONE)
+  if (++link.txSeq == 0) link.txSeq = 1;
+
+  uint8_t frame[FRAME_SIZE_MAX];
+  uint8_t n = frameEncode(frame, link.txSeq, op, payload, len);
+  link.port->write(frame, n);
+
+  if (!track) return;
+
+  // Свободный слот, иначе вытесняем самый старый
+  PendingCommand* slot = &link.pending[0];
+  for (uint8_t i = 0; i < MEGA_PENDING_MAX; i++) {
+    if (!link.pending[i].active) {
+      slot = &link.pending[i];
+      break;
+    }
+    if ((long)(link.pending[i].sentAt - slot->sentAt) < 0) slot = &link.pending[i];
+  }
+  if (slot->active) link.lost++;
+
+  slot->active = true;
+  slot->seq = link.txSeq;
+  slot->retries = 0;
+  slot->sentAt = millis();
+  slot->sentUs = micros();
+  slot->len = n;
+  memcpy(slot->frame, frame, n);
+}
+
+/**
+ * Команда блоку: BLOCK:5:UP:10000 (текст) или кадр FRAME_OP_BLOCK (v4)
+ * @param act MEGA_ACTION_UP / DOWN / STOP (= FRAME_ACT_*)
+ */
+void megaSendBlock(uint8_t megaNum, int blockNum, uint8_t act, unsigned long duration) {
+  MegaLink& link = megaLinks[megaNum];
+  const char* actName = megaActionName((MegaAction)act);
+
+  if (link.proto == FRAME_PROTO_VERSION) {
+    uint8_t payload[6];
+    payload[0] = (uint8_t)blockNum;
+    payload[1] = act;
+    framePutU32(&payload[2], duration);
+    megaSendFrame(megaNum, FRAME_OP_BLOCK, payload, sizeof(payload), true);
+    Serial.printf("[MEGA%d TX] #%u BLOCK:%d:%s:%lu\n", megaNum, link.txSeq, blockNum, actName, duration);
+    return;
+  }
+
+  char cmd[MEGA_LINK_LINE_MAX];
+  snprintf(cmd, sizeof(cmd), "BLOCK:%d:%s:%lu", blockNum, actName, duration);
+  link.port->println(cmd);
+  latencyTextSent(link.latency, micros());
+  Serial.printf("[MEGA%d TX] %s\n", megaNum, cmd);
+}
+
+/**
+ * Маска блоков пакета, если у всех одно действие и одна длительность
+ * (бит n-1 = блок n), иначе 0
+ */
+uint16_t batchGroupMask(const BatchCommand* cmds, uint8_t count) {
+  uint16_t mask = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (cmds[i].act != cmds[0].act || cmds[i].duration != cmds[0].duration) return 0;
+    mask |= FRAME_GROUP_BIT(cmds[i].blockNum);
+  }
+  return mask;
+}
+
+/**
+ * Кадр FRAME_OP_BATCH (только v4)
+ */
+void megaSendBatchFrame(uint8_t megaNum, const BatchCommand* cmds, uint8_t count) {
+  uint8_t payload[FRAME_PAYLOAD_MAX];
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t* e = &payload[i * FRAME_BATCH_ENTRY];
+    e[0] = cmds[i].blockNum;
+    e[1] = cmds[i].act;
+    framePutU32(&e[2], cmds[i].duration);
+  }
+  megaSendFrame(megaNum, FRAME_OP_BATCH, payload, count * FRAME_BATCH_ENTRY, true);
+  Serial.printf("[MEGA%d TX] #%u BATCH x%u\n", megaNum, megaLinks[megaNum].txSeq, count);
+}
+
+/**
+ * Кадр FRAME_OP_GROUP (только v4): одно действие блокам маски
+ */
+void megaSendGroup(uint8_t megaNum, uint16_t mask, uint8_t act, unsigned long duration) {
+  uint8_t payload[FRAME_GROUP_SIZE];
+  framePutU16(payload, mask);
+  payload[2] = act;
+  framePutU32(&payload[3], duration);
+  megaSendFrame(megaNum, FRAME_OP_GROUP, payload, sizeof(payload), true);
+  Serial.printf("[MEGA%d TX] #%u GROUP:%u:%s:%lu\n", megaNum, megaLinks[megaNum].txSeq, mask,
+    megaActionName((MegaAction)act), duration);
+}
+
+/**
+ * Несколько блоков одной Mega одной записью в UART
+ * v4: одно действие и время - кадр FRAME_OP_GROUP (маска блоков), иначе
+ *     FRAME_OP_BATCH; Mega проверяет весь пакет, потом включает реле
+ *     одной записью в порты
+ * v3: строки BLOCK:... подряд одним write (GROUP не шлём: старая Mega
+ *     ответит только ERROR, без отката)
+ * @param count Не больше BATCH_PER_MEGA
+ */
+void megaSendBatch(uint8_t megaNum, const BatchCommand* cmds, uint8_t count) {
+  MegaLink& link = megaLinks[megaNum];
+  if (count == 0) return;
+
+  if (count == 1) {
+    megaSendBlock(megaNum, cmds[0].blockNum, cmds[0].act, cmds[0].duration);
+    return;
+  }
+
+  if (link.proto == FRAME_PROTO_VERSION) {
+    uint16_t mask = batchGroupMask(cmds, count);
+    if (mask) megaSendGroup(megaNum, mask, cmds[0].act, cmds[0].duration);
+    else megaSendBatchFrame(megaNum, cmds, count);
+    return;
+  }
+
+  char text[BATCH_PER_MEGA * BATCH_TEXT_LINE];
+  size_t len = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    len += snprintf(text + len, sizeof(text) - len, "BLOCK:%u:%s:%lu\r\n",
+                    cmds[i].blockNum, megaActionName((MegaAction)cmds[i].act), cmds[i].duration);
+  }
+  link.port->write((const uint8_t*)text, len);
+  uint32_t sentUs = micros();
+  for (uint8_t i = 0; i < count; i++) latencyTextSent(link.latency, sentUs);
+  Serial.printf("[MEGA%d TX] %u x BLOCK (text)\n", megaNum, count);
+}
+
+/**
+ * Пакет блоков одной Mega со стартом в момент atUs (micros() ESP32)
+ * Время переводится в часы Mega; без оценки часов - обычный BATCH сразу
+ * @param count Не больше BATCH_PER_MEGA
+ */
+void megaSendBatchAt(uint8_t megaNum, const BatchCommand* cmds, uint8_t count, uint32_t atUs) {
+  MegaLink& link = megaLinks[megaNum];
+  if (count == 0) return;
+
+  if (link.proto != FRAME_PROTO_VERSION || !link.clock.valid) {
+    megaSendBatch(megaNum, cmds, count);
+    return;
+  }
+
+  uint8_t payload[FRAME_PAYLOAD_MAX];
+  framePutU32(payload, megaClockToMega(link.clock, atUs));
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t* e = &payload[FRAME_AT_HEADER + i * FRAME_BATCH_ENTRY];
+    e[0] = cmds[i].blockNum;
+    e[1] = cmds[i].act;
+    framePutU32(&e[2], cmds[i].duration);
+  }
+  megaSendFrame(megaNum, FRAME_OP_AT, payload, FRAME_AT_HEADER + count * FRAME_BATCH_ENTRY, true);
+  Serial.printf("[MEGA%d TX] #%u AT x%u in %ldus\n", megaNum, link.txSeq, count, (long)(atUs - micros()));
+}
+
+/**
+ * Mega не приняла пакет целиком:
+ * - AT (старая прошивка, очередь полна, время вне окна) - тот же пакет сразу
+ * - GROUP на v4 без FRAME_OP_GROUP (прошивка до group) - те же блоки BATCH
+ * - BATCH на v4 без FRAME_OP_BATCH (прошивка до batch) - по одной команде
+ */
+void megaUnpackBatch(uint8_t megaNum, const PendingCommand& cmd) {
+  if (cmd.frame[3] == FRAME_OP_GROUP) {
+    const uint8_t* payload = &cmd.frame[FRAME_HEADER_SIZE];
+    uint16_t mask = frameGetU16(payload);
+
+    BatchCommand cmds[BATCH_PER_MEGA];
+    uint8_t count = 0;
+    for (uint8_t blockNum = 1; blockNum <= TOTAL_BLOCKS && count < BATCH_PER_MEGA; blockNum++) {
+      if (!(mask & FRAME_GROUP_BIT(blockNum))) continue;
+      cmds[count].blockNum = blockNum;
+      cmds[count].act = payload[2];
+      cmds[count].duration = frameGetU32(&payload[3]);
+      count++;
+    }
+
+    Serial.printf("[MEGA%d] GROUP not supported, resending %u blocks as BATCH\n", megaNum, count);
+    megaSendBatchFrame(megaNum, cmds, count);
+    return;
+  }
+
+  bool at = cmd.frame[3] == FRAME_OP_AT;
+  uint8_t skip = at ? FRAME_AT_HEADER : 0;
+  const uint8_t* payload = &cmd.frame[FRAME_HEADER_SIZE + skip];
+  uint8_t count = (cmd.frame[1] - skip) / FRAME_BATCH_ENTRY;
+
+  BatchCommand cmds[BATCH_PER_MEGA];
+  for (uint8_t i = 0; i < count; i++) {
+    const uint8_t* e = &payload[i * FRAME_BATCH_ENTRY];
+    cmds[i].blockNum = e[0];
+    cmds[i].act = e[1];
+    cmds[i].duration = frameGetU32(&e[2]);
+  }
+
+  if (at) {
+    Serial.printf("[MEGA%d] AT rejected, sending %u blocks now\n", megaNum, count);
+    megaSendBatch(megaNum, cmds, count);
+    return;
+  }
+
+  Serial.printf("[MEGA%d] BATCH not supported, resending %u blocks one by one\n", megaNum, count);
+  for (uint8_t i = 0; i < count; i++) {
+    megaSendBlock(megaNum, cmds[i].blockNum, cmds[i].act, cmds[i].duration);
+  }
+}
+
+void megaSendAllStop(uint8_t megaNum) {
+  MegaLink& link = megaLinks[megaNum];
+
+  if (link.proto == FRAME_PROTO_VERSION) {
+    megaSendFrame(megaNum, FRAME_OP_ALL_STOP, nullptr, 0, true);
+  } else {
+    link.port->println("ALL:STOP");
+    latencyTextSent(link.latency, micros());
+  }
+}
+
+void megaSendPing(uint8_t megaNum) {
+  MegaLink& link = megaLinks[megaNum];
+
+  if (link.proto == FRAME_PROTO_VERSION) {
+    // Отметка времени: Mega вернёт её со своим micros() (MEGA_CLOCK.h)
+    uint8_t payload[4];
+    framePutU32(payload, micros());
+    megaSendFrame(megaNum, FRAME_OP_PING, payload, sizeof(payload), false);
+    return;
+  }
+
+  // Текстовый режим: заодно предложить v4 (старая Mega ответит ERROR один раз)
+  if (!link.textOnly) link.port->println(FRAME_PROTO_HELLO);
+  link.port->println(CMD_PING);
+}
+
+/**
+ * Снять команду из ожидания по SEQ ответа
+ */
+void megaClearPending(MegaLink& link, uint8_t seq) {
+  for (uint8_t i = 0; i < MEGA_PENDING_MAX; i++) {
+    if (link.pending[i].active && link.pending[i].seq == seq) {
+      link.pending[i].active = false;
+      perfHistAdd(link.latency.ackUs, micros() - link.pending[i].sentUs);
+      return;
+    }
+  }
+  link.latency.unmatched++;  // Повторный ACK, ответ после всех повторов
+}
+
+/**
+ * Обработать кадр v4 от Mega
+ */
+void handleMegaFrame(uint8_t megaNum, const Frame& f) {
+  MegaLink& link = megaLinks[megaNum];
+
+  switch (f.op) {
+    case FRAME_OP_PONG:
+      markMegaAlive(megaNum);
+      if (f.len >= 8) {
+        // PONG с отметками на 4 байта длиннее PING: середина RTT сдвинута на 2 байта
+        int32_t asymUs = (int32_t)(2 * (link.legacyBaud ? MEGA_LEGACY_BYTE_US : MEGA_BYTE_US));
+        megaClockSample(link.clock, frameGetU32(&f.payload[0]), frameGetU32(&f.payload[4]),
+                        micros(), asymUs);
+      }
+      break;
+
+    case FRAME_OP_ACK:
+      megaClearPending(link, f.seq);
+      markMegaAlive(megaNum);
+      if (f.len > 2 && f.payload[1] != FRAME_ACT_NONE) {
+        Serial.printf("[MEGA%d RX] #%u ACK:GROUP:%s x%u\n", megaNum, f.seq,
+          megaActionName((MegaAction)f.payload[1]), f.payload[2]);
+        break;
+      }
+      if (f.len > 2) {
+        Serial.printf("[MEGA%d RX] #%u ACK:BATCH x%u\n", megaNum, f.seq, f.payload[2]);
+        break;
+      }
+      Serial.printf("[MEGA%d RX] #%u ACK:%u:%s\n", megaNum, f.seq,
+        f.len > 0 ? f.payload[0] : 0,
+        megaActionName((MegaAction)(f.len > 1 ? f.payload[1] : 0)));
+      break;
+
+    case FRAME_OP_NAK: {
+      bool retried = false;
+      if (f.len > 0) {
+        uint8_t err = f.payload[0];
+        for (uint8_t i = 0; i < MEGA_PENDING_MAX; i++) {
+          const PendingCommand& cmd = link.pending[i];
+          if (!cmd.active || cmd.seq != f.seq) continue;
+          bool retry = ((cmd.frame[3] == FRAME_OP_BATCH || cmd.frame[3] == FRAME_OP_GROUP) &&
+                        err == FRAME_ERR_BAD_OPCODE) ||
+                       (cmd.frame[3] == FRAME_OP_AT && (err == FRAME_ERR_BAD_OPCODE ||
+                        err == FRAME_ERR_QUEUE_FULL || err == FRAME_ERR_BAD_TIME));
+          if (retry) {
+            PendingCommand batch = cmd;
+            megaClearPending(link, f.seq);
+            megaUnpackBatch(megaNum, batch);
+            retried = true;
+            break;
+          }
+        }
+      }
+      if (!retried) {
+        megaClearPending(link, f.seq);
+        link.latency.rejected++;
+      }
+      Serial.printf("[MEGA%d RX] #%u NAK error %u block %u\n", megaNum, f.seq,
+        f.len > 0 ? f.payload[0] : 0, f.len > 1 ? f.payload[1] : 0);
+      // Команда отклонена - блок не поехал (или едет не туда)
+      if (!retried && f.len > 1) handleBlockFault(f.payload[1], "command rejected");
+      break;
+    }
+
+    case FRAME_OP_DONE:
+      Serial.printf("[MEGA%d RX] DONE:%u\n", megaNum, f.len > 0 ? f.payload[0] : 0);
+      if (f.len > 0) handleBlockDone(f.payload[0]);
+      break;
+
+    case FRAME_OP_STATUS:
+      handleMegaStatus(megaNum, f);
+      break;
+
+    default:
+      Serial.printf("[MEGA%d RX] Unknown frame op 0x%02X\n", megaNum, f.op);
+      break;
+  }
+}
+
+/**
+ * Забрать всё что пришло от Mega: кадры начинаются с FRAME_SYNC,
+ * остальные байты - текстовые строки (v3 и согласование)
+ */
+void pollMegaLink(uint8_t megaNum) {
+  MegaLink& link = megaLinks[megaNum];
+
+  while (link.port->available() > 0) {
+    int c = link.port->read();
+    if (c < 0) break;
+
+    unsigned long rxNow = millis();
+    if (link.frameRx.busy() && rxNow - link.lastRxByteMs > FRAME_GAP_MS) {
+      link.frameRx.reset();  // Оборванный кадр
+    }
+    link.lastRxByteMs = rxNow;
+
+    if (link.frameRx.busy() || c == FRAME_SYNC) {
+      if (link.frameRx.feed((uint8_t)c)) handleMegaFrame(megaNum, link.frameRx.frame());
+    } else if (link.lineRx.feed((char)c)) {
+      handleMegaLine(megaNum, link.lineRx.line());
+    }
+  }
+}
+
+/**
+ * Повторить команды без ACK, вернуться на текст если Mega пропала
+ */
+void serviceMegaLink(uint8_t megaNum, unsigned long now) {
+  MegaLink& link = megaLinks[megaNum];
+
+  for (uint8_t i = 0; i < MEGA_PENDING_MAX; i++) {
+    PendingCommand& cmd = link.pending[i];
+    if (!cmd.active || now - cmd.sentAt < FRAME_ACK_TIMEOUT_MS) continue;
+
+    if (cmd.retries >= FRAME_MAX_RETRIES) {
+      cmd.active = false;
+      link.lost++;
+      Serial.printf("[MEGA%d] #%u no ACK after %d retries\n", megaNum, cmd.seq, FRAME_MAX_RETRIES);
+      if (cmd.frame[3] == FRAME_OP_BLOCK) handleBlockFault(cmd.frame[FRAME_HEADER_SIZE], "command lost");
+      continue;
+    }
+
+    // Тот же SEQ: Mega не исполнит команду второй раз, только повторит ACK
+    link.port->write(cmd.frame, cmd.len);
+    cmd.retries++;
+    cmd.sentAt = now;
+    link.retransmits++;
+  }
+
+  // Нет ответов 3 heartbeat подряд: связь потеряна
+  if (now - link.lastReplyMs > 3 * HEARTBEAT_INTERVAL) {
+    bool& alive = (megaNum == 1) ? mega1Alive : mega2Alive;
+    if (alive) {
+      alive = false;
+      Serial.printf("[MEGA%d] No reply - link lost\n", megaNum);
+      for (int b = 1; b <= TOTAL_BLOCKS; b++) {
+        if (getBlockConfig(b)->megaNum == megaNum) handleBlockFault(b, "link lost");
+      }
+    }
+
+    // Mega перезагружена/заменена - заново согласовать протокол
+    if (link.proto == FRAME_PROTO_VERSION) {
+      link.proto = 3;
+      link.textOnly = false;
+      for (uint8_t i = 0; i < MEGA_PENDING_MAX; i++) link.pending[i].active = false;
+      megaClockReset(link.clock);
+      latencyTextDrop(link.latency);
+      Serial.printf("[MEGA%d] Back to text protocol\n", megaNum);
+    }
+
+    // Молчит всё окно на этой скорости - попробовать другую
+    if (link.baudProbeMs == 0) {
+      link.baudProbeMs = now;
+    } else if (now - link.baudProbeMs >= MEGA_BAUD_PROBE_MS) {
+      link.baudProbeMs = now;
+      megaLinkSetBaud(megaNum, !link.legacyBaud);
+    }
+  }
+}
+
+// ============================================================================
+// PUSH СОСТОЯНИЯ (SSE)
+// ============================================================================
+
+PushState capturePushState() {
+  PushState st = {};
+  for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+    uint16_t bit = (uint16_t)(1u << i);
+    if (blockMoving(i)) st.blocks |= bit;
+    if (ledStates[i]) st.leds |= bit;
+    if (fadeEnvelopeRising(fadeStates[i])) st.fadeIn |= bit;
+    if (fadeEnvelopeFalling(fadeStates[i])) st.fadeOut |= bit;
+  }
+  st.mega1 = mega1Alive;
+  st.mega2 = mega2Alive;
+  return st;
+}
+
+void appendBlockList(String& json, const char* key, uint16_t mask) {
+  json += ",\"";
+  json += key;
+  json += "\":[";
+  bool first = true;
+  for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+    if (!(mask & (1u << i))) continue;
+    if (!first) json += ",";
+    json += String(i);
+    first = false;
+  }
+  json += "]";
+}
+
+/**
+ * JSON события: все поля (prev == nullptr) или только изменённые
+ */
+String pushStateJson(const PushState& st, const PushState* prev) {
+  String json = "{\"v\":" + String(stateVersion);
+
+  if (!prev || st.blocks != prev->blocks) {
+    int active = 0;
+    for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+      if (st.blocks & (1u << i)) active++;
+    }
+    json += ",\"active\":" + String(active);
+    appendBlockList(json, "blocks", st.blocks);
+  }
+  if (!prev || st.leds != prev->leds) appendBlockList(json, "leds", st.leds);
+  if (!prev || st.fadeIn != prev->fadeIn) appendBlockList(json, "fadeIn", st.fadeIn);
+  if (!prev || st.fadeOut != prev->fadeOut) appendBlockList(json, "fadeOut", st.fadeOut);
+  if (!prev || st.mega1 != prev->mega1) json += String(",\"mega1\":") + (st.mega1 ? "true" : "false");
+  if (!prev || st.mega2 != prev->mega2) json += String(",\"mega2\":") + (st.mega2 ? "true" : "false");
+
+  json += "}";
+  return json;
+}
+
+/**
+ * Разослать дельту, если состояние изменилось (вызывается в конце loop)
+ * В простое - только сравнение масок, без JSON и без трафика
+ */
+void pushStateIfChanged() {
+  PushState st = capturePushState();
+  if (st.blocks == pushedState.blocks && st.leds == pushedState.leds &&
+      st.fadeIn == pushedState.fadeIn && st.fadeOut == pushedState.fadeOut &&
+      st.mega1 == pushedState.mega1 && st.mega2 == pushedState.mega2) {
+    return;
+  }
+
+  stateVersion++;
+  if (events.count() > 0) {
+    String json = pushStateJson(st, &pushedState);
+    events.send(json.c_str(), "state", stateVersion);
+  }
+  pushedState = st;
+}
+
+// ============================================================================
+// MAIN LOOP - СТИЛЬ DroneControl.ino
+// ============================================================================
+
+void loop() {
+  PERF_MARK(loopStart);
+
+  // Вне блокировки: во время прошивки handle() не возвращается десятки секунд
+  {
+    PERF_SCOPE(PERF_STAGE_OTA);
+    ArduinoOTA.handle();  // Обработка OTA обновлений
+  }
+
+  // HTTP обслуживает async_tcp; пока loop() меняет состояние, handlers ждут
+  ControlLock lock;
+
+  // ===== ЧТЕНИЕ ОТВЕТОВ ОТ MEGA =====
+  // Неблокирующее: забираем только то что уже пришло (кадры v4 и текстовые строки)
+  PERF_MARK(rxStart);
+  pollMegaLink(1);
+  pollMegaLink(2);
+  PERF_RECORD(PERF_STAGE_MEGA_RX, rxStart);
+
+  unsigned long now = millis();
+
+  // ===== ПОВТОРЫ КОМАНД БЕЗ ACK (v4) =====
+  serviceMegaLink(1, now);
+  serviceMegaLink(2, now);
+
+  // ===== ШОУ =====
+  // Реплики по часам ESP32 - сеть на время движения не влияет
+  runShowCues(now);
+
+  // ===== ТАЙМЕРЫ (DEADLINE_HEAP.h) =====
+  // Таймауты блоков, завершение fade и PING - только наступившие;
+  // ничего не наступило - одно сравнение с вершиной кучи
+  bool ledChanged = false;
+  int timer;
+
+  while ((timer = deadlinePopDue(deadlines, now)) >= 0) {
+    if (timer == DEADLINE_HEARTBEAT) {
+      // ===== HEARTBEAT (PING каждые 2 сек) =====
+      // Mega v4.2 и так шлёт STATUS, на кадрах PING нужен для часов AT
+      megaSendPing(1);
+      megaSendPing(2);
+      deadlineSet(deadlines, DEADLINE_HEARTBEAT, now + HEARTBEAT_INTERVAL);
+    } else if (timer <= TOTAL_BLOCKS) {
+      // ===== ТАЙМАУТЫ БЛОКОВ =====
+      // ВАЖНО: LED НЕ выключается по timeout!
+      // LED остается включенным пока не придет команда STOP или DOWN
+      // Таймаут нужен только для безопасности актуаторов (автостоп после движения)
+      Serial.printf("[TIMEOUT] Block %d - actuator stopped, LED stays ON\n", timer);
+      blockMotionEvent(timer, MOTION_EV_DONE);
+    } else {
+      // ===== FADE IN/OUT - ЗАВЕРШЕНИЕ =====
+      // Сама яркость считается в render task поверх эффекта
+      if (finishBlockFade(timer - DEADLINE_FADE(0), now)) ledChanged = true;
+    }
+  }
+
+  // ===== ОЧЕРЕДЬ ХОДОВ =====
+  // DONE / STATUS (pollMegaLink) и таймауты выше освободили бюджет питания
+  admitQueuedMoves();
 
   // ===== ФИЗИЧЕСКАЯ КНОПКА POWER (ВРЕМЕННО ОТКЛЮЧЕНО) =====
   /*
@@ -1201,123 +3020,201 @@ void loop() {
   lastButtonState = buttonState;
   */
 
-  // ===== HEARTBEAT (PING каждые 2 сек) =====
-  if (now - lastHeartbeat > HEARTBEAT_INTERVAL) {
-    Mega1Serial.println(CMD_PING);
-    Mega2Serial.println(CMD_PING);
-    lastHeartbeat = now;
+  if (ledChanged) {
+    publishLedState();
   }
 
-  // ===== FADE IN - ПЛАВНОЕ ПОЯВЛЕНИЕ LED ПРИ ПОДНЯТИИ =====
-  for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-    if (fadeInStates[i].isActive) {
-      unsigned long elapsed = now - fadeInStates[i].startTime;
+  // ===== PUSH СОСТОЯНИЯ В UI (SSE) =====
+  pushStateIfChanged();
 
-      if (elapsed >= fadeInStates[i].duration) {
-        // Fade IN завершен - LED полностью включены
-        fadeInStates[i].isActive = false;
-        Serial.printf("[LED] Block %d FADE IN completed\n", i);
-      }
-      // Fade IN применяется автоматически через mask и эффект Static
-    }
-  }
+#if MOTION_CHECKS
+  checkMotionInvariants();
+#endif
+
+  // LED эффекты, маска, fade и FastLED.show() - в renderTask() на ядре RENDER_CORE
+  PERF_RECORD(PERF_STAGE_LOOP, loopStart);
+}
+
+// ============================================================================
+// RENDER TASK - LED PIPELINE НА ОТДЕЛЬНОМ ЯДРЕ
+// ============================================================================
 
-  // ===== FADE OUT - ПЛАВНОЕ УГАСАНИЕ LED ПРИ ОПУСКАНИИ =====
+static LedFrameState ledRender;      // Снимок текущего кадра (только render task)
+static uint16_t renderMaskBlocks = 0;
+static uint32_t lastShowUs = 0;      // Длительность последнего FastLED.show()
+
+/**
+ * Пересобрать маску из битов блоков снимка
+ */
+void rebuildMask(uint16_t maskBlocks) {
+  mask.clear();
   for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-    if (fadeOutStates[i].isActive) {
-      unsigned long elapsed = now - fadeOutStates[i].startTime;
-
-      if (elapsed >= fadeOutStates[i].duration) {
-        // Fade OUT завершен - выключаем LED полностью
-        fadeOutStates[i].isActive = false;
-        updateMaskForBlock(i, false);  // Убрать из маски
-        applyMask();
-        FastLED.show();
-        Serial.printf("[LED] Block %d FADE OUT completed\n", i);
-      }
-      // Fade OUT продолжается - применяется ниже
-    }
+    if (maskBlocks & (1u << i)) mask.setZone(blockZones[i]);
   }
+  renderMaskBlocks = maskBlocks;
+}
 
-  // ===== LED ЭФФЕКТЫ =====
-  // ВАЖНО: Эффекты работают ВСЕГДА на включенных LED (через mask)
-  // Fade IN/OUT только модулирует яркость при поднятии/опускании
-  static uint32_t lastEffectFrame = 0;
+/**
+ * Вывести рабочий буфер leds: копия в back буфер, переключение, show
+ * Пока FastLED выводит front, следующий кадр собирается в leds
+ */
+void presentFrame() {
+  uint8_t back = frontFrame ^ 1;
+  for (int s = 0; s < NUM_STRIPS; s++) {
+    memcpy(frameBuf[back][s], leds[s], PIN_LEDS[s] * sizeof(CRGB));
+    stripControllers[s]->setLeds(frameBuf[back][s], PIN_LEDS[s]);
+  }
+  FastLED.setBrightness(gBri);
 
-  if (now - lastEffectFrame >= (1000 / FPS)) {
-    lastEffectFrame = now;
+  // I2S: show() запускает DMA на все линии сразу и ждёт на семафоре,
+  // ядро в это время свободно для WiFi. RMT: каналы выводятся по очереди.
+  uint32_t showStart = micros();
+  PERF_MARK(showCycles);
+  FastLED.show();
+  PERF_RECORD(PERF_STAGE_SHOW, showCycles);
+  lastShowUs = micros() - showStart;
 
-    // Проверить есть ли активные блоки
-    bool anyBlockActive = false;
-    for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-      if (ledStates[i]) {
-        anyBlockActive = true;
-        break;
-      }
-    }
+  frontFrame = back;
+}
 
-    // Сначала применяем эффект (или static) ко ВСЕМ LED
-    if (gFx == 0) {
-      // Статический цвет
-      CRGB c(gR, gG, gB);
-      for (int s = 0; s < NUM_STRIPS; s++) {
-        for (uint16_t j = 0; j < PIN_LEDS[s]; j++) {
-          // Если есть активные блоки - используем маску
-          // Если нет активных блоков - показываем на ВСЕХ LED (эффект ALWAYS-ON)
-          leds[s][j] = (anyBlockActive ? mask[s][j] : true) ? c : CRGB::Black;
-        }
-      }
-    } else {
-      // Анимированный эффект (Rainbow, Fire, Wave, etc)
-      // Если нет активных блоков - временно включаем ВСЕ LED для эффекта
-      bool tempMask[NUM_STRIPS][MAX_LEDS];
-      if (!anyBlockActive) {
-        memcpy(tempMask, mask, sizeof(mask)); // Сохраняем текущую маску
-        memset(mask, 1, sizeof(mask)); // Включаем ВСЕ LED
-      }
+/**
+ * Один кадр: снимок → эффект → маска → fade → show
+ */
+void renderFrame(unsigned long now) {
+  PERF_SCOPE(PERF_STAGE_FRAME);
+  uint8_t prevFx = gFx;
+  ledStateBox.read(ledRender);
+
+  if (!ledRender.outputEnabled) {
+    // OTA: погасить ленты
+    memset(leds, 0, sizeof(leds));
+    presentFrame();
+    return;
+  }
 
-      switch (gFx) {
-        case 1: fxPulse();   break;
-        case 2: fxRainbow(); break;
-        case 3: fxChase();   break;
-        case 4: fxSparkle(); break;
-        case 5: fxWave();    break;
-        case 6: fxFire();    break;
-        case 7: fxMeteor();  break;
-      }
+  gR = ledRender.r;
+  gG = ledRender.g;
+  gB = ledRender.b;
+  gBri = ledRender.bri;
+  gFx = ledRender.fx;
+  gSpd = ledRender.spd;
 
-      if (!anyBlockActive) {
-        memcpy(mask, tempMask, sizeof(mask)); // Восстанавливаем маску
-      }
-    }
+  // Очистить heat buffer при переключении на Fire
+  if (gFx == 6 && prevFx != 6) {
+    memset(heat, 0, sizeof(heat));
+  }
 
-    // Теперь применяем FADE IN анимации (модулируем яркость 0→255)
-    for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-      if (fadeInStates[i].isActive) {
-        unsigned long elapsed = now - fadeInStates[i].startTime;
-        float progress = (float)elapsed / (float)fadeInStates[i].duration;  // 0.0 - 1.0
-        if (progress > 1.0) progress = 1.0;
-        uint8_t fadeBrightness = (uint8_t)(255 * progress);  // 0 → 255
-
-        // ✅ Применяем fade яркость ПОВЕРХ эффекта
-        applyFadeBrightnessToBlock(i, fadeBrightness);
-      }
-    }
+  if (ledRender.maskBlocks != renderMaskBlocks) {
+    PERF_SCOPE(PERF_STAGE_MASK);
+    rebuildMask(ledRender.maskBlocks);
+  }
 
-    // Применяем FADE OUT анимации (модулируем яркость 255→0)
-    for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-      if (fadeOutStates[i].isActive) {
-        unsigned long elapsed = now - fadeOutStates[i].startTime;
-        float progress = (float)elapsed / (float)fadeOutStates[i].duration;  // 0.0 - 1.0
-        if (progress > 1.0) progress = 1.0;
-        uint8_t fadeBrightness = (uint8_t)(255 * (1.0 - progress));  // 255 → 0
-
-        // ✅ Применяем fade яркость ПОВЕРХ эффекта
-        applyFadeBrightnessToBlock(i, fadeBrightness);
-      }
+  // ВАЖНО: Эффекты работают ВСЕГДА на включенных LED (через mask)
+  // Fade IN/OUT только модулирует яркость при поднятии/опускании
+  // Если есть активные блоки - используем маску
+  // Если нет активных блоков - показываем на ВСЕХ LED (эффект ALWAYS-ON)
+  mask.setAllOn(!ledRender.anyLedOn);
+
+  // Сначала применяем эффект (или static) ко ВСЕМ LED
+  PERF_MARK(effectStart);
+  if (gFx == 0) {
+    // Статический цвет
+    CRGB c(gR, gG, gB);
+    for (int s = 0; s < NUM_STRIPS; s++) {
+      fill_solid(leds[s], PIN_LEDS[s], c);
+    }
+    applyMask();
+  } else {
+    // Анимированный эффект (Rainbow, Fire, Wave, etc)
+    switch (gFx) {
+      case 1: fxPulse();   break;
+      case 2: fxRainbow(); break;
+      case 3: fxChase();   break;
+      case 4: fxSparkle(); break;
+      case 5: fxWave();    break;
+      case 6: fxFire();    break;
+      case 7: fxMeteor();  break;
     }
+  }
+  PERF_RECORD(PERF_STAGE_EFFECT, effectStart);
+
+  // FADE IN/OUT: одна огибающая на блок, яркость поверх эффекта
+  PERF_MARK(fadeStart);
+  for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+    if (!ledRender.fade[i].isActive) continue;
 
-    // Обновить LED ленты
-    FastLED.show();
+    uint8_t level = fadeEnvelopeLevel(ledRender.fade[i], now);
+    if (level < 255) applyFadeBrightnessToBlock(i, level);
+  }
+  PERF_RECORD(PERF_STAGE_FADE, fadeStart);
+
+  // Обновить LED ленты
+  presentFrame();
+}
+
+/**
+ * FreeRTOS задача рендера (ядро RENDER_CORE)
+ * Кадры строго по расписанию vTaskDelayUntil, не зависит от HTTP/OTA/Mega
+ */
+void renderTask(void* param) {
+  TickType_t lastWake = xTaskGetTickCount();
+  uint32_t lastStart = micros();
+
+  RenderStats stats;
+  memset(&stats, 0, sizeof(stats));
+
+  // Накопители окна 1 секунда: окно закрывается по времени, а не по числу
+  // кадров - иначе fps всегда ровно FPS и пропуски кадров не видны
+  uint32_t windowStartUs = lastStart;
+  uint16_t windowFrames = 0;
+  uint32_t windowFrameSum = 0;
+  uint32_t windowFrameMax = 0;
+  uint32_t windowJitterSum = 0;
+  uint32_t windowJitterMax = 0;
+  uint32_t windowShowSum = 0;
+  uint32_t windowShowMax = 0;
+
+  for (;;) {
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(1000 / FPS));
+
+    uint32_t start = micros();
+    uint32_t period = start - lastStart;
+    lastStart = start;
+    uint32_t jitter = (period > FRAME_US) ? (period - FRAME_US) : (FRAME_US - period);
+
+    renderFrame(millis());
+
+    uint32_t busy = micros() - start;
+    if (busy > FRAME_US) stats.overruns++;
+    stats.frames++;
+
+    windowFrames++;
+    windowFrameSum += busy;
+    windowJitterSum += jitter;
+    if (busy > windowFrameMax) windowFrameMax = busy;
+    if (jitter > windowJitterMax) windowJitterMax = jitter;
+    windowShowSum += lastShowUs;
+    if (lastShowUs > windowShowMax) windowShowMax = lastShowUs;
+
+    uint32_t windowUs = micros() - windowStartUs;
+    if (windowUs >= 1000000UL) {
+      stats.fps = (uint16_t)(((uint64_t)windowFrames * 1000000UL + windowUs / 2) / windowUs);
+      stats.frameUs = windowFrameSum / windowFrames;
+      stats.frameMaxUs = windowFrameMax;
+      stats.jitterUs = windowJitterSum / windowFrames;
+      stats.jitterMaxUs = windowJitterMax;
+      stats.showUs = windowShowSum / windowFrames;
+      stats.showMaxUs = windowShowMax;
+      renderStatsBox.publish(stats);
+
+      windowStartUs += windowUs;
+      windowFrames = 0;
+      windowFrameSum = 0;
+      windowFrameMax = 0;
+      windowJitterSum = 0;
+      windowJitterMax = 0;
+      windowShowSum = 0;
+      windowShowMax = 0;
+    }
   }
 }
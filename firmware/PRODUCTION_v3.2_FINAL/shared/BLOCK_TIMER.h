@@ -0,0 +1,231 @@
+/**
+ * RAMS BLOCK TIMER - остановка блоков по прерыванию Timer3
+ *
+ * Раньше блок останавливала проверка таймаутов в loop(): она шла после
+ * разбора команд и печати в DEBUG_SERIAL, и остановка опаздывала на весь
+ * проход (несколько мс, когда печать на 115200 ждёт место в буфере).
+ * Положение блока считается по времени работы реле (BLOCK_POSITION.h) -
+ * каждая лишняя миллисекунда хода уходит в ошибку положения.
+ *
+ * Здесь сроки остановки (micros()) лежат в списке по возрастанию, реле
+ * выключает прерывание сравнения Timer3:
+ * - Timer3 считает свободно с делителем 64 (4 мкс - тот же шаг, что
+ *   у micros()), OCR3A ставится на ближайший срок; срок дальше
+ *   BLOCK_TIMER_MAX_TICKS - промежуточное сравнение, прерывание просто
+ *   переставит OCR3A
+ * - опоздание = задержка входа в прерывание (UART, Timer0) - единицы мкс
+ *   и не зависит от того, чем занят loop()
+ * - loop() забирает маску сработавших блоков (takeFired) и делает всё
+ *   медленное: положение, EEPROM, лог, DONE / STATUS
+ * - группа блоков (GROUP / BATCH) ставит сроки одним вызовом setGroup():
+ *   один проход по списку и одна перестановка OCR3A на всю группу
+ *
+ * Timer3 на Mega 2560 - ШИМ пинов 2, 3, 5; реле на пинах 22-53, analogWrite
+ * скетчи не используют. Timer1 оставлен библиотекам (Servo).
+ *
+ * ВАЖНО: Этот файл используется в:
+ * - Arduino Mega #1 (actuator_mega1_v3)
+ * - Arduino Mega #2 (actuator_mega2_v3)
+ *
+ * @version 1.1
+ * @date 2026-03-29
+ * @author RAMS Global Team
+ */
+
+#ifndef BLOCK_TIMER_H
+#define BLOCK_TIMER_H
+
+#include <Arduino.h>
+#include <util/atomic.h>
+#include "RELAY_PORTS.h"
+
+// ============================================================================
+// КОНСТАНТЫ
+// ============================================================================
+
+#define BLOCK_TIMER_BLOCKS      8           // Блоков на одной Mega
+#define BLOCK_TIMER_US_PER_TICK 4           // 16 МГц / 64
+#define BLOCK_TIMER_MAX_TICKS   0x8000      // Дальний срок - шагами по ~131 мс
+#define BLOCK_TIMER_MIN_TICKS   2           // Сравнение не ближе 8 мкс от TCNT3
+
+// Сроки сравниваются разностью со знаком (переполнение micros()) -
+// длительность хода ограничена, дальше блок всё равно давно на концевике
+#define BLOCK_TIMER_MAX_MS      1800000UL   // 30 минут
+
+// ============================================================================
+// СПИСОК СРОКОВ
+// ============================================================================
+
+/**
+ * Все обращения из loop() - внутри ATOMIC_BLOCK (там же барьер памяти),
+ * onCompare() - только из ISR(TIMER3_COMPA_vect)
+ */
+class BlockStopTimer {
+public:
+  BlockStopTimer() : _count(0), _fired(0) {
+    for (uint8_t i = 0; i < BLOCK_TIMER_BLOCKS; i++) _lateUs[i] = 0;
+  }
+
+  /**
+   * Timer3: Normal mode, делитель 64, прерывание включается первым сроком
+   */
+  void begin() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      TCCR3A = 0;
+      TCCR3B = (1 << CS31) | (1 << CS30);
+      TIMSK3 = 0;
+      TIFR3 = (1 << OCF3A);
+    }
+  }
+
+  /**
+   * Остановить блок в момент atUs (micros()); прежний срок блока снимается
+   * @param idx индекс блока на этой Mega (0..BLOCK_TIMER_BLOCKS-1)
+   */
+  void set(uint8_t idx, uint8_t blockNum, unsigned long atUs) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      remove((uint8_t)(1 << idx));
+      insert(idx, blockNum, atUs);
+      arm();
+    }
+  }
+
+  /**
+   * Снять срок блока (STOP пришёл раньше)
+   */
+  void cancel(uint8_t idx) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      remove((uint8_t)(1 << idx));
+      arm();
+    }
+  }
+
+  /**
+   * Сроки группы блоков разом: блоки setMask - остановить в atUs[idx],
+   * блоки cancelMask - снять срок
+   * @param firstBlock номер блока с idx = 0
+   */
+  void setGroup(uint8_t setMask, uint8_t cancelMask, uint8_t firstBlock, const unsigned long* atUs) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      remove(setMask | cancelMask);
+      for (uint8_t idx = 0; idx < BLOCK_TIMER_BLOCKS; idx++) {
+        if (setMask & (1 << idx)) insert(idx, firstBlock + idx, atUs[idx]);
+      }
+      arm();
+    }
+  }
+
+  void cancelAll() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      _count = 0;
+      _fired = 0;
+      arm();
+    }
+  }
+
+  /**
+   * Блоки, остановленные прерыванием с прошлого вызова (бит = idx)
+   */
+  uint8_t takeFired() {
+    uint8_t fired;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      fired = _fired;
+      _fired = 0;
+    }
+    return fired;
+  }
+
+  /**
+   * На сколько последняя остановка блока опоздала от срока, мкс
+   */
+  uint16_t lateUs(uint8_t idx) {
+    uint16_t late;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      late = _lateUs[idx];
+    }
+    return late;
+  }
+
+  /**
+   * Из ISR(TIMER3_COMPA_vect): выключить реле наступивших сроков
+   */
+  void onCompare() {
+    unsigned long now = micros();
+
+    uint8_t due = 0;
+    while (due < _count && (long)(now - _list[due].atUs) >= 0) {
+      const Deadline& d = _list[due];
+      relayBlockStop(d.blockNum);
+
+      unsigned long late = now - d.atUs;
+      _lateUs[d.idx] = late > 0xFFFF ? 0xFFFF : (uint16_t)late;
+      _fired |= (uint8_t)(1 << d.idx);
+      due++;
+    }
+
+    for (uint8_t i = due; i < _count; i++) _list[i - due] = _list[i];
+    _count -= due;
+    arm();
+  }
+
+private:
+  struct Deadline {
+    unsigned long atUs;
+    uint8_t idx;
+    uint8_t blockNum;
+  };
+
+  /**
+   * Убрать сроки блоков (бит = idx); остановка, которую loop() ещё
+   * не забрал, тоже снимается - блок уже получил новую команду
+   */
+  void remove(uint8_t mask) {
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+      if (!(mask & (1 << _list[i].idx))) _list[kept++] = _list[i];
+    }
+    _count = kept;
+    _fired &= (uint8_t)~mask;
+  }
+
+  /**
+   * Вставить срок по возрастанию atUs (срока блока в списке уже нет)
+   */
+  void insert(uint8_t idx, uint8_t blockNum, unsigned long atUs) {
+    uint8_t pos = _count;
+    while (pos > 0 && (long)(_list[pos - 1].atUs - atUs) > 0) {
+      _list[pos] = _list[pos - 1];
+      pos--;
+    }
+    _list[pos].atUs = atUs;
+    _list[pos].idx = idx;
+    _list[pos].blockNum = blockNum;
+    _count++;
+  }
+
+  /**
+   * OCR3A на ближайший срок (прерывания уже запрещены)
+   */
+  void arm() {
+    if (_count == 0) {
+      TIMSK3 &= (uint8_t)~(1 << OCIE3A);
+      return;
+    }
+
+    long ahead = (long)(_list[0].atUs - micros());
+    unsigned long ticks = ahead > 0 ? (unsigned long)ahead / BLOCK_TIMER_US_PER_TICK : 0;
+    if (ticks > BLOCK_TIMER_MAX_TICKS) ticks = BLOCK_TIMER_MAX_TICKS;
+    if (ticks < BLOCK_TIMER_MIN_TICKS) ticks = BLOCK_TIMER_MIN_TICKS;
+
+    OCR3A = (uint16_t)(TCNT3 + ticks);
+    TIFR3 = (1 << OCF3A);  // Старое совпадение не должно сработать сразу
+    TIMSK3 |= (1 << OCIE3A);
+  }
+
+  Deadline _list[BLOCK_TIMER_BLOCKS];  // По возрастанию atUs
+  uint8_t _count;
+  uint8_t _fired;
+  uint16_t _lateUs[BLOCK_TIMER_BLOCKS];
+};
+
+#endif // BLOCK_TIMER_H
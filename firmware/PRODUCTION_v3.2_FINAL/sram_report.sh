@@ -0,0 +1,46 @@
+#!/bin/bash
+# SRAM report for both actuator Megas (ATmega2560: 8192 bytes)
+# Usage: ./sram_report.sh [TOP_SYMBOLS]
+# Needs arduino-cli with the arduino:avr core installed
+
+TOP="${1:-10}"
+FQBN="arduino:avr:mega"
+SRAM_TOTAL=8192
+DIR="$(cd "$(dirname "$0")" && pwd)"
+
+for SKETCH in actuator_mega1_v3 actuator_mega2_v3; do
+    BUILD="/tmp/rams_sram_$SKETCH"
+
+    echo "===================="
+    echo "SRAM: $SKETCH"
+    echo "===================="
+
+    OUT=$(arduino-cli compile --fqbn "$FQBN" --build-path "$BUILD" "$DIR/$SKETCH" 2>&1)
+    if [ $? -ne 0 ]; then
+        echo "$OUT"
+        echo "✗ Build failed!"
+        exit 1
+    fi
+
+    # "Global variables use 1234 bytes (15%) of dynamic memory, leaving 6958 bytes ..."
+    USED=$(echo "$OUT" | sed -n 's/^Global variables use \([0-9]*\) bytes.*/\1/p')
+    echo "$OUT" | grep -E "^(Sketch uses|Global variables use)"
+    if [ -n "$USED" ]; then
+        echo "Static SRAM: $USED / $SRAM_TOTAL bytes, $((SRAM_TOTAL - USED)) left for stack"
+    fi
+
+    # Largest objects in .data/.bss (avr-nm ships with the core's toolchain)
+    ELF="$BUILD/$SKETCH.ino.elf"
+    NM=$(command -v avr-nm || find ~/.arduino15/packages/arduino/tools/avr-gcc -name avr-nm 2>/dev/null | head -1)
+    if [ -n "$NM" ] && [ -f "$ELF" ] && [ "$TOP" -gt 0 ]; then
+        echo ""
+        echo "Top $TOP SRAM symbols (bytes):"
+        "$NM" --size-sort -r -S -C "$ELF" | grep -E " [bBdD] " | head -n "$TOP" |
+            while read -r ADDR SIZE TYPE NAME; do
+                printf "  %6d  %s\n" "$((16#$SIZE))" "$NAME"
+            done
+    fi
+    echo ""
+done
+
+echo "Runtime check: \"[RAM] Free SRAM\" in the Mega debug log after boot"
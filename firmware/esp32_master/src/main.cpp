@@ -25,6 +25,9 @@
  *   POST /api/spd?v=0-255         → скорость анимации
  *   POST /api/zones?m=bitmask     → зоны LED
  *
+ * HTTP сервер асинхронный (ESPAsyncWebServer): keep-alive, несколько клиентов
+ * одновременно. Handlers и loop() делят ControlLock (CONTROL_LOCK.h).
+ *
  * Подключение:
  *   Serial1 (TX=25, RX=26) → Mega #1 (Blocks 1–8)
  *   Serial2 (TX=16, RX=17) → Mega #2 (Blocks 9–15)
@@ -33,11 +36,18 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WebServer.h>
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
 #include <Adafruit_NeoPixel.h>
 #include <ArduinoOTA.h>
 #include "protocol.h"
+#include "MEGA_LINK.h"
+#include "CONTROL_LOCK.h"
+#include "DEADLINE_HEAP.h"
+#include "BLOCK_MOTION.h"
+#define PERF_ENABLED 0   // Histograms only — no loop() section timing here
+#include "COMMAND_LATENCY.h"
 
 // ===================== AP CONFIG (собственная точка доступа) =====================
 const char* AP_SSID     = "RAMS-ESP32";
@@ -59,23 +69,31 @@ const char* STA_PASSWORD = "Rams2021";
 #define MEGA2_RX 17
 
 // ===================== GLOBALS =====================
-WebServer server(80);
+AsyncWebServer server(80);
 Adafruit_NeoPixel strip(NUM_LEDS, LED_PIN, NEO_GRB + NEO_KHZ800);
 
-enum BlockState { STATE_STOP = 0, STATE_UP = 1, STATE_DOWN = -1 };
-BlockState blockStates[TOTAL_BLOCKS + 1];
+// Block motion state machine (BLOCK_MOTION.h): down / rising / up / lowering / mid / fault
+uint8_t blockMotion[TOTAL_BLOCKS + 1];
 
-// Active block tracking (max 2 simultaneous)
+// Rising blocks, max 2 simultaneous — kept by setBlockMotion() only.
+// Lowering blocks do not take a slot: the /api/block 429 rule is the same as
+// before the motion states (it counted blocks in STATE_UP)
 int activeBlockCount = 0;
 
-// Block timers — auto-stop after duration
-unsigned long blockStopTime[TOTAL_BLOCKS + 1];
+#define DEFAULT_MOVE_MS 10000UL
+
+// Timers (DEADLINE_HEAP.h): id 0 — heartbeat PING, 1–15 — block auto-stop
+#define TIMER_HEARTBEAT 0
+DeadlineHeap timers;
 
 // LED — 8 effects + OFF (IDs match UI: 0=Static,1=Pulse,2=Rainbow,3=Chase,4=Sparkle,5=Wave,6=Fire,7=Meteor)
 enum LedMode { LED_STATIC=0, LED_PULSE=1, LED_RAINBOW=2, LED_CHASE=3, LED_SPARKLE=4, LED_WAVE=5, LED_FIRE=6, LED_METEOR=7, LED_OFF=8 };
 LedMode currentLedMode = LED_RAINBOW;
 uint32_t ledBaseColor   = 0x0000FF;
 uint8_t  ledSpeed       = 128;       // animation speed 0-255
+// Requested brightness: handlers only store it, loop() applies it to the strip.
+// setBrightness() rescales the pixel buffer in place - never while show() sends it
+uint8_t  ledBrightness  = LED_BRIGHTNESS;
 unsigned long lastLedUpdate = 0;
 uint16_t animCounter        = 0;
 
@@ -90,6 +108,18 @@ unsigned long lastHeartbeatMega2 = 0;
 bool mega1Alive = false;
 bool mega2Alive = false;
 
+// Command -> ACK/ERR latency (COMMAND_LATENCY.h). The relay Megas answer lines
+// in order and send no DONE, so travel time is not measured on this board
+LinkLatency megaLatency[3];                    // [1], [2]
+PerfHistogram blockAckUs[TOTAL_BLOCKS + 1];
+
+// /api/all?action=down: staggered sequence runs from loop(), not the async_tcp task
+volatile bool allDownRequested = false;
+
+// Non-blocking line buffers for Mega replies (no readStringUntil / String)
+LineReader mega1Rx;
+LineReader mega2Rx;
+
 // LED segments per block
 struct LedSegment { int start; int count; };
 LedSegment blockLeds[TOTAL_BLOCKS + 1] = {
@@ -105,8 +135,15 @@ LedSegment blockLeds[TOTAL_BLOCKS + 1] = {
 void routeToMega(int blockId, String action);
 void sendAllStop();
 void sendAllDown();
-void checkBlockTimers();
+void setBlockMotion(int blockNum, uint8_t next, unsigned long duration = 0);
+void blockMotionEvent(int blockNum, uint8_t event);
+#if MOTION_CHECKS
+void checkMotionInvariants();
+#endif
+void checkTimers();
 void checkMegaResponses();
+void handleMegaLine(int megaNum, const char* line);
+void megaLineSent(int megaNum);
 void checkSafety();
 void updateLeds();
 void ledRainbow();
@@ -120,25 +157,32 @@ void highlightBlock(int blockId, uint32_t color);
 void setupRoutes();
 
 // ===================== HTTP HELPERS =====================
-void sendJson(int code, JsonDocument& doc) {
+// CORS headers are added to every response by DefaultHeaders (setupRoutes)
+void sendJson(AsyncWebServerRequest* request, int code, JsonDocument& doc) {
   String body;
   serializeJson(doc, body);
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.send(code, "application/json", body);
+  request->send(code, "application/json", body);
+}
+
+void handleOptions(AsyncWebServerRequest* request) {
+  request->send(204);
 }
 
-void handleOptions() {
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-  server.send(204);
+// {n, min, avg, max, p99} of a latency histogram, µs
+void histToJson(JsonObject out, const PerfHistogram& h) {
+  out["n"]   = h.count;
+  out["min"] = h.count ? h.minUs : 0;
+  out["avg"] = h.count ? (uint32_t)(h.sumUs / h.count) : 0;
+  out["max"] = h.maxUs;
+  out["p99"] = perfHistPercentile(h, 990);
 }
 
 // ===================== ROUTE HANDLERS =====================
 
 // GET /api/status
-void handleStatus() {
+void handleStatus(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
   JsonDocument doc;
   doc["ok"]            = true;
   doc["mega1"]         = mega1Alive ? "ok" : "dead";
@@ -157,58 +201,68 @@ void handleStatus() {
   doc["staConnected"]  = (WiFi.status() == WL_CONNECTED);
 
   JsonArray blocks = doc["blocks"].to<JsonArray>();
+  JsonArray motion = doc["motion"].to<JsonArray>();
   for (int i = 1; i <= TOTAL_BLOCKS; i++) {
     const char* state = "stop";
-    if (blockStates[i] == STATE_UP)   state = "up";
-    if (blockStates[i] == STATE_DOWN) state = "down";
+    if (blockMotion[i] == MOTION_RISING)   state = "up";
+    if (blockMotion[i] == MOTION_LOWERING) state = "down";
     blocks.add(state);
+    motion.add(motionName(blockMotion[i]));
   }
-  sendJson(200, doc);
+
+  JsonObject latency = doc["latency"].to<JsonObject>();
+  for (int m = 1; m <= 2; m++) {
+    JsonObject mega = latency[m == 1 ? "mega1" : "mega2"].to<JsonObject>();
+    histToJson(mega["ackUs"].to<JsonObject>(), megaLatency[m].ackUs);
+    mega["rejected"]  = megaLatency[m].rejected;
+    mega["unmatched"] = megaLatency[m].unmatched;
+  }
+  JsonArray blockAck = latency["blockAckUs"].to<JsonArray>();
+  for (int i = 1; i <= TOTAL_BLOCKS; i++) {
+    histToJson(blockAck.add<JsonObject>(), blockAckUs[i]);
+  }
+  sendJson(request, 200, doc);
 }
 
 // POST /api/block?num=N&action=up/down&duration=D
-void handleBlock() {
-  if (!server.hasArg("num") || !server.hasArg("action")) {
+void handleBlock(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
+  if (!request->hasArg("num") || !request->hasArg("action")) {
     JsonDocument err;
     err["error"] = "num and action required";
-    sendJson(400, err);
+    sendJson(request, 400, err);
     return;
   }
 
-  int blockNum = server.arg("num").toInt();
-  String action = server.arg("action");
+  int blockNum = request->arg("num").toInt();
+  String action = request->arg("action");
   action.toUpperCase();
-  unsigned long duration = server.hasArg("duration")
-    ? (unsigned long)server.arg("duration").toInt()
-    : 10000UL;
+  unsigned long duration = request->hasArg("duration")
+    ? (unsigned long)request->arg("duration").toInt()
+    : DEFAULT_MOVE_MS;
 
   if (blockNum < 1 || blockNum > TOTAL_BLOCKS) {
     JsonDocument err;
     err["error"] = "invalid block number";
-    sendJson(400, err);
+    sendJson(request, 400, err);
     return;
   }
 
   // Enforce max 2 simultaneous blocks
-  if (action == ACTION_UP && blockStates[blockNum] != STATE_UP) {
+  if (action == ACTION_UP && blockMotion[blockNum] != MOTION_RISING) {
     if (activeBlockCount >= 2) {
       JsonDocument err;
       err["error"]   = "max 2 blocks active";
       err["active"]  = activeBlockCount;
-      sendJson(429, err);
+      sendJson(request, 429, err);
       return;
     }
-    activeBlockCount++;
-    blockStopTime[blockNum] = millis() + duration;
-  }
-  else if (action == ACTION_DOWN && blockStates[blockNum] == STATE_UP) {
-    activeBlockCount = max(0, activeBlockCount - 1);
-    blockStopTime[blockNum] = 0;
   }
 
-  if      (action == ACTION_UP)   blockStates[blockNum] = STATE_UP;
-  else if (action == ACTION_DOWN) blockStates[blockNum] = STATE_DOWN;
-  else if (action == ACTION_STOP) blockStates[blockNum] = STATE_STOP;
+  if      (action == ACTION_UP)   setBlockMotion(blockNum, MOTION_RISING, duration);
+  else if (action == ACTION_DOWN) setBlockMotion(blockNum, MOTION_LOWERING, duration);
+  else if (action == ACTION_STOP) blockMotionEvent(blockNum, MOTION_EV_STOP);
 
   routeToMega(blockNum, action);
 
@@ -217,18 +271,20 @@ void handleBlock() {
   doc["block"]    = blockNum;
   doc["action"]   = action;
   doc["duration"] = duration;
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
 
   Serial.printf("[API] block %d → %s (dur=%lums)\n", blockNum, action.c_str(), duration);
 }
 
 // POST /api/all?action=down
-void handleAll() {
-  String action = server.hasArg("action") ? server.arg("action") : "stop";
+void handleAll(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
+  String action = request->hasArg("action") ? request->arg("action") : "stop";
   action.toUpperCase();
 
   if (action == ACTION_DOWN) {
-    sendAllDown();
+    allDownRequested = true;  // Stagger delays must not block the HTTP task
   } else {
     sendAllStop();
   }
@@ -236,25 +292,29 @@ void handleAll() {
   JsonDocument doc;
   doc["ok"]     = true;
   doc["action"] = action;
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
 }
 
 // POST /api/stop  (emergency stop)
-void handleStop() {
+void handleStop(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
   sendAllStop();
   JsonDocument doc;
   doc["ok"] = true;
   doc["action"] = "emergency_stop";
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
   Serial.println("[API] EMERGENCY STOP");
 }
 
 // POST /api/led?mode=RAINBOW|PULSE|WAVE|STATIC|CHASE|SPARKLE|FIRE|METEOR|OFF
 //              &color=FF0000
 //              &brightness=200
-void handleLed() {
-  if (server.hasArg("mode")) {
-    String mode = server.arg("mode");
+void handleLed(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
+  if (request->hasArg("mode")) {
+    String mode = request->arg("mode");
     mode.toUpperCase();
     if      (mode == "STATIC")  currentLedMode = LED_STATIC;
     else if (mode == "PULSE")   currentLedMode = LED_PULSE;
@@ -266,107 +326,121 @@ void handleLed() {
     else if (mode == "METEOR")  currentLedMode = LED_METEOR;
     else if (mode == "OFF")     currentLedMode = LED_OFF;
   }
-  if (server.hasArg("color")) {
-    ledBaseColor = (uint32_t)strtol(server.arg("color").c_str(), NULL, 16);
+  if (request->hasArg("color")) {
+    ledBaseColor = (uint32_t)strtol(request->arg("color").c_str(), NULL, 16);
     currentLedMode = LED_STATIC;
   }
-  if (server.hasArg("brightness")) {
-    int b = server.arg("brightness").toInt();
-    if (b >= 0 && b <= 255) strip.setBrightness(b);
+  if (request->hasArg("brightness")) {
+    int b = request->arg("brightness").toInt();
+    if (b >= 0 && b <= 255) ledBrightness = b;
   }
 
   JsonDocument doc;
   doc["ok"] = true;
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
 }
 
 // POST /api/effect?id=0-7&speed=0-255
-void handleEffect() {
-  if (!server.hasArg("id")) {
+void handleEffect(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
+  if (!request->hasArg("id")) {
     JsonDocument err;
     err["error"] = "id required";
-    sendJson(400, err);
+    sendJson(request, 400, err);
     return;
   }
-  int id = server.arg("id").toInt();
+  int id = request->arg("id").toInt();
   if (id >= 0 && id <= 7) {
     currentLedMode = (LedMode)id;
   }
-  if (server.hasArg("speed")) {
-    ledSpeed = constrain(server.arg("speed").toInt(), 0, 255);
+  if (request->hasArg("speed")) {
+    ledSpeed = constrain(request->arg("speed").toInt(), 0, 255);
   }
   Serial.printf("[LED] Effect → %d, speed → %d\n", id, ledSpeed);
   JsonDocument doc;
   doc["ok"] = true;
   doc["effect"] = id;
   doc["speed"] = ledSpeed;
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
 }
 
 // POST /api/color?r=0-255&g=0-255&b=0-255
-void handleColor() {
-  int r = server.hasArg("r") ? constrain(server.arg("r").toInt(), 0, 255) : 0;
-  int g = server.hasArg("g") ? constrain(server.arg("g").toInt(), 0, 255) : 0;
-  int b = server.hasArg("b") ? constrain(server.arg("b").toInt(), 0, 255) : 0;
+void handleColor(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
+  int r = request->hasArg("r") ? constrain(request->arg("r").toInt(), 0, 255) : 0;
+  int g = request->hasArg("g") ? constrain(request->arg("g").toInt(), 0, 255) : 0;
+  int b = request->hasArg("b") ? constrain(request->arg("b").toInt(), 0, 255) : 0;
   ledBaseColor = ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
   currentLedMode = LED_STATIC;
   Serial.printf("[LED] Color → RGB(%d,%d,%d)\n", r, g, b);
   JsonDocument doc;
   doc["ok"] = true;
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
 }
 
 // POST /api/bri?v=0-255
-void handleBrightness() {
-  int v = server.hasArg("v") ? constrain(server.arg("v").toInt(), 0, 255) : 200;
-  strip.setBrightness(v);
+void handleBrightness(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
+  int v = request->hasArg("v") ? constrain(request->arg("v").toInt(), 0, 255) : 200;
+  ledBrightness = v;
   Serial.printf("[LED] Brightness → %d\n", v);
   JsonDocument doc;
   doc["ok"] = true;
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
 }
 
 // POST /api/spd?v=0-255
-void handleSpeed() {
-  ledSpeed = server.hasArg("v") ? constrain(server.arg("v").toInt(), 0, 255) : 128;
+void handleSpeed(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
+  ledSpeed = request->hasArg("v") ? constrain(request->arg("v").toInt(), 0, 255) : 128;
   Serial.printf("[LED] Speed → %d\n", ledSpeed);
   JsonDocument doc;
   doc["ok"] = true;
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
 }
 
 // GET /api/state
-void handleState() {
+void handleState(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
   JsonDocument doc;
   doc["r"]   = (ledBaseColor >> 16) & 0xFF;
   doc["g"]   = (ledBaseColor >>  8) & 0xFF;
   doc["b"]   =  ledBaseColor        & 0xFF;
-  doc["bri"] = strip.getBrightness();
+  doc["bri"] = ledBrightness;
   doc["spd"] = ledSpeed;
   doc["fx"]  = (int)currentLedMode;
   doc["zm"]  = 0xFFFF; // all zones active
   doc["autoCycle"] = autoCycleEnabled;
   doc["autoCycleInterval"] = autoCycleInterval / 1000;
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
 }
 
 // POST /api/zones?m=bitmask
-void handleZones() {
+void handleZones(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
   // Zone support — placeholder, all LEDs treated as one zone for now
   JsonDocument doc;
   doc["ok"] = true;
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
 }
 
 // POST /api/autocycle?enabled=1&interval=60
 // enabled: 0/1, interval: seconds (default 60)
-void handleAutoCycle() {
-  if (server.hasArg("enabled")) {
-    autoCycleEnabled = server.arg("enabled").toInt() != 0;
+void handleAutoCycle(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
+  if (request->hasArg("enabled")) {
+    autoCycleEnabled = request->arg("enabled").toInt() != 0;
     lastAutoCycle = millis(); // reset timer on toggle
   }
-  if (server.hasArg("interval")) {
-    int sec = constrain(server.arg("interval").toInt(), 5, 3600);
+  if (request->hasArg("interval")) {
+    int sec = constrain(request->arg("interval").toInt(), 5, 3600);
     autoCycleInterval = (uint32_t)sec * 1000;
   }
   Serial.printf("[LED] AutoCycle: %s, interval=%lus\n",
@@ -375,16 +449,18 @@ void handleAutoCycle() {
   doc["ok"] = true;
   doc["autoCycle"] = autoCycleEnabled;
   doc["interval"] = autoCycleInterval / 1000;
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
 }
 
 // GET /api/autocycle — get current auto-cycle state
-void handleGetAutoCycle() {
+void handleGetAutoCycle(AsyncWebServerRequest* request) {
+  ControlLock lock;
+
   JsonDocument doc;
   doc["autoCycle"] = autoCycleEnabled;
   doc["interval"] = autoCycleInterval / 1000;
   doc["currentEffect"] = (int)currentLedMode;
-  sendJson(200, doc);
+  sendJson(request, 200, doc);
 }
 
 // ===================== SETUP ROUTES =====================
@@ -403,6 +479,11 @@ void setupRoutes() {
   server.on("/api/autocycle", HTTP_POST, handleAutoCycle);
   server.on("/api/autocycle", HTTP_GET,  handleGetAutoCycle);
 
+  // CORS
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "Content-Type");
+
   // CORS preflight for all endpoints
   const char* endpoints[] = {"/api/block", "/api/all", "/api/stop", "/api/led",
                              "/api/effect", "/api/color", "/api/bri", "/api/spd",
@@ -412,11 +493,11 @@ void setupRoutes() {
   }
 
   // 404
-  server.onNotFound([]() {
+  server.onNotFound([](AsyncWebServerRequest* request) {
     JsonDocument doc;
     doc["error"] = "not found";
-    doc["uri"]   = server.uri();
-    sendJson(404, doc);
+    doc["uri"]   = request->url();
+    sendJson(request, 404, doc);
   });
 }
 
@@ -428,11 +509,16 @@ void setup() {
 
   Serial.println("\n=== RAMS ESP32 Master v2.0 ===");
 
+  // Before server.begin(): HTTP handlers and loop() share this mutex
+  controlLockInit();
+
   // Initialize block states
   for (int i = 0; i <= TOTAL_BLOCKS; i++) {
-    blockStates[i]   = STATE_STOP;
-    blockStopTime[i] = 0;
+    blockMotion[i] = MOTION_IDLE_DOWN;
+    perfHistReset(blockAckUs[i]);
   }
+  latencyReset(megaLatency[1]);
+  latencyReset(megaLatency[2]);
 
   // LED init
   strip.begin();
@@ -478,6 +564,7 @@ void setup() {
 
   ArduinoOTA.onStart([]() {
     Serial.println("[OTA] Update Start");
+    ControlLock lock;
     // Stop LED updates during OTA
     currentLedMode = LED_OFF;
     strip.clear();
@@ -512,6 +599,7 @@ void setup() {
   Serial2.println("PING");
   lastHeartbeatMega1 = millis();
   lastHeartbeatMega2 = millis();
+  deadlineSet(timers, TIMER_HEARTBEAT, millis() + HEARTBEAT_INTERVAL);
 
   Serial.println("[RAMS] Ready!");
   Serial.printf("[RAMS] AP:  http://%s/api/status\n", WiFi.softAPIP().toString().c_str());
@@ -523,46 +611,115 @@ void setup() {
 
 // ===================== LOOP =====================
 void loop() {
+  // Outside the lock: during an update handle() does not return for tens of seconds
   ArduinoOTA.handle();
-  server.handleClient();
-  checkBlockTimers();
-  checkMegaResponses();
-  checkSafety();
 
-  // Auto-cycle effects
-  if (autoCycleEnabled && millis() - lastAutoCycle >= autoCycleInterval) {
-    lastAutoCycle = millis();
-    // Cycle through effects 0-7, skip OFF(8)
-    int next = ((int)currentLedMode + 1) % 8;
-    currentLedMode = (LedMode)next;
-    Serial.printf("[AutoCycle] Switched to effect %d\n", next);
+  bool frameReady = false;
+  {
+    // HTTP runs in async_tcp; handlers wait while loop() touches shared state
+    ControlLock lock;
+
+    checkTimers();
+    checkMegaResponses();
+    checkSafety();
+
+    // Auto-cycle effects
+    if (autoCycleEnabled && millis() - lastAutoCycle >= autoCycleInterval) {
+      lastAutoCycle = millis();
+      // Cycle through effects 0-7, skip OFF(8)
+      int next = ((int)currentLedMode + 1) % 8;
+      currentLedMode = (LedMode)next;
+      Serial.printf("[AutoCycle] Switched to effect %d\n", next);
+    }
+
+    if (millis() - lastLedUpdate > 33) {
+      if (strip.getBrightness() != ledBrightness) strip.setBrightness(ledBrightness);
+      updateLeds();
+      lastLedUpdate = millis();
+      frameReady = true;
+    }
   }
 
-  if (millis() - lastLedUpdate > 33) {
-    updateLeds();
-    lastLedUpdate = millis();
+  // 900 LEDs ≈ 27 ms with interrupts off - keep HTTP handlers out of that wait
+  if (frameReady) strip.show();
+
+  if (allDownRequested) {
+    allDownRequested = false;
+    sendAllDown();
   }
 
-  // Heartbeat to Megas every 2 seconds
-  static unsigned long lastHB = 0;
-  if (millis() - lastHB > HEARTBEAT_INTERVAL) {
-    Serial1.println("PING");
-    Serial2.println("PING");
-    lastHB = millis();
+#if MOTION_CHECKS
+  {
+    ControlLock lock;
+    checkMotionInvariants();
   }
+#endif
 }
 
-// ===================== BLOCK AUTO-STOP TIMERS =====================
-void checkBlockTimers() {
-  unsigned long now = millis();
+// ===================== BLOCK MOTION =====================
+// The only place blockMotion changes: activeBlockCount follows rising
+// enter/leave, a moving block (re)arms its timer, a stopped one drops it
+void setBlockMotion(int blockNum, uint8_t next, unsigned long duration) {
+  bool wasRising = (blockMotion[blockNum] == MOTION_RISING);
+  bool rising = (next == MOTION_RISING);
+  bool moving = motionMoving(next);
+  if (blockMotion[blockNum] != next) {
+    Serial.printf("[Motion] Block %d %s -> %s\n", blockNum, motionName(blockMotion[blockNum]), motionName(next));
+    blockMotion[blockNum] = next;
+  }
+
+  if (rising && !wasRising) activeBlockCount++;
+  else if (!rising && wasRising) activeBlockCount--;
+
+  if (moving) deadlineSet(timers, blockNum, millis() + duration);
+  else deadlineCancel(timers, blockNum);
+}
+
+// STOP / DONE / FAULT; a move ends at the top (rising) or at the bottom (lowering)
+void blockMotionEvent(int blockNum, uint8_t event) {
+  uint8_t rest = (blockMotion[blockNum] == MOTION_RISING) ? MOTION_UP : MOTION_IDLE_DOWN;
+  uint8_t next = motionNext(blockMotion[blockNum], event, rest);
+  if (next != blockMotion[blockNum]) setBlockMotion(blockNum, next);
+}
+
+#if MOTION_CHECKS
+// Debug build: derived counters and timers agree with block states
+void checkMotionInvariants() {
+  int rising = 0;
   for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-    if (blockStates[i] == STATE_UP && blockStopTime[i] > 0 && now >= blockStopTime[i]) {
-      blockStates[i]   = STATE_STOP;
-      blockStopTime[i] = 0;
-      activeBlockCount = max(0, activeBlockCount - 1);
-      routeToMega(i, ACTION_STOP);
-      Serial.printf("[Timer] Block %d auto-stopped\n", i);
+    bool m = motionMoving(blockMotion[i]);
+    if (blockMotion[i] == MOTION_RISING) rising++;
+    if (blockMotion[i] >= MOTION_COUNT || m != deadlinePending(timers, i)) {
+      Serial.printf("[Motion] Invariant: block %d state %u timer %d\n", i, blockMotion[i], deadlinePending(timers, i));
+    }
+  }
+  if (rising != activeBlockCount) {
+    Serial.printf("[Motion] Invariant: activeBlockCount %d, rising %d\n", activeBlockCount, rising);
+  }
+}
+#endif
+
+// ===================== TIMERS =====================
+// Only due timers are touched; nothing due — one compare with the heap top.
+// Deadlines compare as (int32_t)(a - b), so the 49-day millis() wrap is harmless
+void checkTimers() {
+  unsigned long now = millis();
+  int timer;
+  while ((timer = deadlinePopDue(timers, now)) >= 0) {
+    if (timer == TIMER_HEARTBEAT) {
+      // Heartbeat to Megas every 2 seconds
+      Serial1.println("PING");
+      Serial2.println("PING");
+      deadlineSet(timers, TIMER_HEARTBEAT, now + HEARTBEAT_INTERVAL);
+      continue;
+    }
+
+    // Rising: stop the relays at the end of the move; lowering runs to the bottom on the Mega
+    if (blockMotion[timer] == MOTION_RISING) {
+      routeToMega(timer, ACTION_STOP);
+      Serial.printf("[Timer] Block %d auto-stopped\n", timer);
     }
+    blockMotionEvent(timer, MOTION_EV_DONE);
   }
 }
 
@@ -571,46 +728,82 @@ void routeToMega(int blockId, String action) {
   String msg = "BLOCK:" + String(blockId) + ":" + action + "\n";
   if (blockId >= MEGA1_BLOCK_START && blockId <= MEGA1_BLOCK_END) {
     Serial1.print(msg);
+    megaLineSent(1);
   } else if (blockId >= MEGA2_BLOCK_START && blockId <= MEGA2_BLOCK_END) {
     Serial2.print(msg);
+    megaLineSent(2);
   }
 }
 
+// Every line except PING gets exactly one ACK:/ERR: back
+void megaLineSent(int megaNum) {
+  latencyTextSent(megaLatency[megaNum], micros());
+}
+
 void sendAllStop() {
   for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-    blockStates[i]   = STATE_STOP;
-    blockStopTime[i] = 0;
+    blockMotionEvent(i, MOTION_EV_STOP);
   }
-  activeBlockCount = 0;
   Serial1.println("ALL:STOP");
+  megaLineSent(1);
   Serial2.println("ALL:STOP");
+  megaLineSent(2);
   Serial.println("[ALL] STOP");
 }
 
+// Stays on one BLOCK:N:DOWN line per block on purpose: mega1_relay/mega2_relay
+// have no GROUP command, and the stagger limits relay inrush current
 void sendAllDown() {
   for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-    if (blockStates[i] == STATE_UP) {
-      blockStates[i]   = STATE_DOWN;
-      blockStopTime[i] = 0;
+    {
+      // Lock per block only: HTTP stays responsive during the stagger delay
+      ControlLock lock;
+      // Everything not already down or on its way there — including blocks
+      // that finished rising or stopped midway
+      if (blockMotion[i] == MOTION_IDLE_DOWN || blockMotion[i] == MOTION_LOWERING) continue;
+      setBlockMotion(i, MOTION_LOWERING, DEFAULT_MOVE_MS);
       routeToMega(i, ACTION_DOWN);
-      delay(STAGGER_DELAY_MS);
     }
+    delay(STAGGER_DELAY_MS);
   }
-  activeBlockCount = 0;
   Serial.println("[ALL] DOWN");
 }
 
 // ===================== MEGA RESPONSES =====================
 void checkMegaResponses() {
-  while (Serial1.available()) {
-    String line = Serial1.readStringUntil('\n');
-    line.trim();
-    if (line == "PONG") { mega1Alive = true; lastHeartbeatMega1 = millis(); }
+  // Only consume bytes already in the UART buffer — never wait for '\n'
+  while (mega1Rx.poll(Serial1)) handleMegaLine(1, mega1Rx.line());
+  while (mega2Rx.poll(Serial2)) handleMegaLine(2, mega2Rx.line());
+}
+
+void handleMegaLine(int megaNum, const char* line) {
+  MegaReply reply;
+  if (!parseMegaReply(line, reply)) return;
+
+  if (reply.type == MEGA_REPLY_PONG) {
+    if (megaNum == 1) { mega1Alive = true; lastHeartbeatMega1 = millis(); }
+    else              { mega2Alive = true; lastHeartbeatMega2 = millis(); }
+    return;
   }
-  while (Serial2.available()) {
-    String line = Serial2.readStringUntil('\n');
-    line.trim();
-    if (line == "PONG") { mega2Alive = true; lastHeartbeatMega2 = millis(); }
+
+  // ACK:BLOCK:N:ACTION, ACK:ALL:STOP, ERR:UNKNOWN_BLOCK:N answer the oldest
+  // unanswered line. ERR:BLOCK:N:...TIMEOUT is the relay's own actuator
+  // timeout, not a reply. Timed when LineReader completes the line: no
+  // readStringUntil() wait ends up in the histogram
+  bool unsolicited = (reply.type == MEGA_REPLY_ERROR && reply.blockNum != 0);
+  if ((reply.type == MEGA_REPLY_ACK || reply.type == MEGA_REPLY_ERROR) && !unsolicited) {
+    int32_t us = latencyTextReply(megaLatency[megaNum], micros());
+    if (reply.type == MEGA_REPLY_ERROR) megaLatency[megaNum].rejected++;
+    if (us >= 0 && reply.type == MEGA_REPLY_ACK && reply.blockNum >= 1 && reply.blockNum <= TOTAL_BLOCKS) {
+      perfHistAdd(blockAckUs[reply.blockNum], (uint32_t)us);
+    }
+    return;
+  }
+
+  // ERR:BLOCK:N:ACTx:TIMEOUT — the relay cut power after ACTUATOR_TIMEOUT_MS:
+  // the move is over on the Mega side even if our timer has not fired yet
+  if (reply.type == MEGA_REPLY_ERROR && reply.blockNum >= 1 && reply.blockNum <= TOTAL_BLOCKS) {
+    blockMotionEvent(reply.blockNum, MOTION_EV_DONE);
   }
 }
 
@@ -621,20 +814,22 @@ void checkSafety() {
   if (now - lastHeartbeatMega1 > HEARTBEAT_INTERVAL * 3 && mega1Alive) {
     Serial.println("[SAFETY] Mega#1 heartbeat lost! Stopping blocks 1-8");
     mega1Alive = false;
+    latencyTextDrop(megaLatency[1]);       // Replies to earlier lines are not coming
     Serial1.println("ALL:STOP");
+    megaLineSent(1);
     for (int i = MEGA1_BLOCK_START; i <= MEGA1_BLOCK_END; i++) {
-      if (blockStates[i] == STATE_UP) activeBlockCount = max(0, activeBlockCount - 1);
-      blockStates[i] = STATE_STOP;
+      blockMotionEvent(i, MOTION_EV_FAULT);  // Position unknown until the next command
     }
   }
 
   if (now - lastHeartbeatMega2 > HEARTBEAT_INTERVAL * 3 && mega2Alive) {
     Serial.println("[SAFETY] Mega#2 heartbeat lost! Stopping blocks 9-15");
     mega2Alive = false;
+    latencyTextDrop(megaLatency[2]);       // Replies to earlier lines are not coming
     Serial2.println("ALL:STOP");
+    megaLineSent(2);
     for (int i = MEGA2_BLOCK_START; i <= MEGA2_BLOCK_END; i++) {
-      if (blockStates[i] == STATE_UP) activeBlockCount = max(0, activeBlockCount - 1);
-      blockStates[i] = STATE_STOP;
+      blockMotionEvent(i, MOTION_EV_FAULT);  // Position unknown until the next command
     }
   }
 }
@@ -658,7 +853,7 @@ void updateLeds() {
   }
   // Soft highlight for DOWN blocks only (UP blocks don't interfere with effects)
   for (int i = 1; i <= TOTAL_BLOCKS; i++) {
-    if (blockStates[i] == STATE_DOWN) {
+    if (blockMotion[i] == MOTION_LOWERING) {
       // Soft orange overlay (30% opacity) - doesn't kill the effect
       LedSegment seg = blockLeds[i];
       for (int j = seg.start; j < seg.start + seg.count && j < NUM_LEDS; j++) {
@@ -674,7 +869,7 @@ void updateLeds() {
       }
     }
   }
-  strip.show();
+  // strip.show() is called by loop() after ControlLock is released
 }
 
 void ledRainbow() {
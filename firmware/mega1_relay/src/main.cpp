@@ -4,14 +4,33 @@
  * Serial1 (RX=19, TX=18) ← ESP32
  * Pins 22–53: 16 actuators (2 per block), each H-Bridge uses 2 pins
  * Total: 8 blocks × 2 actuators × 2 pins = 32 pins
+ *
+ * Без delay(): каждый актуатор - автомат IDLE → DEADTIME → DRIVING,
+ * переходы по micros() в serviceActuators(). ALL:UP/DOWN только
+ * расписывает старты (stagger), поэтому ALL:STOP, PING и приём UART
+ * обрабатываются на следующем проходе loop() в любой момент
  */
 
 #include <Arduino.h>
 #include "protocol.h"
 
+// Пауза между актуаторами одного блока (пусковой ток)
+#define ACTUATOR_STAGGER_MS 50
+// Длина строки команды (BLOCK:8:DOWN + запас)
+#define CMD_LINE_MAX        32
+
+enum ActuatorPhase : uint8_t {
+  PHASE_IDLE = 0,   // Реле выключены
+  PHASE_DEADTIME,   // Реле выключены, ждём dueUs до включения target
+  PHASE_DRIVING     // Реле направления state включено
+};
+
 struct Actuator {
-  int pinUp, pinDown, state;
+  int pinUp, pinDown, state;    // state: 1 = вверх, -1 = вниз, 0 = стоп
   unsigned long actionTime;
+  uint8_t phase;
+  int target;                   // Направление после DEADTIME
+  unsigned long dueUs;          // micros() окончания DEADTIME
 };
 
 struct Block {
@@ -44,6 +63,7 @@ void stopActuator(Actuator &act) {
   digitalWrite(act.pinUp, RELAY_OFF);
   digitalWrite(act.pinDown, RELAY_OFF);
   act.state = 0;
+  act.phase = PHASE_IDLE;   // Отменяет и запланированный старт
 }
 
 void stopBlock(int idx) {
@@ -51,34 +71,47 @@ void stopBlock(int idx) {
   stopActuator(blocks[idx].act2);
 }
 
-void moveActuatorUp(Actuator &act) {
-  if (act.state == 1) return;
+/**
+ * Запланировать движение: реле выключаются сразу, нужное включится
+ * через startDelayMs + DEADTIME_MS (в serviceActuators)
+ */
+void scheduleActuator(Actuator &act, int dir, unsigned long startDelayMs) {
+  if (act.state == dir && act.phase == PHASE_DRIVING) return;
+  if (act.target == dir && act.phase == PHASE_DEADTIME) return;
   stopActuator(act);
-  delay(DEADTIME_MS);
-  digitalWrite(act.pinUp, RELAY_ON);
-  act.state = 1;
-  act.actionTime = millis();
+  act.target = dir;
+  act.dueUs = micros() + (startDelayMs + DEADTIME_MS) * 1000UL;
+  act.phase = PHASE_DEADTIME;
 }
 
-void moveActuatorDown(Actuator &act) {
-  if (act.state == -1) return;
-  stopActuator(act);
-  delay(DEADTIME_MS);
-  digitalWrite(act.pinDown, RELAY_ON);
-  act.state = -1;
-  act.actionTime = millis();
+void moveUp(int idx, unsigned long startDelayMs = 0) {
+  scheduleActuator(blocks[idx].act1, 1, startDelayMs);
+  scheduleActuator(blocks[idx].act2, 1, startDelayMs + ACTUATOR_STAGGER_MS);
 }
 
-void moveUp(int idx) {
-  moveActuatorUp(blocks[idx].act1);
-  delay(50);  // Небольшая задержка между актуаторами
-  moveActuatorUp(blocks[idx].act2);
+void moveDown(int idx, unsigned long startDelayMs = 0) {
+  scheduleActuator(blocks[idx].act1, -1, startDelayMs);
+  scheduleActuator(blocks[idx].act2, -1, startDelayMs + ACTUATOR_STAGGER_MS);
 }
 
-void moveDown(int idx) {
-  moveActuatorDown(blocks[idx].act1);
-  delay(50);
-  moveActuatorDown(blocks[idx].act2);
+/**
+ * DEADTIME → DRIVING для актуаторов, чьё время пришло
+ * (разность со знаком - переживает переполнение micros())
+ */
+void serviceActuator(Actuator &act, unsigned long nowUs) {
+  if (act.phase != PHASE_DEADTIME || (long)(nowUs - act.dueUs) < 0) return;
+  digitalWrite(act.target == 1 ? act.pinUp : act.pinDown, RELAY_ON);
+  act.state = act.target;
+  act.phase = PHASE_DRIVING;
+  act.actionTime = millis();
+}
+
+void serviceActuators() {
+  unsigned long nowUs = micros();
+  for (int i = 0; i < NUM_BLOCKS; i++) {
+    serviceActuator(blocks[i].act1, nowUs);
+    serviceActuator(blocks[i].act2, nowUs);
+  }
 }
 
 void stopAll() {
@@ -109,9 +142,8 @@ void processCommand(String cmd) {
   if (cmd.startsWith("ALL:")) {
     String action = cmd.substring(4);
     for (int i = 0; i < NUM_BLOCKS; i++) {
-      if (action == ACTION_UP) moveUp(i);
-      else if (action == ACTION_DOWN) moveDown(i);
-      delay(STAGGER_DELAY_MS);
+      if (action == ACTION_UP) moveUp(i, (unsigned long)i * STAGGER_DELAY_MS);
+      else if (action == ACTION_DOWN) moveDown(i, (unsigned long)i * STAGGER_DELAY_MS);
     }
     Serial1.println("ACK:" + cmd);
     Serial.println("ACK:" + cmd);
@@ -145,6 +177,37 @@ void processCommand(String cmd) {
   Serial.println("ACK:BLOCK:" + String(blockId) + ":" + action);
 }
 
+/**
+ * Накопить строку без ожидания (readStringUntil ждал бы до 1 с на обрывке)
+ * @return true когда строка завершена '\n'
+ */
+struct LineBuffer {
+  char buf[CMD_LINE_MAX + 1];
+  uint8_t len;
+};
+
+bool readLine(Stream &port, LineBuffer &line) {
+  while (port.available()) {
+    char c = (char)port.read();
+    if (c == '\n') {
+      line.buf[line.len] = '\0';
+      line.len = 0;
+      return true;
+    }
+    if (line.len < CMD_LINE_MAX) line.buf[line.len++] = c;
+  }
+  return false;
+}
+
+LineBuffer espLine;
+LineBuffer usbLine;
+
+void handleLine(LineBuffer &line) {
+  String cmd(line.buf);
+  cmd.trim();
+  if (cmd.length() > 0) processCommand(cmd);
+}
+
 void setup() {
   Serial.begin(SERIAL_BAUD);
   Serial1.begin(SERIAL_BAUD);
@@ -168,16 +231,11 @@ void setup() {
 }
 
 void loop() {
-  if (Serial1.available()) {
-    String cmd = Serial1.readStringUntil('\n');
-    cmd.trim();
-    if (cmd.length() > 0) processCommand(cmd);
-  }
-  if (Serial.available()) {
-    String cmd = Serial.readStringUntil('\n');
-    cmd.trim();
-    if (cmd.length() > 0) processCommand(cmd);
-  }
+  if (readLine(Serial1, espLine)) handleLine(espLine);
+  if (readLine(Serial, usbLine)) handleLine(usbLine);
+
+  serviceActuators();
+
   unsigned long now = millis();
   for (int i = 0; i < NUM_BLOCKS; i++) {
     // Проверяем timeout для актуатора 1
@@ -3,14 +3,30 @@
  * Blocks 9–15 (Inner Ring 9–14 + Center 15)
  * Serial1 (RX=19, TX=18) ← ESP32
  * Pins 22–35: 7 relay modules (H-Bridge)
+ *
+ * Без delay(): каждый блок - автомат IDLE → DEADTIME → DRIVING,
+ * переходы по micros() в serviceBlocks(). ALL:STOP обрабатывается
+ * на следующем проходе loop() в любой момент последовательности
  */
 
 #include <Arduino.h>
 #include "protocol.h"
 
+// Длина строки команды (BLOCK:15:DOWN + запас)
+#define CMD_LINE_MAX 32
+
+enum BlockPhase : uint8_t {
+  PHASE_IDLE = 0,   // Реле выключены
+  PHASE_DEADTIME,   // Реле выключены, ждём dueUs до включения target
+  PHASE_DRIVING     // Реле направления state включено
+};
+
 struct Block {
-  int id, pinUp, pinDown, state;
+  int id, pinUp, pinDown, state;  // state: 1 = вверх, -1 = вниз, 0 = стоп
   unsigned long actionTime;
+  uint8_t phase;
+  int target;                     // Направление после DEADTIME
+  unsigned long dueUs;            // micros() окончания DEADTIME
 };
 
 Block blocks[7] = {
@@ -23,24 +39,40 @@ void stopBlock(int idx) {
   digitalWrite(blocks[idx].pinUp, RELAY_OFF);
   digitalWrite(blocks[idx].pinDown, RELAY_OFF);
   blocks[idx].state = 0;
+  blocks[idx].phase = PHASE_IDLE;   // Отменяет и запланированный старт
 }
 
-void moveUp(int idx) {
-  if (blocks[idx].state == 1) return;
+/**
+ * Запланировать движение: реле выключаются сразу, нужное включится
+ * через startDelayMs + DEADTIME_MS (в serviceBlocks)
+ */
+void scheduleBlock(int idx, int dir, unsigned long startDelayMs) {
+  Block &b = blocks[idx];
+  if (b.state == dir && b.phase == PHASE_DRIVING) return;
+  if (b.target == dir && b.phase == PHASE_DEADTIME) return;
   stopBlock(idx);
-  delay(DEADTIME_MS);
-  digitalWrite(blocks[idx].pinUp, RELAY_ON);
-  blocks[idx].state = 1;
-  blocks[idx].actionTime = millis();
+  b.target = dir;
+  b.dueUs = micros() + (startDelayMs + DEADTIME_MS) * 1000UL;
+  b.phase = PHASE_DEADTIME;
 }
 
-void moveDown(int idx) {
-  if (blocks[idx].state == -1) return;
-  stopBlock(idx);
-  delay(DEADTIME_MS);
-  digitalWrite(blocks[idx].pinDown, RELAY_ON);
-  blocks[idx].state = -1;
-  blocks[idx].actionTime = millis();
+void moveUp(int idx, unsigned long startDelayMs = 0) { scheduleBlock(idx, 1, startDelayMs); }
+void moveDown(int idx, unsigned long startDelayMs = 0) { scheduleBlock(idx, -1, startDelayMs); }
+
+/**
+ * DEADTIME → DRIVING для блоков, чьё время пришло
+ * (разность со знаком - переживает переполнение micros())
+ */
+void serviceBlocks() {
+  unsigned long nowUs = micros();
+  for (int i = 0; i < NUM_BLOCKS; i++) {
+    Block &b = blocks[i];
+    if (b.phase != PHASE_DEADTIME || (long)(nowUs - b.dueUs) < 0) continue;
+    digitalWrite(b.target == 1 ? b.pinUp : b.pinDown, RELAY_ON);
+    b.state = b.target;
+    b.phase = PHASE_DRIVING;
+    b.actionTime = millis();
+  }
 }
 
 void stopAll() { for (int i = 0; i < NUM_BLOCKS; i++) stopBlock(i); }
@@ -56,9 +88,8 @@ void processCommand(String cmd) {
   if (cmd.startsWith("ALL:")) {
     String action = cmd.substring(4);
     for (int i = 0; i < NUM_BLOCKS; i++) {
-      if (action == ACTION_UP) moveUp(i);
-      else if (action == ACTION_DOWN) moveDown(i);
-      delay(STAGGER_DELAY_MS);
+      if (action == ACTION_UP) moveUp(i, (unsigned long)i * STAGGER_DELAY_MS);
+      else if (action == ACTION_DOWN) moveDown(i, (unsigned long)i * STAGGER_DELAY_MS);
     }
     Serial1.println("ACK:" + cmd);
     return;
@@ -77,6 +108,37 @@ void processCommand(String cmd) {
   Serial1.println("ACK:BLOCK:" + String(blockId) + ":" + action);
 }
 
+/**
+ * Накопить строку без ожидания (readStringUntil ждал бы до 1 с на обрывке)
+ * @return true когда строка завершена '\n'
+ */
+struct LineBuffer {
+  char buf[CMD_LINE_MAX + 1];
+  uint8_t len;
+};
+
+bool readLine(Stream &port, LineBuffer &line) {
+  while (port.available()) {
+    char c = (char)port.read();
+    if (c == '\n') {
+      line.buf[line.len] = '\0';
+      line.len = 0;
+      return true;
+    }
+    if (line.len < CMD_LINE_MAX) line.buf[line.len++] = c;
+  }
+  return false;
+}
+
+LineBuffer espLine;
+LineBuffer usbLine;
+
+void handleLine(LineBuffer &line) {
+  String cmd(line.buf);
+  cmd.trim();
+  if (cmd.length() > 0) processCommand(cmd);
+}
+
 void setup() {
   Serial.begin(SERIAL_BAUD);
   Serial1.begin(SERIAL_BAUD);
@@ -90,16 +152,11 @@ void setup() {
 }
 
 void loop() {
-  if (Serial1.available()) {
-    String cmd = Serial1.readStringUntil('\n');
-    cmd.trim();
-    if (cmd.length() > 0) processCommand(cmd);
-  }
-  if (Serial.available()) {
-    String cmd = Serial.readStringUntil('\n');
-    cmd.trim();
-    if (cmd.length() > 0) processCommand(cmd);
-  }
+  if (readLine(Serial1, espLine)) handleLine(espLine);
+  if (readLine(Serial, usbLine)) handleLine(usbLine);
+
+  serviceBlocks();
+
   unsigned long now = millis();
   for (int i = 0; i < NUM_BLOCKS; i++) {
     if (blocks[i].state != 0 && (now - blocks[i].actionTime > ACTUATOR_TIMEOUT_MS)) {
@@ -0,0 +1,122 @@
+/**
+ * RAMS BLOCK MOTION - конечный автомат движения блока на ESP32
+ *
+ * Раньше состояние блока было isActive + startTime + duration, а
+ * "поднят / опущен / остановлен посередине" не хранилось нигде. Теперь
+ * у каждого блока одно из состояний:
+ *
+ *   IDLE_DOWN    внизу, стоит
+ *   RISING       едет вверх (UP, POS выше текущего положения)
+ *   UP           вверху, стоит
+ *   LOWERING     едет вниз (DOWN, POS ниже)
+ *   STOPPED_MID  стоит между упорами (STOP, POS на середину)
+ *   FAULT        положение неизвестно: команда отклонена / потеряна,
+ *                связь с Mega пропала во время хода
+ *
+ * Переходы:
+ *   RAISE / LOWER (команда)      любое -> RISING / LOWERING
+ *   STOP (команда)               RISING, LOWERING -> STOPPED_MID
+ *   DONE (DONE от Mega, таймаут) RISING, LOWERING -> rest (цель хода)
+ *   FAULT (NAK, нет ACK, связь)  RISING, LOWERING -> FAULT
+ *   STATUS от Mega               любое -> по upMask / downMask / положению
+ *
+ * Прочие пары (событие, состояние) состояние не меняют. Движется блок
+ * только в RISING / LOWERING - от этого считаются активные блоки и
+ * нагрузка на БП.
+ *
+ * Логика не зависит от Arduino: скетч сам решает, какое событие
+ * произошло, и применяет следствия перехода (таймер, LED, счётчики).
+ *
+ * MOTION_CHECKS 1 - скетч сверяет производные значения с состояниями
+ * после каждого прохода loop() (отладочная сборка).
+ *
+ * @version 1.0
+ * @date 2026-04-02
+ * @author RAMS Global Team
+ */
+
+#ifndef BLOCK_MOTION_H
+#define BLOCK_MOTION_H
+
+#include <Arduino.h>
+
+#ifndef MOTION_CHECKS
+#define MOTION_CHECKS 0
+#endif
+
+#define MOTION_POS_UNKNOWN  0xFF        // = FRAME_STATUS_POS_UNKNOWN
+
+// ============================================================================
+// СОСТОЯНИЯ И СОБЫТИЯ
+// ============================================================================
+
+enum BlockMotion : uint8_t {
+  MOTION_IDLE_DOWN = 0,     // Начальное: до первого STATUS считаем блок внизу
+  MOTION_RISING,
+  MOTION_UP,
+  MOTION_LOWERING,
+  MOTION_STOPPED_MID,
+  MOTION_FAULT,
+  MOTION_COUNT
+};
+
+enum MotionEvent : uint8_t {
+  MOTION_EV_RAISE = 0,      // Команда вверх
+  MOTION_EV_LOWER,          // Команда вниз
+  MOTION_EV_STOP,           // Команда STOP
+  MOTION_EV_DONE,           // Ход завершён (DONE от Mega / свой таймаут)
+  MOTION_EV_FAULT           // NAK, команда без ACK, связь потеряна
+};
+
+inline const char* motionName(uint8_t state) {
+  static const char* const names[MOTION_COUNT] = {
+    "down", "rising", "up", "lowering", "mid", "fault"
+  };
+  return state < MOTION_COUNT ? names[state] : "?";
+}
+
+inline bool motionMoving(uint8_t state) {
+  return state == MOTION_RISING || state == MOTION_LOWERING;
+}
+
+/**
+ * Состояние в конце хода к положению target (% хода)
+ */
+inline uint8_t motionRestAt(uint8_t target) {
+  if (target == 0) return MOTION_IDLE_DOWN;
+  if (target >= 100) return MOTION_UP;
+  return MOTION_STOPPED_MID;
+}
+
+// ============================================================================
+// ПЕРЕХОДЫ
+// ============================================================================
+
+/**
+ * Следующее состояние по событию
+ * @param rest Куда придёт текущий ход (для DONE)
+ */
+inline uint8_t motionNext(uint8_t state, uint8_t event, uint8_t rest) {
+  switch (event) {
+    case MOTION_EV_RAISE: return MOTION_RISING;
+    case MOTION_EV_LOWER: return MOTION_LOWERING;
+    case MOTION_EV_STOP:  return motionMoving(state) ? (uint8_t)MOTION_STOPPED_MID : state;
+    case MOTION_EV_DONE:  return motionMoving(state) ? rest : state;
+    case MOTION_EV_FAULT: return motionMoving(state) ? (uint8_t)MOTION_FAULT : state;
+  }
+  return state;
+}
+
+/**
+ * Сверка с кадром STATUS: реле Mega и её положение важнее своей модели
+ * Положение неизвестно - закончившийся ход приходит в rest, остальное
+ * (в т.ч. FAULT) не меняется
+ */
+inline uint8_t motionFromStatus(uint8_t state, uint8_t rest, bool up, bool down, uint8_t pos) {
+  if (up) return MOTION_RISING;
+  if (down) return MOTION_LOWERING;
+  if (pos == MOTION_POS_UNKNOWN) return motionMoving(state) ? rest : state;
+  return motionRestAt(pos);
+}
+
+#endif // BLOCK_MOTION_H
@@ -0,0 +1,424 @@
+/**
+ * RAMS MEGA LINK - неблокирующее чтение строк ESP32 ↔ Mega
+ *
+ * Заменяет Stream::readStringUntil('\n'), который на неполной строке
+ * ждёт до 1 секунды (Stream timeout) и аллоцирует String на каждую строку.
+ *
+ * LineReader копит байты UART в фиксированном буфере за каждый проход loop()
+ * и отдаёт готовую строку только когда пришёл '\n'. parseMegaReply() разбирает
+ * ответ Mega без String / sscanf.
+ *
+ * На стороне Mega parseMegaCommand() разбирает команду ESP32 тем же
+ * однопроходным токенайзером, ответ собирается в char буфере (MegaReplyBuf)
+ * и уходит одним write - ни одной String на команду. Постоянные части ответа
+ * на Mega - F("..."): строка остаётся во flash, а не занимает SRAM.
+ *
+ * ВАЖНО: Этот файл используется в:
+ * - ESP32 v3.3 (rams_controller_v3)
+ * - ESP32 Master (esp32_master, через firmware/shared)
+ * - Arduino Mega #1 / #2 (actuator_mega1_v3, actuator_mega2_v3)
+ *
+ * @version 1.4
+ * @date 2026-03-29
+ * @author RAMS Global Team
+ */
+
+#ifndef MEGA_LINK_H
+#define MEGA_LINK_H
+
+#include <Arduino.h>
+
+// ============================================================================
+// КОНСТАНТЫ
+// ============================================================================
+
+// Максимальная длина строки протокола (самая длинная: "ERR:BLOCK:15:ACT3:TIMEOUT")
+#define MEGA_LINK_LINE_MAX  64
+
+// ============================================================================
+// НЕБЛОКИРУЮЩИЙ LINE READER
+// ============================================================================
+
+/**
+ * Буфер строки для одного UART
+ *
+ * poll() забирает только то, что уже лежит в RX буфере UART, и никогда не ждёт.
+ * Возвращает true, когда собрана полная строка (без '\r'/'\n', с '\0').
+ * Слишком длинная строка отбрасывается целиком до следующего '\n'.
+ *
+ * Использование:
+ *   while (mega1Rx.poll(Mega1Serial)) handleMegaLine(1, mega1Rx.line());
+ */
+class LineReader {
+public:
+  LineReader() : _len(0), _ready(false), _discard(false), _overflows(0) {
+    _buf[0] = '\0';
+  }
+
+  template <typename TStream>
+  bool poll(TStream& in) {
+    if (_ready) {
+      // Предыдущая строка уже отдана - начинаем новую
+      _ready = false;
+      _len = 0;
+    }
+
+    while (in.available() > 0) {
+      int c = in.read();
+      if (c < 0) break;
+      if (feed((char)c)) return true;
+    }
+    return false;
+  }
+
+  /**
+   * Добавить один байт (для чтения не из Stream, например из ring buffer)
+   * @return true если строка завершена этим байтом
+   */
+  bool feed(char c) {
+    if (_ready) {
+      _ready = false;
+      _len = 0;
+    }
+
+    if (c == '\n') {
+      bool complete = !_discard && _len > 0;
+      _discard = false;
+      _buf[_len] = '\0';
+      if (!complete) {
+        _len = 0;
+        return false;
+      }
+      _ready = true;
+      return true;
+    }
+
+    if (c == '\r' || _discard) return false;
+
+    if (_len >= MEGA_LINK_LINE_MAX - 1) {
+      // Переполнение - строка битая, выбрасываем её до конца
+      _discard = true;
+      _len = 0;
+      _overflows++;
+      return false;
+    }
+
+    _buf[_len++] = c;
+    return false;
+  }
+
+  const char* line() const { return _buf; }
+  uint8_t length() const { return _len; }
+  uint32_t overflows() const { return _overflows; }
+
+private:
+  char _buf[MEGA_LINK_LINE_MAX];
+  uint8_t _len;
+  bool _ready;
+  bool _discard;
+  uint32_t _overflows;
+};
+
+// ============================================================================
+// РАЗБОР ОТВЕТОВ MEGA (БЕЗ String)
+// ============================================================================
+
+enum MegaAction : uint8_t {
+  MEGA_ACTION_NONE = 0,
+  MEGA_ACTION_UP,
+  MEGA_ACTION_DOWN,
+  MEGA_ACTION_STOP,
+  MEGA_ACTION_POS     // Положение блока в % (BLOCK:5:POS:60)
+};
+
+enum MegaReplyType : uint8_t {
+  MEGA_REPLY_UNKNOWN = 0,
+  MEGA_REPLY_PONG,    // PONG
+  MEGA_REPLY_ACK,     // ACK:5:UP | ACK:0:STOP | ACK:BLOCK:5:UP | ACK:ALL:STOP | ACK:GROUP:6:UP
+  MEGA_REPLY_DONE,    // DONE:5
+  MEGA_REPLY_ERROR,   // ERROR:message | ERR:BLOCK:3:ACT1:TIMEOUT
+  MEGA_REPLY_PROTO    // PROTO:4 (Mega поддерживает бинарные кадры, FRAME_CODEC.h)
+};
+
+struct MegaReply {
+  MegaReplyType type;
+  uint8_t blockNum;       // 0 = все блоки / не указан
+  uint16_t blockMask;     // ACK:GROUP - блоки группы (бит n-1 = блок n)
+  MegaAction action;
+  const char* detail;     // Хвост строки после типа (указатель в исходную строку)
+};
+
+/**
+ * Проверить что токен в p равен word (токен заканчивается ':' или '\0')
+ * При совпадении p сдвигается за разделитель
+ */
+inline bool megaLinkTakeToken(const char*& p, const char* word) {
+  const char* s = p;
+  while (*word) {
+    if (*s != *word) return false;
+    s++;
+    word++;
+  }
+  if (*s != ':' && *s != '\0') return false;
+  p = (*s == ':') ? s + 1 : s;
+  return true;
+}
+
+/**
+ * Прочитать беззнаковое число до ':' или '\0'
+ * @return false если токен не число
+ */
+inline bool megaLinkTakeUint(const char*& p, uint32_t& out) {
+  const char* s = p;
+  uint32_t v = 0;
+  if (*s < '0' || *s > '9') return false;
+  while (*s >= '0' && *s <= '9') {
+    v = v * 10 + (uint32_t)(*s - '0');
+    s++;
+  }
+  if (*s != ':' && *s != '\0') return false;
+  p = (*s == ':') ? s + 1 : s;
+  out = v;
+  return true;
+}
+
+/**
+ * Декодировать действие (UP / DOWN / STOP / POS)
+ */
+inline MegaAction megaLinkTakeAction(const char*& p) {
+  if (megaLinkTakeToken(p, "UP")) return MEGA_ACTION_UP;
+  if (megaLinkTakeToken(p, "DOWN")) return MEGA_ACTION_DOWN;
+  if (megaLinkTakeToken(p, "STOP")) return MEGA_ACTION_STOP;
+  if (megaLinkTakeToken(p, "POS")) return MEGA_ACTION_POS;
+  return MEGA_ACTION_NONE;
+}
+
+inline const char* megaActionName(MegaAction action) {
+  switch (action) {
+    case MEGA_ACTION_UP:   return "UP";
+    case MEGA_ACTION_DOWN: return "DOWN";
+    case MEGA_ACTION_STOP: return "STOP";
+    case MEGA_ACTION_POS:  return "POS";
+    default:               return "NONE";
+  }
+}
+
+/**
+ * Разобрать строку ответа Mega за один проход
+ * Понимает формат v3 (ACK:5:UP, DONE:5, ERROR:...) и relay-прошивок
+ * (ACK:BLOCK:5:UP, ACK:ALL:STOP, ERR:BLOCK:3:ACT1:TIMEOUT)
+ * @return false если строка не распознана (out.type = MEGA_REPLY_UNKNOWN)
+ */
+inline bool parseMegaReply(const char* line, MegaReply& out) {
+  out.type = MEGA_REPLY_UNKNOWN;
+  out.blockNum = 0;
+  out.blockMask = 0;
+  out.action = MEGA_ACTION_NONE;
+  out.detail = line;
+
+  const char* p = line;
+  uint32_t num = 0;
+
+  if (megaLinkTakeToken(p, "PONG")) {
+    out.type = MEGA_REPLY_PONG;
+    out.detail = p;
+    return true;
+  }
+
+  if (megaLinkTakeToken(p, "PROTO")) {
+    out.type = MEGA_REPLY_PROTO;
+    out.detail = p;           // Номер версии протокола
+    return true;
+  }
+
+  if (megaLinkTakeToken(p, "ACK")) {
+    out.type = MEGA_REPLY_ACK;
+    if (megaLinkTakeToken(p, "ALL")) {
+      out.blockNum = 0;
+    } else if (megaLinkTakeToken(p, "GROUP")) {
+      if (megaLinkTakeUint(p, num)) out.blockMask = (uint16_t)num;
+    } else {
+      megaLinkTakeToken(p, "BLOCK");
+      if (megaLinkTakeUint(p, num)) out.blockNum = (uint8_t)num;
+    }
+    out.action = megaLinkTakeAction(p);
+    out.detail = p;
+    return true;
+  }
+
+  if (megaLinkTakeToken(p, "DONE")) {
+    out.type = MEGA_REPLY_DONE;
+    if (megaLinkTakeUint(p, num)) out.blockNum = (uint8_t)num;
+    out.detail = p;
+    return true;
+  }
+
+  if (megaLinkTakeToken(p, "ERROR") || megaLinkTakeToken(p, "ERR")) {
+    out.type = MEGA_REPLY_ERROR;
+    if (megaLinkTakeToken(p, "BLOCK") && megaLinkTakeUint(p, num)) {
+      out.blockNum = (uint8_t)num;
+    }
+    out.detail = p;
+    return true;
+  }
+
+  return false;
+}
+
+// ============================================================================
+// РАЗБОР КОМАНД ESP32 НА MEGA (БЕЗ String / sscanf)
+// ============================================================================
+
+enum MegaCommandType : uint8_t {
+  MEGA_CMD_UNKNOWN = 0,
+  MEGA_CMD_PING,      // PING
+  MEGA_CMD_PROTO,     // PROTO:4
+  MEGA_CMD_ALL_STOP,  // ALL:STOP
+  MEGA_CMD_BLOCK,     // BLOCK:5:UP:10000 | BLOCK:5:STOP | BLOCK:5:POS:60
+  MEGA_CMD_GROUP      // GROUP:6:UP:10000 - блоки 2 и 3 (маска: бит n-1 = блок n)
+};
+
+struct MegaCommand {
+  MegaCommandType type;
+  bool hasBlock;          // BLOCK: номер разобран, GROUP: маска разобрана
+  uint8_t blockNum;
+  uint16_t blockMask;     // GROUP
+  MegaAction action;      // MEGA_ACTION_NONE = неизвестное действие
+  uint32_t duration;      // 0 = не указана; POS - цель в %
+  uint32_t protoVersion;
+};
+
+/**
+ * Действие и длительность после номера блока / маски группы
+ */
+inline void megaLinkTakeMove(const char*& p, MegaCommand& out) {
+  uint32_t num = 0;
+  out.action = megaLinkTakeAction(p);
+  if (out.action != MEGA_ACTION_NONE && megaLinkTakeUint(p, num)) out.duration = num;
+  else if (out.action == MEGA_ACTION_POS) out.action = MEGA_ACTION_NONE;  // POS без цели
+}
+
+/**
+ * Разобрать строку команды за один проход
+ * Номер блока и действие не проверяются по диапазону - это делает Mega
+ * @return false если команда не распознана (out.type = MEGA_CMD_UNKNOWN)
+ */
+inline bool parseMegaCommand(const char* line, MegaCommand& out) {
+  out.type = MEGA_CMD_UNKNOWN;
+  out.hasBlock = false;
+  out.blockNum = 0;
+  out.blockMask = 0;
+  out.action = MEGA_ACTION_NONE;
+  out.duration = 0;
+  out.protoVersion = 0;
+
+  const char* p = line;
+  while (*p == ' ') p++;
+
+  uint32_t num = 0;
+
+  if (megaLinkTakeToken(p, "PING")) {
+    if (*p != '\0') return false;
+    out.type = MEGA_CMD_PING;
+    return true;
+  }
+
+  if (megaLinkTakeToken(p, "PROTO")) {
+    if (!megaLinkTakeUint(p, num)) return false;
+    out.type = MEGA_CMD_PROTO;
+    out.protoVersion = num;
+    return true;
+  }
+
+  // Только ALL:STOP целиком: опечатка (ALLUP, ALL:UP) - неизвестная команда,
+  // а не остановка всех блоков без ответа об ошибке
+  if (strcmp(p, "ALL:STOP") == 0) {
+    out.type = MEGA_CMD_ALL_STOP;
+    return true;
+  }
+
+  if (megaLinkTakeToken(p, "BLOCK")) {
+    out.type = MEGA_CMD_BLOCK;
+    if (!megaLinkTakeUint(p, num) || num > 255) return true;
+    out.hasBlock = true;
+    out.blockNum = (uint8_t)num;
+    megaLinkTakeMove(p, out);
+    return true;
+  }
+
+  if (megaLinkTakeToken(p, "GROUP")) {
+    out.type = MEGA_CMD_GROUP;
+    if (!megaLinkTakeUint(p, num) || num > 0xFFFF) return true;
+    out.hasBlock = true;
+    out.blockMask = (uint16_t)num;
+    megaLinkTakeMove(p, out);
+    return true;
+  }
+
+  return false;
+}
+
+// ============================================================================
+// ОТВЕТ MEGA БЕЗ String
+// ============================================================================
+
+/**
+ * Строка ответа в фиксированном буфере: "ACK:" + 5 + ":" + "UP" + "\r\n"
+ * Переполнение обрезает строку, а не пишет за буфер
+ */
+struct MegaReplyBuf {
+  char text[MEGA_LINK_LINE_MAX];
+  uint8_t len;
+
+  MegaReplyBuf() : len(0) { text[0] = '\0'; }
+
+  MegaReplyBuf& add(const char* s) {
+    while (*s && len < MEGA_LINK_LINE_MAX - 3) text[len++] = *s++;
+    text[len] = '\0';
+    return *this;
+  }
+
+  /**
+   * Строка из flash (F("...")) - на AVR читается через pgm_read_byte
+   */
+  MegaReplyBuf& add(const __FlashStringHelper* fs) {
+    PGM_P s = reinterpret_cast<PGM_P>(fs);
+    char c;
+    while ((c = (char)pgm_read_byte(s++)) != '\0' && len < MEGA_LINK_LINE_MAX - 3) text[len++] = c;
+    text[len] = '\0';
+    return *this;
+  }
+
+  MegaReplyBuf& add(char c) {
+    if (len < MEGA_LINK_LINE_MAX - 3) text[len++] = c;
+    text[len] = '\0';
+    return *this;
+  }
+
+  /**
+   * Беззнаковое число (itoa без деления на каждый вызов String)
+   */
+  MegaReplyBuf& add(uint32_t v) {
+    char digits[10];
+    uint8_t n = 0;
+    do {
+      digits[n++] = (char)('0' + v % 10);
+      v /= 10;
+    } while (v > 0);
+    while (n > 0) add(digits[--n]);
+    return *this;
+  }
+
+  /**
+   * Завершить строку "\r\n" (как println)
+   * @return Длина для write()
+   */
+  uint8_t line() {
+    text[len++] = '\r';
+    text[len++] = '\n';
+    text[len] = '\0';
+    return len;
+  }
+};
+
+#endif // MEGA_LINK_H
@@ -0,0 +1,102 @@
+/**
+ * Arduino.h для хост-тестов: ровно то, что берут заголовки прошивки
+ *
+ * Заголовки протокола и логики (MEGA_LINK.h, FRAME_CODEC.h, DEADLINE_HEAP.h
+ * и т.д.) время получают параметром и от железа не зависят - здесь только
+ * типы, PROGMEM-макросы и String поверх std::string. ACTUATOR_CONFIG.h
+ * вдобавок печатает таблицу и дёргает пины - для него пустые Serial и GPIO.
+ *
+ * millis() / micros() - поддельные часы: тест двигает hostClockUs сам.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+
+typedef uint8_t byte;
+
+// ============================================================================
+// ВРЕМЯ
+// ============================================================================
+
+inline uint64_t& hostClockUs() {
+  static uint64_t us = 0;
+  return us;
+}
+
+inline unsigned long micros() { return (unsigned long)(uint32_t)hostClockUs(); }
+inline unsigned long millis() { return (unsigned long)(uint32_t)(hostClockUs() / 1000); }
+
+// ============================================================================
+// FLASH (на хосте - обычная память)
+// ============================================================================
+
+#define PROGMEM
+#define PGM_P const char*
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+#define pgm_read_byte(a) (*(const uint8_t*)(a))
+#define pgm_read_word(a) (*(const uint16_t*)(a))
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+
+// ============================================================================
+// GPIO / Serial (пустые)
+// ============================================================================
+
+#define LOW    0
+#define HIGH   1
+#define INPUT  0
+#define OUTPUT 1
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return LOW; }
+
+struct HostNullSerial {
+  void begin(unsigned long) {}
+  template <typename T> void print(const T&) {}
+  template <typename T> void print(const T&, int) {}
+  template <typename T> void println(const T&) {}
+  void println() {}
+};
+
+inline HostNullSerial Serial;
+
+// ============================================================================
+// String
+// ============================================================================
+
+class String {
+public:
+  String(const char* s = "") : _s(s ? s : "") {}
+  String(const std::string& s) : _s(s) {}
+  String(char c) : _s(1, c) {}
+  String(int v) : _s(std::to_string(v)) {}
+  String(unsigned int v) : _s(std::to_string(v)) {}
+  String(long v) : _s(std::to_string(v)) {}
+  String(unsigned long v) : _s(std::to_string(v)) {}
+
+  String& operator+=(const String& o) { _s += o._s; return *this; }
+  String& operator+=(const char* o) { _s += o; return *this; }
+  String& operator+=(char c) { _s += c; return *this; }
+  friend String operator+(const String& a, const String& b) { return String(a._s + b._s); }
+  friend String operator+(const char* a, const String& b) { return String(std::string(a) + b._s); }
+  friend String operator+(const String& a, const char* b) { return String(a._s + b); }
+  bool operator==(const char* o) const { return _s == o; }
+  bool operator==(const String& o) const { return _s == o._s; }
+
+  const char* c_str() const { return _s.c_str(); }
+  unsigned int length() const { return (unsigned int)_s.size(); }
+
+private:
+  std::string _s;
+};
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,56 @@
+/**
+ * avr/eeprom.h для хост-тестов: 4 КБ EEPROM ATmega2560 в памяти
+ *
+ * Тест читает и портит hostEeprom() напрямую (оборванная запись),
+ * hostEepromReady() = false держит EEPROM "занятой", как во время
+ * записи байта на Mega.
+ */
+
+#ifndef HOST_AVR_EEPROM_H
+#define HOST_AVR_EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define HOST_EEPROM_SIZE 4096
+
+inline uint8_t* hostEeprom() {
+  static uint8_t cells[HOST_EEPROM_SIZE];
+  return cells;
+}
+
+inline bool& hostEepromReady() {
+  static bool ready = true;
+  return ready;
+}
+
+// Записей байта (eeprom_write_byte) с начала теста
+inline uint32_t& hostEepromWrites() {
+  static uint32_t writes = 0;
+  return writes;
+}
+
+inline void hostEepromErase() {
+  memset(hostEeprom(), 0xFF, HOST_EEPROM_SIZE);
+  hostEepromWrites() = 0;
+}
+
+inline bool eeprom_is_ready() { return hostEepromReady(); }
+
+inline uint8_t eeprom_read_byte(const uint8_t* addr) {
+  return hostEeprom()[(uintptr_t)addr % HOST_EEPROM_SIZE];
+}
+
+inline void eeprom_write_byte(uint8_t* addr, uint8_t value) {
+  hostEeprom()[(uintptr_t)addr % HOST_EEPROM_SIZE] = value;
+  hostEepromWrites()++;
+}
+
+inline void eeprom_read_block(void* dst, const void* src, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    ((uint8_t*)dst)[i] = eeprom_read_byte((const uint8_t*)src + i);
+  }
+}
+
+#endif // HOST_AVR_EEPROM_H
@@ -0,0 +1,182 @@
+/**
+ * LED_MASK.h против прежней маски bool[10][150]
+ *
+ * Один кадр = собрать маску активных блоков + залить цветом включённые LED
+ * (путь static / pulse эффекта) + погасить остальные (applyMask). Старый
+ * вариант - как было в скетче: проверка каждого пикселя, а без блоков -
+ * копия маски на стек и обратно. Новый - биты, участки зон и forEachRun.
+ *
+ * Оба варианта считают контрольную сумму буфера: она обязана совпасть,
+ * иначе тест падает. Время - справочно (хост, не ESP32).
+ *
+ *   bench_led_mask [кадров]
+ *
+ * Геометрия лент и зон - из rams_controller_v3.ino (PIN_LEDS,
+ * INNER_/OUTER_START, RAY_IN_/RAY_OUT_, initBlockLEDCoords).
+ */
+
+#include <chrono>
+#include "LED_MASK.h"
+#include "host_test.h"
+
+#define NUM_STRIPS  10
+#define MAX_LEDS    150
+#define TOTAL_BLOCKS 15
+#define S_INNER     8
+#define S_OUTER     9
+
+static const uint16_t PIN_LEDS[NUM_STRIPS] = { 33, 33, 33, 33, 33, 33, 33, 33, 64, 150 };
+static const uint16_t INNER_START[8] = { 16, 8, 0, 56, 47, 40, 33, 24 };
+static const uint16_t INNER_COUNT[8] = {  8, 8, 8,  9,  9,  7,  7,  9 };
+static const uint16_t OUTER_START[8] = { 128, 106, 84, 62, 38, 18, 0, 0 };
+static const uint16_t OUTER_COUNT[8] = {  22,  22, 22, 22, 24, 20, 18, 0 };
+#define RAY_IN_START   0
+#define RAY_IN_COUNT  18
+#define RAY_OUT_START 18
+#define RAY_OUT_COUNT 15
+
+struct Rgb { uint8_t r, g, b; };
+
+static LedZone zones[TOTAL_BLOCKS + 1];
+
+static void initZones() {
+  for (int b = 1; b <= TOTAL_BLOCKS; b++) {
+    int sector = (b - 1) / 2;
+    uint8_t left = (uint8_t)sector;
+    uint8_t right = (uint8_t)((sector + 1) % 8);
+    LedZone& z = zones[b];
+    z.clear();
+    if (b == 15) {
+      z.add(left, 0, PIN_LEDS[left]);
+      z.add(right, 0, PIN_LEDS[right]);
+      z.add(S_INNER, INNER_START[sector], INNER_COUNT[sector]);
+    } else if (b % 2 == 1) {
+      z.add(left, RAY_OUT_START, RAY_OUT_COUNT);
+      z.add(right, RAY_OUT_START, RAY_OUT_COUNT);
+      z.add(S_OUTER, OUTER_START[sector], OUTER_COUNT[sector]);
+    } else {
+      z.add(left, RAY_IN_START, RAY_IN_COUNT);
+      z.add(right, RAY_IN_START, RAY_IN_COUNT);
+      z.add(S_INNER, INNER_START[sector], INNER_COUNT[sector]);
+      z.add(S_OUTER, OUTER_START[sector], OUTER_COUNT[sector]);
+    }
+  }
+}
+
+static uint32_t checksum(const Rgb (&leds)[NUM_STRIPS][MAX_LEDS]) {
+  uint32_t h = 0;
+  for (int s = 0; s < NUM_STRIPS; s++) {
+    for (int j = 0; j < PIN_LEDS[s]; j++) h = h * 31 + leds[s][j].r * 7 + leds[s][j].g * 3 + leds[s][j].b;
+  }
+  return h;
+}
+
+// ============================================================================
+// БЫЛО: bool[10][150], по пикселю
+// ============================================================================
+
+static bool oldMask[NUM_STRIPS][MAX_LEDS];
+
+static void oldFrame(uint16_t blocks, Rgb c, Rgb (&leds)[NUM_STRIPS][MAX_LEDS]) {
+  memset(oldMask, 0, sizeof(oldMask));
+  for (int b = 1; b <= TOTAL_BLOCKS; b++) {
+    if (!(blocks & (1u << b))) continue;
+    for (uint8_t i = 0; i < zones[b].count; i++) {
+      const LedSpan& sp = zones[b].spans[i];
+      for (int j = sp.start; j < sp.start + sp.count; j++) oldMask[sp.strip][j] = true;
+    }
+  }
+
+  // Нет блоков - эффект на всех LED: маска на стек, заполнить, вернуть
+  bool saved[NUM_STRIPS][MAX_LEDS];
+  bool none = (blocks == 0);
+  if (none) {
+    memcpy(saved, oldMask, sizeof(oldMask));
+    memset(oldMask, 1, sizeof(oldMask));
+  }
+
+  for (int s = 0; s < NUM_STRIPS; s++) {
+    for (int j = 0; j < PIN_LEDS[s]; j++) {
+      if (oldMask[s][j]) leds[s][j] = c;
+    }
+  }
+  for (int s = 0; s < NUM_STRIPS; s++) {
+    for (int j = 0; j < PIN_LEDS[s]; j++) {
+      if (!oldMask[s][j]) leds[s][j] = Rgb{0, 0, 0};
+    }
+  }
+
+  if (none) memcpy(oldMask, saved, sizeof(oldMask));
+}
+
+// ============================================================================
+// СТАЛО: LedMask + участки
+// ============================================================================
+
+static LedMask<NUM_STRIPS, MAX_LEDS> newMask;
+
+static void newFrame(uint16_t blocks, Rgb c, Rgb (&leds)[NUM_STRIPS][MAX_LEDS]) {
+  newMask.clear();
+  for (int b = 1; b <= TOTAL_BLOCKS; b++) {
+    if (blocks & (1u << b)) newMask.setZone(zones[b]);
+  }
+  newMask.setAllOn(blocks == 0);
+
+  for (uint8_t s = 0; s < NUM_STRIPS; s++) {
+    newMask.forEachRun(s, PIN_LEDS[s], true, [&](uint16_t start, uint16_t n) {
+      for (uint16_t j = start; j < start + n; j++) leds[s][j] = c;
+    });
+    newMask.forEachRun(s, PIN_LEDS[s], false, [&](uint16_t start, uint16_t n) {
+      memset(&leds[s][start], 0, n * sizeof(Rgb));
+    });
+  }
+}
+
+// ============================================================================
+
+template <typename F>
+static double usPerFrame(uint32_t frames, uint16_t blocks, F frame, uint32_t& sum) {
+  static Rgb leds[NUM_STRIPS][MAX_LEDS];
+  memset(leds, 0x55, sizeof(leds));
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < frames; k++) {
+    frame(blocks, Rgb{(uint8_t)k, 150, 255}, leds);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  sum = checksum(leds);
+  return std::chrono::duration<double, std::micro>(t1 - t0).count() / frames;
+}
+
+int main(int argc, char** argv) {
+  uint32_t frames = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 2000;
+  initZones();
+
+  struct Case { const char* name; uint16_t blocks; };
+  const Case cases[] = {
+    {"no blocks", 0},
+    {"2 blocks", (1u << 5) | (1u << 12)},
+    {"8 blocks", 0x1FE},
+    {"15 blocks", 0xFFFE},
+  };
+
+  for (const Case& c : cases) {
+    uint32_t oldSum = 0;
+    uint32_t newSum = 0;
+    double tOld = usPerFrame(frames, c.blocks, oldFrame, oldSum);
+    double tNew = usPerFrame(frames, c.blocks, newFrame, newSum);
+    printf("%-10s  bool[][] %6.3f us  LedMask %6.3f us  [%08x]\n", c.name, tOld, tNew, newSum);
+    CHECK(oldSum == newSum);
+  }
+
+  // Каждый блок по отдельности: та же маска, что и попиксельная
+  for (int b = 1; b <= TOTAL_BLOCKS; b++) {
+    uint16_t bit = (uint16_t)(1u << b);
+    uint32_t oldSum = 0;
+    uint32_t newSum = 0;
+    usPerFrame(1, bit, oldFrame, oldSum);
+    usPerFrame(1, bit, newFrame, newSum);
+    CHECK(oldSum == newSum);
+  }
+
+  return hostTestResult("bench_led_mask");
+}
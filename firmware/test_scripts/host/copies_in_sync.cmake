@@ -0,0 +1,47 @@
+# Копии PRODUCTION_v3.2_FINAL/shared/*.h в папках скетчей должны совпадать
+# с shared/ байт в байт (Arduino IDE берёт заголовки только из папки скетча,
+# поэтому они скопированы, а не подключены по пути)
+#
+# Заголовки firmware/shared (esp32_master), которые есть и в
+# esp32/rams_controller_v3, тоже должны совпадать. ACTUATOR_CONFIG.h у
+# esp32_master свой (relay-прошивки), он не сверяется.
+#
+#   cmake -DPRODUCTION_DIR=<путь> -DMASTER_SHARED=<путь> -P copies_in_sync.cmake
+
+set(SKETCHES actuator_mega1_v3 actuator_mega2_v3 esp32/rams_controller_v3)
+
+file(GLOB headers RELATIVE ${PRODUCTION_DIR}/shared ${PRODUCTION_DIR}/shared/*.h)
+
+set(checked 0)
+foreach(sketch ${SKETCHES})
+  foreach(header ${headers})
+    set(copy ${PRODUCTION_DIR}/${sketch}/${header})
+    if(NOT EXISTS ${copy})
+      continue()
+    endif()
+    file(SHA256 ${PRODUCTION_DIR}/shared/${header} want)
+    file(SHA256 ${copy} got)
+    if(NOT want STREQUAL got)
+      message(SEND_ERROR "${sketch}/${header} differs from shared/${header}")
+    endif()
+    math(EXPR checked "${checked} + 1")
+  endforeach()
+endforeach()
+
+file(GLOB master_headers RELATIVE ${MASTER_SHARED} ${MASTER_SHARED}/*.h)
+list(REMOVE_ITEM master_headers ACTUATOR_CONFIG.h)
+
+foreach(header ${master_headers})
+  set(copy ${PRODUCTION_DIR}/esp32/rams_controller_v3/${header})
+  if(NOT EXISTS ${copy})
+    continue()
+  endif()
+  file(SHA256 ${MASTER_SHARED}/${header} want)
+  file(SHA256 ${copy} got)
+  if(NOT want STREQUAL got)
+    message(SEND_ERROR "firmware/shared/${header} differs from esp32/rams_controller_v3/${header}")
+  endif()
+  math(EXPR checked "${checked} + 1")
+endforeach()
+
+message(STATUS "${checked} copies of shared/ headers checked")
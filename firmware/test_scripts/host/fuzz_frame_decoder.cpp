@@ -0,0 +1,114 @@
+/**
+ * Фаззер FrameDecoder (FRAME_CODEC.h)
+ *
+ * Свойства на любом входе:
+ * - payload не выходит за FRAME_PAYLOAD_MAX
+ * - принятый кадр - это ровно последние LEN + 5 байт входа: кодирование
+ *   принятого кадра совпадает с ними байт в байт (ложный кадр возможен
+ *   только при случайном совпадении CRC, но он всегда целый)
+ * - счётчики ошибок только растут
+ *
+ * Две сборки:
+ *   по умолчанию  - свой генератор: мутации настоящих кадров + случайные
+ *                   байты, фиксированный seed (ctest)
+ *                     fuzz_frame_decoder [итераций] [seed]
+ *   RAMS_LIBFUZZER=ON (clang) - точка входа libFuzzer
+ *                     fuzz_frame_decoder -max_len=512 corpus/
+ */
+
+#include <vector>
+#include "FRAME_CODEC.h"
+#include "host_test.h"
+
+static void checkStream(const uint8_t* data, size_t size) {
+  FrameDecoder rx;
+  uint32_t crcErrors = 0;
+  uint32_t lenErrors = 0;
+
+  for (size_t i = 0; i < size; i++) {
+    bool done = rx.feed(data[i]);
+    const Frame& f = rx.frame();
+    CHECK(f.len <= FRAME_PAYLOAD_MAX);
+
+    if (done) {
+      uint8_t buf[FRAME_SIZE_MAX];
+      uint8_t n = frameEncode(buf, f.seq, f.op, f.payload, f.len);
+      CHECK(n > 0 && i + 1 >= n);
+      if (n > 0 && i + 1 >= n) CHECK(memcmp(buf, data + i + 1 - n, n) == 0);
+      CHECK(!rx.busy());
+    }
+
+    CHECK(rx.crcErrors() >= crcErrors && rx.lenErrors() >= lenErrors);
+    crcErrors = rx.crcErrors();
+    lenErrors = rx.lenErrors();
+  }
+}
+
+#ifdef RAMS_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  checkStream(data, size);
+  if (hostTestFailures() != 0) abort();
+  return 0;
+}
+
+#else
+
+/**
+ * Вход: настоящие кадры вперемешку с текстом и мусором, затем мутации
+ * (бит, байт, вставка SYNC, обрезка) - так декодер чаще доходит до CRC
+ */
+static std::vector<uint8_t> makeInput(HostRandom& rnd) {
+  std::vector<uint8_t> in;
+  uint32_t parts = 1 + rnd.below(8);
+
+  for (uint32_t p = 0; p < parts; p++) {
+    switch (rnd.below(3)) {
+      case 0: {
+        uint8_t payload[FRAME_PAYLOAD_MAX];
+        uint8_t len = (uint8_t)rnd.below(FRAME_PAYLOAD_MAX + 1);
+        for (uint8_t i = 0; i < len; i++) payload[i] = (uint8_t)rnd.next();
+        uint8_t buf[FRAME_SIZE_MAX];
+        uint8_t n = frameEncode(buf, (uint8_t)rnd.next(), (uint8_t)rnd.next(), payload, len);
+        in.insert(in.end(), buf, buf + n);
+        break;
+      }
+      case 1: {
+        const char* text = "ACK:BLOCK:5:UP\r\n";
+        in.insert(in.end(), text, text + strlen(text));
+        break;
+      }
+      default: {
+        uint32_t n = rnd.below(64);
+        for (uint32_t i = 0; i < n; i++) in.push_back((uint8_t)rnd.next());
+        break;
+      }
+    }
+  }
+
+  uint32_t mutations = rnd.below(4);
+  for (uint32_t m = 0; m < mutations && !in.empty(); m++) {
+    size_t at = rnd.below((uint32_t)in.size());
+    switch (rnd.below(4)) {
+      case 0: in[at] ^= (uint8_t)(1u << rnd.below(8)); break;
+      case 1: in[at] = (uint8_t)rnd.next(); break;
+      case 2: in.insert(in.begin() + at, FRAME_SYNC); break;
+      default: in.resize(at); break;
+    }
+  }
+  return in;
+}
+
+int main(int argc, char** argv) {
+  uint32_t iterations = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 200000;
+  uint32_t seed = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 10) : 0x5EED;
+
+  HostRandom rnd(seed);
+  for (uint32_t i = 0; i < iterations && hostTestFailures() == 0; i++) {
+    std::vector<uint8_t> in = makeInput(rnd);
+    checkStream(in.data(), in.size());
+  }
+  return hostTestResult("fuzz_frame_decoder");
+}
+
+#endif
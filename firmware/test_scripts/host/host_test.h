@@ -0,0 +1,51 @@
+/**
+ * Проверки хост-тестов: CHECK не останавливает тест, итог - код возврата
+ *
+ *   CHECK(reader.poll(port));
+ *   return hostTestResult("line_reader");
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+inline int& hostTestFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(cond)                                                      \
+  do {                                                                   \
+    if (!(cond)) {                                                       \
+      hostTestFailures()++;                                              \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    }                                                                    \
+  } while (0)
+
+inline int hostTestResult(const char* name) {
+  if (hostTestFailures() == 0) {
+    printf("[PASS] %s\n", name);
+    return 0;
+  }
+  printf("[FAIL] %s: %d checks failed\n", name, hostTestFailures());
+  return 1;
+}
+
+/**
+ * xorshift32 - воспроизводимая случайность (тот же seed - те же прогоны)
+ */
+struct HostRandom {
+  uint32_t state;
+  explicit HostRandom(uint32_t seed) : state(seed ? seed : 1) {}
+  uint32_t next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+  uint32_t below(uint32_t n) { return next() % n; }
+};
+
+#endif // HOST_TEST_H
@@ -0,0 +1,235 @@
+/**
+ * Симулятор двух Mega: синхронный старт по кадрам AT (MEGA_CLOCK.h)
+ *
+ * ESP32 и обе Mega со своими кварцами (смещение до 2^32 мкс, уход в ppm),
+ * UART с побайтовым временем MEGA_LINK_BAUD, проходы loop() разной длины:
+ *
+ * - Mega: проход 15-120 мкс; PING -> PONG с micros(), AT -> очередь,
+ *   наступившая команда включает реле в том же проходе (runScheduledCommands)
+ * - ESP32: проход 50-900 мкс, каждый десятый - до 4 мс (ControlLock, WiFi);
+ *   PING с отметкой каждые 2 с, оценка часов - настоящий megaClockSample()
+ * - Раз в 2.5-9 с кадры AT на обе Mega с одним временем через 80 мс
+ *
+ * Критерий запроса: реле двух Mega переключаются в пределах ±1 мс.
+ * Посреди прогона Mega #2 перезагружается (часы с нуля) - оценка должна
+ * сброситься и снова дать ±1 мс.
+ *
+ *   sim_mega_clock [стартов] [seed]
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+#include "ACTUATOR_CONFIG.h"
+#include "FRAME_CODEC.h"
+#include "MEGA_CLOCK.h"
+#include "host_test.h"
+
+#define SKEW_LIMIT_US     1000.0
+#define AT_LEAD_US        80000
+#define PING_PERIOD_US    2000000.0
+#define CHECK_AFTER_US    200000.0
+
+static const double BYTE_US = 1e6 * MEGA_LINK_BYTE_BITS / MEGA_LINK_BAUD;
+// PONG с отметками на 4 байта длиннее PING - как MEGA_CLOCK_ASYM_US в скетче
+static const int32_t ASYM_US = (int32_t)(4 * (uint32_t)(MEGA_LINK_BYTE_BITS * 1000000UL / MEGA_LINK_BAUD) / 2);
+
+static double simT = 0;  // Истинное время, мкс
+
+// ============================================================================
+// МОДЕЛЬ
+// ============================================================================
+
+struct Crystal {
+  double offsetUs;
+  double ppm;
+  uint32_t micros() const {
+    return (uint32_t)(uint64_t)llround(offsetUs + simT * (1.0 + ppm * 1e-6));
+  }
+};
+
+/**
+ * Провод UART: байты приходят по одному через BYTE_US
+ */
+struct Wire {
+  std::deque<std::pair<double, uint8_t>> q;
+  double busyUntil = 0;
+
+  void send(const uint8_t* b, uint8_t n) {
+    for (uint8_t i = 0; i < n; i++) {
+      busyUntil = std::max(busyUntil, simT) + BYTE_US;
+      q.push_back(std::make_pair(busyUntil, b[i]));
+    }
+  }
+  bool ready() const { return !q.empty() && q.front().first <= simT; }
+  uint8_t take() {
+    uint8_t c = q.front().second;
+    q.pop_front();
+    return c;
+  }
+};
+
+static void sendFrame(Wire& w, uint8_t seq, uint8_t op, const uint8_t* p, uint8_t len) {
+  uint8_t buf[FRAME_SIZE_MAX];
+  uint8_t n = frameEncode(buf, seq, op, p, len);
+  w.send(buf, n);
+}
+
+struct SimMega {
+  Crystal clock;
+  Wire rx;            // ESP32 -> Mega
+  Wire tx;            // Mega -> ESP32
+  FrameDecoder dec;
+  bool atPending = false;
+  uint32_t atUs = 0;
+  double switchedAt = -1;  // Истинное время включения реле
+
+  void loopPass() {
+    while (rx.ready()) {
+      if (!dec.feed(rx.take())) continue;
+      const Frame& f = dec.frame();
+      if (f.op == FRAME_OP_PING && f.len >= 4) {
+        uint8_t p[8];
+        memcpy(p, f.payload, 4);
+        framePutU32(&p[4], clock.micros());
+        sendFrame(tx, f.seq, FRAME_OP_PONG, p, sizeof(p));
+      } else if (f.op == FRAME_OP_AT && f.len >= FRAME_AT_HEADER + FRAME_BATCH_ENTRY) {
+        atUs = frameGetU32(f.payload);
+        atPending = true;
+      }
+    }
+    if (atPending && (long)(int32_t)(clock.micros() - atUs) >= 0) {
+      atPending = false;
+      switchedAt = simT;
+    }
+  }
+};
+
+// ============================================================================
+// ПРОГОН
+// ============================================================================
+
+struct SimResult {
+  int starts = 0;
+  int missed = 0;
+  double meanSkewUs = 0;
+  double worstSkewUs = 0;
+};
+
+static SimResult run(uint32_t trials, uint32_t seed) {
+  HostRandom rnd(seed);
+  auto uni = [&](double a, double b) { return a + (b - a) * (rnd.next() / 4294967296.0); };
+
+  Crystal esp = {4294000000.0, 5};  // micros() ESP32 вот-вот переполнится
+  SimMega mega[3];
+  mega[1].clock = {123456789.0, 80};
+  mega[2].clock = {3999000000.0, -60};
+
+  MegaClock clk[3];
+  FrameDecoder espRx[3];
+  megaClockReset(clk[1]);
+  megaClockReset(clk[2]);
+
+  simT = 0;
+  double nextMega[3] = {0, 0, 0};
+  double nextEsp = 0;
+  double nextPing = 0;
+  double nextStart = 3e6;
+  double startT = 0;
+  bool pending = false;
+  bool rebooted = false;
+  uint8_t seq = 0;
+  SimResult r;
+  double sumSkew = 0;
+
+  while ((uint32_t)(r.starts + r.missed) < trials) {
+    simT = std::min({nextMega[1], nextMega[2], nextEsp});
+
+    for (int m = 1; m <= 2; m++) {
+      if (simT < nextMega[m]) continue;
+      mega[m].loopPass();
+      nextMega[m] = simT + uni(15, 120);
+    }
+
+    if (simT < nextEsp) continue;
+    nextEsp = simT + uni(50, rnd.below(10) == 0 ? 4000 : 900);
+
+    for (int m = 1; m <= 2; m++) {
+      while (mega[m].tx.ready()) {
+        if (!espRx[m].feed(mega[m].tx.take())) continue;
+        const Frame& f = espRx[m].frame();
+        if (f.op == FRAME_OP_PONG && f.len >= 8) {
+          megaClockSample(clk[m], frameGetU32(&f.payload[0]), frameGetU32(&f.payload[4]),
+                          esp.micros(), ASYM_US);
+        }
+      }
+    }
+
+    if (simT >= nextPing) {
+      for (int m = 1; m <= 2; m++) {
+        uint8_t p[4];
+        framePutU32(p, esp.micros());
+        sendFrame(mega[m].rx, ++seq, FRAME_OP_PING, p, sizeof(p));
+      }
+      nextPing = simT + PING_PERIOD_US;
+    }
+
+    // Половина прогона: Mega #2 перезагрузилась, её micros() снова с нуля
+    if (!rebooted && (uint32_t)(r.starts + r.missed) >= trials / 2) {
+      rebooted = true;
+      mega[2].clock.offsetUs = -simT * (1.0 + mega[2].clock.ppm * 1e-6);
+      mega[2].atPending = false;
+      nextStart = simT + 3e6;
+    }
+
+    uint32_t nowUs = esp.micros();
+    if (!pending && simT >= nextStart && megaClockReady(clk[1], nowUs) && megaClockReady(clk[2], nowUs)) {
+      uint32_t at = nowUs + AT_LEAD_US;
+      for (int m = 1; m <= 2; m++) {
+        uint8_t p[FRAME_AT_HEADER + FRAME_BATCH_ENTRY];
+        framePutU32(p, megaClockToMega(clk[m], at));
+        p[4] = (uint8_t)(m == 1 ? 1 : 9);
+        p[5] = FRAME_ACT_UP;
+        framePutU32(&p[6], 500);
+        mega[m].switchedAt = -1;
+        sendFrame(mega[m].rx, ++seq, FRAME_OP_AT, p, sizeof(p));
+      }
+      startT = simT;
+      pending = true;
+      nextStart = simT + uni(2.5e6, 9e6);
+    }
+
+    if (pending && simT > startT + CHECK_AFTER_US) {
+      pending = false;
+      if (mega[1].switchedAt < 0 || mega[2].switchedAt < 0) {
+        r.missed++;
+        continue;
+      }
+      double skew = fabs(mega[1].switchedAt - mega[2].switchedAt);
+      r.worstSkewUs = std::max(r.worstSkewUs, skew);
+      sumSkew += skew;
+      r.starts++;
+    }
+  }
+
+  r.meanSkewUs = r.starts ? sumSkew / r.starts : 0;
+  printf("starts=%d missed=%d  mean|skew|=%.0fus worst|skew|=%.0fus  drift m1=%d m2=%d ppm  rejected m1=%u m2=%u\n",
+         r.starts, r.missed, r.meanSkewUs, r.worstSkewUs, (int)clk[1].driftPpm, (int)clk[2].driftPpm,
+         (unsigned)clk[1].rejected, (unsigned)clk[2].rejected);
+
+  // Уход часов Mega относительно ESP32: +75 и -65 ppm
+  CHECK(abs(clk[1].driftPpm - 75) <= 20);
+  CHECK(abs(clk[2].driftPpm + 65) <= 20);
+  return r;
+}
+
+int main(int argc, char** argv) {
+  uint32_t trials = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 200;
+  uint32_t seed = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 10) : 42;
+
+  SimResult r = run(trials, seed);
+  CHECK(r.starts == (int)trials);
+  CHECK(r.worstSkewUs <= SKEW_LIMIT_US);
+  return hostTestResult("sim_mega_clock");
+}
@@ -0,0 +1,68 @@
+/**
+ * BLOCK_MOTION.h - переходы автомата движения блока
+ *
+ * - Таблица motionNext() целиком: каждое (состояние, событие, цель хода)
+ * - STOP / DONE / FAULT меняют только движущийся блок
+ * - Сверка со STATUS: реле Mega важнее модели, FAULT без положения остаётся
+ */
+
+#include "BLOCK_MOTION.h"
+#include "host_test.h"
+
+static const uint8_t RESTS[] = {MOTION_IDLE_DOWN, MOTION_UP, MOTION_STOPPED_MID};
+
+static void testTable() {
+  for (uint8_t s = 0; s < MOTION_COUNT; s++) {
+    bool moving = motionMoving(s);
+    for (uint8_t rest : RESTS) {
+      CHECK(motionNext(s, MOTION_EV_RAISE, rest) == MOTION_RISING);
+      CHECK(motionNext(s, MOTION_EV_LOWER, rest) == MOTION_LOWERING);
+      CHECK(motionNext(s, MOTION_EV_STOP, rest) == (moving ? (uint8_t)MOTION_STOPPED_MID : s));
+      CHECK(motionNext(s, MOTION_EV_DONE, rest) == (moving ? rest : s));
+      CHECK(motionNext(s, MOTION_EV_FAULT, rest) == (moving ? (uint8_t)MOTION_FAULT : s));
+    }
+  }
+
+  // Неизвестное событие ничего не меняет
+  CHECK(motionNext(MOTION_RISING, 200, MOTION_UP) == MOTION_RISING);
+}
+
+static void testMoving() {
+  int moving = 0;
+  for (uint8_t s = 0; s < MOTION_COUNT; s++) {
+    if (motionMoving(s)) moving++;
+  }
+  CHECK(moving == 2);
+  CHECK(motionMoving(MOTION_RISING) && motionMoving(MOTION_LOWERING));
+
+  CHECK(motionRestAt(0) == MOTION_IDLE_DOWN);
+  CHECK(motionRestAt(60) == MOTION_STOPPED_MID);
+  CHECK(motionRestAt(100) == MOTION_UP);
+  CHECK(motionRestAt(150) == MOTION_UP);
+
+  CHECK(strcmp(motionName(MOTION_STOPPED_MID), "mid") == 0);
+  CHECK(strcmp(motionName(MOTION_COUNT), "?") == 0);
+}
+
+static void testFromStatus() {
+  // Реле включены - блок едет, что бы ни думала модель
+  CHECK(motionFromStatus(MOTION_IDLE_DOWN, MOTION_IDLE_DOWN, true, false, 0) == MOTION_RISING);
+  CHECK(motionFromStatus(MOTION_FAULT, MOTION_IDLE_DOWN, false, true, 50) == MOTION_LOWERING);
+
+  // Стоит: состояние по положению
+  CHECK(motionFromStatus(MOTION_RISING, MOTION_UP, false, false, 100) == MOTION_UP);
+  CHECK(motionFromStatus(MOTION_UP, MOTION_UP, false, false, 60) == MOTION_STOPPED_MID);
+  CHECK(motionFromStatus(MOTION_FAULT, MOTION_UP, false, false, 0) == MOTION_IDLE_DOWN);
+
+  // Положение неизвестно: закончившийся ход - в цель, FAULT остаётся
+  CHECK(motionFromStatus(MOTION_LOWERING, MOTION_IDLE_DOWN, false, false, MOTION_POS_UNKNOWN) == MOTION_IDLE_DOWN);
+  CHECK(motionFromStatus(MOTION_FAULT, MOTION_UP, false, false, MOTION_POS_UNKNOWN) == MOTION_FAULT);
+  CHECK(motionFromStatus(MOTION_STOPPED_MID, MOTION_UP, false, false, MOTION_POS_UNKNOWN) == MOTION_STOPPED_MID);
+}
+
+int main() {
+  testTable();
+  testMoving();
+  testFromStatus();
+  return hostTestResult("block_motion");
+}
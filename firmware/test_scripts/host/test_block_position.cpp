@@ -0,0 +1,229 @@
+/**
+ * BLOCK_POSITION.h - положение блоков по времени хода и кольцо в EEPROM
+ *
+ * - positionAfter: частичный ход из известного положения, упоры,
+ *   неизвестное остаётся неизвестным до хода не короче полного
+ * - save / service / load: запись по байту, только когда EEPROM готова,
+ *   несколько save до записи - одна запись с последними положениями
+ * - Оборванная запись (пропало питание) и испорченный байт не проходят
+ *   CRC - load берёт предыдущий слот
+ * - Переполнение seq (65535 -> 0) и конец кольца: load выбирает самую
+ *   новую запись, следующая идёт в слот за ней
+ */
+
+#include <avr/eeprom.h>
+#include "BLOCK_POSITION.h"
+#include "host_test.h"
+
+static const uint16_t HALF = POS_FULL / 2;
+
+/**
+ * Записать запись в слот напрямую (формат BLOCK_POSITION.h)
+ */
+static void putRecord(uint8_t slot, uint16_t seq, uint16_t value) {
+  uint8_t* rec = hostEeprom() + POS_EEPROM_BASE + slot * POS_RECORD_SIZE;
+  rec[0] = POS_RECORD_MAGIC;
+  rec[1] = (uint8_t)seq;
+  rec[2] = (uint8_t)(seq >> 8);
+  for (uint8_t i = 0; i < POS_BLOCKS_MAX; i++) {
+    rec[3 + i * 2] = (uint8_t)value;
+    rec[4 + i * 2] = (uint8_t)(value >> 8);
+  }
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < POS_RECORD_SIZE - 1; i++) crc = frameCrc8(crc, rec[i]);
+  rec[POS_RECORD_SIZE - 1] = crc;
+}
+
+static uint16_t slotSeq(uint8_t slot) {
+  const uint8_t* rec = hostEeprom() + POS_EEPROM_BASE + slot * POS_RECORD_SIZE;
+  return (uint16_t)(rec[1] | (rec[2] << 8));
+}
+
+static void flush(PositionStore& store) {
+  for (int i = 0; i < 1000 && store.busy(); i++) store.service();
+  CHECK(!store.busy());
+}
+
+static void saveAll(PositionStore& store, uint16_t value) {
+  uint16_t pos[POS_BLOCKS_MAX];
+  for (uint8_t i = 0; i < POS_BLOCKS_MAX; i++) pos[i] = value;
+  store.save(pos, POS_BLOCKS_MAX);
+}
+
+static bool loadedAll(uint16_t value) {
+  PositionStore store;
+  uint16_t pos[POS_BLOCKS_MAX];
+  store.load(pos, POS_BLOCKS_MAX);
+  for (uint8_t i = 0; i < POS_BLOCKS_MAX; i++) {
+    if (pos[i] != value) return false;
+  }
+  return true;
+}
+
+// ============================================================================
+// МОДЕЛЬ ХОДА
+// ============================================================================
+
+static void testPositionAfter() {
+  // Частичный ход из известного положения
+  CHECK(positionAfter(0, FRAME_ACT_UP, ACTUATOR_TRAVEL_UP_MS / 2) == HALF);
+  CHECK(positionAfter(POS_FULL, FRAME_ACT_DOWN, ACTUATOR_TRAVEL_DOWN_MS / 4) == POS_FULL * 3 / 4);
+  CHECK(positionAfter(HALF, FRAME_ACT_UP, 0) == HALF);
+  CHECK(positionAfter(HALF, FRAME_ACT_DOWN, 1) == HALF - (POS_FULL + ACTUATOR_TRAVEL_DOWN_MS / 2) / ACTUATOR_TRAVEL_DOWN_MS);
+
+  // Упоры: дальше низа и верха не уходит
+  CHECK(positionAfter(POS_FULL - 10, FRAME_ACT_UP, ACTUATOR_TRAVEL_UP_MS / 2) == POS_FULL);
+  CHECK(positionAfter(10, FRAME_ACT_DOWN, ACTUATOR_TRAVEL_DOWN_MS / 2) == 0);
+  CHECK(positionAfter(HALF, FRAME_ACT_UP, ACTUATOR_TRAVEL_UP_MS * 3) == POS_FULL);
+
+  // Неизвестное: частичный ход вверх и вниз ничего не говорит
+  CHECK(positionAfter(POS_UNKNOWN, FRAME_ACT_UP, ACTUATOR_TRAVEL_UP_MS / 2) == POS_UNKNOWN);
+  CHECK(positionAfter(POS_UNKNOWN, FRAME_ACT_DOWN, ACTUATOR_TRAVEL_DOWN_MS - 1) == POS_UNKNOWN);
+  CHECK(positionAfter(POS_UNKNOWN, FRAME_ACT_UP, 1) == POS_UNKNOWN);
+
+  // ... а полный ход ставит блок на концевик
+  CHECK(positionAfter(POS_UNKNOWN, FRAME_ACT_UP, ACTUATOR_TRAVEL_UP_MS) == POS_FULL);
+  CHECK(positionAfter(POS_UNKNOWN, FRAME_ACT_DOWN, ACTUATOR_TRAVEL_DOWN_MS) == 0);
+  CHECK(positionPercent(POS_UNKNOWN) == FRAME_STATUS_POS_UNKNOWN);
+  CHECK(positionPercent(positionFromPercent(60)) == 60);
+
+  // Частичные ходы туда-обратно из известного - сумма, без дрейфа
+  uint16_t pos = 0;
+  for (int i = 0; i < 10; i++) pos = positionAfter(pos, FRAME_ACT_UP, ACTUATOR_TRAVEL_UP_MS / 10);
+  CHECK(pos == POS_FULL);
+  for (int i = 0; i < 4; i++) pos = positionAfter(pos, FRAME_ACT_DOWN, ACTUATOR_TRAVEL_DOWN_MS / 10);
+  CHECK(pos == POS_FULL * 6 / 10);
+}
+
+// ============================================================================
+// ХРАНЕНИЕ
+// ============================================================================
+
+static void testRoundTrip() {
+  hostEepromErase();
+
+  PositionStore store;
+  uint16_t pos[4] = {1, 2, 3, 4};
+  CHECK(!store.load(pos, 4));
+  for (uint8_t i = 0; i < 4; i++) CHECK(pos[i] == POS_UNKNOWN);
+
+  // EEPROM занята - ни байта
+  hostEepromReady() = false;
+  saveAll(store, 1234);
+  for (int i = 0; i < 50; i++) store.service();
+  CHECK(store.busy() && hostEepromWrites() == 0);
+  hostEepromReady() = true;
+  flush(store);
+  CHECK(store.writes() == 1);
+  CHECK(loadedAll(1234));
+
+  // Несколько save до начала записи - одна запись с последними
+  saveAll(store, 2000);
+  saveAll(store, 3000);
+  saveAll(store, HALF);
+  flush(store);
+  CHECK(store.writes() == 2);
+  CHECK(loadedAll(HALF));
+
+  // Меньше блоков, чем в записи: остальные - неизвестны
+  uint16_t three[3] = {0, POS_FULL, 700};
+  store.save(three, 3);
+  flush(store);
+  PositionStore reload;
+  uint16_t back[POS_BLOCKS_MAX];
+  CHECK(reload.load(back, POS_BLOCKS_MAX));
+  CHECK(back[0] == 0 && back[1] == POS_FULL && back[2] == 700);
+  CHECK(back[3] == POS_UNKNOWN && back[POS_BLOCKS_MAX - 1] == POS_UNKNOWN);
+  CHECK(slotSeq(2) == slotSeq(0) + 2);
+}
+
+static void testTornRecord() {
+  hostEepromErase();
+  PositionStore store;
+  uint16_t pos[POS_BLOCKS_MAX];
+  store.load(pos, POS_BLOCKS_MAX);
+
+  saveAll(store, 1000);
+  flush(store);
+  saveAll(store, 2000);
+  flush(store);
+  CHECK(loadedAll(2000));
+
+  // Питание пропало посреди третьей записи: слот 2 без CRC
+  saveAll(store, 3000);
+  for (int i = 0; i < POS_RECORD_SIZE / 2; i++) store.service();
+  CHECK(store.busy());
+  CHECK(hostEeprom()[POS_EEPROM_BASE + 2 * POS_RECORD_SIZE] == POS_RECORD_MAGIC);
+  CHECK(loadedAll(2000));
+
+  // Дописали всё, кроме CRC
+  for (int i = POS_RECORD_SIZE / 2; i < POS_RECORD_SIZE - 1; i++) store.service();
+  CHECK(loadedAll(2000));
+  store.service();
+  CHECK(loadedAll(3000));
+
+  // Испорченный байт в самой новой записи - снова предыдущая
+  hostEeprom()[POS_EEPROM_BASE + 2 * POS_RECORD_SIZE + 5] ^= 0x10;
+  CHECK(loadedAll(2000));
+
+  // После перезагрузки запись идёт за целой, в битый слот
+  PositionStore next;
+  next.load(pos, POS_BLOCKS_MAX);
+  saveAll(next, 4000);
+  flush(next);
+  CHECK(slotSeq(2) == slotSeq(1) + 1);
+  CHECK(loadedAll(4000));
+}
+
+static void testSeqWrap() {
+  hostEepromErase();
+  putRecord(5, 65534, 100);
+  putRecord(6, 65535, 200);
+  putRecord(7, 0, 300);
+  CHECK(loadedAll(300));    // 0 новее 65535
+
+  putRecord(8, 1, 400);
+  CHECK(loadedAll(400));
+
+  // Запись после переполнения - в слот 9 с seq 2
+  PositionStore store;
+  uint16_t pos[POS_BLOCKS_MAX];
+  CHECK(store.load(pos, POS_BLOCKS_MAX));
+  saveAll(store, 500);
+  flush(store);
+  CHECK(slotSeq(9) == 2);
+  CHECK(loadedAll(500));
+
+  // Запись дальше полукруга seq - из прошлого круга, не выигрывает
+  putRecord(100, 40000, 999);
+  CHECK(loadedAll(500));
+}
+
+static void testRingWrap() {
+  hostEepromErase();
+  for (uint16_t slot = 0; slot < POS_EEPROM_SLOTS; slot++) putRecord((uint8_t)slot, 1000 + slot, slot);
+  CHECK(loadedAll(POS_EEPROM_SLOTS - 1));
+
+  // Кольцо полно: следующая запись - поверх слота 0
+  PositionStore store;
+  uint16_t pos[POS_BLOCKS_MAX];
+  store.load(pos, POS_BLOCKS_MAX);
+  saveAll(store, 7777);
+  flush(store);
+  CHECK(slotSeq(0) == 1000 + POS_EEPROM_SLOTS);
+  CHECK(loadedAll(7777));
+
+  // Оборванная запись поверх старой (слот 1) - остаётся слот 0
+  saveAll(store, 8888);
+  for (int i = 0; i < 4; i++) store.service();
+  CHECK(loadedAll(7777));
+}
+
+int main() {
+  testPositionAfter();
+  testRoundTrip();
+  testTornRecord();
+  testSeqWrap();
+  testRingWrap();
+  return hostTestResult("block_position");
+}
@@ -0,0 +1,101 @@
+/**
+ * COMMAND_LATENCY.h - задержка ответа Mega и время хода блока
+ *
+ * - Ответы по порядку строк: каждый ACK / ERR закрывает старейшую строку,
+ *   лишний ответ - unmatched, переполнение очереди теряет старейшую
+ * - Отметки micros() через переполнение дают верную задержку
+ * - Ответы relay-прошивок (MEGA_LINK.h), как их делит esp32_master:
+ *   ERR:BLOCK:N:...TIMEOUT - не ответ, ERR:UNKNOWN_BLOCK:N - ответ
+ * - Ход: STATUS до старта не заканчивает ход, STOP отменяет измерение,
+ *   дрейф помечается только после LATENCY_DRIFT_MIN_RUNS ходов
+ */
+
+#define PERF_ENABLED 0   // Как в esp32_master: только гистограммы
+#include "COMMAND_LATENCY.h"
+#include "MEGA_LINK.h"
+#include "host_test.h"
+
+static LinkLatency link;
+static BlockTravel travel;
+
+static void testTextOrder() {
+  latencyReset(link);
+
+  // micros() переполняется между отправкой и ответом
+  latencyTextSent(link, 0xFFFFFF00UL);
+  latencyTextSent(link, 0xFFFFFFF0UL);
+  CHECK(latencyTextReply(link, 0x00000100UL) == 0x200);
+  CHECK(latencyTextReply(link, 0x00000110UL) == 0x120);
+  CHECK(link.ackUs.count == 2 && link.ackUs.maxUs == 0x200);
+
+  CHECK(latencyTextReply(link, 0x200) == -1);
+  CHECK(link.unmatched == 1);
+  CHECK(link.ackUs.count == 2);
+}
+
+static void testTextOverflow() {
+  latencyReset(link);
+
+  // Две старейшие строки вытеснены: ответы на них не тратятся
+  for (uint32_t i = 0; i < LATENCY_TEXT_PENDING + 2; i++) latencyTextSent(link, 1000 + i * 10);
+  CHECK(link.textCount == LATENCY_TEXT_PENDING);
+  CHECK(latencyTextReply(link, 2000) == 2000 - 1020);
+  for (uint32_t i = 1; i < LATENCY_TEXT_PENDING; i++) CHECK(latencyTextReply(link, 3000) >= 0);
+  CHECK(latencyTextReply(link, 3000) == -1);
+
+  // Связь потеряна: старые строки не ждём, новая отвечается сразу
+  latencyTextSent(link, 4000);
+  latencyTextSent(link, 4100);
+  latencyTextDrop(link);
+  latencyTextSent(link, 5000);
+  CHECK(latencyTextReply(link, 5070) == 70);
+  CHECK(link.textCount == 0);
+}
+
+static void testRelayReplies() {
+  MegaReply r;
+
+  CHECK(parseMegaReply("ACK:BLOCK:5:UP", r));
+  CHECK(r.type == MEGA_REPLY_ACK && r.blockNum == 5);
+  CHECK(parseMegaReply("ACK:ALL:STOP", r));
+  CHECK(r.type == MEGA_REPLY_ACK && r.blockNum == 0);
+
+  // Ответ на BLOCK:16:UP - закрывает строку
+  CHECK(parseMegaReply("ERR:UNKNOWN_BLOCK:16", r));
+  CHECK(r.type == MEGA_REPLY_ERROR && r.blockNum == 0);
+
+  // Таймаут актуатора на Mega - не ответ
+  CHECK(parseMegaReply("ERR:BLOCK:3:ACT1:TIMEOUT", r));
+  CHECK(r.type == MEGA_REPLY_ERROR && r.blockNum == 3);
+}
+
+static void testTravel() {
+  travelReset(travel);
+
+  uint32_t now = 0xFFFFFF00UL;                 // millis() переполнится в первом ходе
+  for (uint32_t run = 0; run < LATENCY_DRIFT_MIN_RUNS + 2; run++) {
+    travelStart(travel, now, 6000);
+    CHECK(travelObserve(travel, false, now + 10) == -1);    // STATUS до старта
+    CHECK(travelObserve(travel, true, now + 100) == -1);
+    CHECK(travelObserve(travel, false, now + 6300) == 6300);
+    CHECK(travelDrifting(travel) == (run + 1 >= LATENCY_DRIFT_MIN_RUNS));
+    now += 10000;
+  }
+  CHECK(travel.driftMs == 300);
+  CHECK(travel.travelMs.count == LATENCY_DRIFT_MIN_RUNS + 2);
+  CHECK(perfHistPercentile(travel.travelMs, 990) >= 6300);
+
+  // STOP: ход не измеряется
+  travelStart(travel, now, 6000);
+  travelCancel(travel);
+  CHECK(travelEnd(travel, now + 5) == -1);
+  CHECK(travel.runs == LATENCY_DRIFT_MIN_RUNS + 2);
+}
+
+int main() {
+  testTextOrder();
+  testTextOverflow();
+  testRelayReplies();
+  testTravel();
+  return hostTestResult("command_latency");
+}
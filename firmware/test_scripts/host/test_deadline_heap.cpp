@@ -0,0 +1,135 @@
+/**
+ * DEADLINE_HEAP.h - таймеры loop() через переполнение millis()
+ *
+ * - Таймер хода, взведённый за секунды до 0xFFFFFFFF, не срабатывает сразу
+ *   (было: now >= millis() + duration, сумма переполнялась в малое число)
+ * - Перенос и снятие таймера
+ * - Случайные set / cancel / popDue против эталонной модели на 64-битном
+ *   времени: порядок срабатывания, ни один наступивший не пропущен, куча
+ *   цела после каждой операции
+ *
+ *   test_deadline_heap [операций] [seed]
+ */
+
+#include <vector>
+#include "DEADLINE_HEAP.h"
+#include "host_test.h"
+
+static DeadlineHeap heap;
+
+/**
+ * Свойство кучи и согласованность slot[] с heap[]
+ */
+static bool heapValid(const DeadlineHeap& h) {
+  int armed = 0;
+  for (int id = 0; id < DEADLINE_IDS; id++) {
+    if (h.slot[id] != 0) armed++;
+  }
+  if (armed != h.count) return false;
+
+  for (int i = 0; i < h.count; i++) {
+    if (h.slot[h.heap[i]] != i + 1) return false;
+    if (i > 0 && deadlineBefore(h.at[h.heap[i]], h.at[h.heap[(i - 1) / 2]])) return false;
+  }
+  return true;
+}
+
+static void testRollover() {
+  deadlineClear(heap);
+
+  // Ход 10 с за 4 с до переполнения millis()
+  uint32_t now = 0xFFFFFFFFUL - 4000;
+  deadlineSet(heap, 5, now + 10000);
+  deadlineSet(heap, 0, now + 2000);          // Heartbeat до переполнения
+  CHECK(deadlinePopDue(heap, now) == -1);
+  CHECK(deadlinePopDue(heap, now + 1999) == -1);
+  CHECK(deadlinePopDue(heap, now + 2000) == 0);
+  CHECK(deadlinePopDue(heap, now + 5000) == -1);   // millis() уже переполнился
+  CHECK(deadlinePopDue(heap, now + 9999) == -1);
+  CHECK(deadlinePopDue(heap, now + 10000) == 5);
+  CHECK(heap.count == 0);
+
+  // Порядок через 0: раньше - тот, что до переполнения
+  now = 0xFFFFF000UL;
+  deadlineSet(heap, 1, now + 0x2000);
+  deadlineSet(heap, 2, now + 100);
+  deadlineSet(heap, 3, now + 0x1000);        // Ровно 0
+  CHECK(deadlinePopDue(heap, now + 100) == 2);
+  CHECK(deadlinePopDue(heap, 0xFFFFFFFFUL) == -1);
+  CHECK(deadlinePopDue(heap, 0) == 3);
+  CHECK(deadlinePopDue(heap, 0xFFF) == -1);
+  CHECK(deadlinePopDue(heap, 0x1000) == 1);
+  CHECK(heap.count == 0);
+}
+
+static void testRescheduleAndCancel() {
+  deadlineClear(heap);
+
+  deadlineSet(heap, 7, 10);
+  deadlineSet(heap, 7, 1000);                // Перенос, не второй таймер
+  CHECK(heap.count == 1);
+  CHECK(deadlinePending(heap, 7));
+  CHECK(deadlinePopDue(heap, 500) == -1);
+
+  CHECK(deadlineCancel(heap, 7));
+  CHECK(!deadlineCancel(heap, 7));
+  CHECK(!deadlinePending(heap, 7));
+  CHECK(heap.count == 0);
+
+  // id вне диапазона игнорируется
+  deadlineSet(heap, DEADLINE_IDS, 0);
+  CHECK(heap.count == 0);
+  CHECK(!deadlineCancel(heap, DEADLINE_IDS));
+}
+
+static void testAgainstModel(uint32_t ops, uint32_t seed) {
+  deadlineClear(heap);
+  HostRandom rnd(seed);
+
+  // Эталон - 64-битное время от base, -1 = не взведён
+  std::vector<int64_t> ref(DEADLINE_IDS, -1);
+  const uint32_t base = 0xFFF00000UL;
+  int64_t t = 0;
+
+  for (uint32_t i = 0; i < ops && hostTestFailures() == 0; i++) {
+    uint8_t id = (uint8_t)rnd.below(DEADLINE_IDS);
+    switch (rnd.below(4)) {
+      case 0:
+      case 1: {
+        int64_t at = t + rnd.below(5000);
+        deadlineSet(heap, id, (uint32_t)(base + at));
+        ref[id] = at;
+        break;
+      }
+      case 2:
+        CHECK(deadlineCancel(heap, id) == (ref[id] >= 0));
+        ref[id] = -1;
+        break;
+      default: {
+        t += rnd.below(300);
+        int got;
+        while ((got = deadlinePopDue(heap, (uint32_t)(base + t))) >= 0) {
+          CHECK(ref[got] >= 0 && ref[got] <= t);
+          for (int j = 0; j < DEADLINE_IDS; j++) CHECK(!(ref[j] >= 0 && ref[j] < ref[got]));
+          ref[got] = -1;
+        }
+        for (int j = 0; j < DEADLINE_IDS; j++) CHECK(!(ref[j] >= 0 && ref[j] <= t));
+        break;
+      }
+    }
+    CHECK(heapValid(heap));
+  }
+
+  // Прогон должен пройти через 0xFFFFFFFF
+  CHECK((uint32_t)(base + t) < base);
+}
+
+int main(int argc, char** argv) {
+  uint32_t ops = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : 200000;
+  uint32_t seed = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 10) : 1;
+
+  testRollover();
+  testRescheduleAndCancel();
+  testAgainstModel(ops, seed);
+  return hostTestResult("deadline_heap");
+}
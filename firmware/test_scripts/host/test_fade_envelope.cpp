@@ -0,0 +1,107 @@
+/**
+ * FADE_ENVELOPE.h - прогресс и уровень огибающей fade
+ *
+ * - Прогресс 0 / 50 / 100 % для fade чуть короче и чуть длиннее 65 536 мс
+ *   (было: длинный fade делил на duration >> 16 и кончался раньше времени)
+ * - Прогресс растёт монотонно и доходит до конца ровно в duration
+ * - Разворот посреди fade OUT продолжает с текущего уровня
+ * - Огибающая через переполнение millis()
+ */
+
+#include "FADE_ENVELOPE.h"
+#include "host_test.h"
+
+static FadeEnvelope env;
+
+static void startAt(uint8_t from, uint8_t to, uint32_t duration, unsigned long now) {
+  fadeEnvelopeSet(env, from);
+  fadeEnvelopeStart(env, to, duration, FADE_CURVE_LINEAR, now);
+}
+
+static void testProgress() {
+  const uint32_t durations[] = {1000, 65535, 65536, 65537, 100000, 131071, 131072, 600000};
+  for (uint32_t d : durations) {
+    startAt(255, 0, d, 0);
+
+    CHECK(fadeProgressQ16(env, 0) == 0);
+    uint16_t half = fadeProgressQ16(env, d / 2);
+    CHECK(half >= 32767 - 1 && half <= 32768);
+    uint16_t q99 = fadeProgressQ16(env, (uint32_t)((uint64_t)d * 99 / 100));
+    CHECK(q99 >= 64880 - 2 && q99 <= 64881);
+    CHECK(fadeProgressQ16(env, d) == 65535);
+    CHECK(!fadeEnvelopeDone(env, d - 1));
+    CHECK(fadeEnvelopeDone(env, d));
+
+    // Уровень посередине - половина, на конце - цель
+    uint8_t mid = fadeEnvelopeLevel(env, d / 2);
+    CHECK(mid >= 127 && mid <= 128);
+    CHECK(fadeEnvelopeLevel(env, d) == 0);
+
+    uint16_t prev = 0;
+    for (uint32_t t = 0; t <= d; t += d / 97 + 1) {
+      uint16_t q = fadeProgressQ16(env, t);
+      CHECK(q >= prev);
+      prev = q;
+    }
+  }
+
+  // Опускание 100 с: на 65.5 с - 65 %, а не конец fade
+  startAt(255, 0, 100000, 0);
+  uint16_t q = fadeProgressQ16(env, 65536);
+  CHECK(q >= 42949 - 1 && q <= 42949 + 1);
+}
+
+static void testReversal() {
+  // Fade OUT 255 -> 0 за 1 с, UP на 40 %: fade IN с текущего уровня
+  startAt(255, 0, 1000, 5000);
+  CHECK(fadeEnvelopeFalling(env));
+  uint8_t at = fadeEnvelopeLevel(env, 5400);
+  CHECK(at >= 152 && at <= 153);
+
+  fadeEnvelopeStart(env, 255, 1000, FADE_CURVE_LINEAR, 5400);
+  CHECK(fadeEnvelopeRising(env));
+  CHECK(env.from == at);
+  CHECK(fadeEnvelopeLevel(env, 5400) == at);
+  uint8_t mid = fadeEnvelopeLevel(env, 5900);
+  CHECK(mid > at && mid < 255);
+  CHECK(fadeEnvelopeLevel(env, 6400) == 255);
+
+  // Длинный fade: разворот тоже с текущего уровня
+  startAt(0, 255, 100000, 0);
+  at = fadeEnvelopeLevel(env, 50000);
+  CHECK(at >= 127 && at <= 128);
+  fadeEnvelopeStart(env, 0, 100000, FADE_CURVE_EASE_IN_OUT, 50000);
+  CHECK(fadeEnvelopeLevel(env, 50000) == at);
+  CHECK(fadeEnvelopeLevel(env, 150000) == 0);
+}
+
+static void testRollover() {
+  unsigned long start = 0xFFFFFFFFUL - 30000;
+  startAt(0, 255, 70000, start);
+  uint8_t mid = fadeEnvelopeLevel(env, start + 35000);   // millis() уже переполнился
+  CHECK(mid >= 127 && mid <= 128);
+  CHECK(!fadeEnvelopeDone(env, start + 69999));
+  CHECK(fadeEnvelopeDone(env, start + 70000));
+}
+
+static void testCurves() {
+  const uint8_t curves[] = {FADE_CURVE_LINEAR, FADE_CURVE_EASE_IN, FADE_CURVE_EASE_OUT, FADE_CURVE_EASE_IN_OUT};
+  for (uint8_t c : curves) {
+    CHECK(fadeEaseQ16(c, 0) <= 1);     // EASE_OUT: 1 - (65535/65536)² в Q16
+    CHECK(fadeEaseQ16(c, 65535) >= 65533);
+    uint16_t prev = 0;
+    for (uint32_t t = 0; t <= 65535; t += 257) {
+      uint16_t e = fadeEaseQ16(c, (uint16_t)t);
+      CHECK(e >= prev);
+      prev = e;
+    }
+  }
+}
+
+int main() {
+  testProgress();
+  testReversal();
+  testRollover();
+  testCurves();
+  return hostTestResult("fade_envelope");
+}
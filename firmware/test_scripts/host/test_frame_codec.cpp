@@ -0,0 +1,215 @@
+/**
+ * FRAME_CODEC.h: CRC-8, кодирование, побайтовый декодер
+ *
+ * - CRC-8 по эталонному вектору и ловит любой одиночный битовый сбой
+ * - Кадр любой длины 0..FRAME_PAYLOAD_MAX проходит encode -> feed без потерь
+ * - Мусор, текст и оборванные кадры перед кадром: декодер снова находит SYNC
+ * - STATUS v4.4 и короткие STATUS старых Mega декодируются
+ */
+
+#include <vector>
+#include "FRAME_CODEC.h"
+#include "host_test.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+static Bytes encode(uint8_t seq, uint8_t op, const uint8_t* payload, uint8_t len) {
+  uint8_t buf[FRAME_SIZE_MAX];
+  uint8_t n = frameEncode(buf, seq, op, payload, len);
+  return Bytes(buf, buf + n);
+}
+
+/**
+ * Подать поток так, как это делает скетч: вне кадра декодеру - только SYNC
+ * @return Принятые кадры
+ */
+static std::vector<Frame> feedAll(FrameDecoder& rx, const Bytes& in) {
+  std::vector<Frame> frames;
+  for (uint8_t c : in) {
+    if (rx.feed(c)) frames.push_back(rx.frame());
+  }
+  return frames;
+}
+
+static Bytes blockFrame(uint8_t seq, uint8_t block, uint8_t action, uint32_t ms) {
+  uint8_t p[FRAME_BATCH_ENTRY] = {block, action};
+  framePutU32(p + 2, ms);
+  return encode(seq, FRAME_OP_BLOCK, p, sizeof(p));
+}
+
+// ============================================================================
+// CRC
+// ============================================================================
+
+static void testCrc() {
+  // CRC-8 poly 0x07 init 0 (CRC-8/SMBUS): "123456789" -> 0xF4
+  uint8_t crc = 0;
+  for (const char* p = "123456789"; *p; p++) crc = frameCrc8(crc, (uint8_t)*p);
+  CHECK(crc == 0xF4);
+
+  // Любой одиночный бит после SYNC в кадре BLOCK:5:UP:10000 обнаруживается
+  Bytes good = blockFrame(7, 5, FRAME_ACT_UP, 10000);
+  for (size_t bit = 8; bit < good.size() * 8; bit++) {
+    Bytes bad = good;
+    bad[bit / 8] ^= (uint8_t)(1u << (bit % 8));
+    FrameDecoder rx;
+    CHECK(feedAll(rx, bad).empty());
+  }
+}
+
+// ============================================================================
+// КОДИРОВАНИЕ / ДЕКОДИРОВАНИЕ
+// ============================================================================
+
+static void testRoundTripAllLengths() {
+  FrameDecoder rx;
+  for (uint8_t len = 0; len <= FRAME_PAYLOAD_MAX; len++) {
+    uint8_t payload[FRAME_PAYLOAD_MAX];
+    for (uint8_t i = 0; i < len; i++) payload[i] = (uint8_t)(len * 31 + i * 7);
+
+    Bytes f = encode(len, FRAME_OP_BATCH, payload, len);
+    CHECK(f.size() == (size_t)FRAME_HEADER_SIZE + len + 1);
+
+    std::vector<Frame> got = feedAll(rx, f);
+    CHECK(got.size() == 1);
+    if (got.size() != 1) continue;
+    CHECK(got[0].seq == len && got[0].op == FRAME_OP_BATCH && got[0].len == len);
+    CHECK(memcmp(got[0].payload, payload, len) == 0);
+  }
+
+  // Длиннее FRAME_PAYLOAD_MAX не кодируется
+  uint8_t big[FRAME_PAYLOAD_MAX + 1] = {};
+  uint8_t out[FRAME_SIZE_MAX + 1];
+  CHECK(frameEncode(out, 0, FRAME_OP_BATCH, big, FRAME_PAYLOAD_MAX + 1) == 0);
+  CHECK(rx.crcErrors() == 0 && rx.lenErrors() == 0);
+}
+
+static void testLittleEndian() {
+  uint8_t p[4];
+  framePutU32(p, 0x12345678);
+  CHECK(p[0] == 0x78 && p[3] == 0x12);
+  CHECK(frameGetU32(p) == 0x12345678);
+  framePutU16(p, 0xBEEF);
+  CHECK(p[0] == 0xEF && p[1] == 0xBE && frameGetU16(p) == 0xBEEF);
+}
+
+// ============================================================================
+// RESYNC
+// ============================================================================
+
+static void testTextAndGarbageBeforeFrame() {
+  // Текст v3 на том же UART: ASCII никогда не равен SYNC (0xA5)
+  Bytes in;
+  const char* text = "PONG\r\nACK:5:UP\r\n";
+  in.insert(in.end(), text, text + strlen(text));
+  Bytes f = blockFrame(1, 5, FRAME_ACT_UP, 10000);
+  in.insert(in.end(), f.begin(), f.end());
+
+  FrameDecoder rx;
+  std::vector<Frame> got = feedAll(rx, in);
+  CHECK(got.size() == 1 && got[0].seq == 1);
+
+  // SYNC с невозможной длиной - ложный старт, следующий SYNC - кадр
+  Bytes noise = {FRAME_SYNC, FRAME_PAYLOAD_MAX + 1, 0x00, 0x11};
+  noise.insert(noise.end(), f.begin(), f.end());
+  FrameDecoder rx2;
+  got = feedAll(rx2, noise);
+  CHECK(got.size() == 1 && got[0].seq == 1);
+  CHECK(rx2.lenErrors() == 1);
+}
+
+static void testTruncatedFrame() {
+  Bytes f1 = blockFrame(1, 3, FRAME_ACT_DOWN, 5000);
+  Bytes f2 = blockFrame(2, 4, FRAME_ACT_UP, 6000);
+  Bytes f3 = blockFrame(3, 6, FRAME_ACT_STOP, 0);
+
+  // Кадр оборван (Mega перезагрузилась посреди передачи), пауза > FRAME_GAP_MS:
+  // скетч вызывает reset(), следующий кадр принимается целиком
+  for (size_t cut = 1; cut < f1.size(); cut++) {
+    FrameDecoder rx;
+    Bytes part(f1.begin(), f1.begin() + cut);
+    CHECK(feedAll(rx, part).empty());
+    CHECK(rx.busy());
+    rx.reset();
+    std::vector<Frame> got = feedAll(rx, f2);
+    CHECK(got.size() == 1 && got[0].seq == 2);
+  }
+
+  // Без паузы: оборванный кадр съедает байты следующего, CRC не сходится,
+  // и самое позднее через кадр поток снова синхронен
+  for (size_t cut = 1; cut < f1.size(); cut++) {
+    FrameDecoder rx;
+    Bytes in(f1.begin(), f1.begin() + cut);
+    in.insert(in.end(), f2.begin(), f2.end());
+    in.insert(in.end(), f3.begin(), f3.end());
+    in.insert(in.end(), f3.begin(), f3.end());
+    std::vector<Frame> got = feedAll(rx, in);
+    CHECK(!got.empty());
+    CHECK(!got.empty() && got.back().seq == 3);
+    for (const Frame& fr : got) CHECK(fr.seq == 2 || fr.seq == 3);
+  }
+}
+
+// ============================================================================
+// STATUS
+// ============================================================================
+
+static void testStatus() {
+  FrameStatus s = {};
+  s.uptimeMs = 0xDEADBEEF;
+  s.firstBlock = 9;
+  s.blockCount = 7;
+  s.upMask = 0x05;
+  s.downMask = 0x40;
+  for (uint8_t i = 0; i < FRAME_STATUS_BLOCKS; i++) {
+    s.remain[i] = (uint16_t)(i * 100);
+    s.pos[i] = (i == 3) ? FRAME_STATUS_POS_UNKNOWN : (uint8_t)(i * 10);
+  }
+  s.crcErrors = 1;
+  s.lenErrors = 2;
+  s.gapResets = 3;
+  s.lineOverflows = 4;
+  s.queued = 5;
+  s.uartFrameErrors = 6;
+  s.uartParityErrors = 7;
+  s.uartOverruns = 8;
+  s.uartDropped = 9;
+
+  uint8_t p[FRAME_PAYLOAD_MAX];
+  uint8_t len = frameStatusEncode(p, s);
+  CHECK(len == FRAME_STATUS_SIZE);
+
+  FrameStatus d;
+  CHECK(frameStatusDecode(p, len, d));
+  CHECK(d.uptimeMs == s.uptimeMs && d.firstBlock == 9 && d.blockCount == 7);
+  CHECK(d.upMask == 0x05 && d.downMask == 0x40);
+  CHECK(memcmp(d.remain, s.remain, sizeof(s.remain)) == 0);
+  CHECK(memcmp(d.pos, s.pos, sizeof(s.pos)) == 0);
+  CHECK(d.queued == 5 && d.uartFrameErrors == 6 && d.uartDropped == 9);
+
+  // Mega v4.3 (без счётчиков UART) и v4.2 (без положений)
+  CHECK(frameStatusDecode(p, FRAME_STATUS_SIZE_V43, d));
+  CHECK(d.pos[1] == 10 && d.uartFrameErrors == 0);
+  CHECK(frameStatusDecode(p, FRAME_STATUS_SIZE_V42, d));
+  CHECK(d.pos[1] == FRAME_STATUS_POS_UNKNOWN);
+  CHECK(!frameStatusDecode(p, FRAME_STATUS_SIZE_V42 - 1, d));
+
+  // Остаток округляется вверх и насыщается
+  CHECK(frameStatusRemain(0) == 0);
+  CHECK(frameStatusRemain(1) == 1);
+  CHECK(frameStatusRemain(10) == 1);
+  CHECK(frameStatusRemain(655350) == FRAME_STATUS_REMAIN_MAX);
+  CHECK(frameStatusRemain(3600000) == FRAME_STATUS_REMAIN_MAX);
+  CHECK(frameStatusRemain(0xFFFFFFF7) == FRAME_STATUS_REMAIN_MAX);
+  CHECK(frameStatusRemain(0xFFFFFFFF) == FRAME_STATUS_REMAIN_MAX);
+}
+
+int main() {
+  testCrc();
+  testRoundTripAllLengths();
+  testLittleEndian();
+  testTextAndGarbageBeforeFrame();
+  testTruncatedFrame();
+  testStatus();
+  return hostTestResult("frame_codec");
+}
@@ -0,0 +1,145 @@
+/**
+ * LineReader + parseMegaReply (MEGA_LINK.h)
+ *
+ * Главное: poll() на неполной строке не ждёт. UART ниже отдаёт байты
+ * порциями, как они приходят по проводу, и считает чтения при пустом
+ * буфере - у readStringUntil('\n') это был бы ожидающий read() до
+ * таймаута Stream (1 с на проход loop()).
+ */
+
+#include <string>
+#include "MEGA_LINK.h"
+#include "host_test.h"
+
+// ============================================================================
+// UART С ПОРЦИОННОЙ ДОСТАВКОЙ
+// ============================================================================
+
+struct FakeUart {
+  std::string wire;         // Всё, что Mega отправит
+  size_t arrived = 0;       // Сколько уже в RX буфере
+  size_t pos = 0;           // Сколько прочитано
+  uint32_t emptyReads = 0;  // read() при пустом буфере (ожидание)
+
+  void deliver(size_t n) { arrived = (arrived + n > wire.size()) ? wire.size() : arrived + n; }
+  int available() { return (int)(arrived - pos); }
+  int read() {
+    if (pos >= arrived) {
+      emptyReads++;
+      return -1;
+    }
+    return (uint8_t)wire[pos++];
+  }
+};
+
+// ============================================================================
+// ТЕСТЫ
+// ============================================================================
+
+static void testPartialLineDoesNotWait() {
+  FakeUart uart;
+  uart.wire = "PONG\r\nACK:BLOCK:5:UP\n";
+  LineReader rx;
+
+  // "PO" - строка не полная: poll() возвращается сразу, ничего не ждёт
+  uart.deliver(2);
+  CHECK(!rx.poll(uart));
+  CHECK(uart.available() == 0);
+  CHECK(uart.emptyReads == 0);
+
+  // Следующий проход loop(): остаток строки
+  uart.deliver(4);
+  CHECK(rx.poll(uart));
+  CHECK(strcmp(rx.line(), "PONG") == 0);
+
+  // Вторая строка по байту за проход
+  int passes = 0;
+  bool done = false;
+  while (!done && passes < 64) {
+    uart.deliver(1);
+    done = rx.poll(uart);
+    passes++;
+  }
+  CHECK(done);
+  CHECK(passes == 15);
+  CHECK(strcmp(rx.line(), "ACK:BLOCK:5:UP") == 0);
+  CHECK(!rx.poll(uart));
+  CHECK(uart.emptyReads == 0);
+}
+
+static void testSeveralLinesInOneBuffer() {
+  FakeUart uart;
+  uart.wire = "DONE:12\nERROR:Unknown command\r\n\n\r\nPROTO:4\n";
+  uart.deliver(uart.wire.size());
+  LineReader rx;
+
+  CHECK(rx.poll(uart));
+  CHECK(strcmp(rx.line(), "DONE:12") == 0);
+  CHECK(rx.poll(uart));
+  CHECK(strcmp(rx.line(), "ERROR:Unknown command") == 0);
+  // Пустые строки ("\n", "\r\n") не отдаются
+  CHECK(rx.poll(uart));
+  CHECK(strcmp(rx.line(), "PROTO:4") == 0);
+  CHECK(!rx.poll(uart));
+}
+
+static void testOverlongLineDropped() {
+  FakeUart uart;
+  uart.wire = std::string(MEGA_LINK_LINE_MAX + 10, 'X') + "\nPONG\n";
+  uart.deliver(uart.wire.size());
+  LineReader rx;
+
+  // Длинная строка выброшена целиком, следующая цела
+  CHECK(rx.poll(uart));
+  CHECK(strcmp(rx.line(), "PONG") == 0);
+  CHECK(rx.overflows() == 1);
+
+  // Самая длинная строка протокола помещается
+  LineReader rx2;
+  const char* longest = "ERR:BLOCK:15:ACT3:TIMEOUT\n";
+  bool done = false;
+  for (const char* p = longest; *p; p++) done = rx2.feed(*p);
+  CHECK(done);
+  CHECK(rx2.overflows() == 0);
+}
+
+static void testParseReplies() {
+  MegaReply r;
+
+  CHECK(parseMegaReply("PONG", r) && r.type == MEGA_REPLY_PONG);
+
+  CHECK(parseMegaReply("ACK:5:UP", r));
+  CHECK(r.type == MEGA_REPLY_ACK && r.blockNum == 5 && r.action == MEGA_ACTION_UP);
+
+  CHECK(parseMegaReply("ACK:BLOCK:12:DOWN", r));
+  CHECK(r.type == MEGA_REPLY_ACK && r.blockNum == 12 && r.action == MEGA_ACTION_DOWN);
+
+  CHECK(parseMegaReply("ACK:ALL:STOP", r));
+  CHECK(r.type == MEGA_REPLY_ACK && r.blockNum == 0 && r.action == MEGA_ACTION_STOP);
+
+  CHECK(parseMegaReply("ACK:GROUP:6:UP", r));
+  CHECK(r.type == MEGA_REPLY_ACK && r.blockMask == 6 && r.action == MEGA_ACTION_UP);
+
+  CHECK(parseMegaReply("DONE:12", r) && r.type == MEGA_REPLY_DONE && r.blockNum == 12);
+
+  CHECK(parseMegaReply("ERR:BLOCK:3:ACT1:TIMEOUT", r));
+  CHECK(r.type == MEGA_REPLY_ERROR && r.blockNum == 3 && strcmp(r.detail, "ACT1:TIMEOUT") == 0);
+
+  CHECK(parseMegaReply("ERROR:Unknown command", r));
+  CHECK(r.type == MEGA_REPLY_ERROR && strcmp(r.detail, "Unknown command") == 0);
+
+  CHECK(parseMegaReply("PROTO:4", r) && r.type == MEGA_REPLY_PROTO && atoi(r.detail) == 4);
+
+  // Префикс токена - не токен
+  CHECK(!parseMegaReply("PONGX", r) && r.type == MEGA_REPLY_UNKNOWN);
+  CHECK(!parseMegaReply("[DEBUG] block 5", r));
+  CHECK(!parseMegaReply("", r));
+}
+
+int main() {
+  testPartialLineDoesNotWait();
+  testSeveralLinesInOneBuffer();
+  testOverlongLineDropped();
+  testParseReplies();
+  return hostTestResult("line_reader");
+}
@@ -0,0 +1,126 @@
+/**
+ * parseMegaCommand + MegaReplyBuf (MEGA_LINK.h) - разбор команд на Mega
+ *
+ * - Все формы команд ESP32: PING, PROTO, ALL:STOP, BLOCK, GROUP
+ * - Испорченные строки: номер/действие не разобраны, но команда опознана
+ *   (Mega ответит ERROR:Invalid ...), неизвестное - MEGA_CMD_UNKNOWN
+ * - ALL:STOP только целиком: ALLUP или ALL:UP не останавливают все блоки
+ * - Ответ не выходит за MEGA_LINK_LINE_MAX
+ */
+
+#include "MEGA_LINK.h"
+#include "host_test.h"
+
+static MegaCommand parse(const char* line, bool expectKnown) {
+  MegaCommand cmd;
+  bool known = parseMegaCommand(line, cmd);
+  CHECK(known == expectKnown);
+  CHECK(known == (cmd.type != MEGA_CMD_UNKNOWN));
+  return cmd;
+}
+
+// ============================================================================
+// КОМАНДЫ
+// ============================================================================
+
+static void testSimpleCommands() {
+  CHECK(parse("PING", true).type == MEGA_CMD_PING);
+  CHECK(parse("  PING", true).type == MEGA_CMD_PING);
+
+  MegaCommand c = parse("PROTO:4", true);
+  CHECK(c.type == MEGA_CMD_PROTO && c.protoVersion == 4);
+
+  CHECK(parse("ALL:STOP", true).type == MEGA_CMD_ALL_STOP);
+  CHECK(parse(" ALL:STOP", true).type == MEGA_CMD_ALL_STOP);
+}
+
+static void testBlock() {
+  MegaCommand c = parse("BLOCK:5:UP:10000", true);
+  CHECK(c.type == MEGA_CMD_BLOCK && c.hasBlock && c.blockNum == 5);
+  CHECK(c.action == MEGA_ACTION_UP && c.duration == 10000);
+
+  c = parse("BLOCK:12:DOWN", true);
+  CHECK(c.blockNum == 12 && c.action == MEGA_ACTION_DOWN && c.duration == 0);
+
+  c = parse("BLOCK:3:STOP", true);
+  CHECK(c.blockNum == 3 && c.action == MEGA_ACTION_STOP);
+
+  c = parse("BLOCK:9:POS:60", true);
+  CHECK(c.blockNum == 9 && c.action == MEGA_ACTION_POS && c.duration == 60);
+
+  // Опознано как BLOCK, но без номера / действия: Mega ответит ERROR:Invalid
+  c = parse("BLOCK:9:POS", true);
+  CHECK(c.hasBlock && c.action == MEGA_ACTION_NONE);
+  c = parse("BLOCK:5:JUMP", true);
+  CHECK(c.hasBlock && c.action == MEGA_ACTION_NONE);
+  c = parse("BLOCK:X:UP", true);
+  CHECK(c.type == MEGA_CMD_BLOCK && !c.hasBlock);
+  c = parse("BLOCK:300:UP", true);
+  CHECK(c.type == MEGA_CMD_BLOCK && !c.hasBlock);
+  c = parse("BLOCK", true);
+  CHECK(c.type == MEGA_CMD_BLOCK && !c.hasBlock);
+}
+
+static void testGroup() {
+  MegaCommand c = parse("GROUP:6:UP:10000", true);
+  CHECK(c.type == MEGA_CMD_GROUP && c.hasBlock && c.blockMask == 6);
+  CHECK(c.action == MEGA_ACTION_UP && c.duration == 10000);
+
+  c = parse("GROUP:65535:STOP", true);
+  CHECK(c.blockMask == 0xFFFF && c.action == MEGA_ACTION_STOP);
+
+  c = parse("GROUP:65536:UP", true);
+  CHECK(c.type == MEGA_CMD_GROUP && !c.hasBlock);
+}
+
+static void testUnknown() {
+  // Опечатки в ALL:STOP - не остановка всех блоков
+  parse("ALL", false);
+  parse("ALLUP", false);
+  parse("ALL:UP", false);
+  parse("ALL:STOPX", false);
+  parse("ALL:STOP:", false);
+  parse("ALL:STOP:5", false);
+  parse("ALLSTOP", false);
+
+  parse("", false);
+  parse("PONG", false);
+  parse("PING:1", false);
+  parse("PINGX", false);
+  parse("PROTO", false);
+  parse("BLOCKS:5:UP", false);
+  parse("block:5:up", false);
+}
+
+// ============================================================================
+// ОТВЕТ
+// ============================================================================
+
+static void testReplyBuf() {
+  MegaReplyBuf r;
+  r.add(F("ACK:")).add((uint32_t)5).add(':').add("UP");
+  CHECK(strcmp(r.text, "ACK:5:UP") == 0);
+  CHECK(r.line() == 10);
+  CHECK(strcmp(r.text, "ACK:5:UP\r\n") == 0);
+
+  MegaReplyBuf n;
+  n.add((uint32_t)0).add(',').add((uint32_t)4294967295UL);
+  CHECK(strcmp(n.text, "0,4294967295") == 0);
+
+  // Переполнение обрезает, "\r\n" и '\0' всё равно помещаются
+  MegaReplyBuf big;
+  for (int i = 0; i < 40; i++) big.add("ERR:");
+  CHECK(big.len == MEGA_LINK_LINE_MAX - 3);
+  uint8_t len = big.line();
+  CHECK(len == MEGA_LINK_LINE_MAX - 1);
+  CHECK(big.text[len - 2] == '\r' && big.text[len - 1] == '\n' && big.text[len] == '\0');
+}
+
+int main() {
+  testSimpleCommands();
+  testBlock();
+  testGroup();
+  testUnknown();
+  testReplyBuf();
+  return hostTestResult("mega_command");
+}
@@ -0,0 +1,184 @@
+/**
+ * MOVE_QUEUE.h - очередь ходов, ждущих бюджет питания
+ *
+ * - FIFO: ходы с одним priority выходят в порядке прихода
+ * - priority: ход встаёт перед всеми с меньшим priority, за всеми с
+ *   таким же и большим; место в очереди - как в ответе 202 QUEUED:N
+ * - Повторная команда блоку снимает его прежний ход, а не добавляет второй
+ * - moveQueueHasWaiting: новый ход не обгоняет ждущих с тем же priority,
+ *   голова, которая не помещается в бюджет, держит лёгкие ходы за собой
+ * - moveQueuePop: счётчик стартов и худшее ожидание
+ */
+
+#include "MEGA_LINK.h"
+#include "MOVE_QUEUE.h"
+#include "host_test.h"
+
+static MoveQueue q;
+
+static void reset() {
+  memset(&q, 0, sizeof(q));
+}
+
+static bool orderIs(const uint8_t* blocks, uint8_t count) {
+  if (q.count != count) return false;
+  for (uint8_t i = 0; i < count; i++) {
+    if (q.items[i].blockNum != blocks[i]) return false;
+  }
+  return true;
+}
+
+// ============================================================================
+// ПОРЯДОК
+// ============================================================================
+
+static void testFifo() {
+  reset();
+  CHECK(moveQueuePush(q, 3, MEGA_ACTION_UP, 10000, 0, 100) == 1);
+  CHECK(moveQueuePush(q, 7, MEGA_ACTION_DOWN, 0, 0, 200) == 2);
+  CHECK(moveQueuePush(q, 1, MEGA_ACTION_POS, 60, 0, 300) == 3);
+  const uint8_t order[] = {3, 7, 1};
+  CHECK(orderIs(order, 3));
+
+  CHECK(moveQueuePosition(q, 7) == 2);
+  CHECK(moveQueuePosition(q, 9) == 0);
+  CHECK(q.items[2].act == MEGA_ACTION_POS && q.items[2].arg == 60);
+
+  moveQueuePop(q, 1100);
+  CHECK(q.count == 2 && q.items[0].blockNum == 7);
+  moveQueuePop(q, 1200);
+  moveQueuePop(q, 1300);
+  CHECK(q.count == 0);
+  moveQueuePop(q, 1400);   // Пустая - ничего
+  CHECK(q.count == 0 && q.admitted == 3);
+}
+
+static void testPriority() {
+  reset();
+  moveQueuePush(q, 1, MEGA_ACTION_UP, 0, 0, 0);
+  moveQueuePush(q, 2, MEGA_ACTION_UP, 0, 0, 0);
+  CHECK(moveQueuePush(q, 3, MEGA_ACTION_UP, 0, 1, 0) == 1);   // Вперёд обычных
+  CHECK(moveQueuePush(q, 4, MEGA_ACTION_UP, 0, 1, 0) == 2);   // За равным
+  CHECK(moveQueuePush(q, 5, MEGA_ACTION_UP, 0, 0, 0) == 5);
+  const uint8_t order[] = {3, 4, 1, 2, 5};
+  CHECK(orderIs(order, 5));
+
+  // Заполненная очередь: по ходу на каждый блок
+  reset();
+  for (uint8_t b = 1; b <= TOTAL_BLOCKS; b++) {
+    CHECK(moveQueuePush(q, b, MEGA_ACTION_UP, 0, b % 2, 0) >= 1);
+  }
+  CHECK(q.count == TOTAL_BLOCKS);
+  for (uint8_t i = 1; i < q.count; i++) {
+    CHECK(q.items[i - 1].priority >= q.items[i].priority);
+    if (q.items[i - 1].priority == q.items[i].priority) {
+      CHECK(q.items[i - 1].blockNum < q.items[i].blockNum);
+    }
+  }
+}
+
+static void testRequeue() {
+  reset();
+  moveQueuePush(q, 1, MEGA_ACTION_UP, 0, 0, 0);
+  moveQueuePush(q, 2, MEGA_ACTION_UP, 0, 0, 0);
+  moveQueuePush(q, 3, MEGA_ACTION_UP, 0, 0, 0);
+
+  // Новая команда блоку 1: прежний ход снят, новый - в хвост
+  CHECK(moveQueuePush(q, 1, MEGA_ACTION_DOWN, 5000, 0, 50) == 3);
+  const uint8_t order[] = {2, 3, 1};
+  CHECK(orderIs(order, 3));
+  CHECK(q.items[2].act == MEGA_ACTION_DOWN && q.items[2].arg == 5000);
+  CHECK(q.items[2].queuedMs == 50);
+
+  // С priority - в голову, по-прежнему один ход блока
+  CHECK(moveQueuePush(q, 3, MEGA_ACTION_UP, 0, 1, 60) == 1);
+  const uint8_t order2[] = {3, 2, 1};
+  CHECK(orderIs(order2, 3));
+
+  // STOP снимает ход
+  CHECK(moveQueueRemove(q, 2));
+  CHECK(!moveQueueRemove(q, 2));
+  const uint8_t order3[] = {3, 1};
+  CHECK(orderIs(order3, 2));
+
+  moveQueueClear(q);
+  CHECK(q.count == 0 && moveQueuePosition(q, 3) == 0);
+}
+
+// ============================================================================
+// ДОПУСК
+// ============================================================================
+
+static void testHasWaiting() {
+  reset();
+  CHECK(!moveQueueHasWaiting(q, 0));
+  CHECK(!moveQueueHasWaiting(q, 1));
+
+  moveQueuePush(q, 4, MEGA_ACTION_UP, 0, 0, 0);
+  CHECK(moveQueueHasWaiting(q, 0));    // Обычный ход встаёт за ним
+  CHECK(!moveQueueHasWaiting(q, 1));   // priority=1 может стартовать сразу
+
+  moveQueuePush(q, 5, MEGA_ACTION_UP, 0, 1, 0);
+  CHECK(moveQueueHasWaiting(q, 1));
+  CHECK(moveQueueHasWaiting(q, 0));
+}
+
+/**
+ * Голова не обгоняется: блок 15 (3 актуатора) ждёт, пока освободится
+ * бюджет на него, лёгкий блок за ним не стартует раньше, хотя поместился бы
+ * (как admitQueuedMoves: решает только голова)
+ */
+static void testHeadBlocking() {
+  reset();
+  const uint8_t heavy = 15, light = 2;
+  CHECK(getBlockActuatorCount(heavy) == 3);
+  CHECK(getBlockActuatorCount(light) == 2);
+
+  uint8_t load = 2;   // Едет один обычный блок
+  moveQueuePush(q, heavy, MEGA_ACTION_UP, 0, 0, 1000);
+  moveQueuePush(q, light, MEGA_ACTION_UP, 0, 0, 1500);
+  CHECK(load + getBlockActuatorCount(light) <= MAX_ACTIVE_ACTUATORS);
+
+  auto admit = [&](uint32_t now) {
+    uint8_t started = 0;
+    while (q.count > 0) {
+      uint8_t cost = getBlockActuatorCount(q.items[0].blockNum);
+      if (load + cost > MAX_ACTIVE_ACTUATORS && load > 0) break;
+      load += cost;
+      moveQueuePop(q, now);
+      started++;
+    }
+    return started;
+  };
+
+  CHECK(admit(2000) == 0);
+  CHECK(q.count == 2 && q.items[0].blockNum == heavy);
+
+  load = 0;           // DONE обычного блока
+  CHECK(admit(4000) == 1);
+  CHECK(q.count == 1 && q.items[0].blockNum == light);
+  CHECK(q.waitMaxMs == 3000);
+
+  load = 0;           // DONE блока 15
+  CHECK(admit(9000) == 1);
+  CHECK(q.count == 0 && q.admitted == 2);
+  CHECK(q.waitMaxMs == 7500);
+}
+
+static void testWaitRollover() {
+  reset();
+  uint32_t start = 0xFFFFFFFFUL - 500;
+  moveQueuePush(q, 6, MEGA_ACTION_UP, 0, 0, start);
+  moveQueuePop(q, start + 1500);   // millis() переполнился в очереди
+  CHECK(q.waitMaxMs == 1500);
+}
+
+int main() {
+  testFifo();
+  testPriority();
+  testRequeue();
+  testHasWaiting();
+  testHeadBlocking();
+  testWaitRollover();
+  return hostTestResult("move_queue");
+}
@@ -0,0 +1,204 @@
+/**
+ * SHOW_TIMELINE.h: порядок реплик, формат во flash, воспроизведение
+ *
+ * Плеер крутится как в loop() ESP32: millis() - поддельные часы
+ * (hostClockUs), проход loop() - шаг часов.
+ *
+ * - Реплики по времени, равные t - в порядке загрузки
+ * - Файл show.bin туда-обратно; обрезанный / чужой файл не портит шоу
+ * - Реплика исполняется ровно в start + t даже через переполнение millis()
+ * - Редкие проходы loop(): опоздание не больше шага и не копится
+ * - Повтор: каждый проход начинается ровно через длительность шоу
+ */
+
+#include <vector>
+#include "SHOW_TIMELINE.h"
+#include "host_test.h"
+
+static ShowTimeline timeline;
+static ShowTimeline decoded;
+
+static void setClockMs(uint64_t ms) { hostClockUs() = ms * 1000; }
+static void advanceMs(uint32_t ms) { hostClockUs() += (uint64_t)ms * 1000; }
+
+static void load(ShowTimeline& t, const uint32_t* times, uint16_t n) {
+  t.count = n;
+  for (uint16_t i = 0; i < n; i++) {
+    t.cues[i].atMs = times[i];
+    t.cues[i].type = SHOW_CUE_BLOCK;
+    t.cues[i].act = (uint8_t)i;        // Порядок загрузки
+    t.cues[i].blocks = (uint16_t)(1u << (i % 15 + 1));
+    t.cues[i].arg = 1000 + i;
+  }
+}
+
+/**
+ * Один проход loop(): все наступившие реплики
+ */
+static std::vector<const ShowCue*> tick(ShowPlayer& p) {
+  std::vector<const ShowCue*> due;
+  const ShowCue* cue;
+  while ((cue = showPlayerNext(p, timeline, (uint32_t)millis())) != nullptr) due.push_back(cue);
+  return due;
+}
+
+// ============================================================================
+// СПИСОК
+// ============================================================================
+
+static void testSortStable() {
+  const uint32_t times[] = {500, 0, 500, 100, 1000, 0};
+  load(timeline, times, 6);
+  showTimelineSort(timeline);
+
+  const uint32_t wantT[] = {0, 0, 100, 500, 500, 1000};
+  const uint8_t wantAct[] = {1, 5, 3, 0, 2, 4};
+  for (int i = 0; i < 6; i++) {
+    CHECK(timeline.cues[i].atMs == wantT[i]);
+    CHECK(timeline.cues[i].act == wantAct[i]);
+  }
+  CHECK(showTimelineLength(timeline) == 1000);
+}
+
+static void testEncodeDecode() {
+  const uint32_t times[] = {0, 250, 250, 4000, 0xFFFFFFF0};
+  load(timeline, times, 5);
+  timeline.cues[1].type = SHOW_CUE_COLOR;
+  timeline.cues[1].arg = 0x00FF8800;
+
+  static uint8_t buf[SHOW_HEADER_SIZE + SHOW_CUES_MAX * SHOW_CUE_SIZE];
+  size_t len = showTimelineEncodedSize(timeline);
+  CHECK(len == SHOW_HEADER_SIZE + 5 * SHOW_CUE_SIZE);
+  showTimelineEncode(timeline, buf);
+
+  CHECK(showTimelineDecode(decoded, buf, len));
+  CHECK(decoded.count == 5);
+  CHECK(memcmp(decoded.cues, timeline.cues, 5 * sizeof(ShowCue)) == 0);
+
+  // Обрезанный файл, чужой magic, count больше SHOW_CUES_MAX: шоу не меняется
+  decoded.count = 7;
+  CHECK(!showTimelineDecode(decoded, buf, len - 1));
+  CHECK(!showTimelineDecode(decoded, buf, SHOW_HEADER_SIZE - 1));
+  buf[0] ^= 0xFF;
+  CHECK(!showTimelineDecode(decoded, buf, len));
+  buf[0] ^= 0xFF;
+  framePutU16(&buf[4], SHOW_CUES_MAX + 1);
+  CHECK(!showTimelineDecode(decoded, buf, sizeof(buf)));
+  CHECK(decoded.count == 7);
+
+  // Файл в произвольном порядке после загрузки отсортирован
+  framePutU16(&buf[4], 2);
+  framePutU32(&buf[SHOW_HEADER_SIZE], 900);
+  CHECK(showTimelineDecode(decoded, buf, len));
+  CHECK(decoded.count == 2 && decoded.cues[0].atMs == 250 && decoded.cues[1].atMs == 900);
+}
+
+// ============================================================================
+// ВОСПРОИЗВЕДЕНИЕ
+// ============================================================================
+
+static void testExactTimesAcrossRollover() {
+  const uint32_t times[] = {0, 100, 500, 500, 1000};
+  load(timeline, times, 5);
+
+  // millis() переполнится через 256 мс после старта
+  setClockMs(0xFFFFFF00ULL);
+  ShowPlayer p;
+  uint32_t start = (uint32_t)millis();
+  showPlayerStart(p, start, false);
+
+  int fired = 0;
+  for (int ms = 0; ms <= 1200; ms++) {
+    for (const ShowCue* cue : tick(p)) {
+      CHECK((uint32_t)millis() - start == cue->atMs);
+      CHECK(cue->act == fired);
+      fired++;
+    }
+    advanceMs(1);
+  }
+  CHECK(fired == 5);
+  CHECK(!p.playing);
+  CHECK(p.fired == 5 && p.lateMaxMs == 0);
+}
+
+static void testCoarseTicksDoNotAccumulate() {
+  // Реплика каждые 100 мс, loop() раз в 37 мс: опоздание < шага у каждой
+  uint32_t times[20];
+  for (int i = 0; i < 20; i++) times[i] = (uint32_t)i * 100;
+  load(timeline, times, 20);
+
+  setClockMs(5000);
+  ShowPlayer p;
+  uint32_t start = (uint32_t)millis();
+  showPlayerStart(p, start, false);
+
+  int fired = 0;
+  while (p.playing && fired < 40) {
+    for (const ShowCue* cue : tick(p)) {
+      uint32_t late = (uint32_t)millis() - start - cue->atMs;
+      CHECK(late < 37);
+      fired++;
+    }
+    advanceMs(37);
+  }
+  CHECK(fired == 20);
+  CHECK(p.lateMaxMs < 37);
+
+  // Долгая пауза loop(): все пропущенные реплики - в одном проходе, по порядку
+  showPlayerStart(p, (uint32_t)millis(), false);
+  advanceMs(450);
+  std::vector<const ShowCue*> due = tick(p);
+  CHECK(due.size() == 5);
+  for (size_t i = 0; i < due.size(); i++) CHECK(due[i]->atMs == i * 100);
+  CHECK(p.lateMaxMs == 450);
+}
+
+static void testLoop() {
+  const uint32_t times[] = {0, 300, 1000};
+  load(timeline, times, 3);
+
+  setClockMs(0xFFFFFA00ULL);  // Переполнение millis() во втором проходе
+  ShowPlayer p;
+  uint32_t start = (uint32_t)millis();
+  showPlayerStart(p, start, true);
+
+  // Повтор: реплика t = 1000 прошлого прохода и t = 0 следующего совпадают
+  // (по одной реплике: p.passes меняется внутри прохода loop())
+  int fired = 0;
+  for (int ms = 0; ms <= 3500; ms++) {
+    const ShowCue* cue;
+    while ((cue = showPlayerNext(p, timeline, (uint32_t)millis())) != nullptr) {
+      uint32_t t = (uint32_t)millis() - start;
+      CHECK(t == p.passes * 1000 + cue->atMs);
+      fired++;
+    }
+    advanceMs(1);
+  }
+  CHECK(p.playing);
+  CHECK(p.passes == 3);
+  CHECK(fired == 3 * 3 + 2);   // Проходы 0-2 целиком, в 3-м - t = 0 и 300
+  CHECK(p.lateMaxMs == 0);
+  CHECK(showPlayerElapsed(p, (uint32_t)millis()) == 501);
+
+  showPlayerStop(p);
+  CHECK(tick(p).empty());
+  CHECK(showPlayerElapsed(p, (uint32_t)millis()) == 0);
+}
+
+static void testEmptyShowStops() {
+  timeline.count = 0;
+  ShowPlayer p;
+  showPlayerStart(p, (uint32_t)millis(), true);
+  CHECK(tick(p).empty());
+  CHECK(!p.playing);
+}
+
+int main() {
+  testSortStable();
+  testEncodeDecode();
+  testExactTimesAcrossRollover();
+  testCoarseTicksDoNotAccumulate();
+  testLoop();
+  testEmptyShowStops();
+  return hostTestResult("show_timeline");
+}
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+НАГРУЗОЧНЫЙ ТЕСТ HTTP API контроллера ESP32
+
+Имитирует киоск: несколько клиентов одновременно опрашивают /api/status
+(actuator-control 2 с, control-panel 3 с, use-project-sync 5 с) и шлют команды.
+Каждый клиент держит одно keep-alive соединение, как браузер.
+
+Печатает p50 / p90 / p99 / max задержки по каждому эндпоинту.
+
+Использование:
+    python3 http_load_test.py 192.168.110.65
+    python3 http_load_test.py 192.168.4.1 --clients 8 --seconds 60
+    python3 http_load_test.py 192.168.110.65 --no-keepalive   # как старый WebServer
+
+Команды безопасные: только /api/status и /api/bri (актуаторы не двигаются).
+"""
+
+import argparse
+import http.client
+import random
+import threading
+import time
+
+# (метод, путь, вес в смеси запросов)
+REQUESTS = [
+    ("GET", "/api/status", 8),
+    ("POST", "/api/bri?v={bri}", 1),
+]
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0.0
+    k = (len(sorted_values) - 1) * pct / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(sorted_values) - 1)
+    return sorted_values[lo] + (sorted_values[hi] - sorted_values[lo]) * (k - lo)
+
+
+class Client(threading.Thread):
+    def __init__(self, host, port, deadline, keepalive, interval, results, lock):
+        super().__init__(daemon=True)
+        self.host = host
+        self.port = port
+        self.deadline = deadline
+        self.keepalive = keepalive
+        self.interval = interval
+        self.results = results
+        self.lock = lock
+        self.conn = None
+
+    def connect(self):
+        self.conn = http.client.HTTPConnection(self.host, self.port, timeout=5)
+
+    def run(self):
+        weighted = [r for r in REQUESTS for _ in range(r[2])]
+        self.connect()
+
+        while time.time() < self.deadline:
+            method, path, _ = random.choice(weighted)
+            url = path.format(bri=random.randint(150, 220))
+            name = path.split("?")[0]
+            headers = {} if self.keepalive else {"Connection": "close"}
+
+            start = time.perf_counter()
+            try:
+                self.conn.request(method, url, headers=headers)
+                resp = self.conn.getresponse()
+                resp.read()
+                ok = 200 <= resp.status < 300
+                if not self.keepalive or resp.getheader("Connection", "").lower() == "close":
+                    self.conn.close()
+                    self.connect()
+            except (OSError, http.client.HTTPException):
+                ok = False
+                self.conn.close()
+                self.connect()
+            ms = (time.perf_counter() - start) * 1000.0
+
+            with self.lock:
+                entry = self.results.setdefault(name, {"lat": [], "errors": 0})
+                if ok:
+                    entry["lat"].append(ms)
+                else:
+                    entry["errors"] += 1
+
+            if self.interval > 0:
+                time.sleep(self.interval)
+
+        self.conn.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="HTTP load test for RAMS ESP32 controller")
+    parser.add_argument("host", help="IP контроллера (например 192.168.110.65)")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--clients", type=int, default=6, help="одновременных клиентов (по умолчанию 6)")
+    parser.add_argument("--seconds", type=int, default=30, help="длительность теста")
+    parser.add_argument("--interval", type=float, default=0.0,
+                        help="пауза клиента между запросами, с (0 = максимальная нагрузка)")
+    parser.add_argument("--no-keepalive", action="store_true", help="новое соединение на каждый запрос")
+    args = parser.parse_args()
+
+    results = {}
+    lock = threading.Lock()
+    deadline = time.time() + args.seconds
+    keepalive = not args.no_keepalive
+
+    print("==========================================")
+    print("  HTTP LOAD TEST")
+    print("==========================================")
+    print(f"Target:     http://{args.host}:{args.port}")
+    print(f"Clients:    {args.clients} ({'keep-alive' if keepalive else 'Connection: close'})")
+    print(f"Duration:   {args.seconds} s")
+    print("")
+
+    clients = [Client(args.host, args.port, deadline, keepalive, args.interval, results, lock)
+               for _ in range(args.clients)]
+    for c in clients:
+        c.start()
+    for c in clients:
+        c.join()
+
+    total = 0
+    print(f"{'endpoint':<14} {'n':>6} {'err':>5} {'p50':>8} {'p90':>8} {'p99':>8} {'max':>8}   (ms)")
+    for name, entry in sorted(results.items()):
+        lat = sorted(entry["lat"])
+        total += len(lat)
+        print(f"{name:<14} {len(lat):>6} {entry['errors']:>5} "
+              f"{percentile(lat, 50):>8.1f} {percentile(lat, 90):>8.1f} "
+              f"{percentile(lat, 99):>8.1f} {(lat[-1] if lat else 0):>8.1f}")
+
+    print("")
+    print(f"Throughput: {total / args.seconds:.1f} req/s")
+
+
+if __name__ == "__main__":
+    main()
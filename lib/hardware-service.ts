@@ -6,15 +6,15 @@ import { GALLERY_CARDS } from "./data/gallery-config";
  * Maps project IDs to physical block numbers and delegates to IPC service.
  * Custom block mapping (from admin panel) overrides the default values in gallery-config.
  *
- * ОГРАНИЧЕНИЕ: Максимум 2 актуатора одновременно!
+ * Лимит питания (сколько блоков едет одновременно) держит ESP32: лишние
+ * ходы он ставит в очередь и запускает сам (202 QUEUED:N), здесь не отклоняем.
  */
 
 // Cached custom mapping — loaded once, updated via setBlockMapping
 let cachedMapping: BlockMapping | null = null;
 
-// Отслеживание активных блоков (максимум 2)
+// Поднятые блоки (повторный выбор не шлёт команду)
 const activeBlocks = new Set<number>();
-const MAX_ACTIVE_BLOCKS = 2;
 
 /**
  * Resolve project ID → physical block number.
@@ -43,7 +43,7 @@ async function resolveBlockNumber(projectId: string): Promise<number | undefined
 export const hardwareService = {
   /**
    * Select a project — raises the corresponding physical block
-   * ОГРАНИЧЕНИЕ: Максимум 2 актуатора одновременно
+   * (queued on the ESP32 if the power budget is busy)
    */
   async selectProject(projectId: string): Promise<boolean> {
     const blockNumber = await resolveBlockNumber(projectId);
@@ -52,23 +52,17 @@ export const hardwareService = {
       return false;
     }
 
-    // Проверка: не превышен ли лимит активных блоков
     if (activeBlocks.has(blockNumber)) {
       console.log(`[HardwareService] Block ${blockNumber} already active`);
       return true; // Уже активен
     }
 
-    if (activeBlocks.size >= MAX_ACTIVE_BLOCKS) {
-      console.warn(`[HardwareService] Maximum ${MAX_ACTIVE_BLOCKS} blocks active! Cannot activate block ${blockNumber}`);
-      return false; // Отклоняем команду
-    }
-
     const hw = HardwareIPCService.getInstance();
     const success = await hw.blockUp(blockNumber);
 
     if (success) {
       activeBlocks.add(blockNumber);
-      console.log(`[HardwareService] Block ${blockNumber} UP - Active: ${activeBlocks.size}/${MAX_ACTIVE_BLOCKS}`);
+      console.log(`[HardwareService] Block ${blockNumber} UP - Active: ${activeBlocks.size}`);
     }
 
     return success;
@@ -86,7 +80,7 @@ export const hardwareService = {
 
     if (success) {
       activeBlocks.delete(blockNumber);
-      console.log(`[HardwareService] Block ${blockNumber} DOWN - Active: ${activeBlocks.size}/${MAX_ACTIVE_BLOCKS}`);
+      console.log(`[HardwareService] Block ${blockNumber} DOWN - Active: ${activeBlocks.size}`);
     }
 
     return success;
@@ -101,7 +95,7 @@ export const hardwareService = {
 
     if (success) {
       activeBlocks.clear();
-      console.log(`[HardwareService] ALL DOWN - Active: 0/${MAX_ACTIVE_BLOCKS}`);
+      console.log(`[HardwareService] ALL DOWN - Active: 0`);
     }
 
     return success;
@@ -116,7 +110,7 @@ export const hardwareService = {
 
     if (success) {
       activeBlocks.clear();
-      console.log(`[HardwareService] EMERGENCY STOP - Active: 0/${MAX_ACTIVE_BLOCKS}`);
+      console.log(`[HardwareService] EMERGENCY STOP - Active: 0`);
     }
 
     return success;
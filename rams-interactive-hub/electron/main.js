@@ -119,7 +119,8 @@ function sendHttpRequest(endpoint, params = {}) {
       let data = '';
       res.on('data', (chunk) => { data += chunk; });
       res.on('end', () => {
-        if (res.statusCode === 200) {
+        // 202 QUEUED:N - ESP32 запустит ход, когда освободится бюджет питания
+        if (res.statusCode === 200 || res.statusCode === 202) {
           log(`[HTTP] Success: ${data}`);
           espConnected = true;
           lastPong = Date.now();